@@ -85,18 +85,30 @@
 #define N_BITS     (N_HIST_BITS + N_IADD_BITS)
 #define N_COUNTERS (1 << N_BITS)
 
-static UWord shift_register = 0;   /* Contains global history */
-static UChar counters[N_COUNTERS]; /* Counter array; presumably auto-zeroed */
+/* See do_ind_branch_predict. */
+#define N_BTAC_BITS 9
+#define N_BTAC      (1 << N_BTAC_BITS)
+
+/* Predictor state.  Normally there is one, shared by all threads;  with
+   --parallel-execution=yes each thread has its own, so that threads can
+   run instrumented code at the same time.  It must be zeroed before
+   use. */
+typedef struct {
+   UWord shift_register;        /* Contains global history */
+   UChar counters[N_COUNTERS];  /* Counter array */
+   Addr  btac[N_BTAC];          /* BTAC */
+} branchpred_t;
 
 
-static ULong do_cond_branch_predict ( Addr instr_addr, Word takenW )
+static ULong do_cond_branch_predict ( branchpred_t* bp,
+                                      Addr instr_addr, Word takenW )
 {
    UWord indx;
    Bool  predicted_taken, actually_taken, mispredict;
 
    const UWord hist_mask = (1 << N_HIST_BITS) - 1;
    const UWord iadd_mask = (1 << N_IADD_BITS) - 1;
-         UWord hist_bits = shift_register & hist_mask;
+         UWord hist_bits = bp->shift_register & hist_mask;
          UWord iadd_bits = (instr_addr >> N_IADDR_LO_ZERO_BITS)
                            & iadd_mask;
 
@@ -107,24 +119,24 @@ static ULong do_cond_branch_predict ( Addr instr_addr, Word takenW )
    if (0) VG_(printf)("index = %d\n", (Int)indx);
 
    tl_assert(takenW <= 1);
-   predicted_taken = counters[ indx ] >= 2;
+   predicted_taken = bp->counters[ indx ] >= 2;
    actually_taken  = takenW > 0;
 
    mispredict = (actually_taken && (!predicted_taken))
                 || ((!actually_taken) && predicted_taken);
 
-   shift_register <<= 1;
-   shift_register |= (actually_taken ? 1 : 0);
+   bp->shift_register <<= 1;
+   bp->shift_register |= (actually_taken ? 1 : 0);
 
    if (actually_taken) {
-      if (counters[indx] < 3)
-         counters[indx]++;
+      if (bp->counters[indx] < 3)
+         bp->counters[indx]++;
    } else {
-      if (counters[indx] > 0)
-         counters[indx]--;
+      if (bp->counters[indx] > 0)
+         bp->counters[indx]--;
    }
 
-   tl_assert(counters[indx] <= 3);
+   tl_assert(bp->counters[indx] <= 3);
 
    return mispredict ? 1 : 0;
 }
@@ -134,19 +146,16 @@ static ULong do_cond_branch_predict ( Addr instr_addr, Word takenW )
    to index a table which records the previous target address for this
    branch (or whatever aliased with it) and use that as the
    prediction. */
-#define N_BTAC_BITS 9
-#define N_BTAC      (1 << N_BTAC_BITS)
-static Addr btac[N_BTAC]; /* BTAC; presumably auto-zeroed */
-
-static ULong do_ind_branch_predict ( Addr instr_addr, Addr actual )
+static ULong do_ind_branch_predict ( branchpred_t* bp,
+                                     Addr instr_addr, Addr actual )
 {
    Bool mispredict;
    const UWord mask = (1 << N_BTAC_BITS) - 1;
          UWord indx = (instr_addr >> N_IADDR_LO_ZERO_BITS) 
                       & mask;
    tl_assert(indx < N_BTAC);
-   mispredict = btac[indx] != actual;
-   btac[indx] = actual;
+   mispredict = bp->btac[indx] != actual;
+   bp->btac[indx] = actual;
    return mispredict ? 1 : 0;
 }
 
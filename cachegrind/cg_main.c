@@ -46,6 +46,7 @@
 #include "pub_tool_tooliface.h"
 #include "pub_tool_xarray.h"
 #include "pub_tool_clientstate.h"
+#include "pub_tool_threadstate.h"  // VG_(get_tid_from_guest_state)
 #include "pub_tool_machine.h"      // VG_(fnptr_to_fnentry)
 
 #include "cg_arch.h"
@@ -125,8 +126,6 @@ typedef struct {
 CodeLoc;
 
 typedef struct {
-   CodeLoc  loc; /* Source location that these counts pertain to */
-    
    CacheCC  Ir;  /* Insn read counts */
    CacheCC  Dr;  /* Data read counts */
    CacheCC  Dw;  /* Data write/modify counts */
@@ -137,6 +136,12 @@ typedef struct {
     
    BranchCC Bc;  /* Conditional branch counts */
    BranchCC Bi;  /* Indirect branch counts */
+} LineCounts;
+
+typedef struct {
+   CodeLoc    loc; /* Source location that these counts pertain to */
+   UInt       ix;  /* Index of this line's counts in each thread's CgThread */
+   LineCounts cc;  /* The counts, for all threads */
 } LineCC;
 
 // First compare file, then fn, then line.
@@ -184,6 +189,134 @@ struct _SB_info {
 
 static OSet* instrInfoTable;
 
+//------------------------------------------------------------
+// Primary data structure #3: per-thread state
+// - Only used with --parallel-execution=yes.  Otherwise all threads share
+//   one set of simulated caches and one branch predictor, and the helpers
+//   count straight into the line CCs.
+// - With it, each thread has its own simulated caches and branch
+//   predictor, and its own counts for every line CC, so that threads can
+//   run instrumented code at the same time.  The helpers are passed the
+//   guest state, to find the running thread.
+// - The counts are kept in chunks of LINE_CHUNK_SIZE, found by
+//   LineCC.ix.  When a line CC needs a new chunk, it is added to every
+//   thread at once;  this happens while instrumenting, so before any code
+//   using the line CC can run, and the helpers never have to check.
+// - cg_fini adds every thread's counts into the line CCs.
+
+#define LINE_CHUNK_BITS  10
+#define LINE_CHUNK_SIZE  (1 << LINE_CHUNK_BITS)
+
+typedef struct {
+   cache_sim_t  sim;
+   branchpred_t bp;
+   LineCounts** chunks;   /* n_line_chunks_max of them */
+} CgThread;
+
+static CgThread* cg_threads[VG_N_THREADS];
+
+static UInt n_lineCCs = 0;
+static UInt n_line_chunks_max = 0;
+
+// The caches and branch predictor shared by all threads, when they don't
+// run in parallel.
+static cache_sim_t  shared_sim;
+static branchpred_t shared_bp;
+
+#define CG_THREAD(gst) \
+   (cg_threads[VG_(get_tid_from_guest_state)(gst)])
+
+#define LINE_COUNTS(t, lineCC) \
+   (&(t)->chunks[(lineCC)->ix >> LINE_CHUNK_BITS] \
+                [(lineCC)->ix & (LINE_CHUNK_SIZE - 1)])
+
+static LineCounts* new_line_chunk(void)
+{
+   return VG_(calloc)("cg.main.nlc.1", LINE_CHUNK_SIZE, sizeof(LineCounts));
+}
+
+// Double the size of every thread's chunk table.  Other threads may be
+// running, and looking at their old tables, so those are not freed;  they
+// add up to no more than the new ones.
+static void grow_line_chunk_tables(void)
+{
+   ThreadId     tid;
+   UInt         new_max = n_line_chunks_max == 0 ? 64 : 2 * n_line_chunks_max;
+   LineCounts** chunks;
+
+   for (tid = 0; tid < VG_N_THREADS; tid++) {
+      if (cg_threads[tid]) {
+         chunks = VG_(calloc)("cg.main.glct.1", new_max, sizeof(LineCounts*));
+         if (n_line_chunks_max > 0)
+            VG_(memcpy)(chunks, cg_threads[tid]->chunks,
+                        n_line_chunks_max * sizeof(LineCounts*));
+         cg_threads[tid]->chunks = chunks;
+      }
+   }
+   n_line_chunks_max = new_max;
+}
+
+// Give every thread chunk 'i', for line CCs created from now on.
+static void add_line_chunk(UInt i)
+{
+   ThreadId tid;
+   if (i >= n_line_chunks_max)
+      grow_line_chunk_tables();
+   tl_assert(i < n_line_chunks_max);
+   for (tid = 0; tid < VG_N_THREADS; tid++) {
+      if (cg_threads[tid]) {
+         tl_assert(cg_threads[tid]->chunks[i] == NULL);
+         cg_threads[tid]->chunks[i] = new_line_chunk();
+      }
+   }
+}
+
+static void cg_pre_thread_ll_create(ThreadId parent, ThreadId child)
+{
+   CgThread* t;
+   UInt      i;
+
+   if (!VG_(clo_parallel_execution))
+      return;
+
+   tl_assert(child > 0 && child < VG_N_THREADS);
+
+   // A thread which reuses the ThreadId of one that has gone carries on
+   // with its state.  Simplest, and the counts must be kept anyway.
+   if (cg_threads[child])
+      return;
+
+   t = VG_(calloc)("cg.main.cptlc.1", 1, sizeof(CgThread));
+   cachesim_initsim(&t->sim);
+   if (n_line_chunks_max > 0)
+      t->chunks = VG_(calloc)("cg.main.cptlc.2",
+                              n_line_chunks_max, sizeof(LineCounts*));
+   for (i = 0; i * LINE_CHUNK_SIZE < n_lineCCs; i++)
+      t->chunks[i] = new_line_chunk();
+   cg_threads[child] = t;
+}
+
+static void add_CacheCC(CacheCC* dst, CacheCC* src)
+{
+   dst->a  += src->a;
+   dst->m1 += src->m1;
+   dst->m2 += src->m2;
+   dst->mL += src->mL;
+}
+
+static void add_TLBCC(TLBCC* dst, TLBCC* src)
+{
+   dst->a  += src->a;
+   dst->t1 += src->t1;
+   dst->t2 += src->t2;
+}
+
+static void add_BranchCC(BranchCC* dst, BranchCC* src)
+{
+   dst->b  += src->b;
+   dst->mp += src->mp;
+}
+
 //------------------------------------------------------------
 // Secondary data structure: string table
 // - holds strings, avoiding dups
@@ -294,31 +427,35 @@ static LineCC* get_lineCC(Addr origAddr)
       lineCC->loc.file = get_perm_string(loc.file);
       lineCC->loc.fn   = get_perm_string(loc.fn);
       lineCC->loc.line = loc.line;
-      lineCC->Ir.a     = 0;
-      lineCC->Ir.m1    = 0;
-      lineCC->Ir.m2    = 0;
-      lineCC->Ir.mL    = 0;
-       lineCC->t_Ir.a  = 0;
-       lineCC->t_Ir.t1 = 0;
-       lineCC->t_Ir.t2 = 0;
-      lineCC->Dr.a     = 0;
-      lineCC->Dr.m1    = 0;
-      lineCC->Dr.m2    = 0;
-      lineCC->Dr.mL    = 0;
-       lineCC->t_Dr.a  = 0;
-       lineCC->t_Dr.t1 = 0;
-       lineCC->t_Dr.t2 = 0;
-      lineCC->Dw.a     = 0;
-      lineCC->Dw.m1    = 0;
-      lineCC->Dw.m2    = 0;
-      lineCC->Dw.mL    = 0;
-       lineCC->t_Dw.a  = 0;
-       lineCC->t_Dw.t1 = 0;
-       lineCC->t_Dw.t2 = 0;
-      lineCC->Bc.b     = 0;
-      lineCC->Bc.mp    = 0;
-      lineCC->Bi.b     = 0;
-      lineCC->Bi.mp    = 0;
+      lineCC->ix       = n_lineCCs++;
+      if (VG_(clo_parallel_execution)
+          && (lineCC->ix & (LINE_CHUNK_SIZE - 1)) == 0)
+         add_line_chunk(lineCC->ix >> LINE_CHUNK_BITS);
+      lineCC->cc.Ir.a  = 0;
+      lineCC->cc.Ir.m1 = 0;
+      lineCC->cc.Ir.m2 = 0;
+      lineCC->cc.Ir.mL = 0;
+       lineCC->cc.t_Ir.a  = 0;
+       lineCC->cc.t_Ir.t1 = 0;
+       lineCC->cc.t_Ir.t2 = 0;
+      lineCC->cc.Dr.a  = 0;
+      lineCC->cc.Dr.m1 = 0;
+      lineCC->cc.Dr.m2 = 0;
+      lineCC->cc.Dr.mL = 0;
+       lineCC->cc.t_Dr.a  = 0;
+       lineCC->cc.t_Dr.t1 = 0;
+       lineCC->cc.t_Dr.t2 = 0;
+      lineCC->cc.Dw.a  = 0;
+      lineCC->cc.Dw.m1 = 0;
+      lineCC->cc.Dw.m2 = 0;
+      lineCC->cc.Dw.mL = 0;
+       lineCC->cc.t_Dw.a  = 0;
+       lineCC->cc.t_Dw.t1 = 0;
+       lineCC->cc.t_Dw.t2 = 0;
+      lineCC->cc.Bc.b  = 0;
+      lineCC->cc.Bc.mp = 0;
+      lineCC->cc.Bi.b  = 0;
+      lineCC->cc.Bi.mp = 0;
       VG_(OSetGen_Insert)(CC_table, lineCC);
    }
 
@@ -329,28 +466,73 @@ static LineCC* get_lineCC(Addr origAddr)
 /*--- Cache simulation functions                           ---*/
 /*------------------------------------------------------------*/
 
+// The work for one instruction fetch, or one data access, done by the
+// helpers below.  'sim' and 'c' are the caches and the counts to use:
+// shared_sim and the line CC's own counts, or with --parallel-execution
+// the running thread's.  The helpers pass constant addresses for the
+// shared ones, so once these are inlined that costs nothing;  hence the
+// always_inline, as for the cachesim_*_doref functions.
+
+__attribute__((always_inline))
+static __inline__
+void do_Ir_cache_access(cache_sim_t* sim, LineCounts* c, InstrInfo* n)
+{
+   cachesim_I1_doref(sim, n->instr_addr, n->instr_len, 
+                     &c->Ir.m1, &c->Ir.m2, &c->Ir.mL);
+   c->Ir.a++;
+
+   reference_address(n->instr_addr, 0, &c->t_Ir.t1, &c->t_Ir.t2);
+   c->t_Ir.a++;
+}
+
+__attribute__((always_inline))
+static __inline__
+void do_Dr_cache_access(cache_sim_t* sim, LineCounts* c,
+                        Addr data_addr, Word data_size)
+{
+   cachesim_D1_doref(sim, data_addr, data_size, 
+                     &c->Dr.m1, &c->Dr.m2, &c->Dr.mL);
+   c->Dr.a++;
+
+   reference_address(data_addr, 1, &c->t_Dr.t1, &c->t_Dr.t2);
+   c->t_Dr.a++;
+}
+
+__attribute__((always_inline))
+static __inline__
+void do_Dw_cache_access(cache_sim_t* sim, LineCounts* c,
+                        Addr data_addr, Word data_size)
+{
+   cachesim_D1_doref(sim, data_addr, data_size, 
+                     &c->Dw.m1, &c->Dw.m2, &c->Dw.mL);
+   c->Dw.a++;
+
+   reference_address(data_addr, 1, &c->t_Dw.t1, &c->t_Dw.t2);
+   c->t_Dw.a++;
+}
+
 // Only used with --cache-sim=no.
 static VG_REGPARM(1)
 void log_1I(InstrInfo* n)
 {
-   n->parent->Ir.a++;
+   n->parent->cc.Ir.a++;
 }
 
 // Only used with --cache-sim=no.
 static VG_REGPARM(2)
 void log_2I(InstrInfo* n, InstrInfo* n2)
 {
-   n->parent->Ir.a++;
-   n2->parent->Ir.a++;
+   n->parent->cc.Ir.a++;
+   n2->parent->cc.Ir.a++;
 }
 
 // Only used with --cache-sim=no.
 static VG_REGPARM(3)
 void log_3I(InstrInfo* n, InstrInfo* n2, InstrInfo* n3)
 {
-   n->parent->Ir.a++;
-   n2->parent->Ir.a++;
-   n3->parent->Ir.a++;
+   n->parent->cc.Ir.a++;
+   n2->parent->cc.Ir.a++;
+   n3->parent->cc.Ir.a++;
 }
 
 
@@ -359,12 +541,7 @@ void log_1I_0D_cache_access(InstrInfo* n)
 {
    //VG_(printf)("1I_0D :  CCaddr=0x%010lx,  iaddr=0x%010lx,  isize=%lu\n",
    //             n, n->instr_addr, n->instr_len);
-   cachesim_I1_doref(n->instr_addr, n->instr_len, 
-                     &n->parent->Ir.m1, &n->parent->Ir.m2, &n->parent->Ir.mL);
-   n->parent->Ir.a++;
-
-   reference_address(n->instr_addr, 0, &n->parent->t_Ir.t1, &n->parent->t_Ir.t2);
-   n->parent->t_Ir.a++;
+   do_Ir_cache_access(&shared_sim, &n->parent->cc, n);
 }
 
 
@@ -376,23 +553,8 @@ void log_2I_0D_cache_access(InstrInfo* n, InstrInfo* n2)
    //            "        CC2addr=0x%010lx, i2addr=0x%010lx, i2size=%lu\n",
    //            n,  n->instr_addr,  n->instr_len,
    //            n2, n2->instr_addr, n2->instr_len);
-    
-   cachesim_I1_doref(n->instr_addr, n->instr_len, 
-                     &n->parent->Ir.m1, &n->parent->Ir.m2,&n->parent->Ir.mL);
-   n->parent->Ir.a++;
-    
-   reference_address(n->instr_addr, 0, &n->parent->t_Ir.t1, &n->parent->t_Ir.t2);
-   n->parent->t_Ir.a++;
-    
-    
-   cachesim_I1_doref(n2->instr_addr, n2->instr_len, 
-                     &n2->parent->Ir.m1,&n2->parent->Ir.m2, &n2->parent->Ir.mL);
-   n2->parent->Ir.a++;
-    
-   reference_address(n2->instr_addr, 0, &n2->parent->t_Ir.t1, &n2->parent->t_Ir.t2);
-   n2->parent->t_Ir.a++;
-    
-   
+   do_Ir_cache_access(&shared_sim, &n->parent->cc,  n);
+   do_Ir_cache_access(&shared_sim, &n2->parent->cc, n2);
 }
 
 //3Instruction, 0 data
@@ -405,31 +567,9 @@ void log_3I_0D_cache_access(InstrInfo* n, InstrInfo* n2, InstrInfo* n3)
    //            n,  n->instr_addr,  n->instr_len,
    //            n2, n2->instr_addr, n2->instr_len,
    //            n3, n3->instr_addr, n3->instr_len);
-    
-   cachesim_I1_doref(n->instr_addr, n->instr_len, 
-                     &n->parent->Ir.m1,&n->parent->Ir.m2, &n->parent->Ir.mL);
-   n->parent->Ir.a++;
-    
-   reference_address(n->instr_addr, 0, &n->parent->t_Ir.t1, &n->parent->t_Ir.t2);
-   n->parent->t_Ir.a++;
-    
-    
-   cachesim_I1_doref(n2->instr_addr, n2->instr_len,
-                     &n2->parent->Ir.m1,&n2->parent->Ir.m2, &n2->parent->Ir.mL);
-   n2->parent->Ir.a++;
-   
-   reference_address(n2->instr_addr, 0, &n2->parent->t_Ir.t1, &n2->parent->t_Ir.t2);
-   n2->parent->t_Ir.a++;
-    
-
-   cachesim_I1_doref(n3->instr_addr, n3->instr_len, 
-                     &n3->parent->Ir.m1,&n3->parent->Ir.m2, &n3->parent->Ir.mL);
-   n3->parent->Ir.a++;
-   
-   reference_address(n3->instr_addr, 0, &n3->parent->t_Ir.t1, &n3->parent->t_Ir.t2);
-   n3->parent->t_Ir.a++;
-    
-   
+   do_Ir_cache_access(&shared_sim, &n->parent->cc,  n);
+   do_Ir_cache_access(&shared_sim, &n2->parent->cc, n2);
+   do_Ir_cache_access(&shared_sim, &n3->parent->cc, n3);
 }
 
 //1 Instruction, 1 Data read
@@ -439,22 +579,8 @@ void log_1I_1Dr_cache_access(InstrInfo* n, Addr data_addr, Word data_size)
    //VG_(printf)("1I_1Dr:  CCaddr=0x%010lx,  iaddr=0x%010lx,  isize=%lu\n"
    //            "                               daddr=0x%010lx,  dsize=%lu\n",
    //            n, n->instr_addr, n->instr_len, data_addr, data_size);
-   cachesim_I1_doref(n->instr_addr, n->instr_len, 
-                     &n->parent->Ir.m1,&n->parent->Ir.m2, &n->parent->Ir.mL);
-   n->parent->Ir.a++;
-   
-   reference_address(n->instr_addr, 0, &n->parent->t_Ir.t1, &n->parent->t_Ir.t2);
-   n->parent->t_Ir.a++;
-   
-    
-   cachesim_D1_doref(data_addr, data_size, 
-                     &n->parent->Dr.m1,&n->parent->Dr.m2, &n->parent->Dr.mL);
-   n->parent->Dr.a++;
-   
-   reference_address(data_addr, 1, &n->parent->t_Dr.t1, &n->parent->t_Dr.t2);
-   n->parent->t_Dr.a++;
-    
-
+   do_Ir_cache_access(&shared_sim, &n->parent->cc, n);
+   do_Dr_cache_access(&shared_sim, &n->parent->cc, data_addr, data_size);
 }
 
 static VG_REGPARM(3)
@@ -463,21 +589,8 @@ void log_1I_1Dw_cache_access(InstrInfo* n, Addr data_addr, Word data_size)
    //VG_(printf)("1I_1Dw:  CCaddr=0x%010lx,  iaddr=0x%010lx,  isize=%lu\n"
    //            "                               daddr=0x%010lx,  dsize=%lu\n",
    //            n, n->instr_addr, n->instr_len, data_addr, data_size);
-   cachesim_I1_doref(n->instr_addr, n->instr_len, 
-                     &n->parent->Ir.m1,&n->parent->Ir.m2, &n->parent->Ir.mL);
-   n->parent->Ir.a++;
-  
-   reference_address(n->instr_addr, 0, &n->parent->t_Ir.t1,&n->parent->t_Ir.t2);
-   n->parent->t_Ir.a++;
-    
-    
-   cachesim_D1_doref(data_addr, data_size, 
-                     &n->parent->Dw.m1,&n->parent->Dw.m2, &n->parent->Dw.mL);
-   n->parent->Dw.a++;
- 
-   reference_address(data_addr, 1, &n->parent->t_Dw.t1,&n->parent->t_Dw.t2);
-   n->parent->t_Dw.a++;
-    
+   do_Ir_cache_access(&shared_sim, &n->parent->cc, n);
+   do_Dw_cache_access(&shared_sim, &n->parent->cc, data_addr, data_size);
 }
 
 static VG_REGPARM(3)
@@ -485,14 +598,7 @@ void log_0I_1Dr_cache_access(InstrInfo* n, Addr data_addr, Word data_size)
 {
    //VG_(printf)("0I_1Dr:  CCaddr=0x%010lx,  daddr=0x%010lx,  dsize=%lu\n",
    //            n, data_addr, data_size);
-   cachesim_D1_doref(data_addr, data_size, 
-                     &n->parent->Dr.m1,&n->parent->Dr.m2, &n->parent->Dr.mL);
-   n->parent->Dr.a++;
-   
-   reference_address(data_addr, 1, &n->parent->t_Dr.t1,&n->parent->t_Dr.t2);
-   n->parent->t_Dr.a++;
-    
-   
+   do_Dr_cache_access(&shared_sim, &n->parent->cc, data_addr, data_size);
 }
 
 static VG_REGPARM(3)
@@ -500,14 +606,7 @@ void log_0I_1Dw_cache_access(InstrInfo* n, Addr data_addr, Word data_size)
 {
    //VG_(printf)("0I_1Dw:  CCaddr=0x%010lx,  daddr=0x%010lx,  dsize=%lu\n",
    //            n, data_addr, data_size);
-   cachesim_D1_doref(data_addr, data_size, 
-                     &n->parent->Dw.m1,&n->parent->Dw.m2, &n->parent->Dw.mL);
-   n->parent->Dw.a++;
-   
-   reference_address(data_addr, 1, &n->parent->t_Dw.t1,&n->parent->t_Dw.t2 );
-   n->parent->t_Dw.a++;
-    
-   
+   do_Dw_cache_access(&shared_sim, &n->parent->cc, data_addr, data_size);
 }
 
 /* For branches, we consult two different predictors, one which
@@ -520,9 +619,9 @@ void log_cond_branch(InstrInfo* n, Word taken)
 {
    //VG_(printf)("cbrnch:  CCaddr=0x%010lx,  taken=0x%010lx\n",
    //             n, taken);
-   n->parent->Bc.b++;
-   n->parent->Bc.mp 
-      += (1 & do_cond_branch_predict(n->instr_addr, taken));
+   n->parent->cc.Bc.b++;
+   n->parent->cc.Bc.mp 
+      += (1 & do_cond_branch_predict(&shared_bp, n->instr_addr, taken));
 }
 
 static VG_REGPARM(2)
@@ -530,9 +629,119 @@ void log_ind_branch(InstrInfo* n, UWord actual_dst)
 {
    //VG_(printf)("ibrnch:  CCaddr=0x%010lx,    dst=0x%010lx\n",
    //             n, actual_dst);
-   n->parent->Bi.b++;
-   n->parent->Bi.mp
-      += (1 & do_ind_branch_predict(n->instr_addr, actual_dst));
+   n->parent->cc.Bi.b++;
+   n->parent->cc.Bi.mp
+      += (1 & do_ind_branch_predict(&shared_bp, n->instr_addr, actual_dst));
+}
+
+// The same again for --parallel-execution=yes.  These are also passed the
+// guest state (so take their arguments the ordinary way, regparms 0), to
+// find the running thread's CgThread.
+
+static
+void log_1I_pt(void* gst, InstrInfo* n)
+{
+   CgThread* t = CG_THREAD(gst);
+   LINE_COUNTS(t, n->parent)->Ir.a++;
+}
+
+static
+void log_2I_pt(void* gst, InstrInfo* n, InstrInfo* n2)
+{
+   CgThread* t = CG_THREAD(gst);
+   LINE_COUNTS(t, n->parent)->Ir.a++;
+   LINE_COUNTS(t, n2->parent)->Ir.a++;
+}
+
+static
+void log_3I_pt(void* gst, InstrInfo* n, InstrInfo* n2, InstrInfo* n3)
+{
+   CgThread* t = CG_THREAD(gst);
+   LINE_COUNTS(t, n->parent)->Ir.a++;
+   LINE_COUNTS(t, n2->parent)->Ir.a++;
+   LINE_COUNTS(t, n3->parent)->Ir.a++;
+}
+
+static
+void log_1I_0D_cache_access_pt(void* gst, InstrInfo* n)
+{
+   CgThread* t = CG_THREAD(gst);
+   do_Ir_cache_access(&t->sim, LINE_COUNTS(t, n->parent), n);
+}
+
+static
+void log_2I_0D_cache_access_pt(void* gst, InstrInfo* n, InstrInfo* n2)
+{
+   CgThread* t = CG_THREAD(gst);
+   do_Ir_cache_access(&t->sim, LINE_COUNTS(t, n->parent),  n);
+   do_Ir_cache_access(&t->sim, LINE_COUNTS(t, n2->parent), n2);
+}
+
+static
+void log_3I_0D_cache_access_pt(void* gst,
+                               InstrInfo* n, InstrInfo* n2, InstrInfo* n3)
+{
+   CgThread* t = CG_THREAD(gst);
+   do_Ir_cache_access(&t->sim, LINE_COUNTS(t, n->parent),  n);
+   do_Ir_cache_access(&t->sim, LINE_COUNTS(t, n2->parent), n2);
+   do_Ir_cache_access(&t->sim, LINE_COUNTS(t, n3->parent), n3);
+}
+
+static
+void log_1I_1Dr_cache_access_pt(void* gst, InstrInfo* n,
+                                Addr data_addr, Word data_size)
+{
+   CgThread*   t = CG_THREAD(gst);
+   LineCounts* c = LINE_COUNTS(t, n->parent);
+   do_Ir_cache_access(&t->sim, c, n);
+   do_Dr_cache_access(&t->sim, c, data_addr, data_size);
+}
+
+static
+void log_1I_1Dw_cache_access_pt(void* gst, InstrInfo* n,
+                                Addr data_addr, Word data_size)
+{
+   CgThread*   t = CG_THREAD(gst);
+   LineCounts* c = LINE_COUNTS(t, n->parent);
+   do_Ir_cache_access(&t->sim, c, n);
+   do_Dw_cache_access(&t->sim, c, data_addr, data_size);
+}
+
+static
+void log_0I_1Dr_cache_access_pt(void* gst, InstrInfo* n,
+                                Addr data_addr, Word data_size)
+{
+   CgThread* t = CG_THREAD(gst);
+   do_Dr_cache_access(&t->sim, LINE_COUNTS(t, n->parent),
+                      data_addr, data_size);
+}
+
+static
+void log_0I_1Dw_cache_access_pt(void* gst, InstrInfo* n,
+                                Addr data_addr, Word data_size)
+{
+   CgThread* t = CG_THREAD(gst);
+   do_Dw_cache_access(&t->sim, LINE_COUNTS(t, n->parent),
+                      data_addr, data_size);
+}
+
+static
+void log_cond_branch_pt(void* gst, InstrInfo* n, Word taken)
+{
+   CgThread*   t = CG_THREAD(gst);
+   LineCounts* c = LINE_COUNTS(t, n->parent);
+   c->Bc.b++;
+   c->Bc.mp += (1 & do_cond_branch_predict(&t->bp, n->instr_addr, taken));
+}
+
+static
+void log_ind_branch_pt(void* gst, InstrInfo* n, UWord actual_dst)
+{
+   CgThread*   t = CG_THREAD(gst);
+   LineCounts* c = LINE_COUNTS(t, n->parent);
+   c->Bi.b++;
+   c->Bi.mp
+      += (1 & do_ind_branch_predict(&t->bp, n->instr_addr, actual_dst));
 }
 
 
@@ -760,6 +969,21 @@ InstrInfo* setup_InstrInfo ( CgState* cgs, Addr instr_addr, UInt instr_len )
    empty.  Code is generated into cgs->bbOut, and this activity
    'consumes' slots in cgs->sbInfo. */
 
+/* Use the helper 'fn', which takes 'n' arguments, or with
+   --parallel-execution its per-thread twin fn_pt. */
+#define SET_HELPER(fn, n)                          \
+   do {                                            \
+      if (VG_(clo_parallel_execution)) {           \
+         helperName = #fn "_pt";                   \
+         helperAddr = &fn##_pt;                    \
+         regparms   = 0;                           \
+      } else {                                     \
+         helperName = #fn;                         \
+         helperAddr = &fn;                         \
+         regparms   = (n);                         \
+      }                                            \
+   } while (0)
+
 static void flushEvents ( CgState* cgs )
 {
    Int        i, regparms;
@@ -810,24 +1034,20 @@ static void flushEvents ( CgState* cgs )
                   immediately preceding Ir.  Same applies to analogous
                   assertions in the subsequent cases. */
                tl_assert(ev2->inode == ev->inode);
-               helperName = "log_1I_1Dr_cache_access";
-               helperAddr = &log_1I_1Dr_cache_access;
+               SET_HELPER(log_1I_1Dr_cache_access, 3);
                argv = mkIRExprVec_3( i_node_expr,
                                      get_Event_dea(ev2),
                                      mkIRExpr_HWord( get_Event_dszB(ev2) ) );
-               regparms = 3;
                i += 2;
             }
             /* Merge an Ir with a following Dw. */
             else
             if (ev2 && ev2->tag == Ev_Dw) {
                tl_assert(ev2->inode == ev->inode);
-               helperName = "log_1I_1Dw_cache_access";
-               helperAddr = &log_1I_1Dw_cache_access;
+               SET_HELPER(log_1I_1Dw_cache_access, 3);
                argv = mkIRExprVec_3( i_node_expr,
                                      get_Event_dea(ev2),
                                      mkIRExpr_HWord( get_Event_dszB(ev2) ) );
-               regparms = 3;
                i += 2;
             }
             /* Merge an Ir with two following Irs. */
@@ -835,95 +1055,80 @@ static void flushEvents ( CgState* cgs )
             if (ev2 && ev3 && ev2->tag == Ev_Ir && ev3->tag == Ev_Ir)
             {
                if (clo_cache_sim) {
-                  helperName = "log_3I_0D_cache_access";
-                  helperAddr = &log_3I_0D_cache_access;
+                  SET_HELPER(log_3I_0D_cache_access, 3);
                } else {
-                  helperName = "log_3I";
-                  helperAddr = &log_3I;
+                  SET_HELPER(log_3I, 3);
                }
                argv = mkIRExprVec_3( i_node_expr, 
                                      mkIRExpr_HWord( (HWord)ev2->inode ), 
                                      mkIRExpr_HWord( (HWord)ev3->inode ) );
-               regparms = 3;
                i += 3;
             }
             /* Merge an Ir with one following Ir. */
             else
             if (ev2 && ev2->tag == Ev_Ir) {
                if (clo_cache_sim) {
-                  helperName = "log_2I_0D_cache_access";
-                  helperAddr = &log_2I_0D_cache_access;
+                  SET_HELPER(log_2I_0D_cache_access, 2);
                } else {
-                  helperName = "log_2I";
-                  helperAddr = &log_2I;
+                  SET_HELPER(log_2I, 2);
                }
                argv = mkIRExprVec_2( i_node_expr,
                                      mkIRExpr_HWord( (HWord)ev2->inode ) );
-               regparms = 2;
                i += 2;
             }
             /* No merging possible; emit as-is. */
             else {
                if (clo_cache_sim) {
-                  helperName = "log_1I_0D_cache_access";
-                  helperAddr = &log_1I_0D_cache_access;
+                  SET_HELPER(log_1I_0D_cache_access, 1);
                } else {
-                  helperName = "log_1I";
-                  helperAddr = &log_1I;
+                  SET_HELPER(log_1I, 1);
                }
                argv = mkIRExprVec_1( i_node_expr );
-               regparms = 1;
                i++;
             }
             break;
          case Ev_Dr:
          case Ev_Dm:
             /* Data read or modify */
-            helperName = "log_0I_1Dr_cache_access";
-            helperAddr = &log_0I_1Dr_cache_access;
+            SET_HELPER(log_0I_1Dr_cache_access, 3);
             argv = mkIRExprVec_3( i_node_expr, 
                                   get_Event_dea(ev), 
                                   mkIRExpr_HWord( get_Event_dszB(ev) ) );
-            regparms = 3;
             i++;
             break;
          case Ev_Dw:
             /* Data write */
-            helperName = "log_0I_1Dw_cache_access";
-            helperAddr = &log_0I_1Dw_cache_access;
+            SET_HELPER(log_0I_1Dw_cache_access, 3);
             argv = mkIRExprVec_3( i_node_expr,
                                   get_Event_dea(ev), 
                                   mkIRExpr_HWord( get_Event_dszB(ev) ) );
-            regparms = 3;
             i++;
             break;
          case Ev_Bc:
             /* Conditional branch */
-            helperName = "log_cond_branch";
-            helperAddr = &log_cond_branch;
+            SET_HELPER(log_cond_branch, 2);
             argv = mkIRExprVec_2( i_node_expr, ev->Ev.Bc.taken );
-            regparms = 2;
             i++;
             break;
          case Ev_Bi:
             /* Branch to an unknown destination */
-            helperName = "log_ind_branch";
-            helperAddr = &log_ind_branch;
+            SET_HELPER(log_ind_branch, 2);
             argv = mkIRExprVec_2( i_node_expr, ev->Ev.Bi.dst );
-            regparms = 2;
             i++;
             break;
          default:
             tl_assert(0);
       }
 
-      /* Add the helper. */
+      /* Add the helper.  The per-thread ones are also passed the
+         guest state. */
       tl_assert(helperName);
       tl_assert(helperAddr);
       tl_assert(argv);
       di = unsafeIRDirty_0_N( regparms, 
                               helperName, VG_(fnptr_to_fnentry)( helperAddr ), 
                               argv );
+      di->needsBBP = VG_(clo_parallel_execution);
       addStmtToIRSB( cgs->sbOut, IRStmt_Dirty(di) );
    }
 
@@ -1357,6 +1562,34 @@ static TLBCC    t_Dw_total;
 static BranchCC Bc_total;
 static BranchCC Bi_total;
 
+// Add every thread's counts into the line CCs.
+static void sum_thread_counts(void)
+{
+   ThreadId tid;
+   LineCC*  lineCC;
+
+   if (!VG_(clo_parallel_execution))
+      return;
+
+   VG_(OSetGen_ResetIter)(CC_table);
+   while ( (lineCC = VG_(OSetGen_Next)(CC_table)) ) {
+      for (tid = 0; tid < VG_N_THREADS; tid++) {
+         LineCounts* c;
+         if (!cg_threads[tid])
+            continue;
+         c = LINE_COUNTS(cg_threads[tid], lineCC);
+         add_CacheCC (&lineCC->cc.Ir,   &c->Ir);
+         add_CacheCC (&lineCC->cc.Dr,   &c->Dr);
+         add_CacheCC (&lineCC->cc.Dw,   &c->Dw);
+         add_TLBCC   (&lineCC->cc.t_Ir, &c->t_Ir);
+         add_TLBCC   (&lineCC->cc.t_Dr, &c->t_Dr);
+         add_TLBCC   (&lineCC->cc.t_Dw, &c->t_Dw);
+         add_BranchCC(&lineCC->cc.Bc,   &c->Bc);
+         add_BranchCC(&lineCC->cc.Bi,   &c->Bi);
+      }
+   }
+}
+
 static void fprint_CC_table_and_calc_totals(void)
 {
    Int     i, fd;
@@ -1396,7 +1629,9 @@ static void fprint_CC_table_and_calc_totals(void)
                      "desc:  iTLB cache:       %s\n"
                      "desc:  dTLB cache:       %s\n"
                      "desc: L2TLB cache:       %s\n",
-                     I1.desc_line, D1.desc_line,L2.desc_line, LL.desc_line, TLBc[0].desc_line, TLBc[1].desc_line, TLBc[2].desc_line);
+                     cachesim_proto.I1.desc_line, cachesim_proto.D1.desc_line,
+                     cachesim_proto.L2.desc_line, cachesim_proto.LL.desc_line,
+                     TLBc[0].desc_line, TLBc[1].desc_line, TLBc[2].desc_line);
 
    VG_(write)(fd, (void*)buf, VG_(strlen)(buf));
 
@@ -1480,14 +1715,14 @@ static void fprint_CC_table_and_calc_totals(void)
                              " %llu %llu %llu"
                              " %llu %llu %llu %llu\n",
                             lineCC->loc.line,
-                            lineCC->Ir.a, lineCC->Ir.m1, lineCC->Ir.m2, lineCC->Ir.mL,
-                            lineCC->t_Ir.a, lineCC->t_Ir.t1, lineCC->t_Ir.t2,
-                            lineCC->Dr.a, lineCC->Dr.m1, lineCC->Dr.m2, lineCC->Dr.mL,
-                            lineCC->t_Dr.a, lineCC->t_Dr.t1, lineCC->t_Dr.t2,
-                            lineCC->Dw.a, lineCC->Dw.m1, lineCC->Dw.m2, lineCC->Dw.mL,
-                            lineCC->t_Dw.a, lineCC->t_Dw.t1, lineCC->t_Dw.t2,
-                            lineCC->Bc.b, lineCC->Bc.mp, 
-                            lineCC->Bi.b, lineCC->Bi.mp);
+                            lineCC->cc.Ir.a, lineCC->cc.Ir.m1, lineCC->cc.Ir.m2, lineCC->cc.Ir.mL,
+                            lineCC->cc.t_Ir.a, lineCC->cc.t_Ir.t1, lineCC->cc.t_Ir.t2,
+                            lineCC->cc.Dr.a, lineCC->cc.Dr.m1, lineCC->cc.Dr.m2, lineCC->cc.Dr.mL,
+                            lineCC->cc.t_Dr.a, lineCC->cc.t_Dr.t1, lineCC->cc.t_Dr.t2,
+                            lineCC->cc.Dw.a, lineCC->cc.Dw.m1, lineCC->cc.Dw.m2, lineCC->cc.Dw.mL,
+                            lineCC->cc.t_Dw.a, lineCC->cc.t_Dw.t1, lineCC->cc.t_Dw.t2,
+                            lineCC->cc.Bc.b, lineCC->cc.Bc.mp, 
+                            lineCC->cc.Bi.b, lineCC->cc.Bi.mp);
       }
       else if (clo_cache_sim && clo_branch_sim && !isTLBsim()) {
           VG_(sprintf)(buf,
@@ -1496,11 +1731,11 @@ static void fprint_CC_table_and_calc_totals(void)
                        " %llu %llu %llu %llu"
                        " %llu %llu %llu %llu\n",
                        lineCC->loc.line,
-                       lineCC->Ir.a, lineCC->Ir.m1, lineCC->Ir.m2, lineCC->Ir.mL,
-                       lineCC->Dr.a, lineCC->Dr.m1, lineCC->Dr.m2, lineCC->Dr.mL,
-                       lineCC->Dw.a, lineCC->Dw.m1, lineCC->Dw.m2, lineCC->Dw.mL,
-                       lineCC->Bc.b, lineCC->Bc.mp,
-                       lineCC->Bi.b, lineCC->Bi.mp);
+                       lineCC->cc.Ir.a, lineCC->cc.Ir.m1, lineCC->cc.Ir.m2, lineCC->cc.Ir.mL,
+                       lineCC->cc.Dr.a, lineCC->cc.Dr.m1, lineCC->cc.Dr.m2, lineCC->cc.Dr.mL,
+                       lineCC->cc.Dw.a, lineCC->cc.Dw.m1, lineCC->cc.Dw.m2, lineCC->cc.Dw.mL,
+                       lineCC->cc.Bc.b, lineCC->cc.Bc.mp,
+                       lineCC->cc.Bi.b, lineCC->cc.Bi.mp);
       }
       else if (clo_cache_sim && !clo_branch_sim && isTLBsim()) {
          VG_(sprintf)(buf, "%u %llu %llu %llu %llu"
@@ -1510,12 +1745,12 @@ static void fprint_CC_table_and_calc_totals(void)
                              " %llu %llu %llu %llu"
                              " %llu %llu %llu\n",
                             lineCC->loc.line,
-                            lineCC->Ir.a, lineCC->Ir.m1, lineCC->Ir.m2, lineCC->Ir.mL,
-                            lineCC->t_Ir.a, lineCC->t_Ir.t1, lineCC->t_Ir.t2,
-                            lineCC->Dr.a, lineCC->Dr.m1, lineCC->Dr.m2, lineCC->Dr.mL,
-                            lineCC->t_Dr.a, lineCC->t_Dr.t1, lineCC->t_Dr.t2,
-                            lineCC->Dw.a, lineCC->Dw.m1, lineCC->Dw.m2, lineCC->Dw.mL,
-                            lineCC->t_Dw.a, lineCC->t_Dw.t1, lineCC->t_Dw.t2);
+                            lineCC->cc.Ir.a, lineCC->cc.Ir.m1, lineCC->cc.Ir.m2, lineCC->cc.Ir.mL,
+                            lineCC->cc.t_Ir.a, lineCC->cc.t_Ir.t1, lineCC->cc.t_Ir.t2,
+                            lineCC->cc.Dr.a, lineCC->cc.Dr.m1, lineCC->cc.Dr.m2, lineCC->cc.Dr.mL,
+                            lineCC->cc.t_Dr.a, lineCC->cc.t_Dr.t1, lineCC->cc.t_Dr.t2,
+                            lineCC->cc.Dw.a, lineCC->cc.Dw.m1, lineCC->cc.Dw.m2, lineCC->cc.Dw.mL,
+                            lineCC->cc.t_Dw.a, lineCC->cc.t_Dw.t1, lineCC->cc.t_Dw.t2);
       }
       else if (clo_cache_sim && !clo_branch_sim && !isTLBsim()) {
           VG_(sprintf)(buf,
@@ -1523,51 +1758,51 @@ static void fprint_CC_table_and_calc_totals(void)
                        " %llu %llu %llu %llu"
                        " %llu %llu %llu %llu\n",
                        lineCC->loc.line,
-                       lineCC->Ir.a, lineCC->Ir.m1, lineCC->Ir.m2, lineCC->Ir.mL,
-                       lineCC->Dr.a, lineCC->Dr.m1, lineCC->Dr.m2, lineCC->Dr.mL,
-                       lineCC->Dw.a, lineCC->Dw.m1, lineCC->Dw.m2, lineCC->Dw.mL);
+                       lineCC->cc.Ir.a, lineCC->cc.Ir.m1, lineCC->cc.Ir.m2, lineCC->cc.Ir.mL,
+                       lineCC->cc.Dr.a, lineCC->cc.Dr.m1, lineCC->cc.Dr.m2, lineCC->cc.Dr.mL,
+                       lineCC->cc.Dw.a, lineCC->cc.Dw.m1, lineCC->cc.Dw.m2, lineCC->cc.Dw.mL);
       }
       else if (!clo_cache_sim && clo_branch_sim) {
          VG_(sprintf)(buf, "%u %llu"
                              " %llu %llu %llu %llu\n",
                             lineCC->loc.line,
-                            lineCC->Ir.a, 
-                            lineCC->Bc.b, lineCC->Bc.mp, 
-                            lineCC->Bi.b, lineCC->Bi.mp);
+                            lineCC->cc.Ir.a, 
+                            lineCC->cc.Bc.b, lineCC->cc.Bc.mp, 
+                            lineCC->cc.Bi.b, lineCC->cc.Bi.mp);
       }
       else {
          VG_(sprintf)(buf, "%u %llu\n",
                             lineCC->loc.line,
-                            lineCC->Ir.a);
+                            lineCC->cc.Ir.a);
       }
       VG_(write)(fd, (void*)buf, VG_(strlen)(buf));
 
       // Update summary stats
-      Ir_total.a  += lineCC->Ir.a;
-      Ir_total.m1 += lineCC->Ir.m1;
-      Ir_total.m2 += lineCC->Ir.m2;
-      Ir_total.mL += lineCC->Ir.mL;
-       t_Ir_total.a  += lineCC->t_Ir.a;
-       t_Ir_total.t1 += lineCC->t_Ir.t1;
-       t_Ir_total.t2 += lineCC->t_Ir.t2;
-      Dr_total.a  += lineCC->Dr.a;
-      Dr_total.m1 += lineCC->Dr.m1;
-      Dr_total.m2 += lineCC->Dr.m2;
-      Dr_total.mL += lineCC->Dr.mL;
-       t_Dr_total.a  += lineCC->t_Dr.a;
-       t_Dr_total.t1 += lineCC->t_Dr.t1;
-       t_Dr_total.t2 += lineCC->t_Dr.t2;
-      Dw_total.a  += lineCC->Dw.a;
-      Dw_total.m1 += lineCC->Dw.m1;
-      Dw_total.m2 += lineCC->Dw.m2;
-      Dw_total.mL += lineCC->Dw.mL;
-       t_Dw_total.a  += lineCC->t_Dw.a;
-       t_Dw_total.t1 += lineCC->t_Dw.t1;
-       t_Dw_total.t2 += lineCC->t_Dw.t2;
-      Bc_total.b  += lineCC->Bc.b;
-      Bc_total.mp += lineCC->Bc.mp;
-      Bi_total.b  += lineCC->Bi.b;
-      Bi_total.mp += lineCC->Bi.mp;
+      Ir_total.a  += lineCC->cc.Ir.a;
+      Ir_total.m1 += lineCC->cc.Ir.m1;
+      Ir_total.m2 += lineCC->cc.Ir.m2;
+      Ir_total.mL += lineCC->cc.Ir.mL;
+       t_Ir_total.a  += lineCC->cc.t_Ir.a;
+       t_Ir_total.t1 += lineCC->cc.t_Ir.t1;
+       t_Ir_total.t2 += lineCC->cc.t_Ir.t2;
+      Dr_total.a  += lineCC->cc.Dr.a;
+      Dr_total.m1 += lineCC->cc.Dr.m1;
+      Dr_total.m2 += lineCC->cc.Dr.m2;
+      Dr_total.mL += lineCC->cc.Dr.mL;
+       t_Dr_total.a  += lineCC->cc.t_Dr.a;
+       t_Dr_total.t1 += lineCC->cc.t_Dr.t1;
+       t_Dr_total.t2 += lineCC->cc.t_Dr.t2;
+      Dw_total.a  += lineCC->cc.Dw.a;
+      Dw_total.m1 += lineCC->cc.Dw.m1;
+      Dw_total.m2 += lineCC->cc.Dw.m2;
+      Dw_total.mL += lineCC->cc.Dw.mL;
+       t_Dw_total.a  += lineCC->cc.t_Dw.a;
+       t_Dw_total.t1 += lineCC->cc.t_Dw.t1;
+       t_Dw_total.t2 += lineCC->cc.t_Dw.t2;
+      Bc_total.b  += lineCC->cc.Bc.b;
+      Bc_total.mp += lineCC->cc.Bc.mp;
+      Bi_total.b  += lineCC->cc.Bi.b;
+      Bi_total.mp += lineCC->cc.Bi.mp;
 
       distinct_lines++;
    }
@@ -1648,6 +1883,7 @@ static void cg_fini(Int exitcode)
          L2_total, L2_total_r, L2_total_w;
    Int l1, l2, l3;
 
+   sum_thread_counts();
    fprint_CC_table_and_calc_totals();
 
    if (VG_(clo_verbosity) == 0) 
@@ -1923,6 +2159,7 @@ static void cg_pre_clo_init(void)
                                    cg_fini);
 
    VG_(needs_superblock_discards)(cg_discard_superblock_info);
+   VG_(track_pre_thread_ll_create)(cg_pre_thread_ll_create);
    VG_(needs_command_line_options)(cg_process_cmd_line_option,
                                    cg_print_usage,
                                    cg_print_debug_usage);
@@ -1989,6 +2226,7 @@ static void cg_post_clo_init(void)
    cachesim_D1_initcache(D1c);
    cachesim_L2_initcache(L2c);
    cachesim_LL_initcache(LLc);
+   cachesim_initsim(&shared_sim);
     
     //Initialise TLB for simulation!
     tlbsim_init(0,iTLBc.size,iTLBc.assoc,iTLBc.line_size);
@@ -1996,6 +2234,12 @@ static void cg_post_clo_init(void)
     tlbsim_init(2,L2TLBc.size,L2TLBc.assoc,L2TLBc.line_size);
     
     tlb_post_clo_init();
+
+   // The TLB simulation is not kept per thread (nor is it reentrant), so
+   // threads can only run in parallel without it.  Whether they do is only
+   // settled once this returns;  see VG_(clo_parallel_execution).
+   if (!isTLBsim())
+      VG_(needs_thread_safe_instrumentation)();
 }
 
 VG_DETERMINE_INTERFACE_VERSION(cg_pre_clo_init)
@@ -50,10 +50,10 @@ typedef struct {
    UWord*       tags;
 } cache_t2;
 
-/* By this point, the size/assoc/line_size has been checked. */
+/* By this point, the size/assoc/line_size has been checked.  This only
+   sets up the geometry;  see cachesim_clonecache. */
 static void cachesim_initcache(cache_t config, cache_t2* c)
 {
-   Int i;
    c->size      = config.size;
    c->assoc     = config.assoc;
    c->line_size = config.line_size;
@@ -71,6 +71,15 @@ static void cachesim_initcache(cache_t config, cache_t2* c)
                                  c->size, c->line_size, c->assoc);
    }
 
+   c->tags = NULL;
+}
+
+/* Make 'c' an empty cache with the same geometry as 'proto'. */
+static void cachesim_clonecache(cache_t2* proto, cache_t2* c)
+{
+   Int i;
+   *c = *proto;
+
    c->tags = VG_(malloc)("cg.sim.ci.1",
                          sizeof(UWord) * c->sets * c->assoc);
 
@@ -78,28 +87,41 @@ static void cachesim_initcache(cache_t config, cache_t2* c)
       c->tags[i] = 0;
 }
 
+/* A set of simulated caches.  Normally there is one, shared by all
+   threads;  with --parallel-execution=yes each thread has its own, so
+   that threads can run instrumented code at the same time. */
+typedef struct {
+   cache_t2 I1;
+   cache_t2 D1;
+   cache_t2 L2;
+   cache_t2 LL;
+} cache_sim_t;
+
+/* The configured caches, which the simulated ones are copies of.  Their
+   tags are not allocated. */
+static cache_sim_t cachesim_proto;
+
 /* This is done as a macro rather than by passing in the cache_t2 as an 
  * arg because it slows things down by a small amount (3-5%) due to all 
- * that extra indirection. */
+ * that extra indirection.  Only the cache_sim_t is passed in;  which of
+ * its caches to use is fixed by the macro. */
 
 #define CACHESIM(L, MISS_TREATMENT)                                         \
-/* The cache and associated bits and pieces. */                             \
-static cache_t2 L;                                                          \
-                                                                            \
 static void cachesim_##L##_initcache(cache_t config)                        \
 {                                                                           \
-    cachesim_initcache(config, &L);                                         \
+    cachesim_initcache(config, &cachesim_proto.L);                          \
 }                                                                           \
                                                                             \
 /* This attribute forces GCC to inline this function, even though it's */   \
 /* bigger than its usual limit.  Inlining gains around 5--10% speedup. */   \
 __attribute__((always_inline))                                              \
 static __inline__                                                           \
-void cachesim_##L##_doref(Addr a, UChar size, ULong* m1, ULong *m2, ULong *mL)\
+void cachesim_##L##_doref(cache_sim_t* sim, Addr a, UChar size,              \
+                          ULong* m1, ULong *m2, ULong *mL)                  \
 {                                                                           \
-   UInt  set1 = ( a         >> L.line_size_bits) & (L.sets_min_1);          \
-   UInt  set2 = ((a+size-1) >> L.line_size_bits) & (L.sets_min_1);          \
-   UWord tag  = a >> L.tag_shift;                                           \
+   UInt  set1 = ( a         >> sim->L.line_size_bits) & (sim->L.sets_min_1); \
+   UInt  set2 = ((a+size-1) >> sim->L.line_size_bits) & (sim->L.sets_min_1); \
+   UWord tag  = a >> sim->L.tag_shift;                                      \
    UWord tag2;                                                              \
    Int i, j;                                                                \
    Bool is_miss = False;                                                    \
@@ -108,7 +130,7 @@ void cachesim_##L##_doref(Addr a, UChar size, ULong* m1, ULong *m2, ULong *mL)\
    /* First case: word entirely within line. */                             \
    if (set1 == set2) {                                                      \
                                                                             \
-      set = &(L.tags[set1 * L.assoc]);                                      \
+      set = &(sim->L.tags[set1 * sim->L.assoc]);                            \
                                                                             \
       /* This loop is unrolled for just the first case, which is the most */\
       /* common.  We can't unroll any further because it would screw up   */\
@@ -118,7 +140,7 @@ void cachesim_##L##_doref(Addr a, UChar size, ULong* m1, ULong *m2, ULong *mL)\
       }                                                                     \
       /* If the tag is one other than the MRU, move it into the MRU spot  */\
       /* and shuffle the rest down.                                       */\
-      for (i = 1; i < L.assoc; i++) {                                       \
+      for (i = 1; i < sim->L.assoc; i++) {                                  \
          if (tag == set[i]) {                                               \
             for (j = i; j > 0; j--) {                                       \
                set[j] = set[j - 1];                                         \
@@ -129,7 +151,7 @@ void cachesim_##L##_doref(Addr a, UChar size, ULong* m1, ULong *m2, ULong *mL)\
       }                                                                     \
                                                                             \
       /* A miss;  install this tag as MRU, shuffle rest down. */            \
-      for (j = L.assoc - 1; j > 0; j--) {                                   \
+      for (j = sim->L.assoc - 1; j > 0; j--) {                              \
          set[j] = set[j - 1];                                               \
       }                                                                     \
       set[0] = tag;                                                         \
@@ -138,12 +160,12 @@ void cachesim_##L##_doref(Addr a, UChar size, ULong* m1, ULong *m2, ULong *mL)\
                                                                             \
    /* Second case: word straddles two lines. */                             \
    /* Nb: this is a fast way of doing ((set1+1) % L.sets) */                \
-   } else if (((set1 + 1) & (L.sets_min_1)) == set2) {                      \
-      set = &(L.tags[set1 * L.assoc]);                                      \
+   } else if (((set1 + 1) & (sim->L.sets_min_1)) == set2) {                 \
+      set = &(sim->L.tags[set1 * sim->L.assoc]);                            \
       if (tag == set[0]) {                                                  \
          goto block2;                                                       \
       }                                                                     \
-      for (i = 1; i < L.assoc; i++) {                                       \
+      for (i = 1; i < sim->L.assoc; i++) {                                  \
          if (tag == set[i]) {                                               \
             for (j = i; j > 0; j--) {                                       \
                set[j] = set[j - 1];                                         \
@@ -152,18 +174,18 @@ void cachesim_##L##_doref(Addr a, UChar size, ULong* m1, ULong *m2, ULong *mL)\
             goto block2;                                                    \
          }                                                                  \
       }                                                                     \
-      for (j = L.assoc - 1; j > 0; j--) {                                   \
+      for (j = sim->L.assoc - 1; j > 0; j--) {                              \
          set[j] = set[j - 1];                                               \
       }                                                                     \
       set[0] = tag;                                                         \
       is_miss = True;                                                       \
 block2:                                                                     \
-      set = &(L.tags[set2 * L.assoc]);                                      \
-      tag2 = (a+size-1) >> L.tag_shift;                                     \
+      set = &(sim->L.tags[set2 * sim->L.assoc]);                            \
+      tag2 = (a+size-1) >> sim->L.tag_shift;                                \
       if (tag2 == set[0]) {                                                 \
          goto miss_treatment;                                               \
       }                                                                     \
-      for (i = 1; i < L.assoc; i++) {                                       \
+      for (i = 1; i < sim->L.assoc; i++) {                                  \
          if (tag2 == set[i]) {                                              \
             for (j = i; j > 0; j--) {                                       \
                set[j] = set[j - 1];                                         \
@@ -172,7 +194,7 @@ block2:                                                                     \
             goto miss_treatment;                                            \
          }                                                                  \
       }                                                                     \
-      for (j = L.assoc - 1; j > 0; j--) {                                   \
+      for (j = sim->L.assoc - 1; j > 0; j--) {                              \
          set[j] = set[j - 1];                                               \
       }                                                                     \
       set[0] = tag2;                                                        \
@@ -189,9 +211,18 @@ miss_treatment:                                                             \
 
 CACHESIM(LL, (*mL)++ );
 //CACHESIM(LL, {(*m2)++; (*mL)++;} );
-CACHESIM(L2, { (*m2)++; cachesim_LL_doref(a, size, m1, m2, mL); } );
-CACHESIM(I1, { (*m1)++; cachesim_L2_doref(a, size, m1, m2, mL); } );
-CACHESIM(D1, { (*m1)++; cachesim_L2_doref(a, size, m1, m2, mL); } );
+CACHESIM(L2, { (*m2)++; cachesim_LL_doref(sim, a, size, m1, m2, mL); } );
+CACHESIM(I1, { (*m1)++; cachesim_L2_doref(sim, a, size, m1, m2, mL); } );
+CACHESIM(D1, { (*m1)++; cachesim_L2_doref(sim, a, size, m1, m2, mL); } );
+
+/* Make 'sim' a set of empty caches of the configured sizes. */
+static void cachesim_initsim(cache_sim_t* sim)
+{
+   cachesim_clonecache(&cachesim_proto.I1, &sim->I1);
+   cachesim_clonecache(&cachesim_proto.D1, &sim->D1);
+   cachesim_clonecache(&cachesim_proto.L2, &sim->L2);
+   cachesim_clonecache(&cachesim_proto.LL, &sim->LL);
+}
 
 
 /* Initial: 
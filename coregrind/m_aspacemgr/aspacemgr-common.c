@@ -186,6 +186,11 @@ SysRes local_do_mprotect_NO_NOTIFY(Addr start, SizeT length, UInt prot)
    return VG_(do_syscall3)(__NR_mprotect, (UWord)start, length, prot );
 }
 
+SysRes ML_(am_do_mprotect_NO_NOTIFY)(Addr start, SizeT length, UInt prot)
+{
+   return local_do_mprotect_NO_NOTIFY(start, length, prot);
+}
+
 SysRes ML_(am_do_munmap_NO_NOTIFY)(Addr start, SizeT length)
 {
    return VG_(do_syscall2)(__NR_munmap, (UWord)start, length );
@@ -865,7 +865,7 @@ static void sync_check_mapping_callback ( Addr addr, SizeT len, UInt prot,
                                           const UChar* filename )
 {
    Int  iLo, iHi, i;
-   Bool sloppyXcheck;
+   Bool sloppyXcheck, sloppyWcheck;
 
    /* If a problem has already been detected, don't continue comparing
       segments, so as to avoid flooding the output with error
@@ -909,6 +909,12 @@ static void sync_check_mapping_callback ( Addr addr, SizeT len, UInt prot,
    sloppyXcheck = False;
 #  endif
 
+   /* With --smc-check=pageprot, client pages which code has been
+      translated from may be write-protected behind our back (see
+      VG_(am_set_client_page_writable)), so allow the kernel to report
+      no write permission when we were expecting it. */
+   sloppyWcheck = VG_(clo_smc_check) == Vg_SmcPageProt;
+
    /* NSegments iLo .. iHi inclusive should agree with the presented
       data. */
    for (i = iLo; i <= iHi; i++) {
@@ -962,6 +968,9 @@ static void sync_check_mapping_callback ( Addr addr, SizeT len, UInt prot,
       if (sloppyXcheck && (prot & VKI_PROT_EXEC) != 0) {
          seg_prot |= VKI_PROT_EXEC;
       }
+      if (sloppyWcheck && (prot & VKI_PROT_WRITE) == 0) {
+         seg_prot &= ~VKI_PROT_WRITE;
+      }
 
       same = same
              && seg_prot == prot
@@ -2111,8 +2120,12 @@ Bool VG_(am_notify_mprotect)( Addr start, SizeT len, UInt prot )
    newW = toBool(prot & VKI_PROT_WRITE);
    newX = toBool(prot & VKI_PROT_EXEC);
 
-   /* Discard is needed if we're dumping X permission */
-   needDiscard = any_Ts_in_range( start, len ) && !newX;
+   /* Discard is needed if we're dumping X permission, or, with
+      --smc-check=pageprot, if we're (re)granting W permission, since
+      that undoes any write-protection of code pages. */
+   needDiscard = any_Ts_in_range( start, len )
+                 && (!newX
+                     || (newW && VG_(clo_smc_check) == Vg_SmcPageProt));
 
    split_nsegments_lo_and_hi( start, start+len-1, &iLo, &iHi );
 
@@ -2756,6 +2769,37 @@ void VG_(am_set_segment_hasT_if_SkFileC_or_SkAnonC)( NSegment* seg )
 }
 
 
+/* For --smc-check=pageprot: set the real protection of the client
+   page containing 'a' to what aspacem has recorded for it, but without
+   write permission if 'writable' is False.  aspacem's record is not
+   changed, so as far as the rest of the system is concerned the page
+   stays writable.  Returns False if 'a' is not in a writable client
+   mapping, or the mprotect failed. */
+Bool VG_(am_set_client_page_writable)( Addr a, Bool writable )
+{
+   Int    i;
+   UInt   prot;
+   SysRes sres;
+
+   i = find_nsegment_idx( a );
+   aspacem_assert(i >= 0 && i < nsegments_used);
+   if (nsegments[i].kind != SkAnonC && nsegments[i].kind != SkFileC
+       && nsegments[i].kind != SkShmC)
+      return False;
+   if (!nsegments[i].hasW)
+      return False;
+
+   prot = 0;
+   if (nsegments[i].hasR) prot |= VKI_PROT_READ;
+   if (writable)          prot |= VKI_PROT_WRITE;
+   if (nsegments[i].hasX) prot |= VKI_PROT_EXEC;
+
+   sres = ML_(am_do_mprotect_NO_NOTIFY)( VG_PGROUNDDN(a), VKI_PAGE_SIZE,
+                                         prot );
+   return !sr_isError(sres);
+}
+
+
 /* --- --- --- reservations --- --- --- */
 
 /* Create a reservation from START .. START+LENGTH-1, with the given
@@ -87,6 +87,10 @@ extern Int    ML_(am_getpid)( void );
 extern UInt   ML_(am_sprintf) ( HChar* buf, const HChar *format, ... );
 
 /* mmap et al wrappers */
+/* wrapper for mprotect */
+extern SysRes ML_(am_do_mprotect_NO_NOTIFY)(Addr start, SizeT length,
+                                            UInt prot);
+
 /* wrapper for munmap */
 extern SysRes ML_(am_do_munmap_NO_NOTIFY)(Addr start, SizeT length);
 
@@ -422,7 +422,7 @@ static Bool get_Dwarf_Reg( /*OUT*/Addr* a, Word regno, RegSummary* regs )
 }
 
 /* Convert a stated address to an actual address */
-static Bool bias_address( Addr* a, const DebugInfo* di )
+Bool ML_(bias_address)( Addr* a, const DebugInfo* di )
 {
    if (di->text_present
        && di->text_size > 0
@@ -564,7 +564,7 @@ GXResult ML_(evaluate_Dwarf3_Expr) ( UChar* expr, UWord exprszB,
                could it be otherwise?)  So we add the appropriate bias
                on before pushing the result. */
             a1 = ML_(read_Addr)(expr);
-            if (bias_address(&a1, di)) {
+            if (ML_(bias_address)(&a1, di)) {
                PUSH( a1 ); 
                expr += sizeof(Addr);
             }
@@ -1047,7 +1047,7 @@ GXResult ML_(evaluate_trivial_GX)( GExpr* gx, const DebugInfo* di )
       if (nbytes == 1 + sizeof(Addr) && *p == DW_OP_addr) {
          /* DW_OP_addr a */
          Addr a = ML_(read_Addr)((p+1));
-         if (bias_address(&a, di)) {
+         if (ML_(bias_address)(&a, di)) {
             thisResult.b = True;
             thisResult.ul = (ULong)a;
          } else {
@@ -1067,7 +1067,7 @@ GXResult ML_(evaluate_trivial_GX)( GExpr* gx, const DebugInfo* di )
           && p[1 + sizeof(Addr)] == DW_OP_plus_uconst 
           && p[1 + sizeof(Addr) + 1] < 0x80 /*1-byte ULEB*/) {
          Addr a = ML_(read_Addr)(&p[1]);
-         if (bias_address(&a, di)) {
+         if (ML_(bias_address)(&a, di)) {
             thisResult.b = True;
             thisResult.ul = (ULong)a + (ULong)p[1 + sizeof(Addr) + 1];
          } else {
@@ -56,9 +56,10 @@
 #include "priv_storage.h"
 #include "priv_readdwarf.h"
 #include "priv_readstabs.h"
+#include "priv_dicache.h"
+#include "priv_readdwarf3.h"
 #if defined(VGO_linux)
 # include "priv_readelf.h"
-# include "priv_readdwarf3.h"
 # include "priv_readpdb.h"
 #elif defined(VGO_darwin)
 # include "priv_readmacho.h"
@@ -101,6 +102,7 @@
 /*------------------------------------------------------------*/
 
 static void cfsi_cache__invalidate ( void );
+static void discard_deferred_DebugInfo ( DebugInfo* di );
 
 
 /*------------------------------------------------------------*/
@@ -111,6 +113,11 @@ static void cfsi_cache__invalidate ( void );
    linked list of DebugInfos. */
 static DebugInfo* debugInfo_list = NULL;
 
+/* How many of them still have deferred debug info
+   (--read-debuginfo=lazy)?  Lets the call frame info search skip
+   looking for them once there are none. */
+static UInt n_deferred_DebugInfos = 0;
+
 
 /* Find 'di' in the debugInfo_list and move it one step closer the the
    front of the list, so as to make subsequent searches for it
@@ -201,19 +208,26 @@ DebugInfo* alloc_DebugInfo( const UChar* filename )
 /* Free a DebugInfo, and also all the stuff hanging off it. */
 static void free_DebugInfo ( DebugInfo* di )
 {
-   Word i, j, n;
+   Word i, n;
    struct strchunk *chunk, *next;
-   TyEnt* ent;
-   GExpr* gexpr;
 
    vg_assert(di != NULL);
+   if (di->deferred)     discard_deferred_DebugInfo(di);
+   if (di->lazy_vars)    ML_(lazy_varinfo_discard)(di);
+#  if defined(VGO_linux)
+   if (di->kept_sections) ML_(unmap_elf_kept_sections)(di);
+#  endif
    if (di->fsm.maps)     VG_(deleteXA)(di->fsm.maps);
    if (di->fsm.filename) ML_(dinfo_free)(di->fsm.filename);
    if (di->soname)       ML_(dinfo_free)(di->soname);
+   if (di->buildid)      ML_(dinfo_free)(di->buildid);
    if (di->loctab)       ML_(dinfo_free)(di->loctab);
    if (di->cfsi)         ML_(dinfo_free)(di->cfsi);
    if (di->cfsi_exprs)   VG_(deleteXA)(di->cfsi_exprs);
+   ML_(free_cfsi_index)(di);
    if (di->fpo)          ML_(dinfo_free)(di->fpo);
+   if (di->dicache_img)  ML_(dicache_release)(di);
+   if (di->dicache_srcs) VG_(deleteXA)(di->dicache_srcs);
 
    if (di->symtab) {
       /* We have to visit all the entries so as to free up any
@@ -233,60 +247,7 @@ static void free_DebugInfo ( DebugInfo* di )
       ML_(dinfo_free)(chunk);
    }
 
-   /* Delete the two admin arrays.  These lists exist primarily so
-      that we can visit each object exactly once when we need to
-      delete them. */
-   if (di->admin_tyents) {
-      n = VG_(sizeXA)(di->admin_tyents);
-      for (i = 0; i < n; i++) {
-         ent = (TyEnt*)VG_(indexXA)(di->admin_tyents, i);
-         /* Dump anything hanging off this ent */
-         ML_(TyEnt__make_EMPTY)(ent);
-      }
-      VG_(deleteXA)(di->admin_tyents);
-      di->admin_tyents = NULL;
-   }
-
-   if (di->admin_gexprs) {
-      n = VG_(sizeXA)(di->admin_gexprs);
-      for (i = 0; i < n; i++) {
-         gexpr = *(GExpr**)VG_(indexXA)(di->admin_gexprs, i);
-         ML_(dinfo_free)(gexpr);
-      }
-      VG_(deleteXA)(di->admin_gexprs);
-      di->admin_gexprs = NULL;
-   }
-
-   /* Dump the variable info.  This is kinda complex: we must take
-      care not to free items which reside in either the admin lists
-      (as we have just freed them) or which reside in the DebugInfo's
-      string table. */
-   if (di->varinfo) {
-      for (i = 0; i < VG_(sizeXA)(di->varinfo); i++) {
-         OSet* scope = *(OSet**)VG_(indexXA)(di->varinfo, i);
-         if (!scope) continue;
-         /* iterate over all entries in 'scope' */
-         VG_(OSetGen_ResetIter)(scope);
-         while (True) {
-            DiAddrRange* arange = VG_(OSetGen_Next)(scope);
-            if (!arange) break;
-            /* for each var in 'arange' */
-            vg_assert(arange->vars);
-            for (j = 0; j < VG_(sizeXA)( arange->vars ); j++) {
-               DiVariable* var = (DiVariable*)VG_(indexXA)(arange->vars,j);
-               vg_assert(var);
-               /* Nothing to free in var: all the pointer fields refer
-                  to stuff either on an admin list, or in
-                  .strchunks */
-            }
-            VG_(deleteXA)(arange->vars);
-            /* Don't free arange itself, as OSetGen_Destroy does
-               that */
-         }
-         VG_(OSetGen_Destroy)(scope);
-      }
-      VG_(deleteXA)(di->varinfo);
-   }
+   ML_(free_varinfo)(di);
 
    ML_(dinfo_free)(di);
 }
@@ -638,8 +599,10 @@ static ULong di_notify_ACHIEVE_ACCEPT_STATE ( struct _DebugInfo* di )
                    "acquired info ------\n");
       /* invalidate the CFI unwind cache. */
       cfsi_cache__invalidate();
-      /* prepare read data for use */
-      ML_(canonicaliseTables)( di );
+      /* prepare read data for use (tables from the debug info
+         cache already are) */
+      if (di->dicache_img == 0)
+         ML_(canonicaliseTables)( di );
       /* notify m_redir about it */
       TRACE_SYMTAB("\n------ Notifying m_redir ------\n");
       VG_(redir_notify_new_DebugInfo)( di );
@@ -647,10 +610,16 @@ static ULong di_notify_ACHIEVE_ACCEPT_STATE ( struct _DebugInfo* di )
       di->have_dinfo = True;
       tl_assert(di->handle > 0);
       di_handle = di->handle;
+      if (di->deferred)
+         n_deferred_DebugInfos++;
       /* Check invariants listed in
          Comment_on_IMPORTANT_REPRESENTATIONAL_INVARIANTS in
          priv_storage.h. */
       check_CFSI_related_invariants(di);
+      /* and keep the tables for next time, if asked to */
+      if (VG_(clo_debuginfo_cache_dir) && di->buildid
+          && !di->deferred && di->dicache_img == 0)
+         ML_(dicache_save)(di);
 
    } else {
       TRACE_SYMTAB("\n------ ELF reading failed ------\n");
@@ -671,6 +640,67 @@ static ULong di_notify_ACHIEVE_ACCEPT_STATE ( struct _DebugInfo* di )
 }
 
 
+/*------------------------------------------------------------*/
+/*--- Deferred reading (--read-debuginfo=lazy)             ---*/
+/*------------------------------------------------------------*/
+
+/* With --read-debuginfo=lazy, only the symbol tables are read when an
+   object is mapped (m_redir needs them straight away), and the rest
+   of the debug info -- line numbers, call frame info, variable info,
+   which for big programs is where nearly all of the startup time
+   goes -- is read when it is first asked for.  Every query which
+   needs any of that for some object therefore has to call
+   load_deferred_DebugInfo for it first. */
+
+static void load_deferred_DebugInfo ( DebugInfo* di )
+{
+   if (LIKELY(di->deferred == NULL))
+      return;
+#  if defined(VGO_linux)
+   vg_assert(n_deferred_DebugInfos > 0);
+   n_deferred_DebugInfos--;
+   TRACE_SYMTAB("\n------ Reading deferred debug info for %s ------\n",
+                di->fsm.filename);
+   ML_(read_elf_deferred_debug_info)( di );
+   ML_(canonicaliseDebugTables)( di );
+   /* The new call frame info can change the answer for addresses
+      already looked up, so drop the cache. */
+   cfsi_cache__invalidate();
+   check_CFSI_related_invariants(di);
+#  else
+   vg_assert(0);
+#  endif
+}
+
+/* Load the deferred debug info, if any, for the object whose code
+   contains 'a'. */
+static void load_deferred_DebugInfo_for_code ( Addr a )
+{
+   DebugInfo* di;
+   for (di = debugInfo_list; di != NULL; di = di->next) {
+      if (di->deferred != NULL
+          && di->fsm.have_rx_map
+          && ML_(find_rx_mapping)(di, a, a) != NULL) {
+         load_deferred_DebugInfo(di);
+         return;
+      }
+   }
+}
+
+/* Throw away deferred debug info without reading it, for an object
+   which is being discarded. */
+static void discard_deferred_DebugInfo ( DebugInfo* di )
+{
+#  if defined(VGO_linux)
+   vg_assert(n_deferred_DebugInfos > 0);
+   n_deferred_DebugInfos--;
+   ML_(discard_elf_deferred_debug_info)( di );
+#  else
+   vg_assert(0);
+#  endif
+}
+
+
 /* Notify the debuginfo system about a new mapping.  This is the way
    new debug information gets loaded.  If allow_SkFileV is True, it
    will try load debug info if the mapping at 'a' belongs to Valgrind;
@@ -1318,6 +1348,35 @@ struct _DebugInfoMapping* ML_(find_rx_mapping) ( struct _DebugInfo* di,
 /*--- plausible-looking stack dumps.                       ---*/
 /*------------------------------------------------------------*/
 
+/* Does 'ptr' fall in one of the data sections of 'di'? */
+static Bool data_address_is_in_DebugInfo ( DebugInfo* di, Addr ptr )
+{
+   return (di->data_present
+           && di->data_size > 0
+           && di->data_avma <= ptr 
+           && ptr < di->data_avma + di->data_size)
+          ||
+          (di->sdata_present
+           && di->sdata_size > 0
+           && di->sdata_avma <= ptr 
+           && ptr < di->sdata_avma + di->sdata_size)
+          ||
+          (di->bss_present
+           && di->bss_size > 0
+           && di->bss_avma <= ptr 
+           && ptr < di->bss_avma + di->bss_size)
+          ||
+          (di->sbss_present
+           && di->sbss_size > 0
+           && di->sbss_avma <= ptr 
+           && ptr < di->sbss_avma + di->sbss_size)
+          ||
+          (di->rodata_present
+           && di->rodata_size > 0
+           && di->rodata_avma <= ptr 
+           && ptr < di->rodata_avma + di->rodata_size);
+}
+
 /* Search all symtabs that we know about to locate ptr.  If found, set
    *pdi to the relevant DebugInfo, and *symno to the symtab entry
    *number within that.  If not found, *psi is set to NULL.
@@ -1342,30 +1401,7 @@ static void search_all_symtabs ( Addr ptr, /*OUT*/DebugInfo** pdi,
          inRange = di->fsm.have_rx_map
                    && (ML_(find_rx_mapping)(di, ptr, ptr) != NULL);
       } else {
-         inRange = (di->data_present
-                    && di->data_size > 0
-                    && di->data_avma <= ptr 
-                    && ptr < di->data_avma + di->data_size)
-                   ||
-                   (di->sdata_present
-                    && di->sdata_size > 0
-                    && di->sdata_avma <= ptr 
-                    && ptr < di->sdata_avma + di->sdata_size)
-                   ||
-                   (di->bss_present
-                    && di->bss_size > 0
-                    && di->bss_avma <= ptr 
-                    && ptr < di->bss_avma + di->bss_size)
-                   ||
-                   (di->sbss_present
-                    && di->sbss_size > 0
-                    && di->sbss_avma <= ptr 
-                    && ptr < di->sbss_avma + di->sbss_size)
-                   ||
-                   (di->rodata_present
-                    && di->rodata_size > 0
-                    && di->rodata_avma <= ptr 
-                    && ptr < di->rodata_avma + di->rodata_size);
+         inRange = data_address_is_in_DebugInfo(di, ptr);
       }
 
       if (!inRange) continue;
@@ -1396,6 +1432,7 @@ static void search_all_loctabs ( Addr ptr, /*OUT*/DebugInfo** pdi,
           && di->text_size > 0
           && di->text_avma <= ptr 
           && ptr < di->text_avma + di->text_size) {
+         load_deferred_DebugInfo(di);
          lno = ML_(search_one_loctab) ( di, ptr );
          if (lno == -1) goto not_found;
          *locno = lno;
@@ -2132,11 +2169,19 @@ UWord evalCfiExpr ( XArray* exprs, Int ix,
 }
 
 
-/* Search all the DebugInfos in the entire system, to find the DiCfSI
-   that pertains to 'ip'. 
+/* Statistics for the CFI lookups, for --stats=yes. */
+static ULong n_cfsi_cache_queries = 0;
+static ULong n_cfsi_cache_misses  = 0;
+static ULong n_cfsi_cache_flushes = 0;
+static ULong n_cfsi_searches      = 0;
+static ULong n_cfsi_search_steps  = 0;
+
+
+/* Search all the DebugInfos in the entire system, to find the unwind
+   rule that pertains to 'ip'.
 
    If found, set *diP to the DebugInfo in which it resides, and
-   *ixP to the index in that DebugInfo's cfsi array.
+   *ixP to the index in that DebugInfo's cfsi_rules array.
 
    If not found, set *diP to (DebugInfo*)1 and *ixP to zero.
 */
@@ -2148,15 +2193,16 @@ static void find_DiCfSI ( /*OUT*/DebugInfo** diP,
    DebugInfo* di;
    Word       i = -1;
 
-   static UWord n_search = 0;
-   static UWord n_steps = 0;
-   n_search++;
+   n_cfsi_searches++;
 
    if (0) VG_(printf)("search for %#lx\n", ip);
 
+   if (UNLIKELY(n_deferred_DebugInfos > 0))
+      load_deferred_DebugInfo_for_code(ip);
+
    for (di = debugInfo_list; di != NULL; di = di->next) {
       Word j;
-      n_steps++;
+      n_cfsi_search_steps++;
 
       /* Use the per-DebugInfo summary address ranges to skip
          inapplicable DebugInfos quickly. */
@@ -2165,9 +2211,9 @@ static void find_DiCfSI ( /*OUT*/DebugInfo** diP,
       if (ip < di->cfsi_minavma || ip > di->cfsi_maxavma)
          continue;
 
-      /* It might be in this DebugInfo.  Search it. */
-      j = ML_(search_one_cfitab)( di, ip );
-      vg_assert(j >= -1 && j < (Word)di->cfsi_used);
+      /* It might be in this DebugInfo.  Search its index. */
+      j = ML_(search_cfsi_index)( di, ip );
+      vg_assert(j >= -1 && j < (Word)di->cfsi_rules_used);
 
       if (j != -1) {
          i = j;
@@ -2187,7 +2233,7 @@ static void find_DiCfSI ( /*OUT*/DebugInfo** diP,
       /* ensure that di is 4-aligned (at least), so it can't possibly
          be equal to (DebugInfo*)1. */
       vg_assert(di && VG_IS_4_ALIGNED(di));
-      vg_assert(i >= 0 && i < di->cfsi_used);
+      vg_assert(i >= 0 && i < di->cfsi_rules_used);
       *diP = di;
       *ixP = i;
 
@@ -2198,17 +2244,12 @@ static void find_DiCfSI ( /*OUT*/DebugInfo** diP,
          amd64, this in fact reduces the total amount of searching
          done by the above find-the-right-DebugInfo loop by more than
          a factor of 20. */
-      if ((n_search & 0xF) == 0) {
+      if ((n_cfsi_searches & 0xF) == 0) {
          /* Move di one step closer to the start of the list. */
          move_DebugInfo_one_step_forward( di );
       }
       /* End of performance-enhancing hack. */
 
-      if (0 && ((n_search & 0x7FFFF) == 0))
-         VG_(printf)("find_DiCfSI: %lu searches, "
-                     "%lu DebugInfos looked at\n", 
-                     n_search, n_steps);
-
    }
 
 }
@@ -2220,51 +2261,82 @@ static void find_DiCfSI ( /*OUT*/DebugInfo** diP,
    Each cache entry binds an ip value to a (di, ix) pair.  Possible
    values:
 
-   di is non-null, ix >= 0  ==>  cache slot in use, "di->cfsi[ix]"
+   di is non-null, ix >= 0  ==>  cache slot in use, "di->cfsi_rules[ix]"
    di is (DebugInfo*)1      ==>  cache slot in use, no associated di
    di is NULL               ==>  cache slot not in use
 
    Hence simply zeroing out the entire cache invalidates all
    entries.
 
+   The cache is CFSI_CACHE_WAYS-way set associative.  Deep stacks
+   visit many return addresses per unwind, and a direct-mapped cache
+   loses too many of them to conflicts.  A hit moves the entry one
+   step towards the front of its set, and a new entry goes at the
+   front, pushing the last one out; so entries that are used often
+   stay, and ones used once soon go.
+
    Why not map ip values directly to DiCfSI*'s?  Because this would
-   cause problems if/when the cfsi array is moved due to resizing.
-   Instead we cache .cfsi array index value, which should be invariant
-   across resizing.  (That said, I don't think the current
-   implementation will resize whilst during queries, since the DiCfSI
-   records are added all at once, when the debuginfo for an object is
-   read, and is not changed ever thereafter. */
+   cause problems if/when the rules array is moved, as it is when the
+   index is rebuilt.  Instead we cache the rules array index value. */
 
-#define N_CFSI_CACHE 511
+#define CFSI_CACHE_WAYS      4
+#define CFSI_CACHE_SET_BITS  10
+#define N_CFSI_CACHE_SETS    (1 << CFSI_CACHE_SET_BITS)
 
 typedef
    struct { Addr ip; DebugInfo* di; Word ix; }
    CFSICacheEnt;
 
-static CFSICacheEnt cfsi_cache[N_CFSI_CACHE];
+typedef
+   struct { CFSICacheEnt ent[CFSI_CACHE_WAYS]; }
+   CFSICacheSet;
+
+static CFSICacheSet cfsi_cache[N_CFSI_CACHE_SETS];
 
 static void cfsi_cache__invalidate ( void ) {
    VG_(memset)(&cfsi_cache, 0, sizeof(cfsi_cache));
+   n_cfsi_cache_flushes++;
 }
 
 
 static inline CFSICacheEnt* cfsi_cache__find ( Addr ip )
 {
-   UWord         hash = ip % N_CFSI_CACHE;
-   CFSICacheEnt* ce = &cfsi_cache[hash];
-   static UWord  n_q = 0, n_m = 0;
+   UWord         hash = (ip ^ (ip >> CFSI_CACHE_SET_BITS))
+                        & (N_CFSI_CACHE_SETS - 1);
+   CFSICacheSet* set  = &cfsi_cache[hash];
+   CFSICacheEnt* ce;
+   UInt          w;
 
-   n_q++;
-   if (0 && 0 == (n_q & 0x1FFFFF))
-      VG_(printf)("QQQ %lu %lu\n", n_q, n_m);
+   n_cfsi_cache_queries++;
+
+   for (w = 0; w < CFSI_CACHE_WAYS; w++) {
+      if (LIKELY(set->ent[w].ip == ip) && LIKELY(set->ent[w].di != NULL))
+         break;
+   }
 
-   if (LIKELY(ce->ip == ip) && LIKELY(ce->di != NULL)) {
+   if (LIKELY(w < CFSI_CACHE_WAYS)) {
       /* found an entry in the cache .. */
+      if (w > 0) {
+         CFSICacheEnt tmp = set->ent[w-1];
+         set->ent[w-1] = set->ent[w];
+         set->ent[w]   = tmp;
+         w--;
+      }
+      ce = &set->ent[w];
    } else {
-      /* not found in cache.  Search and update. */
-      n_m++;
+      /* not found in cache.  Search and update.  Do the search
+         before touching the set, since the search may read
+         deferred debug info and so invalidate the cache. */
+      DebugInfo* di;
+      Word       ix;
+      n_cfsi_cache_misses++;
+      find_DiCfSI( &di, &ix, ip );
+      for (w = CFSI_CACHE_WAYS-1; w > 0; w--)
+         set->ent[w] = set->ent[w-1];
+      ce = &set->ent[0];
       ce->ip = ip;
-      find_DiCfSI( &ce->di, &ce->ix, ip );
+      ce->di = di;
+      ce->ix = ix;
    }
 
    if (UNLIKELY(ce->di == (DebugInfo*)1)) {
@@ -2277,10 +2349,63 @@ static inline CFSICacheEnt* cfsi_cache__find ( Addr ip )
 }
 
 
+void VG_(print_debuginfo_stats) ( void )
+{
+   DebugInfo* di;
+   ULong      n_recs = 0, n_ranges = 0, n_rules = 0;
+
+   for (di = debugInfo_list; di != NULL; di = di->next) {
+      n_recs   += di->cfsi_used;
+      n_ranges += di->cfsi_bounds_used;
+      n_rules  += di->cfsi_rules_used;
+   }
+   VG_(message)(Vg_DebugMsg,
+      "     cfsi: %'llu lookups, %'llu misses (%'llu per 1000), "
+      "%'llu flushes\n",
+      n_cfsi_cache_queries, n_cfsi_cache_misses,
+      n_cfsi_cache_queries == 0
+         ? 0ULL
+         : (n_cfsi_cache_misses * 1000ULL) / n_cfsi_cache_queries,
+      n_cfsi_cache_flushes );
+   VG_(message)(Vg_DebugMsg,
+      "     cfsi: cache is %d-way, %d sets; "
+      "%'llu searches looked at %'llu objects\n",
+      CFSI_CACHE_WAYS, N_CFSI_CACHE_SETS,
+      n_cfsi_searches, n_cfsi_search_steps );
+   VG_(message)(Vg_DebugMsg,
+      "     cfsi: %'llu records indexed as %'llu ranges, "
+      "%'llu distinct rules\n",
+      n_recs, n_ranges, n_rules );
+}
+
+
+ULong VG_(CF_info_generation) ( void )
+{
+   return n_cfsi_cache_flushes;
+}
+
+
+/* Note in 'log', if there is one, that an unwinding step read 'v'
+   from 'a'. */
+static inline void log_CF_read ( CFReadLog* log, Addr a, UWord v )
+{
+   if (log == NULL || log->n_reads < 0)
+      return;
+   if (log->n_reads == CF_READS_MAX) {
+      log->n_reads = -1;
+      return;
+   }
+   log->read_at[log->n_reads]  = a;
+   log->read_val[log->n_reads] = v;
+   log->n_reads++;
+}
+
+
 inline
 static Addr compute_cfa ( D3UnwindRegs* uregs,
                           Addr min_accessible, Addr max_accessible,
-                          DebugInfo* di, DiCfSI* cfsi )
+                          DebugInfo* di, DiCfSI* cfsi,
+                          CFReadLog* log )
 {
    CfiExprEvalContext eec;
    Addr               cfa;
@@ -2319,6 +2444,7 @@ static Addr compute_cfa ( D3UnwindRegs* uregs,
          if (a < min_accessible || a > max_accessible-sizeof(Addr))
             break;
          cfa = ML_(read_Addr)((void *)a);
+         log_CF_read(log, a, cfa);
          break;
       }
       case CFIR_SAME:
@@ -2351,6 +2477,7 @@ static Addr compute_cfa ( D3UnwindRegs* uregs,
          eec.min_accessible = min_accessible;
          eec.max_accessible = max_accessible;
          ok = True;
+         if (log) log->n_reads = -1;
          cfa = evalCfiExpr(di->cfsi_exprs, cfsi->cfa_off, &eec, &ok );
          if (!ok) return 0;
          break;
@@ -2377,7 +2504,7 @@ Addr ML_(get_CFA) ( Addr ip, Addr sp, Addr fp,
       return 0; /* no info.  Nothing we can do. */
 
    di = ce->di;
-   cfsi = &di->cfsi[ ce->ix ];
+   cfsi = &di->cfsi_rules[ ce->ix ];
 
    /* Temporary impedance-matching kludge so that this keeps working
       on x86-linux and amd64-linux. */
@@ -2387,7 +2514,7 @@ Addr ML_(get_CFA) ( Addr ip, Addr sp, Addr fp,
      uregs.xsp = sp;
      uregs.xbp = fp;
      return compute_cfa(&uregs,
-                        min_accessible,  max_accessible, di, cfsi);
+                        min_accessible,  max_accessible, di, cfsi, NULL);
    }
 #elif defined(VGA_s390x)
    { D3UnwindRegs uregs;
@@ -2395,7 +2522,7 @@ Addr ML_(get_CFA) ( Addr ip, Addr sp, Addr fp,
      uregs.sp = sp;
      uregs.fp = fp;
      return compute_cfa(&uregs,
-                        min_accessible,  max_accessible, di, cfsi);
+                        min_accessible,  max_accessible, di, cfsi, NULL);
    }
 
 #  else
@@ -2414,9 +2541,10 @@ Addr ML_(get_CFA) ( Addr ip, Addr sp, Addr fp,
 
    For arm, the unwound registers are: R7 R11 R12 R13 R14 R15.
 */
-Bool VG_(use_CF_info) ( /*MOD*/D3UnwindRegs* uregsHere,
-                        Addr min_accessible,
-                        Addr max_accessible )
+static Bool use_CF_info_wrk ( /*MOD*/D3UnwindRegs* uregsHere,
+                              Addr min_accessible,
+                              Addr max_accessible,
+                              /*OUT*/CFReadLog* log )
 {
    DebugInfo*         di;
    DiCfSI*            cfsi = NULL;
@@ -2439,11 +2567,13 @@ Bool VG_(use_CF_info) ( /*MOD*/D3UnwindRegs* uregsHere,
 #  endif
    ce = cfsi_cache__find(ipHere);
 
-   if (UNLIKELY(ce == NULL))
+   if (UNLIKELY(ce == NULL)) {
+      if (log) log->no_info = True;
       return False; /* no info.  Nothing we can do. */
+   }
 
    di = ce->di;
-   cfsi = &di->cfsi[ ce->ix ];
+   cfsi = &di->cfsi_rules[ ce->ix ];
 
    if (0) {
       VG_(printf)("found cfisi: "); 
@@ -2454,7 +2584,7 @@ Bool VG_(use_CF_info) ( /*MOD*/D3UnwindRegs* uregsHere,
 
    /* First compute the CFA. */
    cfa = compute_cfa(uregsHere,
-                     min_accessible, max_accessible, di, cfsi);
+                     min_accessible, max_accessible, di, cfsi, log);
    if (UNLIKELY(cfa == 0))
       return False;
 
@@ -2474,6 +2604,7 @@ Bool VG_(use_CF_info) ( /*MOD*/D3UnwindRegs* uregsHere,
                    || a > max_accessible-sizeof(Addr))  \
                   return False;                         \
                _prev = ML_(read_Addr)((void *)a);       \
+               log_CF_read(log, a, _prev);              \
                break;                                   \
             }                                           \
             case CFIR_CFAREL:                           \
@@ -2485,6 +2616,7 @@ Bool VG_(use_CF_info) ( /*MOD*/D3UnwindRegs* uregsHere,
                eec.uregs = uregsHere;                   \
                eec.min_accessible = min_accessible;     \
                eec.max_accessible = max_accessible;     \
+               if (log) log->n_reads = -1;              \
                Bool ok = True;                          \
                _prev = evalCfiExpr(di->cfsi_exprs, _off, &eec, &ok ); \
                if (!ok) return False;                   \
@@ -2524,6 +2656,25 @@ Bool VG_(use_CF_info) ( /*MOD*/D3UnwindRegs* uregsHere,
    return True;
 }
 
+Bool VG_(use_CF_info) ( /*MOD*/D3UnwindRegs* uregsHere,
+                        Addr min_accessible,
+                        Addr max_accessible )
+{
+   return use_CF_info_wrk( uregsHere, min_accessible, max_accessible,
+                           NULL );
+}
+
+Bool VG_(use_CF_info_logged) ( /*MOD*/D3UnwindRegs* uregsHere,
+                               Addr min_accessible,
+                               Addr max_accessible,
+                               /*OUT*/CFReadLog* log )
+{
+   log->n_reads = 0;
+   log->no_info = False;
+   return use_CF_info_wrk( uregsHere, min_accessible, max_accessible,
+                           log );
+}
+
 
 /*--------------------------------------------------------------*/
 /*---                                                        ---*/
@@ -3033,6 +3184,82 @@ static void format_message ( /*MOD*/XArray* /* of HChar */ dn1,
 }
 
 
+/* Try to describe data_addr as (part of) a global variable in the
+   variable info of 'di'.  Returns True if that worked. */
+static Bool describe_global_in_DebugInfo ( /*MOD*/XArray* dname1,
+                                           /*MOD*/XArray* dname2,
+                                           Addr data_addr,
+                                           DebugInfo* di )
+{
+   OSet*        global_scope;
+   Word         gs_size;
+   Addr         zero;
+   DiAddrRange* global_arange;
+   Word         i;
+   XArray*      vars;
+
+   /* any var info at all? */
+   if (!di->varinfo)
+      return False;
+   /* perhaps this object didn't contribute any vars at all? */
+   if (VG_(sizeXA)( di->varinfo ) == 0)
+      return False;
+   global_scope = *(OSet**)VG_(indexXA)( di->varinfo, 0 );
+   vg_assert(global_scope);
+   gs_size = VG_(OSetGen_Size)( global_scope );
+   /* The global scope might be completely empty if this
+      compilation unit declared locals but nothing global. */
+   if (gs_size == 0)
+       return False;
+   /* But if it isn't empty, then it must contain exactly one
+      element, which covers the entire address range. */
+   vg_assert(gs_size == 1);
+   /* Fish out the global scope and check it is as expected. */
+   zero = 0;
+   global_arange 
+      = VG_(OSetGen_Lookup)( global_scope, &zero );
+   /* The global range from (Addr)0 to ~(Addr)0 must exist */
+   vg_assert(global_arange);
+   vg_assert(global_arange->aMin == (Addr)0
+             && global_arange->aMax == ~(Addr)0);
+   /* Any vars in this range? */
+   if (!global_arange->vars)
+      return False;
+   /* Ok, there are some vars in the global scope of this
+      DebugInfo.  Wade through them and see if the data addresses
+      of any of them bracket data_addr. */
+   vars = global_arange->vars;
+   for (i = 0; i < VG_(sizeXA)( vars ); i++) {
+      PtrdiffT offset;
+      DiVariable* var = (DiVariable*)VG_(indexXA)( vars, i );
+      vg_assert(var->name);
+      /* Note we use a NULL RegSummary* here.  It can't make any
+         sense for a global variable to have a location expression
+         which depends on a SP/FP/IP value.  So don't supply any.
+         This means, if the evaluation of the location
+         expression/list requires a register, we have to let it
+         fail. */
+      if (data_address_is_in_var( &offset, di->admin_tyents, var, 
+                                  NULL/* RegSummary* */, 
+                                  data_addr, di )) {
+         PtrdiffT residual_offset = 0;
+         XArray* described = ML_(describe_type)( &residual_offset,
+                                                 di->admin_tyents,
+                                                 var->typeR, offset );
+         format_message( dname1, dname2,
+                         data_addr, var, offset, residual_offset,
+                         described, -1/*frameNo*/,
+                         VG_INVALID_THREADID );
+         VG_(deleteXA)( described );
+         zterm_XA( dname1 );
+         zterm_XA( dname2 );
+         return True;
+      }
+   }
+   return False;
+}
+
+
 /* Determine if data_addr is a local variable in the frame
    characterised by (ip,sp,fp), and if so write its description at the
    ends of DNAME{1,2}, which are XArray*s of HChar, that have been
@@ -3072,6 +3299,7 @@ Bool consider_vars_in_frame ( /*MOD*/XArray* /* of HChar */ dname1,
       could be generating code to run. */
    if (!di)
       return False;
+   load_deferred_DebugInfo(di);
 
    if (0 && ((n_search & 0x1) == 0))
       VG_(printf)("consider_vars_in_frame: %u searches, "
@@ -3087,6 +3315,10 @@ Bool consider_vars_in_frame ( /*MOD*/XArray* /* of HChar */ dname1,
    }
    /* End of performance-enhancing hack. */
 
+   /* With --read-var-info=lazy, get the info for the CU at ip. */
+   if (di->lazy_vars)
+      ML_(lazy_varinfo_select_code)(di, ip);
+
    /* any var info at all? */
    if (!di->varinfo)
       return False;
@@ -3198,74 +3430,31 @@ Bool VG_(get_data_description)(
       outermost scope of all of them, as that should be a global
       scope. */
    for (di = debugInfo_list; di != NULL; di = di->next) {
-      OSet*        global_scope;
-      Word         gs_size;
-      Addr         zero;
-      DiAddrRange* global_arange;
-      Word         i;
-      XArray*      vars;
+      Word nth;
 
       /* text segment missing? unlikely, but handle it .. */
       if (!di->text_present || di->text_size == 0)
          continue;
-      /* any var info at all? */
-      if (!di->varinfo)
-         continue;
-      /* perhaps this object didn't contribute any vars at all? */
-      if (VG_(sizeXA)( di->varinfo ) == 0)
-         continue;
-      global_scope = *(OSet**)VG_(indexXA)( di->varinfo, 0 );
-      vg_assert(global_scope);
-      gs_size = VG_(OSetGen_Size)( global_scope );
-      /* The global scope might be completely empty if this
-         compilation unit declared locals but nothing global. */
-      if (gs_size == 0)
-          continue;
-      /* But if it isn't empty, then it must contain exactly one
-         element, which covers the entire address range. */
-      vg_assert(gs_size == 1);
-      /* Fish out the global scope and check it is as expected. */
-      zero = 0;
-      global_arange 
-         = VG_(OSetGen_Lookup)( global_scope, &zero );
-      /* The global range from (Addr)0 to ~(Addr)0 must exist */
-      vg_assert(global_arange);
-      vg_assert(global_arange->aMin == (Addr)0
-                && global_arange->aMax == ~(Addr)0);
-      /* Any vars in this range? */
-      if (!global_arange->vars)
-         continue;
-      /* Ok, there are some vars in the global scope of this
-         DebugInfo.  Wade through them and see if the data addresses
-         of any of them bracket data_addr. */
-      vars = global_arange->vars;
-      for (i = 0; i < VG_(sizeXA)( vars ); i++) {
-         PtrdiffT offset;
-         DiVariable* var = (DiVariable*)VG_(indexXA)( vars, i );
-         vg_assert(var->name);
-         /* Note we use a NULL RegSummary* here.  It can't make any
-            sense for a global variable to have a location expression
-            which depends on a SP/FP/IP value.  So don't supply any.
-            This means, if the evaluation of the location
-            expression/list requires a register, we have to let it
-            fail. */
-         if (data_address_is_in_var( &offset, di->admin_tyents, var, 
-                                     NULL/* RegSummary* */, 
-                                     data_addr, di )) {
-            PtrdiffT residual_offset = 0;
-            XArray* described = ML_(describe_type)( &residual_offset,
-                                                    di->admin_tyents,
-                                                    var->typeR, offset );
-            format_message( dname1, dname2,
-                            data_addr, var, offset, residual_offset,
-                            described, -1/*frameNo*/,
-                            VG_INVALID_THREADID );
-            VG_(deleteXA)( described );
-            zterm_XA( dname1 );
-            zterm_XA( dname2 );
-            return True;
+      /* only read deferred var info for the object that data_addr
+         is in */
+      if (di->deferred && data_address_is_in_DebugInfo(di, data_addr))
+         load_deferred_DebugInfo(di);
+      /* Likewise with --read-var-info=lazy, and then only the CUs
+         which might have a global variable at data_addr. */
+      if (di->lazy_vars) {
+         if (!data_address_is_in_DebugInfo(di, data_addr))
+            continue;
+         for (nth = 0;
+              ML_(lazy_varinfo_select_global)(di, data_addr, nth);
+              nth++) {
+            if (describe_global_in_DebugInfo(dname1, dname2,
+                                             data_addr, di))
+               return True;
          }
+         continue;
       }
+      if (describe_global_in_DebugInfo(dname1, dname2, data_addr, di))
+         return True;
    }
 
    /* Ok, well it's not a global variable.  So now let's snoop around
@@ -3544,6 +3733,7 @@ void* /* really, XArray* of StackBlock */
       could be generating code to run. */
    if (!di)
       return res; /* currently empty */
+   load_deferred_DebugInfo(di);
 
    if (0 && ((n_search & 0x1) == 0))
       VG_(printf)("VG_(di_get_stack_blocks_at_ip): %u searches, "
@@ -3559,6 +3749,10 @@ void* /* really, XArray* of StackBlock */
    }
    /* End of performance-enhancing hack. */
 
+   /* With --read-var-info=lazy, get the info for the CU at ip. */
+   if (di->lazy_vars)
+      ML_(lazy_varinfo_select_code)(di, ip);
+
    /* any var info at all? */
    if (!di->varinfo)
       return res; /* currently empty */
@@ -3618,45 +3812,13 @@ void* /* really, XArray* of StackBlock */
 }
 
 
-/* Get an array of GlobalBlock which describe the global blocks owned
-   by the shared object characterised by the given di_handle.  Asserts
-   if the handle is invalid.  The caller is responsible for freeing
-   the array at some point.  If 'arrays_only' is True, only
-   array-typed blocks are returned; otherwise blocks of all types are
-   returned. */
-
-void* /* really, XArray* of GlobalBlock */
-      VG_(di_get_global_blocks_from_dihandle) ( ULong di_handle,
-                                                Bool  arrays_only )
+/* Add the blocks for the variables with constant addresses in di's
+   variable info to 'gvars'. */
+static void collect_global_blocks ( /*MOD*/XArray* /* of GlobalBlock */ gvars,
+                                    DebugInfo* di, Bool arrays_only )
 {
-   /* This is a derivation of consider_vars_in_frame() above. */
-
-   DebugInfo* di;
-   XArray* gvars; /* XArray* of GlobalBlock */
    Word nScopes, scopeIx;
 
-   /* The first thing to do is find the DebugInfo that
-      pertains to 'di_handle'. */
-   tl_assert(di_handle > 0);
-   for (di = debugInfo_list; di; di = di->next) {
-      if (di->handle == di_handle)
-         break;
-   }
-
-   /* If this fails, we were unable to find any DebugInfo with the
-      given handle.  This is considered an error on the part of the
-      caller. */
-   tl_assert(di != NULL);
-
-   /* we'll put the collected variables in here. */
-   gvars = VG_(newXA)( ML_(dinfo_zalloc), "di.debuginfo.dggbfd.1",
-                       ML_(dinfo_free), sizeof(GlobalBlock) );
-   tl_assert(gvars);
-
-   /* any var info at all? */
-   if (!di->varinfo)
-      return gvars;
-
    /* we'll iterate over all the variables we can find, even if
       it seems senseless to visit stack-allocated variables */
    /* Iterate over all scopes */
@@ -3751,7 +3913,62 @@ void* /* really, XArray* of GlobalBlock */
       } /* while ( (range = VG_(OSetGen_Next)(scope)) ) */
 
    } /* for (scopeIx = 0; scopeIx < nScopes; scopeIx++) */
+}
+
+
+/* Get an array of GlobalBlock which describe the global blocks owned
+   by the shared object characterised by the given di_handle.  Asserts
+   if the handle is invalid.  The caller is responsible for freeing
+   the array at some point.  If 'arrays_only' is True, only
+   array-typed blocks are returned; otherwise blocks of all types are
+   returned. */
+
+void* /* really, XArray* of GlobalBlock */
+      VG_(di_get_global_blocks_from_dihandle) ( ULong di_handle,
+                                                Bool  arrays_only )
+{
+   /* This is a derivation of consider_vars_in_frame() above. */
+
+   DebugInfo* di;
+   XArray* gvars; /* XArray* of GlobalBlock */
+   Word i, n;
+
+   /* The first thing to do is find the DebugInfo that
+      pertains to 'di_handle'. */
+   tl_assert(di_handle > 0);
+   for (di = debugInfo_list; di; di = di->next) {
+      if (di->handle == di_handle)
+         break;
+   }
+
+   /* If this fails, we were unable to find any DebugInfo with the
+      given handle.  This is considered an error on the part of the
+      caller. */
+   tl_assert(di != NULL);
+
+   /* we'll put the collected variables in here. */
+   gvars = VG_(newXA)( ML_(dinfo_zalloc), "di.debuginfo.dggbfd.1",
+                       ML_(dinfo_free), sizeof(GlobalBlock) );
+   tl_assert(gvars);
+
+   load_deferred_DebugInfo(di);
+
+   /* With --read-var-info=lazy, this means reading every CU. */
+   if (di->lazy_vars) {
+      n = ML_(lazy_varinfo_n_cus)(di);
+      for (i = 0; i < n; i++) {
+         ML_(lazy_varinfo_select_cu)(di, i);
+         if (di->varinfo)
+            collect_global_blocks(gvars, di, arrays_only);
+      }
+      return gvars;
+   }
+
+   /* any var info at all? */
+   if (!di->varinfo)
+      return gvars;
 
+   collect_global_blocks(gvars, di, arrays_only);
    return gvars;
 }
 
@@ -0,0 +1,815 @@
+
+/*--------------------------------------------------------------------*/
+/*--- On-disk cache of canonicalised debug info tables.            ---*/
+/*---                                                    dicache.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2000-2012 Julian Seward
+      jseward@acm.org
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "pub_core_basics.h"
+#include "pub_core_vki.h"
+#include "pub_core_debuginfo.h"
+#include "pub_core_aspacemgr.h"    /* for mmaping cache files */
+#include "pub_core_libcbase.h"
+#include "pub_core_libcassert.h"
+#include "pub_core_libcfile.h"
+#include "pub_core_libcprint.h"
+#include "pub_core_libcproc.h"     /* VG_(getpid) */
+#include "pub_core_options.h"
+#include "pub_core_tooliface.h"    /* VG_(needs) */
+#include "pub_core_xarray.h"
+#include "priv_misc.h"             /* dinfo_zalloc/free */
+#include "priv_d3basics.h"
+#include "priv_tytypes.h"
+#include "priv_storage.h"
+#include "priv_dicache.h"          /* self */
+
+/* How this works.
+
+   Reading DWARF line info and CFI for a big object is expensive, and
+   programs run under Valgrind over and over (in test suites, say)
+   read the same objects every time.  The product of all that work is
+   three sorted arrays -- DiSym, DiLoc and DiCfSI, plus the CfiExprs
+   the CFI refers to -- and the strings they point at.  So once an
+   object's tables have been canonicalised, they are written out,
+   more or less as they are in memory, to
+
+      <dir>/<build-id>.vgdi
+
+   and a later run which maps an object with the same build-id maps
+   that file instead of reading the object's debug info.
+
+   The build-id identifies the object's contents, but not where it
+   is loaded, so the file also records the text and data biases the
+   tables were made with.  Loading requires the object to have moved
+   as a whole (the same delta for text and data) and adds the delta
+   to every address.  Pointers to strings are stored as offsets into
+   a single string table at the end of the file; on loading, the
+   string table is used where it lies in the mapped file, and the
+   arrays are copied into VG_AR_DINFO with their pointers and
+   addresses fixed up.  That is one linear pass and much cheaper than
+   reading DWARF, and it means the tables look exactly like freshly
+   read ones to the rest of m_debuginfo.  The mapping is kept for as
+   long as the DebugInfo exists.
+
+   The build-id says nothing about the separate debug files the
+   tables may have been read from, though, and those can be installed,
+   removed or changed at any time.  So each file which reading looked
+   at as a possible debug file or dwz alternate file is recorded as it
+   was then (ML_(dicache_note_source)): its path, whether it existed,
+   whether it was used, and its size, inode and modification time.  A
+   cache file is only used if every one of them still looks the same,
+   and the places which would now be searched for the debug file
+   start with those it records, which covers a debug file appearing
+   where there was none.  The options which affect reading are
+   recorded and must match too.
+
+   Only these tables are cached.  Variable info is not, so the cache
+   is neither consulted nor written when variable info is wanted.  A
+   file is only used if it was made by the same version of Valgrind
+   for the same platform, and everything in it is checked before use,
+   so a damaged or foreign file is simply a miss.  Files are written
+   to a temporary name and renamed, so processes sharing a cache
+   directory never see partial files. */
+
+#define DIC_MAGIC    0x5644494341434845ULL   /* "VDICACHE" */
+#define DIC_VERSION  2
+
+/* Bits of DICacheHdr.read_opts. */
+#define DIC_OPT_VAR_INFO  (1 << 0)
+
+/* Sections are aligned to this in the file. */
+#define DIC_ALIGN    8
+
+typedef
+   struct {
+      ULong    magic;
+      UInt     version;
+      UInt     sizeof_DiSym;
+      UInt     sizeof_DiLoc;
+      UInt     sizeof_DiCfSI;
+      UInt     sizeof_CfiExpr;
+      UInt     data_present;
+      HChar    vg_version[64];   /* VERSION "-" VG_PLATFORM */
+      UInt     read_opts;        /* DIC_OPT_* */
+      /* Where the object was when the tables were made. */
+      PtrdiffT text_bias;
+      PtrdiffT data_bias;
+      SizeT    text_size;
+      Addr     cfsi_minavma;
+      Addr     cfsi_maxavma;
+      /* Counts and file offsets of the sections. */
+      UWord    n_srcs;
+      UWord    n_syms;
+      UWord    n_secnames;
+      UWord    n_locs;
+      UWord    n_cfsi;
+      UWord    n_exprs;
+      UWord    strtab_szB;
+      UWord    off_srcs;
+      UWord    off_syms;
+      UWord    off_secnames;
+      UWord    off_locs;
+      UWord    off_cfsi;
+      UWord    off_exprs;
+      UWord    off_strtab;
+   }
+   DICacheHdr;
+
+static const HChar* dic_vg_version = VERSION "-" VG_PLATFORM;
+
+/* A file looked at as a source of debug info, as it was then. */
+typedef
+   struct {
+      UInt  kind;      /* DIC_SRC_* */
+      UInt  present;   /* did it exist? */
+      UInt  used;      /* was debug info read from it? */
+      ULong size;
+      ULong dev;
+      ULong ino;
+      ULong mtime;
+      ULong mtime_nsec;
+      HChar path[DIC_MAX_SRC_PATH];
+   }
+   DICacheSrc;
+
+/* The options in force which affect reading. */
+static UInt dic_read_opts ( void )
+{
+   UInt opts = 0;
+   if (VG_(needs).var_info || VG_(clo_read_var_info))
+      opts |= DIC_OPT_VAR_INFO;
+   return opts;
+}
+
+/* Fill in src's description of the file at its path. */
+static void stat_src ( DICacheSrc* src )
+{
+   struct vg_stat st;
+   SysRes sres = VG_(stat)(src->path, &st);
+   src->present    = !sr_isError(sres);
+   src->size       = src->present ? st.size : 0;
+   src->dev        = src->present ? st.dev : 0;
+   src->ino        = src->present ? st.ino : 0;
+   src->mtime      = src->present ? st.mtime : 0;
+   src->mtime_nsec = src->present ? st.mtime_nsec : 0;
+}
+
+void ML_(dicache_note_source) ( struct _DebugInfo* di, const HChar* path,
+                                UInt kind, Bool used )
+{
+   DICacheSrc src;
+
+   if (VG_(clo_debuginfo_cache_dir) == NULL)
+      return;
+   if (di->dicache_srcs == NULL)
+      di->dicache_srcs = VG_(newXA)( ML_(dinfo_zalloc), "di.dicache.ns.1",
+                                     ML_(dinfo_free), sizeof(DICacheSrc) );
+   VG_(memset)(&src, 0, sizeof(src));
+   /* A path that doesn't fit can't be checked later. */
+   src.kind = VG_(strlen)(path) < sizeof(src.path) ? kind
+                                                   : DIC_SRC_UNCHECKED;
+   src.used = used;
+   VG_(strncpy)(src.path, path, sizeof(src.path) - 1);
+   stat_src(&src);
+   VG_(addToXA)(di->dicache_srcs, &src);
+}
+
+/* Do the sources recorded in a cache file still look the same?
+   'debug_cands' are the places a debug file would be searched for
+   now, in order. */
+static Bool srcs_unchanged ( const DICacheSrc* srcs, UWord n_srcs,
+                             XArray* debug_cands )
+{
+   UWord      i, j = 0;
+   Word       n_cands = debug_cands ? VG_(sizeXA)(debug_cands) : 0;
+   Bool       last_used = False;
+   DICacheSrc now;
+
+   for (i = 0; i < n_srcs; i++) {
+      if (srcs[i].path[sizeof(srcs[i].path) - 1] != 0)
+         return False;
+      switch (srcs[i].kind) {
+         case DIC_SRC_DEBUG:
+            if ((Word)j >= n_cands
+                || VG_(strcmp)(srcs[i].path,
+                               *(HChar**)VG_(indexXA)(debug_cands, j)) != 0)
+               return False;
+            j++;
+            last_used = srcs[i].used;
+            break;
+         case DIC_SRC_ALT:
+            break;
+         default:
+            return False;
+      }
+      VG_(memset)(&now, 0, sizeof(now));
+      VG_(strcpy)(now.path, srcs[i].path);
+      stat_src(&now);
+      if (now.present != srcs[i].present
+          || now.size != srcs[i].size
+          || now.dev != srcs[i].dev
+          || now.ino != srcs[i].ino
+          || now.mtime != srcs[i].mtime
+          || now.mtime_nsec != srcs[i].mtime_nsec)
+         return False;
+   }
+   /* The search stopped early only if it found the debug file. */
+   return (Word)j == n_cands || last_used;
+}
+
+
+/* Name of the cache file for 'buildid'.  Caller frees it. */
+static HChar* cache_file_name ( const UChar* buildid )
+{
+   HChar* name
+      = ML_(dinfo_zalloc)("di.dicache.cfn.1",
+                          VG_(strlen)(VG_(clo_debuginfo_cache_dir))
+                          + VG_(strlen)(buildid) + 8);
+   VG_(sprintf)(name, "%s/%s.vgdi", VG_(clo_debuginfo_cache_dir), buildid);
+   return name;
+}
+
+/* Does [off, off + n * szB) lie within an image of n_img bytes? */
+static Bool in_image ( UWord n_img, UWord off, UWord n, UWord szB )
+{
+   if (off > n_img)
+      return False;
+   if (szB > 0 && n > (n_img - off) / szB)
+      return False;
+   return True;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Loading                                              ---*/
+/*------------------------------------------------------------*/
+
+/* Turn a stored string reference (offset + 1, or 0 for NULL) back
+   into a pointer.  Returns False if it is out of range. */
+static Bool get_str ( /*OUT*/UChar** res, UWord ref,
+                      UChar* strtab, UWord strtab_szB )
+{
+   if (ref == 0) {
+      *res = NULL;
+      return True;
+   }
+   if (ref - 1 >= strtab_szB)
+      return False;
+   *res = strtab + (ref - 1);
+   return True;
+}
+
+static void free_loaded_tables ( struct _DebugInfo* di )
+{
+   UWord i;
+   if (di->symtab) {
+      for (i = 0; i < di->symtab_used; i++)
+         if (di->symtab[i].sec_names)
+            ML_(dinfo_free)(di->symtab[i].sec_names);
+      ML_(dinfo_free)(di->symtab);
+   }
+   if (di->loctab)
+      ML_(dinfo_free)(di->loctab);
+   if (di->cfsi)
+      ML_(dinfo_free)(di->cfsi);
+   if (di->cfsi_exprs)
+      VG_(deleteXA)(di->cfsi_exprs);
+   ML_(free_cfsi_index)(di);
+   di->symtab = NULL;
+   di->symtab_used = di->symtab_size = 0;
+   di->loctab = NULL;
+   di->loctab_used = di->loctab_size = 0;
+   di->cfsi = NULL;
+   di->cfsi_used = di->cfsi_size = 0;
+   di->cfsi_exprs = NULL;
+}
+
+Bool ML_(dicache_load) ( struct _DebugInfo* di, const UChar* buildid,
+                         XArray* debug_cands )
+{
+   HChar*      name;
+   SysRes      fd, sres;
+   Long        n_imgL;
+   UWord       n_img, i, j;
+   Addr        img;
+   DICacheHdr* hdr;
+   UChar*      strtab;
+   UWord*      secnames;
+   PtrdiffT    delta;
+
+   vg_assert(VG_(clo_debuginfo_cache_dir));
+   vg_assert(!di->symtab && !di->loctab && !di->cfsi && !di->cfsi_exprs);
+   vg_assert(di->dicache_img == 0);
+
+   if (!di->text_present)
+      return False;
+
+   name = cache_file_name(buildid);
+   fd = VG_(open)(name, VKI_O_RDONLY, 0);
+   if (sr_isError(fd)) {
+      ML_(dinfo_free)(name);
+      return False;
+   }
+   n_imgL = VG_(fsize)(sr_Res(fd));
+   if (n_imgL < (Long)sizeof(DICacheHdr)) {
+      VG_(close)(sr_Res(fd));
+      ML_(dinfo_free)(name);
+      return False;
+   }
+   n_img = (UWord)n_imgL;
+   sres = VG_(am_mmap_file_float_valgrind)( n_img, VKI_PROT_READ,
+                                            sr_Res(fd), 0 );
+   VG_(close)(sr_Res(fd));
+   if (sr_isError(sres)) {
+      ML_(dinfo_free)(name);
+      return False;
+   }
+   img = sr_Res(sres);
+   hdr = (DICacheHdr*)img;
+
+   /* Is it ours, and intact? */
+   if (hdr->magic != DIC_MAGIC
+       || hdr->version != DIC_VERSION
+       || hdr->sizeof_DiSym != sizeof(DiSym)
+       || hdr->sizeof_DiLoc != sizeof(DiLoc)
+       || hdr->sizeof_DiCfSI != sizeof(DiCfSI)
+       || hdr->sizeof_CfiExpr != sizeof(CfiExpr)
+       || VG_(strncmp)(hdr->vg_version, dic_vg_version,
+                       sizeof(hdr->vg_version)) != 0
+       || hdr->read_opts != dic_read_opts()
+       || !in_image(n_img, hdr->off_srcs,     hdr->n_srcs,
+                                              sizeof(DICacheSrc))
+       || !in_image(n_img, hdr->off_syms,     hdr->n_syms, sizeof(DiSym))
+       || !in_image(n_img, hdr->off_secnames, hdr->n_secnames,
+                                              sizeof(UWord))
+       || !in_image(n_img, hdr->off_locs,     hdr->n_locs, sizeof(DiLoc))
+       || !in_image(n_img, hdr->off_cfsi,     hdr->n_cfsi, sizeof(DiCfSI))
+       || !in_image(n_img, hdr->off_exprs,    hdr->n_exprs,
+                                              sizeof(CfiExpr))
+       || !in_image(n_img, hdr->off_strtab,   hdr->strtab_szB, 1)
+       || (hdr->strtab_szB > 0
+           && ((UChar*)img)[hdr->off_strtab + hdr->strtab_szB - 1] != 0)
+       || (hdr->n_secnames > 0
+           && ((UWord*)(img + hdr->off_secnames))[hdr->n_secnames-1] != 0))
+      goto fail;
+
+   /* Is the debug info still where, and what, it was? */
+   if (!srcs_unchanged((DICacheSrc*)(img + hdr->off_srcs), hdr->n_srcs,
+                       debug_cands))
+      goto fail;
+
+   /* Has the object moved as a whole since?  If so, by how much? */
+   if (hdr->text_size != di->text_size
+       || hdr->data_present != (UInt)di->data_present)
+      goto fail;
+   delta = di->text_bias - hdr->text_bias;
+   if (di->data_present && di->data_bias - hdr->data_bias != delta)
+      goto fail;
+
+   strtab   = (UChar*)(img + hdr->off_strtab);
+   secnames = (UWord*)(img + hdr->off_secnames);
+
+   /* Symbols. */
+   if (hdr->n_syms > 0) {
+      DiSym* syms = (DiSym*)(img + hdr->off_syms);
+      di->symtab = ML_(dinfo_zalloc)("di.dicache.load.1",
+                                     hdr->n_syms * sizeof(DiSym));
+      di->symtab_size = hdr->n_syms;
+      for (i = 0; i < hdr->n_syms; i++) {
+         DiSym* sym = &di->symtab[i];
+         UWord  ix  = (UWord)syms[i].sec_names;
+         *sym = syms[i];
+         sym->sec_names = NULL;
+         /* Count it now, so that free_loaded_tables frees sec_names
+            if we bail out below. */
+         di->symtab_used = i + 1;
+         sym->addr += delta;
+         if (sym->tocptr != 0)
+            sym->tocptr += delta;
+         if (!get_str(&sym->pri_name, (UWord)syms[i].pri_name,
+                      strtab, hdr->strtab_szB)
+             || sym->pri_name == NULL)
+            goto fail;
+         if (ix != 0) {
+            UWord n = 0;
+            if (ix - 1 >= hdr->n_secnames)
+               goto fail;
+            while (secnames[ix - 1 + n] != 0)
+               n++;
+            sym->sec_names = ML_(dinfo_zalloc)("di.dicache.load.2",
+                                               (n + 1) * sizeof(UChar*));
+            for (j = 0; j < n; j++)
+               if (!get_str(&sym->sec_names[j], secnames[ix - 1 + j],
+                            strtab, hdr->strtab_szB))
+                  goto fail;
+            sym->sec_names[n] = NULL;
+         }
+      }
+   }
+
+   /* Source locations. */
+   if (hdr->n_locs > 0) {
+      DiLoc* locs = (DiLoc*)(img + hdr->off_locs);
+      di->loctab = ML_(dinfo_zalloc)("di.dicache.load.3",
+                                     hdr->n_locs * sizeof(DiLoc));
+      di->loctab_size = di->loctab_used = hdr->n_locs;
+      for (i = 0; i < hdr->n_locs; i++) {
+         DiLoc* loc = &di->loctab[i];
+         *loc = locs[i];
+         loc->addr += delta;
+         if (!get_str(&loc->filename, (UWord)locs[i].filename,
+                      strtab, hdr->strtab_szB)
+             || !get_str(&loc->dirname, (UWord)locs[i].dirname,
+                         strtab, hdr->strtab_szB))
+            goto fail;
+      }
+   }
+
+   /* Call frame info.  This has to satisfy the invariants that
+      check_CFSI_related_invariants asserts, so check them here
+      rather than have a bad file bring Valgrind down. */
+   if (hdr->n_cfsi > 0) {
+      DiCfSI* cfsi = (DiCfSI*)(img + hdr->off_cfsi);
+      di->cfsi = ML_(dinfo_zalloc)("di.dicache.load.4",
+                                   hdr->n_cfsi * sizeof(DiCfSI));
+      di->cfsi_size = di->cfsi_used = hdr->n_cfsi;
+      for (i = 0; i < hdr->n_cfsi; i++) {
+         DiCfSI* si = &di->cfsi[i];
+         *si = cfsi[i];
+         si->base += delta;
+         if (si->len == 0
+             || ML_(find_rx_mapping)(di, si->base,
+                                     si->base + si->len - 1) == NULL)
+            goto fail;
+         if (i > 0 && di->cfsi[i-1].base + di->cfsi[i-1].len > si->base)
+            goto fail;
+      }
+      di->cfsi_minavma = hdr->cfsi_minavma + delta;
+      di->cfsi_maxavma = hdr->cfsi_maxavma + delta;
+      if (di->cfsi_minavma != di->cfsi[0].base
+          || di->cfsi_maxavma
+             != di->cfsi[hdr->n_cfsi-1].base + di->cfsi[hdr->n_cfsi-1].len - 1)
+         goto fail;
+      ML_(build_cfsi_index)(di);
+   } else {
+      /* As ML_(canonicaliseCFI) leaves them. */
+      di->cfsi_minavma = ~(Addr)0;
+      di->cfsi_maxavma = 0;
+   }
+   if (hdr->n_exprs > 0) {
+      di->cfsi_exprs = VG_(newXA)( ML_(dinfo_zalloc), "di.dicache.load.5",
+                                   ML_(dinfo_free), sizeof(CfiExpr) );
+      VG_(addBytesToXA)( di->cfsi_exprs, (void*)(img + hdr->off_exprs),
+                         hdr->n_exprs * sizeof(CfiExpr) );
+   }
+
+   di->dicache_img   = img;
+   di->n_dicache_img = n_img;
+   if (VG_(clo_verbosity) > 1)
+      VG_(message)(Vg_DebugMsg, "Read cached debug info for %s from %s\n",
+                                di->fsm.filename, name);
+   ML_(dinfo_free)(name);
+   return True;
+
+  fail:
+   free_loaded_tables(di);
+   sres = VG_(am_munmap_valgrind)( img, n_img );
+   vg_assert(!sr_isError(sres));
+   if (VG_(clo_verbosity) > 1)
+      VG_(message)(Vg_DebugMsg, "Ignoring unusable debug info cache "
+                                "file %s\n", name);
+   ML_(dinfo_free)(name);
+   return False;
+}
+
+void ML_(dicache_release) ( struct _DebugInfo* di )
+{
+   SysRes sres;
+   if (di->dicache_img == 0)
+      return;
+   sres = VG_(am_munmap_valgrind)( di->dicache_img, di->n_dicache_img );
+   vg_assert(!sr_isError(sres));
+   di->dicache_img   = 0;
+   di->n_dicache_img = 0;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Saving                                               ---*/
+/*------------------------------------------------------------*/
+
+/* The string chunks of a DebugInfo, sorted by address, and where each
+   one goes in the file's string table. */
+typedef
+   struct {
+      UChar* start;
+      UWord  used;
+      UWord  off;
+   }
+   StrChunkIx;
+
+static Int cmp_StrChunkIx ( void* v1, void* v2 )
+{
+   StrChunkIx* c1 = (StrChunkIx*)v1;
+   StrChunkIx* c2 = (StrChunkIx*)v2;
+   if (c1->start < c2->start) return -1;
+   if (c1->start > c2->start) return 1;
+   return 0;
+}
+
+/* Turn a string pointer into a stored reference (offset + 1, or 0 for
+   NULL).  Returns False if the string is not in any chunk. */
+static Bool put_str ( /*OUT*/UWord* ref, UChar* str,
+                      StrChunkIx* chunks, UWord n_chunks )
+{
+   Word lo = 0, hi = (Word)n_chunks - 1;
+   if (str == NULL) {
+      *ref = 0;
+      return True;
+   }
+   while (lo <= hi) {
+      Word mid = (lo + hi) / 2;
+      if (str < chunks[mid].start) { hi = mid - 1; continue; }
+      if (str >= chunks[mid].start + chunks[mid].used) { lo = mid + 1; continue; }
+      *ref = chunks[mid].off + (str - chunks[mid].start) + 1;
+      return True;
+   }
+   return False;
+}
+
+/* A small buffered writer. */
+typedef
+   struct {
+      Int   fd;
+      UWord pos;
+      Bool  ok;
+      UInt  used;
+      UChar buf[16384];
+   }
+   Writer;
+
+static void w_flush ( Writer* w )
+{
+   if (w->ok && w->used > 0
+       && VG_(write)(w->fd, w->buf, w->used) != (Int)w->used)
+      w->ok = False;
+   w->used = 0;
+}
+
+static void w_bytes ( Writer* w, const void* p, UWord n )
+{
+   const UChar* b = p;
+   while (n > 0) {
+      UWord chunk = sizeof(w->buf) - w->used;
+      if (chunk > n)
+         chunk = n;
+      VG_(memcpy)(&w->buf[w->used], b, chunk);
+      w->used += chunk;
+      w->pos  += chunk;
+      b += chunk;
+      n -= chunk;
+      if (w->used == sizeof(w->buf))
+         w_flush(w);
+   }
+}
+
+static void w_align ( Writer* w )
+{
+   static const UChar zeroes[DIC_ALIGN] = { 0 };
+   if (w->pos % DIC_ALIGN)
+      w_bytes(w, zeroes, DIC_ALIGN - w->pos % DIC_ALIGN);
+}
+
+static UWord align_up ( UWord off )
+{
+   return VG_ROUNDUP(off, DIC_ALIGN);
+}
+
+void ML_(dicache_save) ( struct _DebugInfo* di )
+{
+   static Bool warned = False;
+   struct strchunk* chunk;
+   StrChunkIx* chunks;
+   UWord       n_chunks, i, j;
+   DICacheHdr  hdr;
+   HChar*      name;
+   HChar*      tmp;
+   SysRes      sres;
+   Writer*     w;
+   Bool        ok;
+
+   vg_assert(VG_(clo_debuginfo_cache_dir));
+   vg_assert(di->buildid);
+   vg_assert(di->have_dinfo);
+   vg_assert(di->deferred == NULL);
+
+   /* Tables which came from the cache are there already. */
+   if (di->dicache_img != 0)
+      return;
+   if (!di->text_present)
+      return;
+   /* A load would never use them. */
+   if (dic_read_opts() & DIC_OPT_VAR_INFO)
+      return;
+   /* Nor if some source can't be checked. */
+   if (di->dicache_srcs) {
+      for (i = 0; i < VG_(sizeXA)(di->dicache_srcs); i++) {
+         DICacheSrc* src = VG_(indexXA)(di->dicache_srcs, i);
+         if (src->kind == DIC_SRC_UNCHECKED)
+            return;
+      }
+   }
+
+   /* Lay out the string table. */
+   n_chunks = 0;
+   for (chunk = di->strchunks; chunk; chunk = chunk->next)
+      n_chunks++;
+   chunks = ML_(dinfo_zalloc)("di.dicache.save.1",
+                              (n_chunks + 1) * sizeof(StrChunkIx));
+   i = 0;
+   for (chunk = di->strchunks; chunk; chunk = chunk->next, i++) {
+      chunks[i].start = chunk->strtab;
+      chunks[i].used  = chunk->strtab_used;
+   }
+   VG_(ssort)(chunks, n_chunks, sizeof(StrChunkIx), cmp_StrChunkIx);
+
+   VG_(memset)(&hdr, 0, sizeof(hdr));
+   hdr.magic          = DIC_MAGIC;
+   hdr.version        = DIC_VERSION;
+   hdr.sizeof_DiSym   = sizeof(DiSym);
+   hdr.sizeof_DiLoc   = sizeof(DiLoc);
+   hdr.sizeof_DiCfSI  = sizeof(DiCfSI);
+   hdr.sizeof_CfiExpr = sizeof(CfiExpr);
+   VG_(strncpy)(hdr.vg_version, dic_vg_version, sizeof(hdr.vg_version) - 1);
+   hdr.read_opts      = dic_read_opts();
+   hdr.text_bias      = di->text_bias;
+   hdr.data_present   = di->data_present;
+   hdr.data_bias      = di->data_present ? di->data_bias : 0;
+   hdr.text_size      = di->text_size;
+   hdr.cfsi_minavma   = di->cfsi_minavma;
+   hdr.cfsi_maxavma   = di->cfsi_maxavma;
+   hdr.n_srcs         = di->dicache_srcs ? VG_(sizeXA)(di->dicache_srcs) : 0;
+   hdr.n_syms         = di->symtab_used;
+   hdr.n_locs         = di->loctab_used;
+   hdr.n_cfsi         = di->cfsi_used;
+   hdr.n_exprs        = di->cfsi_exprs ? VG_(sizeXA)(di->cfsi_exprs) : 0;
+   hdr.n_secnames     = 0;
+   for (i = 0; i < di->symtab_used; i++) {
+      UChar** sn = di->symtab[i].sec_names;
+      if (sn) {
+         while (*sn++)
+            hdr.n_secnames++;
+         hdr.n_secnames++;   /* terminator */
+      }
+   }
+   hdr.strtab_szB = 0;
+   for (i = 0; i < n_chunks; i++) {
+      chunks[i].off = hdr.strtab_szB;
+      hdr.strtab_szB += chunks[i].used;
+   }
+   hdr.off_srcs     = align_up(sizeof(hdr));
+   hdr.off_syms     = align_up(hdr.off_srcs + hdr.n_srcs * sizeof(DICacheSrc));
+   hdr.off_secnames = align_up(hdr.off_syms + hdr.n_syms * sizeof(DiSym));
+   hdr.off_locs     = align_up(hdr.off_secnames
+                               + hdr.n_secnames * sizeof(UWord));
+   hdr.off_cfsi     = align_up(hdr.off_locs + hdr.n_locs * sizeof(DiLoc));
+   hdr.off_exprs    = align_up(hdr.off_cfsi + hdr.n_cfsi * sizeof(DiCfSI));
+   hdr.off_strtab   = align_up(hdr.off_exprs
+                               + hdr.n_exprs * sizeof(CfiExpr));
+
+   name = cache_file_name(di->buildid);
+   tmp  = ML_(dinfo_zalloc)("di.dicache.save.2", VG_(strlen)(name) + 32);
+   VG_(sprintf)(tmp, "%s.%d.tmp", name, VG_(getpid)());
+   sres = VG_(open)( tmp, VKI_O_CREAT|VKI_O_WRONLY|VKI_O_TRUNC,
+                     VKI_S_IRUSR|VKI_S_IWUSR );
+   if (sr_isError(sres)) {
+      if (!warned) {
+         VG_(umsg)("Warning: can't create debug info cache file '%s'\n",
+                   tmp);
+         warned = True;
+      }
+      ML_(dinfo_free)(tmp);
+      ML_(dinfo_free)(name);
+      ML_(dinfo_free)(chunks);
+      return;
+   }
+
+   w = ML_(dinfo_zalloc)("di.dicache.save.3", sizeof(Writer));
+   w->fd = sr_Res(sres);
+   w->ok = True;
+   ok    = True;
+
+   w_bytes(w, &hdr, sizeof(hdr));
+
+   w_align(w);
+   vg_assert(w->pos == hdr.off_srcs);
+   for (i = 0; i < hdr.n_srcs; i++)
+      w_bytes(w, VG_(indexXA)(di->dicache_srcs, i), sizeof(DICacheSrc));
+
+   w_align(w);
+   vg_assert(w->pos == hdr.off_syms);
+   j = 0;
+   for (i = 0; ok && i < di->symtab_used; i++) {
+      DiSym  sym = di->symtab[i];
+      UWord  ref;
+      ok &= put_str(&ref, sym.pri_name, chunks, n_chunks);
+      sym.pri_name = (UChar*)ref;
+      if (sym.sec_names) {
+         UChar** sn = sym.sec_names;
+         sym.sec_names = (UChar**)(j + 1);
+         while (*sn++)
+            j++;
+         j++;
+      }
+      w_bytes(w, &sym, sizeof(sym));
+   }
+
+   w_align(w);
+   vg_assert(!ok || w->pos == hdr.off_secnames);
+   for (i = 0; ok && i < di->symtab_used; i++) {
+      UChar** sn = di->symtab[i].sec_names;
+      UWord   ref;
+      if (!sn)
+         continue;
+      for (; *sn; sn++) {
+         ok &= put_str(&ref, *sn, chunks, n_chunks);
+         w_bytes(w, &ref, sizeof(ref));
+      }
+      ref = 0;
+      w_bytes(w, &ref, sizeof(ref));
+   }
+
+   w_align(w);
+   vg_assert(!ok || w->pos == hdr.off_locs);
+   for (i = 0; ok && i < di->loctab_used; i++) {
+      DiLoc loc = di->loctab[i];
+      UWord ref;
+      ok &= put_str(&ref, loc.filename, chunks, n_chunks);
+      loc.filename = (UChar*)ref;
+      ok &= put_str(&ref, loc.dirname, chunks, n_chunks);
+      loc.dirname = (UChar*)ref;
+      w_bytes(w, &loc, sizeof(loc));
+   }
+
+   w_align(w);
+   vg_assert(!ok || w->pos == hdr.off_cfsi);
+   if (ok && di->cfsi_used > 0)
+      w_bytes(w, di->cfsi, di->cfsi_used * sizeof(DiCfSI));
+
+   w_align(w);
+   vg_assert(!ok || w->pos == hdr.off_exprs);
+   for (i = 0; ok && i < hdr.n_exprs; i++)
+      w_bytes(w, VG_(indexXA)(di->cfsi_exprs, i), sizeof(CfiExpr));
+
+   w_align(w);
+   vg_assert(!ok || w->pos == hdr.off_strtab);
+   for (i = 0; ok && i < n_chunks; i++)
+      w_bytes(w, chunks[i].start, chunks[i].used);
+
+   w_flush(w);
+   ok = ok && w->ok;
+   VG_(close)(w->fd);
+
+   /* A string not in the string chunks means some reader put strings
+      somewhere else; just don't cache that object. */
+   if (ok && VG_(rename)(tmp, name) == 0) {
+      if (VG_(clo_verbosity) > 1)
+         VG_(message)(Vg_DebugMsg, "Saved debug info for %s in %s\n",
+                                   di->fsm.filename, name);
+   } else {
+      VG_(unlink)(tmp);
+   }
+
+   ML_(dinfo_free)(w);
+   ML_(dinfo_free)(tmp);
+   ML_(dinfo_free)(name);
+   ML_(dinfo_free)(chunks);
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
@@ -0,0 +1,465 @@
+/*--------------------------------------------------------------------*/
+/*--- Decompression of zlib-compressed debug sections.             ---*/
+/*---                                                    inflate.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2000-2012 Julian Seward
+      jseward@acm.org
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "pub_core_basics.h"
+#include "pub_core_libcbase.h"
+#include "priv_inflate.h"          /* self */
+
+/* How this works.
+
+   Toolchains can compress the .debug_* sections of an object, either
+   as .zdebug_* sections (the GNU extension) or as SHF_COMPRESSED
+   sections (the gABI way).  Both hold a zlib stream, and since we
+   cannot link against libz, this is a small decoder for such streams,
+   in the manner of Mark Adler's "puff".  Only the decompressed size
+   given in the section header is ever produced, so the output is a
+   flat buffer and there is no need for a sliding window.
+
+   Huffman codes are kept in canonical form: the number of codes of
+   each length, and the symbols in order of their codes.  Decoding one
+   bit at a time from that is simple but slow, so codes of up to
+   FASTBITS bits are also looked up directly in a table indexed by the
+   next FASTBITS bits of input; only longer codes take the slow
+   path. */
+
+#define MAXBITS   15   /* longest code in a DEFLATE stream */
+#define MAXLCODES 286  /* literal/length codes in a dynamic block */
+#define MAXDCODES 30   /* distance codes */
+#define MAXCODES  (MAXLCODES+MAXDCODES)
+#define FIXLCODES 288  /* literal/length codes in a fixed block */
+#define FASTBITS  9    /* bits looked up directly */
+
+typedef
+   struct {
+      UShort count[MAXBITS+1];    /* number of codes of each length */
+      UShort symbol[FIXLCODES];   /* symbols, in order of their codes */
+      /* For each FASTBITS-bit value, (symbol << 4) | length of the
+         code it starts with, or zero if that code is longer. */
+      UShort fast[1 << FASTBITS];
+   }
+   Huffman;
+
+typedef
+   struct {
+      const UChar* in;
+      SizeT        inlen;
+      SizeT        incnt;
+      ULong        bitbuf;   /* bits not yet used, LSB first */
+      Int          bitcnt;
+      UChar*       out;
+      SizeT        outlen;
+      SizeT        outcnt;
+      Bool         bad;      /* ran off the end of the input */
+   }
+   InflateState;
+
+
+/*------------------------------------------------------------*/
+/*--- Reading bits                                         ---*/
+/*------------------------------------------------------------*/
+
+/* Top up the bit buffer, as far as the input allows. */
+static inline void fill_bits ( InflateState* s )
+{
+   while (s->bitcnt <= 56 && s->incnt < s->inlen) {
+      s->bitbuf |= ((ULong)s->in[s->incnt++]) << s->bitcnt;
+      s->bitcnt += 8;
+   }
+}
+
+static inline UInt get_bits ( InflateState* s, Int n )
+{
+   UInt v;
+   if (n == 0)
+      return 0;
+   if (s->bitcnt < n) {
+      fill_bits(s);
+      if (s->bitcnt < n) {
+         s->bad = True;
+         return 0;
+      }
+   }
+   v = (UInt)(s->bitbuf & ((1ULL << n) - 1));
+   s->bitbuf >>= n;
+   s->bitcnt -= n;
+   return v;
+}
+
+/* Skip to the next byte boundary.  Whole bytes still in the bit
+   buffer are handed back to the input. */
+static void align_to_byte ( InflateState* s )
+{
+   s->incnt -= s->bitcnt / 8;
+   s->bitbuf = 0;
+   s->bitcnt = 0;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Huffman codes                                        ---*/
+/*------------------------------------------------------------*/
+
+/* Build 'h' from the code lengths length[0 .. n-1].  Returns zero for
+   a complete code, a positive number for an incomplete one, and a
+   negative number if the lengths are over-subscribed. */
+static Int build_huffman ( Huffman* h, const UShort* length, Int n )
+{
+   Int    sym, len, left, ix, k;
+   UInt   code, rev, j;
+   UShort offs[MAXBITS+1];
+
+   for (len = 0; len <= MAXBITS; len++)
+      h->count[len] = 0;
+   for (sym = 0; sym < n; sym++)
+      h->count[length[sym]]++;
+   VG_(memset)(h->fast, 0, sizeof(h->fast));
+   if (h->count[0] == n)
+      return 0;   /* no codes at all; decoding will fail */
+
+   left = 1;
+   for (len = 1; len <= MAXBITS; len++) {
+      left <<= 1;
+      left -= h->count[len];
+      if (left < 0)
+         return left;
+   }
+
+   offs[1] = 0;
+   for (len = 1; len < MAXBITS; len++)
+      offs[len+1] = offs[len] + h->count[len];
+   for (sym = 0; sym < n; sym++)
+      if (length[sym] != 0)
+         h->symbol[offs[length[sym]]++] = sym;
+
+   /* Codes are sent MSB first but read LSB first, so each short code
+      goes in the fast table at its bit-reversed value, and at every
+      index which has that as its low 'len' bits. */
+   code = 0;
+   ix   = 0;
+   for (len = 1; len <= FASTBITS; len++) {
+      for (k = 0; k < h->count[len]; k++) {
+         sym = h->symbol[ix++];
+         rev = 0;
+         for (j = 0; j < len; j++)
+            rev |= ((code >> j) & 1) << (len - 1 - j);
+         for (j = rev; j < (1 << FASTBITS); j += 1 << len)
+            h->fast[j] = (sym << 4) | len;
+         code++;
+      }
+      code <<= 1;
+   }
+   return left;
+}
+
+/* Decode a code the slow way, one bit at a time. */
+static Int decode_slow ( InflateState* s, const Huffman* h )
+{
+   Int len, code = 0, first = 0, index = 0, count;
+   for (len = 1; len <= MAXBITS; len++) {
+      code |= get_bits(s, 1);
+      if (s->bad)
+         return -1;
+      count = h->count[len];
+      if (code - count < first)
+         return h->symbol[index + (code - first)];
+      index += count;
+      first += count;
+      first <<= 1;
+      code  <<= 1;
+   }
+   return -1;   /* no such code */
+}
+
+/* Decode one symbol, or return -1 if that can't be done. */
+static inline Int decode ( InflateState* s, const Huffman* h )
+{
+   UShort e;
+   if (s->bitcnt < FASTBITS)
+      fill_bits(s);
+   /* Bits beyond bitcnt are zero, so the lookup is safe even at the
+      end of the input, as long as the code found fits. */
+   e = h->fast[s->bitbuf & ((1 << FASTBITS) - 1)];
+   if (e != 0 && (e & 15) <= s->bitcnt) {
+      s->bitbuf >>= (e & 15);
+      s->bitcnt -= (e & 15);
+      return e >> 4;
+   }
+   return decode_slow(s, h);
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Blocks                                               ---*/
+/*------------------------------------------------------------*/
+
+static const UShort length_base[29] = {
+   3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+   35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const UChar length_extra[29] = {
+   0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+   3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const UShort dist_base[30] = {
+   1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+   257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+   8193, 12289, 16385, 24577 };
+static const UChar dist_extra[30] = {
+   0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+   7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+/* A block without compression. */
+static Bool inflate_stored ( InflateState* s )
+{
+   UInt len, nlen;
+
+   align_to_byte(s);
+   if (s->inlen - s->incnt < 4)
+      return False;
+   len  = s->in[s->incnt]   | (s->in[s->incnt+1] << 8);
+   nlen = s->in[s->incnt+2] | (s->in[s->incnt+3] << 8);
+   s->incnt += 4;
+   if (len != (~nlen & 0xFFFF))
+      return False;
+   if (s->inlen - s->incnt < len || s->outlen - s->outcnt < len)
+      return False;
+   VG_(memcpy)(s->out + s->outcnt, s->in + s->incnt, len);
+   s->incnt  += len;
+   s->outcnt += len;
+   return True;
+}
+
+/* The literals, lengths and distances of a compressed block. */
+static Bool inflate_codes ( InflateState* s,
+                            const Huffman* lencode,
+                            const Huffman* distcode )
+{
+   Int   sym;
+   UInt  len, dist;
+   UChar *from, *to;
+
+   while (True) {
+      sym = decode(s, lencode);
+      if (sym < 0)
+         return False;
+      if (sym < 256) {
+         if (s->outcnt == s->outlen)
+            return False;
+         s->out[s->outcnt++] = (UChar)sym;
+         continue;
+      }
+      if (sym == 256)
+         return True;   /* end of block */
+
+      sym -= 257;
+      if (sym >= 29)
+         return False;
+      len = length_base[sym] + get_bits(s, length_extra[sym]);
+      sym = decode(s, distcode);
+      if (sym < 0 || sym >= 30)
+         return False;
+      dist = dist_base[sym] + get_bits(s, dist_extra[sym]);
+      if (s->bad)
+         return False;
+      if (dist > s->outcnt || s->outlen - s->outcnt < len)
+         return False;
+      /* The source and destination may overlap, in which case the
+         copy must go byte by byte, forwards. */
+      to   = s->out + s->outcnt;
+      from = to - dist;
+      s->outcnt += len;
+      while (len-- > 0)
+         *to++ = *from++;
+   }
+}
+
+static Huffman fixed_lencode, fixed_distcode;
+static Bool    fixed_built = False;
+
+/* A block compressed with the fixed codes. */
+static Bool inflate_fixed ( InflateState* s )
+{
+   if (!fixed_built) {
+      UShort lengths[FIXLCODES];
+      Int    sym;
+      for (sym = 0; sym < 144; sym++)
+         lengths[sym] = 8;
+      for (; sym < 256; sym++)
+         lengths[sym] = 9;
+      for (; sym < 280; sym++)
+         lengths[sym] = 7;
+      for (; sym < FIXLCODES; sym++)
+         lengths[sym] = 8;
+      build_huffman(&fixed_lencode, lengths, FIXLCODES);
+      for (sym = 0; sym < MAXDCODES; sym++)
+         lengths[sym] = 5;
+      build_huffman(&fixed_distcode, lengths, MAXDCODES);
+      fixed_built = True;
+   }
+   return inflate_codes(s, &fixed_lencode, &fixed_distcode);
+}
+
+static Huffman dyn_lencode, dyn_distcode;
+
+/* A block compressed with codes sent at its start. */
+static Bool inflate_dynamic ( InflateState* s )
+{
+   static const UChar order[19]
+      = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+   UShort lengths[MAXCODES];
+   Int    nlen, ndist, ncode, index, sym, rep;
+   UShort len;
+
+   nlen  = get_bits(s, 5) + 257;
+   ndist = get_bits(s, 5) + 1;
+   ncode = get_bits(s, 4) + 4;
+   if (s->bad || nlen > MAXLCODES || ndist > MAXDCODES)
+      return False;
+
+   /* First the code lengths code, which must be complete ... */
+   for (index = 0; index < ncode; index++)
+      lengths[order[index]] = get_bits(s, 3);
+   for (; index < 19; index++)
+      lengths[order[index]] = 0;
+   if (s->bad || build_huffman(&dyn_lencode, lengths, 19) != 0)
+      return False;
+
+   /* ... then the literal/length and distance code lengths, in
+      terms of it. */
+   index = 0;
+   while (index < nlen + ndist) {
+      sym = decode(s, &dyn_lencode);
+      if (sym < 0)
+         return False;
+      if (sym < 16) {
+         lengths[index++] = sym;
+         continue;
+      }
+      len = 0;
+      if (sym == 16) {
+         if (index == 0)
+            return False;
+         len = lengths[index - 1];
+         rep = 3 + get_bits(s, 2);
+      } else if (sym == 17) {
+         rep = 3 + get_bits(s, 3);
+      } else {
+         rep = 11 + get_bits(s, 7);
+      }
+      if (s->bad || index + rep > nlen + ndist)
+         return False;
+      while (rep-- > 0)
+         lengths[index++] = len;
+   }
+   if (lengths[256] == 0)
+      return False;   /* no end-of-block code */
+
+   if (build_huffman(&dyn_lencode, lengths, nlen) < 0
+       || build_huffman(&dyn_distcode, lengths + nlen, ndist) < 0)
+      return False;
+   return inflate_codes(s, &dyn_lencode, &dyn_distcode);
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Top level                                            ---*/
+/*------------------------------------------------------------*/
+
+static UInt adler32 ( const UChar* p, SizeT n )
+{
+   UInt  a = 1, b = 0;
+   SizeT k;
+   while (n > 0) {
+      /* 5552 is the most bytes that can be summed before b could
+         overflow 32 bits. */
+      k = n < 5552 ? n : 5552;
+      n -= k;
+      while (k-- > 0) {
+         a += *p++;
+         b += a;
+      }
+      a %= 65521;
+      b %= 65521;
+   }
+   return (b << 16) | a;
+}
+
+Bool ML_(inflate_zlib) ( UChar* dst, SizeT dstsz,
+                         const UChar* src, SizeT srcsz )
+{
+   InflateState s;
+   UInt  last, type, check;
+   Bool  ok;
+
+   /* The zlib header: deflate with a window of at most 32k, a valid
+      header check, and no preset dictionary. */
+   if (srcsz < 2 + 4)
+      return False;
+   if ((src[0] & 0x0F) != 8 || (src[0] >> 4) > 7)
+      return False;
+   if ((((UInt)src[0] << 8) | src[1]) % 31 != 0)
+      return False;
+   if (src[1] & 0x20)
+      return False;
+
+   VG_(memset)(&s, 0, sizeof(s));
+   s.in     = src + 2;
+   s.inlen  = srcsz - 2;
+   s.out    = dst;
+   s.outlen = dstsz;
+
+   do {
+      last = get_bits(&s, 1);
+      type = get_bits(&s, 2);
+      if (s.bad)
+         return False;
+      switch (type) {
+         case 0:  ok = inflate_stored(&s);  break;
+         case 1:  ok = inflate_fixed(&s);   break;
+         case 2:  ok = inflate_dynamic(&s); break;
+         default: ok = False;               break;
+      }
+      if (!ok || s.bad)
+         return False;
+   } while (!last);
+
+   if (s.outcnt != dstsz)
+      return False;
+
+   /* And the trailer: the Adler-32 of the output, big-endian. */
+   align_to_byte(&s);
+   if (s.inlen - s.incnt < 4)
+      return False;
+   check = ((UInt)s.in[s.incnt]   << 24) | ((UInt)s.in[s.incnt+1] << 16)
+         | ((UInt)s.in[s.incnt+2] <<  8) |  (UInt)s.in[s.incnt+3];
+   return check == adler32(dst, dstsz);
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
@@ -51,6 +51,14 @@ void* ML_(dinfo_zalloc) ( HChar* cc, SizeT szB ) {
    return v;
 }
 
+void* ML_(dinfo_malloc) ( HChar* cc, SizeT szB ) {
+   void* v;
+   vg_assert(szB > 0);
+   v = VG_(arena_malloc)( VG_AR_DINFO, cc, szB );
+   vg_assert(v);
+   return v;
+}
+
 void ML_(dinfo_free) ( void* v ) {
    VG_(arena_free)( VG_AR_DINFO, v );
 }
@@ -672,6 +672,11 @@ GXResult ML_(evaluate_Dwarf3_Expr) ( UChar* expr, UWord exprszB,
    covered by the guard is also ignored. */
 GXResult ML_(evaluate_trivial_GX)( GExpr* gx, const DebugInfo* di );
 
+/* Convert a stated address (svma) in one of di's text or data
+   sections to an actual address (avma).  Returns False, leaving *a
+   alone, if it isn't in any of them. */
+Bool ML_(bias_address)( Addr* a, const DebugInfo* di );
+
 /* Compute call frame address (CFA) for IP/SP/FP.  */
 Addr ML_(get_CFA) ( Addr ip, Addr sp, Addr fp,
                     Addr min_accessible, Addr max_accessible );
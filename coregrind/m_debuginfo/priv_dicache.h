@@ -0,0 +1,77 @@
+
+/*--------------------------------------------------------------------*/
+/*--- On-disk cache of canonicalised debug info tables.            ---*/
+/*---                                               priv_dicache.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2000-2012 Julian Seward
+      jseward@acm.org
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __PRIV_DICACHE_H
+#define __PRIV_DICACHE_H
+
+/* With --debuginfo-cache-dir=<dir>, the symbol, location and CFI
+   tables of each object with a build-id are saved in <dir> once they
+   have been read and canonicalised, and later runs take them from
+   there instead of reading the object's debug info again. */
+
+/* Kinds of files looked at for debug info, besides the object. */
+#define DIC_SRC_DEBUG      1   /* a separate debug file */
+#define DIC_SRC_ALT        2   /* a dwz alternate debug file */
+#define DIC_SRC_UNCHECKED  3   /* something that can't be checked later */
+
+/* Longest path of such a file that can be recorded. */
+#define DIC_MAX_SRC_PATH   512
+
+/* Record that reading di's debug info looked at the file at 'path',
+   of the given kind, and whether it read from it.  Debug files must
+   be noted in the order they are searched for.  Does nothing unless
+   the cache is in use. */
+extern void ML_(dicache_note_source) ( struct _DebugInfo* di,
+                                       const HChar* path,
+                                       UInt kind, Bool used );
+
+/* Try to fill in di's symbol, location and CFI tables from the cache
+   entry for 'buildid'.  di's mappings and section addresses must
+   already have been worked out, and 'debug_cands' (an XArray of
+   HChar*, or NULL if there are none) must be the places a separate
+   debug file would be searched for, in order.  Returns True if this
+   succeeded, in which case the tables are already canonical and
+   di->dicache_img is set. */
+extern Bool ML_(dicache_load) ( struct _DebugInfo* di,
+                                const UChar* buildid,
+                                XArray* debug_cands );
+
+/* Save di's canonicalised tables in the cache, under di->buildid. */
+extern void ML_(dicache_save) ( struct _DebugInfo* di );
+
+/* Unmap the cache file which di's tables came from. */
+extern void ML_(dicache_release) ( struct _DebugInfo* di );
+
+#endif /* ndef __PRIV_DICACHE_H */
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
@@ -0,0 +1,47 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Decompression of zlib-compressed debug sections.             ---*/
+/*---                                               priv_inflate.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2000-2012 Julian Seward
+      jseward@acm.org
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __PRIV_INFLATE_H
+#define __PRIV_INFLATE_H
+
+/* Inflate the zlib stream (RFC 1950 wrapping RFC 1951 DEFLATE data)
+   of 'srcsz' bytes at 'src' into the 'dstsz' bytes at 'dst'.  Returns
+   True only if the stream is well formed, decompresses to exactly
+   'dstsz' bytes and its checksum is correct.  On failure the contents
+   of 'dst' are undefined. */
+extern Bool ML_(inflate_zlib) ( UChar* dst, SizeT dstsz,
+                                const UChar* src, SizeT srcsz );
+
+#endif /* ndef __PRIV_INFLATE_H */
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
@@ -37,8 +37,10 @@
 #define __PRIV_MISC_H
 
 
-/* Allocate(zeroed), free, strdup, memdup, all in VG_AR_DINFO. */
+/* Allocate(zeroed), allocate(not zeroed), free, strdup, memdup, all
+   in VG_AR_DINFO. */
 void*  ML_(dinfo_zalloc)( HChar* cc, SizeT szB );
+void*  ML_(dinfo_malloc)( HChar* cc, SizeT szB );
 void   ML_(dinfo_free)( void* v );
 UChar* ML_(dinfo_strdup)( HChar* cc, const UChar* str );
 UChar* ML_(dinfo_memdup)( HChar* cc, UChar* str, SizeT nStr );
@@ -55,6 +55,47 @@ ML_(new_dwarf3_reader) (
    UChar* debug_str_alt_img,  SizeT debug_str_alt_sz
 );
 
+/* For --read-var-info=lazy: instead of reading them, index the CUs
+   in .debug_info so that the variables and types of each can be read
+   when they are first needed.  Returns False if that can't be done,
+   in which case ML_(new_dwarf3_reader) should be used instead.  If
+   it returns True, the sections must stay mapped until
+   ML_(lazy_varinfo_discard) has been called. */
+Bool
+ML_(new_dwarf3_lazy_reader) (
+   struct _DebugInfo* di,
+   UChar* debug_info_img,   SizeT debug_info_sz,
+   UChar* debug_types_img,  SizeT debug_types_sz,
+   UChar* debug_abbv_img,   SizeT debug_abbv_sz,
+   UChar* debug_line_img,   SizeT debug_line_sz,
+   UChar* debug_str_img,    SizeT debug_str_sz,
+   UChar* debug_ranges_img, SizeT debug_ranges_sz,
+   UChar* debug_loc_img,    SizeT debug_loc_sz,
+   UChar* debug_info_alt_img, SizeT debug_info_alt_sz,
+   UChar* debug_abbv_alt_img, SizeT debug_abbv_alt_sz,
+   UChar* debug_line_alt_img, SizeT debug_line_alt_sz,
+   UChar* debug_str_alt_img,  SizeT debug_str_alt_sz
+);
+
+/* Free everything hanging off di->lazy_vars, and it. */
+void ML_(lazy_varinfo_discard) ( struct _DebugInfo* di );
+
+/* The following all require di->lazy_vars to be non-NULL.  Each
+   leaves di's variable info tables (.varinfo and so on) holding
+   those of one CU, reading it first if need be, or empty. */
+
+/* Select the CU containing code address 'ip'. */
+void ML_(lazy_varinfo_select_code) ( struct _DebugInfo* di, Addr ip );
+
+/* Select the nth CU which may define a variable containing data
+   address 'data_addr'.  Returns False if there are no more. */
+Bool ML_(lazy_varinfo_select_global) ( struct _DebugInfo* di,
+                                       Addr data_addr, Word nth );
+
+/* Select each CU in turn. */
+Word ML_(lazy_varinfo_n_cus)     ( struct _DebugInfo* di );
+void ML_(lazy_varinfo_select_cu) ( struct _DebugInfo* di, Word cuIx );
+
 #endif /* ndef __PRIV_READDWARF3_H */
 
 /*--------------------------------------------------------------------*/
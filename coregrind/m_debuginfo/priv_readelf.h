@@ -50,6 +50,19 @@ extern Bool ML_(is_elf_object_file)( void* image, SizeT n_image, Bool rel_ok );
 */
 extern Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di );
 
+/* With --read-debuginfo=lazy, ML_(read_elf_debug_info) only reads
+   the symbol tables, and leaves di->deferred saying where the rest
+   is.  Read the rest now, and clear di->deferred.  The caller must
+   canonicalise the new tables with ML_(canonicaliseDebugTables). */
+extern void ML_(read_elf_deferred_debug_info) ( struct _DebugInfo* di );
+
+/* Forget about any deferred debug info without reading it. */
+extern void ML_(discard_elf_deferred_debug_info) ( struct _DebugInfo* di );
+
+/* Unmap the images kept for --read-var-info=lazy, if any.  Call this
+   only after ML_(lazy_varinfo_discard). */
+extern void ML_(unmap_elf_kept_sections) ( struct _DebugInfo* di );
+
 
 #endif /* ndef __PRIV_READELF_H */
 
@@ -524,6 +524,37 @@ struct _DebugInfo {
    /* The file's soname. */
    UChar* soname;
 
+   /* The file's build-id, as a hex string, or NULL if it has none. */
+   UChar* buildid;
+
+   /* With --read-debuginfo=lazy, only the symbol tables are read
+      when the object is mapped.  Until the rest (line numbers, call
+      frame info, variable info) is read, on the first query which
+      needs it, .deferred says where to find it; otherwise it is
+      NULL.  Only readelf.c knows what is in it. */
+   struct _DebugInfoDeferred* deferred;
+
+   /* If the symbol, location and CFI tables were taken from the
+      --debuginfo-cache-dir cache, the cache file, which the tables'
+      strings point into, is mapped here; otherwise zero.  See
+      dicache.c. */
+   Addr  dicache_img;
+   SizeT n_dicache_img;
+
+   /* The files looked at for separate debug info while reading, for
+      the cache to record (an XArray of DICacheSrc, see dicache.c), or
+      NULL if there were none or the cache is not in use. */
+   XArray* dicache_srcs;
+
+   /* With --read-var-info=lazy, the variable info is read one CU at
+      a time, when it is asked for.  .lazy_vars then indexes the CUs
+      and holds the info of those which have been read (see
+      readdwarf3.c), and .kept_sections says where the images it is
+      read from are mapped, since they stay mapped until the object
+      is discarded.  Both are NULL otherwise. */
+   struct _DebugInfoLazyVars* lazy_vars;
+   struct _DebugInfoDeferred* kept_sections;
+
    /* Description of some important mapped segments.  The presence or
       absence of the mapping is denoted by the _present field, since
       in some obscure circumstances (to do with data/sdata/bss) it is
@@ -748,6 +779,28 @@ struct _DebugInfo {
    Addr    cfsi_maxavma;
    XArray* cfsi_exprs; /* XArray of CfiExpr */
 
+   /* A compiled index of the cfsi array, which is what unwinding
+      actually uses; built by ML_(build_cfsi_index) once the array is
+      canonical.  cfsi_bounds[0 .. cfsi_bounds_used-1] are the start
+      addresses of the maximal ranges in [cfsi_minavma, cfsi_maxavma]
+      over which the unwind rule stays the same, in order, and
+      cfsi_bounds_rix[] gives the index of each range's rule in
+      cfsi_rules[], or CFSI_NO_RULE for a gap.  cfsi_rules[] holds
+      each distinct rule once (with zero base and len), so there are
+      typically far fewer of them than records.  To cut the binary
+      search short, cfsi_pages[p] is the index of the first range
+      starting at or after cfsi_minavma + (p << cfsi_page_shift), for
+      p in 0 .. cfsi_pages_used-1, and cfsi_pages[cfsi_pages_used] is
+      cfsi_bounds_used. */
+   Addr*   cfsi_bounds;
+   UInt*   cfsi_bounds_rix;
+   UWord   cfsi_bounds_used;
+   DiCfSI* cfsi_rules;
+   UWord   cfsi_rules_used;
+   UInt*   cfsi_pages;
+   UWord   cfsi_pages_used;
+   UInt    cfsi_page_shift;
+
    /* Optimized code under Wine x86: MSVC++ PDB FramePointerOmitted
       data.  Non-expandable array, hence .size == .used. */
    FPO_DATA* fpo;
@@ -784,6 +837,10 @@ struct _DebugInfo {
       that exist for any value of the PC (that is, global vars), it
       follows that Entry 0's inner array can only have one address
       range pair, one that covers the entire address space.
+
+      With --read-var-info=lazy, this and the two arrays below hold
+      the info of just one CU, whichever was most recently selected
+      by one of the ML_(lazy_varinfo_select_*) functions.
    */
    XArray* /* of OSet of DiAddrRange */varinfo;
 
@@ -843,10 +900,19 @@ extern void ML_(addVar)( struct _DebugInfo* di,
                          Int    lineNo, /* where decl'd - may be zero */
                          Bool   show );
 
+/* Free the variable info, types and location expressions held by
+   'di', and set the fields which hold them to NULL. */
+extern void ML_(free_varinfo) ( struct _DebugInfo* di );
+
 /* Canonicalise the tables held by 'di', in preparation for use.  Call
    this after finishing adding entries to these tables. */
 extern void ML_(canonicaliseTables) ( struct _DebugInfo* di );
 
+/* Canonicalise all of those except the symbol table.  This is what
+   has to be done after reading deferred debug info
+   (--read-debuginfo=lazy). */
+extern void ML_(canonicaliseDebugTables) ( struct _DebugInfo* di );
+
 /* Canonicalise the call-frame-info table held by 'di', in preparation
    for use. This is called by ML_(canonicaliseTables) but can also be
    called on it's own to sort just this table. */
@@ -868,6 +934,17 @@ extern Word ML_(search_one_loctab) ( struct _DebugInfo* di, Addr ptr );
    not found.  Binary search.  */
 extern Word ML_(search_one_cfitab) ( struct _DebugInfo* di, Addr ptr );
 
+/* Build (or rebuild) di's compiled CFI index from its canonical cfsi
+   array, and free it, respectively. */
+#define CFSI_NO_RULE 0xFFFFFFFF
+extern void ML_(build_cfsi_index) ( struct _DebugInfo* di );
+extern void ML_(free_cfsi_index) ( struct _DebugInfo* di );
+
+/* Find the index in di->cfsi_rules of the unwind rule for the
+   specified pointer, or -1 if there is none.  Uses the compiled
+   index. */
+extern Word ML_(search_cfsi_index) ( struct _DebugInfo* di, Addr ptr );
+
 /* Find a FPO-table index containing the specified pointer, or -1
    if not found.  Binary search.  */
 extern Word ML_(search_one_fpotab) ( struct _DebugInfo* di, Addr ptr );
@@ -135,11 +135,16 @@
    groupies always show up at the top of performance profiles. */
 
 #include "pub_core_basics.h"
+#include "pub_core_vki.h"
 #include "pub_core_debuginfo.h"
+#include "pub_core_aspacemgr.h"    /* for mmaping helpers' output */
 #include "pub_core_libcbase.h"
 #include "pub_core_libcassert.h"
+#include "pub_core_libcfile.h"
 #include "pub_core_libcprint.h"
+#include "pub_core_libcproc.h"     /* VG_(fork_quietly) */
 #include "pub_core_libcsetjmp.h"   // setjmp facilities
+#include "pub_core_libcsignal.h"   /* VG_(kill) */
 #include "pub_core_hashtable.h"
 #include "pub_core_options.h"
 #include "pub_core_tooliface.h"    /* VG_(needs) */
@@ -3072,6 +3077,13 @@ static void parse_type_DIE ( /*MOD*/XArray* /* of TyEnt */ tyents,
 /*---                                                      ---*/
 /*------------------------------------------------------------*/
 
+/* True when new_dwarf3_reader_wrk is reading only some of the CUs
+   in .debug_info (see "Reading variable info one CU at a time"
+   below).  Type references into the CUs which are not being read
+   then cannot be resolved; they are taken to refer to an unknown
+   type, rather than being complained about. */
+static Bool d3rd_partial = False;
+
 static UWord chase_cuOff ( Bool* changed,
                            XArray* /* of TyEnt */ ents,
                            TyEntIndexCache* ents_cache,
@@ -3080,6 +3092,11 @@ static UWord chase_cuOff ( Bool* changed,
    TyEnt* ent;
    ent = ML_(TyEnts__index_by_cuOff)( ents, ents_cache, cuOff );
 
+   if (!ent && d3rd_partial) {
+      *changed = True;
+      return D3_INVALID_CUOFF;
+   }
+
    if (!ent) {
       VG_(printf)("chase_cuOff: no entry for 0x%05lx\n", cuOff);
       *changed = False;
@@ -3373,7 +3390,13 @@ static void resolve_variable_types (
 
       /* If there's no ent, it probably we did not manage to read a
          type at the cuOffset which is stated as being this variable's
-         type.  Maybe a deficiency in parse_type_DIE.  Complain. */
+         type.  Maybe a deficiency in parse_type_DIE.  Complain --
+         unless the type is in a CU we are not reading, in which case
+         the variable is simply not usable. */
+      if (ent == NULL && d3rd_partial) {
+         var->typeR = D3_INVALID_CUOFF;
+         continue;
+      }
       if (ent == NULL) {
          VG_(printf)("\n: Invalid cuOff = 0x%05lx\n", var->typeR );
          barf("resolve_variable_types: "
@@ -3515,10 +3538,650 @@ static void read_DIE (
 }
 
 
+/*------------------------------------------------------------*/
+/*---                                                      ---*/
+/*--- Reading .debug_info with helper processes            ---*/
+/*---                                                      ---*/
+/*------------------------------------------------------------*/
+
+/* With --debuginfo-workers=N, a large .debug_info section is divided
+   into up to N+1 chunks of whole CUs, of about the same size.
+   Valgrind reads the first chunk itself, as usual.  For each of the
+   others it forks a helper process (with VG_(fork_quietly), so the
+   client never hears of it), which reads just that chunk, writes the
+   TyEnts, GExprs and TempVars it produced to a temporary file, and
+   exits.  Once Valgrind has read its own chunk it takes in the
+   helpers' results in chunk order, so that the arrays end up exactly
+   as reading the whole section in order would have left them, and
+   all the post-processing (type dedup, variable type resolution,
+   handing the variables to ML_(addVar)) is unchanged.
+
+   This works because reading a CU depends on nothing left over from
+   previous CUs: the parser stacks are empty between CUs, and shared
+   inputs such as the .debug_types signature table are set up before
+   any CU is read.  The strings and arrays which TyEnts and TempVars
+   point at are copied into the file along with them, and pointers to
+   GExprs are turned into indices.
+
+   If a helper can't be started, or fails, or its output doesn't make
+   sense, Valgrind reads that chunk itself.  If the chunk really is
+   bad, that produces the same complaint as reading the section in
+   one go would have. */
+
+#define D3_MAX_CHUNKS       65
+
+#define D3W_MAGIC           0x44335752UL /* "D3WR" */
+
+/* Helpers are forked with VG_(fork_quietly), which only works on
+   Linux; waiting for them needs this. */
+#if defined(VGO_linux)
+#  define D3_WAIT_OPTIONS   __VKI_WCLONE
+#else
+#  define D3_WAIT_OPTIONS   0
+#endif
+
+typedef
+   struct {
+      UWord start; /* .debug_info offset of the first CU in the chunk */
+      UWord end;   /* and of the first one after it */
+      Int   pid;   /* helper reading it, or 0 if none */
+      Int   fd;    /* helper's output file, if pid != 0 */
+   }
+   D3Chunk;
+
+static D3Chunk d3_chunks[D3_MAX_CHUNKS];
+static Int     d3_n_chunks = 0;
+
+/* In a helper: True, plus where to write the results, and how much of
+   each array was already there when it was forked. */
+static Bool    d3rd_in_worker   = False;
+static Int     d3_worker_fd     = -1;
+static Word    d3_n_tyents0     = 0;
+static Word    d3_n_gexprs0     = 0;
+static Word    d3_n_tempvars0   = 0;
+
+/* Fill in d3_chunks[] and d3_n_chunks, dividing the .debug_info
+   section 'info' into at most 'max_chunks' chunks.  Leaves the
+   cursor at the start of the section. */
+static void divide_debug_info ( Cursor* info, UWord section_size,
+                                Int max_chunks )
+{
+   UWord target = section_size / max_chunks;
+   UWord start  = 0;
+   UWord pos    = 0;
+   Int   n      = 0;
+
+   /* Walk the CU headers, in the same way as the reading loop does,
+      and end a chunk at the first CU boundary after each multiple of
+      'target'. */
+   while (section_size - pos >= 11) {
+      Bool  is_dw64;
+      ULong len;
+      set_position_of_Cursor( info, pos );
+      len = get_Initial_Length( &is_dw64, info,
+               "divide_debug_info: invalid initial-length field" );
+      if (len > section_size - pos)
+         break; /* bogus; let the reader complain about it */
+      pos += len + (is_dw64 ? 12 : 4);
+      if (pos > section_size)
+         break;
+      if (pos - start >= target && pos < section_size
+          && n < max_chunks - 1) {
+         d3_chunks[n].start = start;
+         d3_chunks[n].end   = pos;
+         d3_chunks[n].pid   = 0;
+         d3_chunks[n].fd    = -1;
+         n++;
+         start = pos;
+      }
+   }
+   d3_chunks[n].start = start;
+   d3_chunks[n].end   = section_size;
+   d3_chunks[n].pid   = 0;
+   d3_chunks[n].fd    = -1;
+   d3_n_chunks = n + 1;
+   set_position_of_Cursor( info, 0 );
+}
+
+/* Divide up .debug_info and fork helpers for all chunks but the
+   first.  Returns the chunk the caller should now read: 0 in
+   Valgrind itself, or the helper's chunk in a helper. */
+static Int start_d3_workers ( struct _DebugInfo* di,
+                              Cursor* info, UWord section_size,
+                              XArray* tyents, XArray* tempvars,
+                              XArray* gexprs )
+{
+   HChar name[256];
+   Int   i, fd, pid, n_started = 0;
+   Int   max_chunks = VG_(clo_debuginfo_workers) + 1;
+
+   if (max_chunks > D3_MAX_CHUNKS)
+      max_chunks = D3_MAX_CHUNKS;
+   divide_debug_info( info, section_size, max_chunks );
+
+   d3_n_tyents0   = VG_(sizeXA)( tyents );
+   d3_n_gexprs0   = VG_(sizeXA)( gexprs );
+   d3_n_tempvars0 = VG_(sizeXA)( tempvars );
+
+   for (i = 1; i < d3_n_chunks; i++) {
+      fd = VG_(mkstemp)( "dwarf3", name );
+      if (fd < 0)
+         continue;
+      /* Nobody needs the name, and this way the file can't be left
+         behind. */
+      VG_(unlink)( name );
+      pid = VG_(fork_quietly)();
+      if (pid == 0) {
+         /* We're the helper for chunk i. */
+         d3rd_in_worker = True;
+         d3_worker_fd   = fd;
+         return i;
+      }
+      if (pid < 0) {
+         VG_(close)( fd );
+         continue;
+      }
+      d3_chunks[i].pid = pid;
+      d3_chunks[i].fd  = fd;
+      n_started++;
+   }
+
+   if (VG_(clo_verbosity) > 1)
+      VG_(message)(Vg_DebugMsg,
+                   "Reading variable info for %s in %d chunks, "
+                   "with %d helpers\n",
+                   di->fsm.filename, d3_n_chunks, n_started);
+   return 0;
+}
+
+/* Get rid of any helpers whose results have not been taken in. */
+static void reap_d3_workers ( void )
+{
+   Int i, status;
+   for (i = 0; i < d3_n_chunks; i++) {
+      if (d3_chunks[i].pid == 0)
+         continue;
+      VG_(kill)( d3_chunks[i].pid, VKI_SIGKILL );
+      VG_(waitpid)( d3_chunks[i].pid, &status, D3_WAIT_OPTIONS );
+      VG_(close)( d3_chunks[i].fd );
+      d3_chunks[i].pid = 0;
+      d3_chunks[i].fd  = -1;
+   }
+   d3_n_chunks = 0;
+}
+
+/* --- Writing a helper's results --- */
+
+static void d3w_bytes ( XArray* out, void* p, UWord n ) {
+   VG_(addBytesToXA)( out, p, n );
+}
+static void d3w_UWord ( XArray* out, UWord w ) {
+   d3w_bytes( out, &w, sizeof(w) );
+}
+static void d3w_str ( XArray* out, UChar* s ) {
+   UWord n;
+   if (s == NULL) {
+      d3w_UWord( out, ~0UL );
+      return;
+   }
+   n = VG_(strlen)( s );
+   d3w_UWord( out, n );
+   d3w_bytes( out, s, n );
+}
+static void d3w_UWords ( XArray* out, XArray* /* of UWord */ xa ) {
+   Word n;
+   if (xa == NULL) {
+      d3w_UWord( out, ~0UL );
+      return;
+   }
+   n = VG_(sizeXA)( xa );
+   d3w_UWord( out, n );
+   if (n > 0)
+      d3w_bytes( out, VG_(indexXA)( xa, 0 ), n * sizeof(UWord) );
+}
+
+/* How many bytes of payload does 'gx' have? */
+static UWord size_of_GX ( GExpr* gx )
+{
+   UShort nbytes;
+   UChar* p = &gx->payload[0];
+   p++; /*biasMe*/
+   while (True) {
+      UChar uc = *p++;
+      if (uc == 1)
+         break; /*isEnd*/
+      vg_assert(uc == 0);
+      p += 2 * sizeof(Addr); /*aMin, aMax*/
+      nbytes = ML_(read_UShort)(p); p += sizeof(UShort);
+      p += nbytes;
+   }
+   return p - &gx->payload[0];
+}
+
+static void write_TyEnt ( XArray* out, TyEnt* te )
+{
+   d3w_bytes( out, te, sizeof(TyEnt) );
+   switch (te->tag) {
+      case Te_Atom:
+         d3w_str( out, te->Te.Atom.name );
+         break;
+      case Te_Field:
+         d3w_str( out, te->Te.Field.name );
+         if (te->Te.Field.nLoc > 0)
+            d3w_bytes( out, te->Te.Field.pos.loc, te->Te.Field.nLoc );
+         break;
+      case Te_TyBase:
+         d3w_str( out, te->Te.TyBase.name );
+         break;
+      case Te_TyTyDef:
+         d3w_str( out, te->Te.TyTyDef.name );
+         break;
+      case Te_TyStOrUn:
+         d3w_str( out, te->Te.TyStOrUn.name );
+         d3w_UWords( out, te->Te.TyStOrUn.fieldRs );
+         break;
+      case Te_TyEnum:
+         d3w_str( out, te->Te.TyEnum.name );
+         d3w_UWords( out, te->Te.TyEnum.atomRs );
+         break;
+      case Te_TyArray:
+         d3w_UWords( out, te->Te.TyArray.boundRs );
+         break;
+      default:
+         break;
+   }
+}
+
+/* Called in a helper once it has read its chunk.  Writes everything
+   read since the fork to d3_worker_fd, then exits. */
+static __attribute__((noreturn))
+void finish_d3_worker ( UWord end,
+                        XArray* tyents, XArray* tempvars, XArray* gexprs )
+{
+   XArray* out;
+   WordFM* gx_ixs; /* GExpr* -> index in the output */
+   UChar*  p;
+   Word    i, n;
+   UWord   keyW, valW;
+
+   out = VG_(newXA)( ML_(dinfo_zalloc), "di.readdwarf3.fdw.1",
+                     ML_(dinfo_free), sizeof(UChar) );
+   gx_ixs = VG_(newFM)( ML_(dinfo_zalloc), "di.readdwarf3.fdw.2",
+                        ML_(dinfo_free), NULL );
+
+   d3w_UWord( out, D3W_MAGIC );
+   d3w_UWord( out, end );
+   d3w_UWord( out, VG_(sizeXA)( tyents ) - d3_n_tyents0 );
+   d3w_UWord( out, VG_(sizeXA)( gexprs ) - d3_n_gexprs0 );
+   d3w_UWord( out, VG_(sizeXA)( tempvars ) - d3_n_tempvars0 );
+
+   n = VG_(sizeXA)( tyents );
+   for (i = d3_n_tyents0; i < n; i++)
+      write_TyEnt( out, VG_(indexXA)( tyents, i ) );
+
+   n = VG_(sizeXA)( gexprs );
+   for (i = d3_n_gexprs0; i < n; i++) {
+      GExpr* gx = *(GExpr**)VG_(indexXA)( gexprs, i );
+      UWord  szB = size_of_GX( gx );
+      VG_(addToFM)( gx_ixs, (UWord)gx, i - d3_n_gexprs0 );
+      d3w_UWord( out, szB );
+      d3w_bytes( out, &gx->payload[0], szB );
+   }
+
+   n = VG_(sizeXA)( tempvars );
+   for (i = d3_n_tempvars0; i < n; i++) {
+      TempVar* tv = *(TempVar**)VG_(indexXA)( tempvars, i );
+      d3w_bytes( out, tv, sizeof(TempVar) );
+      d3w_str( out, tv->name );
+      d3w_str( out, tv->fName );
+      if (tv->nRanges > 1) {
+         d3w_UWord( out, VG_(sizeXA)( tv->rngMany ) );
+         d3w_bytes( out, VG_(indexXA)( tv->rngMany, 0 ),
+                    VG_(sizeXA)( tv->rngMany ) * sizeof(AddrRange) );
+      }
+      /* Both GExprs were made while reading this chunk, since the
+         frame base expressions don't outlive the CU. */
+      if (tv->gexpr == NULL)
+         valW = ~0UL;
+      else if (!VG_(lookupFM)( gx_ixs, &keyW, &valW, (UWord)tv->gexpr ))
+         VG_(exit)(1);
+      d3w_UWord( out, valW );
+      if (tv->fbGX == NULL)
+         valW = ~0UL;
+      else if (!VG_(lookupFM)( gx_ixs, &keyW, &valW, (UWord)tv->fbGX ))
+         VG_(exit)(1);
+      d3w_UWord( out, valW );
+   }
+
+   d3w_UWord( out, D3W_MAGIC );
+
+   p = VG_(indexXA)( out, 0 );
+   n = VG_(sizeXA)( out );
+   while (n > 0) {
+      Int w = VG_(write)( d3_worker_fd, p, n > 1048576 ? 1048576 : n );
+      if (w <= 0)
+         VG_(exit)(1);
+      p += w;
+      n -= w;
+   }
+   VG_(exit)(0);
+   /*NOTREACHED*/
+   vg_assert(0);
+}
+
+/* --- Taking in a helper's results --- */
+
+typedef
+   struct {
+      UChar* p;
+      UChar* end;
+      Bool   ok;
+   }
+   D3WReader;
+
+/* Returns a pointer to the next n bytes, or NULL if there aren't that
+   many left. */
+static UChar* d3r_bytes ( D3WReader* rd, UWord n ) {
+   UChar* p = rd->p;
+   if (!rd->ok || n > (UWord)(rd->end - rd->p)) {
+      rd->ok = False;
+      return NULL;
+   }
+   rd->p += n;
+   return p;
+}
+static UWord d3r_UWord ( D3WReader* rd ) {
+   UWord  w = 0;
+   UChar* p = d3r_bytes( rd, sizeof(UWord) );
+   if (p)
+      VG_(memcpy)( &w, p, sizeof(UWord) );
+   return w;
+}
+/* Next string, as a pointer into the file and a length. */
+static UChar* d3r_str ( D3WReader* rd, /*OUT*/UWord* len ) {
+   *len = d3r_UWord( rd );
+   if (!rd->ok || *len == ~0UL)
+      return NULL;
+   return d3r_bytes( rd, *len );
+}
+static UChar* d3r_strdup ( D3WReader* rd, HChar* cc ) {
+   UWord  len;
+   UChar* s = d3r_str( rd, &len );
+   UChar* res;
+   if (s == NULL)
+      return NULL;
+   res = ML_(dinfo_zalloc)( cc, len + 1 );
+   VG_(memcpy)( res, s, len );
+   return res;
+}
+static XArray* d3r_UWords ( D3WReader* rd, HChar* cc ) {
+   UWord   n = d3r_UWord( rd );
+   UChar*  p;
+   XArray* xa;
+   if (!rd->ok || n == ~0UL || n > (UWord)(rd->end - rd->p) / sizeof(UWord))
+      return NULL;
+   p  = d3r_bytes( rd, n * sizeof(UWord) );
+   xa = VG_(newXA)( ML_(dinfo_zalloc), cc, ML_(dinfo_free), sizeof(UWord) );
+   for (; n > 0; n--, p += sizeof(UWord))
+      VG_(addToXA)( xa, p );
+   return xa;
+}
+
+/* Read a TyEnt.  On failure, 'te' is left holding a valid (if
+   useless) TyEnt, which the caller should free. */
+static Bool read_TyEnt ( D3WReader* rd, /*OUT*/TyEnt* te )
+{
+   UChar* p = d3r_bytes( rd, sizeof(TyEnt) );
+   if (p == NULL) {
+      VG_(memset)( te, 0, sizeof(*te) );
+      te->tag = Te_EMPTY;
+      return False;
+   }
+   VG_(memcpy)( te, p, sizeof(TyEnt) );
+   /* The pointers in it are the helper's; clear them all first, so
+      that 'te' can be freed whatever happens below. */
+   switch (te->tag) {
+      case Te_EMPTY: case Te_INDIR: case Te_UNKNOWN: case Te_Bound:
+      case Te_TyPtr: case Te_TyRef: case Te_TyPtrMbr: case Te_TyRvalRef:
+      case Te_TyFn: case Te_TyQual: case Te_TyVoid:
+         break;
+      case Te_Atom:
+         te->Te.Atom.name = NULL;
+         te->Te.Atom.name = d3r_strdup( rd, "di.readdwarf3.rte.1" );
+         break;
+      case Te_Field:
+         te->Te.Field.name = NULL;
+         if (te->Te.Field.nLoc >= 0)
+            te->Te.Field.pos.loc = NULL;
+         te->Te.Field.name = d3r_strdup( rd, "di.readdwarf3.rte.2" );
+         if (te->Te.Field.nLoc > 0) {
+            p = d3r_bytes( rd, te->Te.Field.nLoc );
+            if (p)
+               te->Te.Field.pos.loc
+                  = ML_(dinfo_memdup)( "di.readdwarf3.rte.3",
+                                       p, te->Te.Field.nLoc );
+            else
+               te->Te.Field.nLoc = 0;
+         }
+         break;
+      case Te_TyBase:
+         te->Te.TyBase.name = NULL;
+         te->Te.TyBase.name = d3r_strdup( rd, "di.readdwarf3.rte.4" );
+         break;
+      case Te_TyTyDef:
+         te->Te.TyTyDef.name = NULL;
+         te->Te.TyTyDef.name = d3r_strdup( rd, "di.readdwarf3.rte.5" );
+         break;
+      case Te_TyStOrUn:
+         te->Te.TyStOrUn.name    = NULL;
+         te->Te.TyStOrUn.fieldRs = NULL;
+         te->Te.TyStOrUn.name    = d3r_strdup( rd, "di.readdwarf3.rte.6" );
+         te->Te.TyStOrUn.fieldRs = d3r_UWords( rd, "di.readdwarf3.rte.7" );
+         break;
+      case Te_TyEnum:
+         te->Te.TyEnum.name   = NULL;
+         te->Te.TyEnum.atomRs = NULL;
+         te->Te.TyEnum.name   = d3r_strdup( rd, "di.readdwarf3.rte.8" );
+         te->Te.TyEnum.atomRs = d3r_UWords( rd, "di.readdwarf3.rte.9" );
+         break;
+      case Te_TyArray:
+         te->Te.TyArray.boundRs = NULL;
+         te->Te.TyArray.boundRs = d3r_UWords( rd, "di.readdwarf3.rte.10" );
+         break;
+      default:
+         VG_(memset)( te, 0, sizeof(*te) );
+         te->tag = Te_EMPTY;
+         rd->ok = False;
+         break;
+   }
+   return rd->ok;
+}
+
+/* Wait for the helper reading 'chunk' and take in its results.
+   Returns False, having changed nothing (other than perhaps adding
+   some strings to the DebugInfo), if that could not be done. */
+static Bool merge_d3_worker_output ( struct _DebugInfo* di,
+                                     D3Chunk* chunk,
+                                     WordFM* rangestree,
+                                     XArray* tyents, XArray* tempvars,
+                                     XArray* gexprs )
+{
+   Word      n_tyents0   = VG_(sizeXA)( tyents );
+   Word      n_gexprs0   = VG_(sizeXA)( gexprs );
+   Word      n_tempvars0 = VG_(sizeXA)( tempvars );
+   Int       r, status   = -1;
+   Long      szL;
+   SysRes    sres;
+   Addr      img = 0;
+   D3WReader rd;
+   UWord     n_tyents, n_gexprs, n_tempvars, i, j, len, ix;
+   UChar*    p;
+   Bool      ok = False;
+
+   vg_assert(chunk->pid > 0);
+   r = VG_(waitpid)( chunk->pid, &status, D3_WAIT_OPTIONS );
+   chunk->pid = 0;
+   if (r < 0 || status != 0)
+      goto out;
+
+   szL = VG_(fsize)( chunk->fd );
+   if (szL <= 0)
+      goto out;
+   sres = VG_(am_mmap_file_float_valgrind)( szL, VKI_PROT_READ,
+                                            chunk->fd, 0 );
+   if (sr_isError(sres))
+      goto out;
+   img    = sr_Res(sres);
+   rd.p   = (UChar*)img;
+   rd.end = rd.p + szL;
+   rd.ok  = True;
+
+   if (d3r_UWord( &rd ) != D3W_MAGIC || d3r_UWord( &rd ) != chunk->end)
+      goto out;
+   n_tyents   = d3r_UWord( &rd );
+   n_gexprs   = d3r_UWord( &rd );
+   n_tempvars = d3r_UWord( &rd );
+   if (!rd.ok)
+      goto out;
+
+   for (i = 0; rd.ok && i < n_tyents; i++) {
+      TyEnt te;
+      if (read_TyEnt( &rd, &te ))
+         VG_(addToXA)( tyents, &te );
+      else
+         ML_(TyEnt__make_EMPTY)( &te );
+   }
+
+   for (i = 0; rd.ok && i < n_gexprs; i++) {
+      GExpr* gx;
+      len = d3r_UWord( &rd );
+      p   = d3r_bytes( &rd, len );
+      if (p == NULL)
+         break;
+      gx = ML_(dinfo_zalloc)( "di.readdwarf3.mdwo.1", sizeof(GExpr) + len );
+      VG_(memcpy)( &gx->payload[0], p, len );
+      VG_(addToXA)( gexprs, &gx );
+      if (len < 2 || size_of_GX( gx ) != len)
+         rd.ok = False;
+   }
+
+   for (i = 0; rd.ok && i < n_tempvars; i++) {
+      TempVar* tv;
+      p = d3r_bytes( &rd, sizeof(TempVar) );
+      if (p == NULL)
+         break;
+      tv = ML_(dinfo_zalloc)( "di.readdwarf3.mdwo.2", sizeof(TempVar) );
+      VG_(memcpy)( tv, p, sizeof(TempVar) );
+      tv->rngMany = NULL;
+      tv->gexpr   = NULL;
+      tv->fbGX    = NULL;
+      VG_(addToXA)( tempvars, &tv );
+      p = d3r_str( &rd, &len );
+      tv->name  = p ? ML_(addStr)( di, p, len ) : NULL;
+      p = d3r_str( &rd, &len );
+      tv->fName = p ? ML_(addStr)( di, p, len ) : NULL;
+      if (tv->nRanges > 1) {
+         /* As in parse_var_DIE, share structurally identical range
+            lists. */
+         XArray* xa;
+         UWord   keyW, valW;
+         len = d3r_UWord( &rd );
+         if (len != tv->nRanges
+             || len > (UWord)(rd.end - rd.p) / sizeof(AddrRange)) {
+            rd.ok = False;
+            break;
+         }
+         p  = d3r_bytes( &rd, len * sizeof(AddrRange) );
+         xa = VG_(newXA)( ML_(dinfo_zalloc), "di.readdwarf3.mdwo.3",
+                          ML_(dinfo_free), sizeof(AddrRange) );
+         for (j = 0; j < len; j++)
+            VG_(addToXA)( xa, p + j * sizeof(AddrRange) );
+         if (VG_(lookupFM)( rangestree, &keyW, &valW, (UWord)xa )) {
+            tv->rngMany = (XArray*)keyW;
+            VG_(deleteXA)( xa );
+         } else {
+            tv->rngMany = xa;
+            VG_(addToFM)( rangestree, (UWord)xa, 0 );
+         }
+      }
+      ix = d3r_UWord( &rd );
+      if (ix != ~0UL) {
+         if (ix >= n_gexprs)
+            rd.ok = False;
+         else
+            tv->gexpr = *(GExpr**)VG_(indexXA)( gexprs, n_gexprs0 + ix );
+      }
+      ix = d3r_UWord( &rd );
+      if (ix != ~0UL) {
+         if (ix >= n_gexprs)
+            rd.ok = False;
+         else
+            tv->fbGX = *(GExpr**)VG_(indexXA)( gexprs, n_gexprs0 + ix );
+      }
+   }
+
+   if (rd.ok && d3r_UWord( &rd ) == D3W_MAGIC && rd.p == rd.end)
+      ok = True;
+
+  out:
+   if (!ok) {
+      /* Back out whatever was taken in.  Range lists added to
+         'rangestree' can stay; they are freed along with it. */
+      while (VG_(sizeXA)( tyents ) > n_tyents0) {
+         TyEnt* te = VG_(indexXA)( tyents, VG_(sizeXA)( tyents ) - 1 );
+         ML_(TyEnt__make_EMPTY)( te );
+         VG_(dropTailXA)( tyents, 1 );
+      }
+      while (VG_(sizeXA)( tempvars ) > n_tempvars0) {
+         TempVar* tv = *(TempVar**)VG_(indexXA)( tempvars,
+                                                 VG_(sizeXA)( tempvars ) - 1 );
+         ML_(dinfo_free)( tv );
+         VG_(dropTailXA)( tempvars, 1 );
+      }
+      while (VG_(sizeXA)( gexprs ) > n_gexprs0) {
+         GExpr* gx = *(GExpr**)VG_(indexXA)( gexprs,
+                                             VG_(sizeXA)( gexprs ) - 1 );
+         ML_(dinfo_free)( gx );
+         VG_(dropTailXA)( gexprs, 1 );
+      }
+      if (VG_(clo_verbosity) > 1)
+         VG_(message)(Vg_DebugMsg,
+                      "Helper failed; reading .debug_info at 0x%lx "
+                      "of %s directly\n", chunk->start, di->fsm.filename);
+   }
+   if (img) {
+      sres = VG_(am_munmap_valgrind)( img, szL );
+      vg_assert(!sr_isError(sres));
+   }
+   VG_(close)( chunk->fd );
+   chunk->fd = -1;
+   return ok;
+}
+
+/* Take in the results of chunks 'from' onwards, for as long as they
+   were read by helpers.  Returns the first chunk that Valgrind has to
+   read itself, or d3_n_chunks if there is none. */
+static Int merge_d3_workers ( struct _DebugInfo* di, Int from,
+                              WordFM* rangestree,
+                              XArray* tyents, XArray* tempvars,
+                              XArray* gexprs )
+{
+   Int i;
+   for (i = from; i < d3_n_chunks; i++) {
+      if (d3_chunks[i].pid == 0
+          || !merge_d3_worker_output( di, &d3_chunks[i], rangestree,
+                                      tyents, tempvars, gexprs ))
+         break;
+   }
+   return i;
+}
+
+
 static
 void new_dwarf3_reader_wrk ( 
    struct _DebugInfo* di,
    __attribute__((noreturn)) void (*barf)( HChar* ),
+   UWord cus_start, UWord cus_end,
    UChar* debug_info_img,   SizeT debug_info_sz,
    UChar* debug_types_img,  SizeT debug_types_sz,
    UChar* debug_abbv_img,   SizeT debug_abbv_sz,
@@ -3686,6 +4349,11 @@ void new_dwarf3_reader_wrk (
    }
    TRACE_SYMTAB("\n");
 
+   /* Only the CUs in [cus_start, cus_end) of .debug_info are to be
+      read.  Normally that is all of them. */
+   vg_assert(cus_start <= cus_end && cus_end <= debug_info_sz);
+   d3rd_partial = cus_start > 0 || cus_end < debug_info_sz;
+
    /* We'll park the harvested type information in here.  Also create
       a fake "void" entry with offset D3_FAKEVOID_CUOFF, so we always
       have at least one type entry to refer to.  D3_FAKEVOID_CUOFF is
@@ -3798,6 +4466,11 @@ void new_dwarf3_reader_wrk (
       kept inline instead.  */
    for (pass = 0; pass < 3; ++pass) {
       UWord section_size;
+      /* The chunk of the section being read, and where it ends.
+         Normally a section is read as one chunk; see "Reading
+         .debug_info with helper processes" above. */
+      Int   chunk;
+      UWord chunk_end;
 
       if (pass == 0) {
          if (debug_info_alt_img == NULL)
@@ -3832,6 +4505,21 @@ void new_dwarf3_reader_wrk (
          TRACE_D3("\n------ Parsing .debug_types section ------\n");
       }
 
+      d3_n_chunks = 1;
+      d3_chunks[0].start = pass == 1 ? cus_start : 0;
+      d3_chunks[0].end   = pass == 1 ? cus_end : section_size;
+      d3_chunks[0].pid   = 0;
+      d3_chunks[0].fd    = -1;
+      if (pass == 1 && !td3 && !d3rd_partial
+          && VG_(clo_debuginfo_workers) > 0
+          && section_size >= VG_(clo_debuginfo_workers_min_szB))
+         chunk = start_d3_workers( di, &info, section_size,
+                                   tyents, tempvars, gexprs );
+      else
+         chunk = 0;
+      chunk_end = d3_chunks[chunk].end;
+      set_position_of_Cursor( &info, d3_chunks[chunk].start );
+
       while (True) {
          UWord   cu_start_offset, cu_offset_now;
          CUConst cc;
@@ -3859,7 +4547,7 @@ void new_dwarf3_reader_wrk (
             CU header can be smaller than 11 bytes, so I don't think
             there's any harm possible through the test -- it just adds
             robustness. */
-         Word avail = get_remaining_length_Cursor( &info );
+         Word avail = chunk_end - get_position_of_Cursor( &info );
          if (avail < 11) {
             if (avail > 0)
                TRACE_D3("new_dwarf3_reader_wrk: warning: "
@@ -3996,10 +4684,24 @@ void new_dwarf3_reader_wrk (
          VG_(deleteXA)( varparser.filenameTable );
          varparser.filenameTable = NULL;
 
-         if (cu_offset_now == section_size)
-            break;
+         if (cu_offset_now == chunk_end) {
+            if (d3rd_in_worker)
+               finish_d3_worker( chunk_end, tyents, tempvars, gexprs );
+            /* Take in what the helpers read, up to the next chunk
+               (if any) which we have to read ourselves. */
+            chunk = merge_d3_workers( di, chunk + 1, rangestree,
+                                      tyents, tempvars, gexprs );
+            if (chunk == d3_n_chunks)
+               break;
+            chunk_end = d3_chunks[chunk].end;
+            set_position_of_Cursor( &info, d3_chunks[chunk].start );
+         }
          /* else keep going */
       }
+
+      if (d3rd_in_worker)
+         finish_d3_worker( chunk_end, tyents, tempvars, gexprs );
+      reap_d3_workers();
    }
 
    /* From here on we're post-processing the stuff we got
@@ -4155,6 +4857,16 @@ void new_dwarf3_reader_wrk (
             VG_(printf)("  abstract origin: <%lx>\n", varp->absOri);
       }
 
+      /* When reading just some of the CUs, the alternate .debug_info
+         and .debug_types are read as well, for the sake of the types
+         in them.  Leave out their variables, though, rather than
+         adding them again for every CU that is read. */
+      if (d3rd_partial
+          && (varp->dioff < cus_start || varp->dioff >= cus_end)) {
+         TRACE_D3("  SKIP (not in the CUs being read)\n\n");
+         continue;
+      }
+
       /* Skip variables which have no location.  These must be
          abstract instances; they are useless as-is since with no
          location they have no specified memory location.  They will
@@ -4349,9 +5061,11 @@ static __attribute__((noreturn)) void barf ( HChar* reason ) {
 }
 
 
-void 
-ML_(new_dwarf3_reader) (
+/* Run new_dwarf3_reader_wrk on the CUs in [cus_start, cus_end) of
+   .debug_info, catching any failure.  Returns True if it succeeded. */
+static Bool run_dwarf3_reader (
    struct _DebugInfo* di,
+   UWord cus_start, UWord cus_end,
    UChar* debug_info_img,   SizeT debug_info_sz,
    UChar* debug_types_img,  SizeT debug_types_sz,
    UChar* debug_abbv_img,   SizeT debug_abbv_sz,
@@ -4379,7 +5093,7 @@ ML_(new_dwarf3_reader) (
    jumped = VG_MINIMAL_SETJMP(d3rd_jmpbuf);
    if (jumped == 0) {
       /* try this ... */
-      new_dwarf3_reader_wrk( di, barf,
+      new_dwarf3_reader_wrk( di, barf, cus_start, cus_end,
                              debug_info_img,   debug_info_sz,
                              debug_types_img,  debug_types_sz,
                              debug_abbv_img,   debug_abbv_sz,
@@ -4399,6 +5113,13 @@ ML_(new_dwarf3_reader) (
       /* Can't longjump without giving some sort of reason. */
       vg_assert(d3rd_jmpbuf_reason != NULL);
 
+      /* A helper just gives up; Valgrind will read its chunk itself
+         and report the problem then.  Otherwise, make sure there are
+         no helpers left running. */
+      if (d3rd_in_worker)
+         VG_(exit)(1);
+      reap_d3_workers();
+
       TRACE_D3("\n------ .debug_info reading failed ------\n");
 
       ML_(symerr)(di, True, d3rd_jmpbuf_reason);
@@ -4406,9 +5127,669 @@ ML_(new_dwarf3_reader) (
 
    d3rd_jmpbuf_valid  = False;
    d3rd_jmpbuf_reason = NULL;
+   d3rd_partial       = False;
+   return jumped == 0;
+}
+
+
+void 
+ML_(new_dwarf3_reader) (
+   struct _DebugInfo* di,
+   UChar* debug_info_img,   SizeT debug_info_sz,
+   UChar* debug_types_img,  SizeT debug_types_sz,
+   UChar* debug_abbv_img,   SizeT debug_abbv_sz,
+   UChar* debug_line_img,   SizeT debug_line_sz,
+   UChar* debug_str_img,    SizeT debug_str_sz,
+   UChar* debug_ranges_img, SizeT debug_ranges_sz,
+   UChar* debug_loc_img,    SizeT debug_loc_sz,
+   UChar* debug_info_alt_img, SizeT debug_info_alt_sz,
+   UChar* debug_abbv_alt_img, SizeT debug_abbv_alt_sz,
+   UChar* debug_line_alt_img, SizeT debug_line_alt_sz,
+   UChar* debug_str_alt_img,  SizeT debug_str_alt_sz
+)
+{
+   (void)run_dwarf3_reader( di, 0, debug_info_sz,
+                            debug_info_img,   debug_info_sz,
+                            debug_types_img,  debug_types_sz,
+                            debug_abbv_img,   debug_abbv_sz,
+                            debug_line_img,   debug_line_sz,
+                            debug_str_img,    debug_str_sz,
+                            debug_ranges_img, debug_ranges_sz,
+                            debug_loc_img,    debug_loc_sz,
+                            debug_info_alt_img, debug_info_alt_sz,
+                            debug_abbv_alt_img, debug_abbv_alt_sz,
+                            debug_line_alt_img, debug_line_alt_sz,
+                            debug_str_alt_img,  debug_str_alt_sz );
+}
+
+
+/*------------------------------------------------------------*/
+/*---                                                      ---*/
+/*--- Reading variable info one CU at a time               ---*/
+/*---                                                      ---*/
+/*------------------------------------------------------------*/
+
+/* With --read-var-info=lazy, all that is read from .debug_info when
+   an object is mapped is the CU headers and the address ranges given
+   by each CU's top level DIE.  A CU's DIEs are read only when a query
+   asks about a code address inside it, or about a data address at
+   which one of its DW_TAG_variables is located.  The index needed
+   for the latter is made by skimming all the DIEs, without reading
+   anything into the DebugInfo, the first time the object's globals
+   are asked about.
+
+   Reading a CU is done by new_dwarf3_reader_wrk restricted to that
+   CU, and what it produces is kept with the CU: the variable info,
+   the types and the location expressions, and the strings, which are
+   put into a chunk list of their own so they can be freed with the
+   CU.  Whichever CU was most recently selected has its tables in the
+   DebugInfo's .varinfo, .admin_tyents and .admin_gexprs, so the rest
+   of m_debuginfo can use them exactly as it would use those of an
+   object read eagerly.  At most --read-var-info-cus= CUs, over all
+   objects, have their info in memory at any one time; the least
+   recently used ones are thrown away to make room. */
+
+typedef
+   struct {
+      UWord   cuStart;  /* offset of the CU header in .debug_info */
+      UWord   cuEnd;    /* offset just past the end of the CU */
+      Bool    resident; /* has been read, and not thrown away since */
+      Bool    bad;      /* reading it failed; don't try again */
+      ULong   lastUsed; /* value of lazy_CU_clock when last selected */
+      /* When resident, what the reader left in the DebugInfo. */
+      XArray* varinfo;
+      XArray* tyents;
+      XArray* gexprs;
+      struct strchunk* strchunks;
+   }
+   LazyCU;
+
+/* An address range covered by a CU's code, or, with aMin == aMax,
+   the address of a variable defined in a CU.  Both are avmas. */
+typedef
+   struct {
+      Addr aMin;
+      Addr aMax;
+      Word cuIx;
+   }
+   LazyCURange;
+
+struct _DebugInfoLazyVars {
+   struct _DebugInfoLazyVars* next;  /* in lazy_vars_list */
+   struct _DebugInfo* di;
+   /* The sections, which stay mapped while this exists. */
+   UChar* debug_info_img;     SizeT debug_info_sz;
+   UChar* debug_types_img;    SizeT debug_types_sz;
+   UChar* debug_abbv_img;     SizeT debug_abbv_sz;
+   UChar* debug_line_img;     SizeT debug_line_sz;
+   UChar* debug_str_img;      SizeT debug_str_sz;
+   UChar* debug_ranges_img;   SizeT debug_ranges_sz;
+   UChar* debug_loc_img;      SizeT debug_loc_sz;
+   UChar* debug_info_alt_img; SizeT debug_info_alt_sz;
+   UChar* debug_abbv_alt_img; SizeT debug_abbv_alt_sz;
+   UChar* debug_line_alt_img; SizeT debug_line_alt_sz;
+   UChar* debug_str_alt_img;  SizeT debug_str_alt_sz;
+   /* The CUs, in .debug_info order. */
+   XArray* /* of LazyCU */ cus;
+   /* The CUs' code address ranges, sorted by aMin. */
+   XArray* /* of LazyCURange */ code;
+   /* The addresses of the variables with fixed addresses, sorted
+      by aMin, or NULL if not worked out yet. */
+   XArray* /* of LazyCURange */ globals;
+   /* The CU whose tables are in the DebugInfo, or -1 if none. */
+   Word selected;
+};
+
+static struct _DebugInfoLazyVars* lazy_vars_list = NULL;
+static Word  n_resident_lazy_CUs = 0;
+static ULong lazy_CU_clock = 0;
+
+static Int cmp_LazyCURange ( void* v1, void* v2 ) {
+   LazyCURange* r1 = (LazyCURange*)v1;
+   LazyCURange* r2 = (LazyCURange*)v2;
+   if (r1->aMin < r2->aMin) return -1;
+   if (r1->aMin > r2->aMin) return 1;
+   return 0;
+}
+
+/* Find the last entry in 'xa' (of LazyCURange, sorted) whose aMin is
+   <= a, or return -1 if there isn't one. */
+static Word find_LazyCURange ( XArray* xa, Addr a )
+{
+   Word lo = 0, hi = VG_(sizeXA)( xa ) - 1, res = -1;
+   while (lo <= hi) {
+      Word mid = (lo + hi) / 2;
+      LazyCURange* r = VG_(indexXA)( xa, mid );
+      if (r->aMin <= a) {
+         res = mid;
+         lo = mid + 1;
+      } else {
+         hi = mid - 1;
+      }
+   }
+   return res;
+}
+
+/* Note that CU cuIx covers the code at svmas [aMin, aMax].  Ranges
+   which aren't in the text segment once biased (such as those of
+   functions which the linker threw away) are of no use. */
+static void add_lazy_code_range ( struct _DebugInfoLazyVars* lv,
+                                  Addr aMin, Addr aMax, Word cuIx )
+{
+   struct _DebugInfo* di = lv->di;
+   LazyCURange r;
+   if (!di->text_present || di->text_size == 0)
+      return;
+   r.aMin = aMin + di->text_debug_bias;
+   r.aMax = aMax + di->text_debug_bias;
+   r.cuIx = cuIx;
+   if (r.aMin < di->text_avma || r.aMax >= di->text_avma + di->text_size)
+      return;
+   VG_(addToXA)( lv->code, &r );
+}
+
+/* Read the attributes of the DIE at 'c', whose abbreviation is at
+   'abbv' (just past the tag and children flag).  If the DIE is a
+   DW_TAG_variable of CU cuIx located at a fixed address, note that
+   in lv->globals; for any other DIE, pass cuIx == -1. */
+static void skim_DIE ( struct _DebugInfoLazyVars* lv, CUConst* cc,
+                       Cursor* c, Cursor* abbv, Word cuIx )
+{
+   ULong cts;
+   Int   ctsSzB;
+   UWord ctsMemSzB;
+   while (True) {
+      DW_AT   attr = (DW_AT)  get_ULEB128( abbv );
+      DW_FORM form = (DW_FORM)get_ULEB128( abbv );
+      if (attr == 0 && form == 0) break;
+      /* There is no need to look up type signatures here. */
+      if (form == DW_FORM_ref_sig8) {
+         (void)get_ULong( c );
+         continue;
+      }
+      get_Form_contents( &cts, &ctsSzB, &ctsMemSzB,
+                         cc, c, False/*td3*/, form );
+      if (cuIx >= 0 && attr == DW_AT_location
+          && ctsMemSzB == 1 + sizeof(Addr)) {
+         UChar* block = (UChar*)(UWord)cts;
+         LazyCURange r;
+         if (block[0] != DW_OP_addr)
+            continue;
+         r.aMin = ML_(read_Addr)( block + 1 );
+         if (!ML_(bias_address)( &r.aMin, lv->di ))
+            continue;
+         r.aMax = r.aMin;
+         r.cuIx = cuIx;
+         VG_(addToXA)( lv->globals, &r );
+      }
+   }
+}
+
+/* Walk over the CUs in .debug_info.  If 'globals' is False, make
+   lv->cus and lv->code; otherwise (they must already have been
+   made), skim all the DIEs too and fill in lv->globals. */
+static void index_lazy_CUs_wrk ( struct _DebugInfoLazyVars* lv,
+                                 Bool globals,
+                                 VgHashTable signature_types )
+{
+   Cursor info;
+   Word   cuIx = 0;
+
+   init_Cursor( &info, lv->debug_info_img, lv->debug_info_sz, 0, barf,
+                "Overrun whilst indexing .debug_info section" );
+
+   /* As in new_dwarf3_reader_wrk, stop if there is not enough left
+      to hold a CU header. */
+   while (lv->debug_info_sz - get_position_of_Cursor( &info ) >= 11) {
+      UWord   cu_start, cu_end;
+      ULong   abbv_code;
+      UInt    has_children;
+      Int     depth;
+      Cursor  abbv;
+      CUConst cc;
+
+      cu_start = get_position_of_Cursor( &info );
+      parse_CU_Header( &cc, False, &info,
+                       lv->debug_abbv_img, lv->debug_abbv_sz,
+                       False, False );
+      cu_end = cu_start + cc.unit_length + (cc.is_dw64 ? 12 : 4);
+      if (cu_end > lv->debug_info_sz)
+         barf("index_lazy_CUs: CU extends beyond end of .debug_info");
+      cc.debug_str_img    = lv->debug_str_img;
+      cc.debug_str_sz     = lv->debug_str_sz;
+      cc.debug_ranges_img = lv->debug_ranges_img;
+      cc.debug_ranges_sz  = lv->debug_ranges_sz;
+      cc.debug_loc_img    = lv->debug_loc_img;
+      cc.debug_loc_sz     = lv->debug_loc_sz;
+      cc.debug_line_img   = lv->debug_line_img;
+      cc.debug_line_sz    = lv->debug_line_sz;
+      cc.debug_info_img   = lv->debug_info_img;
+      cc.debug_info_sz    = lv->debug_info_sz;
+      cc.debug_types_img  = lv->debug_types_img;
+      cc.debug_types_sz   = lv->debug_types_sz;
+      cc.debug_info_alt_img = lv->debug_info_alt_img;
+      cc.debug_info_alt_sz  = lv->debug_info_alt_sz;
+      cc.debug_str_alt_img  = lv->debug_str_alt_img;
+      cc.debug_str_alt_sz   = lv->debug_str_alt_sz;
+      cc.types_cuOff_bias = lv->debug_info_sz;
+      cc.alt_cuOff_bias   = lv->debug_info_sz + lv->debug_types_sz;
+      cc.cu_start_offset  = cu_start;
+      cc.di               = lv->di;
+      cc.signature_types  = signature_types;
+
+      if (globals) {
+         vg_assert(cuIx < VG_(sizeXA)( lv->cus ));
+         vg_assert(((LazyCU*)VG_(indexXA)( lv->cus, cuIx ))->cuStart
+                   == cu_start);
+      } else {
+         LazyCU cu;
+         VG_(memset)( &cu, 0, sizeof(cu) );
+         cu.cuStart = cu_start;
+         cu.cuEnd   = cu_end;
+         VG_(addToXA)( lv->cus, &cu );
+      }
+
+      /* The one-and-only top level DIE. */
+      abbv_code = get_ULEB128( &info );
+      if (abbv_code != 0) {
+         set_abbv_Cursor( &abbv, False, &cc, abbv_code );
+         (void)get_ULEB128( &abbv ); /* the tag */
+         has_children = get_UChar( &abbv );
+
+         if (globals) {
+            skim_DIE( lv, &cc, &info, &abbv, -1 );
+         } else {
+            /* Work out the CU's address ranges in the same way as
+               parse_var_DIE does. */
+            ULong cts;
+            Int   ctsSzB;
+            UWord ctsMemSzB;
+            Bool  have_lo = False, have_hi1 = False;
+            Bool  hiIsRelative = False, have_range = False;
+            Addr  ip_lo = 0, ip_hi1 = 0, rangeoff = 0;
+            while (True) {
+               DW_AT   attr = (DW_AT)  get_ULEB128( &abbv );
+               DW_FORM form = (DW_FORM)get_ULEB128( &abbv );
+               if (attr == 0 && form == 0) break;
+               get_Form_contents( &cts, &ctsSzB, &ctsMemSzB,
+                                  &cc, &info, False/*td3*/, form );
+               if (attr == DW_AT_low_pc && ctsSzB > 0) {
+                  ip_lo   = cts;
+                  have_lo = True;
+               }
+               if (attr == DW_AT_high_pc && ctsSzB > 0) {
+                  ip_hi1   = cts;
+                  have_hi1 = True;
+                  if (form != DW_FORM_addr)
+                     hiIsRelative = True;
+               }
+               if (attr == DW_AT_ranges && ctsSzB > 0) {
+                  rangeoff   = cts;
+                  have_range = True;
+               }
+            }
+            if (have_lo && have_hi1 && hiIsRelative)
+               ip_hi1 += ip_lo;
+            if (have_lo && have_hi1 && !have_range) {
+               if (ip_lo < ip_hi1)
+                  add_lazy_code_range( lv, ip_lo, ip_hi1 - 1, cuIx );
+            } else
+            if (!have_hi1 && have_range && (!have_lo || ip_lo == 0)) {
+               Word i;
+               XArray* ranges = get_range_list( &cc, False, rangeoff,
+                                                have_lo ? ip_lo : 0 );
+               for (i = 0; i < VG_(sizeXA)( ranges ); i++) {
+                  AddrRange* r = VG_(indexXA)( ranges, i );
+                  add_lazy_code_range( lv, r->aMin, r->aMax, cuIx );
+               }
+               VG_(deleteXA)( ranges );
+            }
+         }
+
+         /* And, if wanted, all the DIEs below it. */
+         depth = has_children ? 1 : 0;
+         while (globals && depth > 0
+                && get_position_of_Cursor( &info ) < cu_end) {
+            ULong atag;
+            abbv_code = get_ULEB128( &info );
+            if (abbv_code == 0) {
+               depth--;
+               continue;
+            }
+            set_abbv_Cursor( &abbv, False, &cc, abbv_code );
+            atag = get_ULEB128( &abbv );
+            has_children = get_UChar( &abbv );
+            skim_DIE( lv, &cc, &info, &abbv,
+                      atag == DW_TAG_variable ? cuIx : -1 );
+            if (has_children)
+               depth++;
+         }
+      }
+
+      set_position_of_Cursor( &info, cu_end );
+      cuIx++;
+   }
+}
+
+/* Run index_lazy_CUs_wrk, catching any failure, and sort what it
+   made.  Returns True if it succeeded. */
+static Bool index_lazy_CUs ( struct _DebugInfoLazyVars* lv, Bool globals )
+{
+   volatile Int jumped;
+   VgHashTable  signature_types;
+
+   vg_assert(d3rd_jmpbuf_valid  == False);
+   vg_assert(d3rd_jmpbuf_reason == NULL);
+
+   /* Always empty.  References by signature are never followed while
+      indexing. */
+   signature_types = VG_(HT_construct) ("lazy_signature_types");
+
+   d3rd_jmpbuf_valid = True;
+   jumped = VG_MINIMAL_SETJMP(d3rd_jmpbuf);
+   if (jumped == 0) {
+      index_lazy_CUs_wrk( lv, globals, signature_types );
+   } else {
+      vg_assert(d3rd_jmpbuf_reason != NULL);
+      ML_(symerr)(lv->di, True, d3rd_jmpbuf_reason);
+   }
+   d3rd_jmpbuf_valid  = False;
+   d3rd_jmpbuf_reason = NULL;
+
+   VG_(HT_destruct) ( signature_types, ML_(dinfo_free) );
+
+   VG_(setCmpFnXA)( globals ? lv->globals : lv->code, cmp_LazyCURange );
+   VG_(sortXA)( globals ? lv->globals : lv->code );
+   return jumped == 0;
+}
+
+/* Take the selected CU's tables, if any, out of the DebugInfo. */
+static void deselect_lazy_CU ( struct _DebugInfoLazyVars* lv )
+{
+   lv->di->varinfo      = NULL;
+   lv->di->admin_tyents = NULL;
+   lv->di->admin_gexprs = NULL;
+   lv->selected         = -1;
+}
+
+/* Throw away the info read for CU cuIx. */
+static void free_lazy_CU ( struct _DebugInfoLazyVars* lv, Word cuIx )
+{
+   struct _DebugInfo* di = lv->di;
+   LazyCU* cu = VG_(indexXA)( lv->cus, cuIx );
+   struct strchunk *chunk, *next;
+
+   vg_assert(cu->resident);
+   deselect_lazy_CU( lv );
+   di->varinfo      = cu->varinfo;
+   di->admin_tyents = cu->tyents;
+   di->admin_gexprs = cu->gexprs;
+   ML_(free_varinfo)( di );
+   for (chunk = cu->strchunks; chunk != NULL; chunk = next) {
+      next = chunk->next;
+      ML_(dinfo_free)(chunk);
+   }
+   cu->varinfo   = NULL;
+   cu->tyents    = NULL;
+   cu->gexprs    = NULL;
+   cu->strchunks = NULL;
+   cu->resident  = False;
+   vg_assert(n_resident_lazy_CUs > 0);
+   n_resident_lazy_CUs--;
+}
+
+/* Throw away least recently used CUs, other than CU 'keep' of
+   'keep_lv', until no more than --read-var-info-cus= are
+   resident. */
+static void evict_lazy_CUs ( struct _DebugInfoLazyVars* keep_lv,
+                             Word keep )
+{
+   while (n_resident_lazy_CUs > VG_(clo_read_var_info_cus)) {
+      struct _DebugInfoLazyVars *lv, *victim_lv = NULL;
+      Word  i, n, victim = -1;
+      ULong oldest = 0;
+      for (lv = lazy_vars_list; lv != NULL; lv = lv->next) {
+         n = VG_(sizeXA)( lv->cus );
+         for (i = 0; i < n; i++) {
+            LazyCU* cu = VG_(indexXA)( lv->cus, i );
+            if (!cu->resident || (lv == keep_lv && i == keep))
+               continue;
+            if (victim_lv == NULL || cu->lastUsed < oldest) {
+               victim_lv = lv;
+               victim    = i;
+               oldest    = cu->lastUsed;
+            }
+         }
+      }
+      if (victim_lv == NULL)
+         break;
+      free_lazy_CU( victim_lv, victim );
+   }
+}
+
+/* Read CU cuIx. */
+static void read_lazy_CU ( struct _DebugInfoLazyVars* lv, Word cuIx )
+{
+   struct _DebugInfo* di = lv->di;
+   LazyCU* cu = VG_(indexXA)( lv->cus, cuIx );
+   struct strchunk* strchunks;
+   Bool ok;
+
+   vg_assert(!cu->resident && !cu->bad);
+   if (VG_(clo_verbosity) > 2)
+      VG_(message)(Vg_DebugMsg, "Reading variable info for CU at 0x%lx "
+                                "in %s\n", cu->cuStart, di->fsm.filename);
+
+   /* The reader starts with empty tables, and its strings go into a
+      chunk list of their own. */
+   deselect_lazy_CU( lv );
+   strchunks = di->strchunks;
+   di->strchunks = NULL;
+
+   ok = run_dwarf3_reader( di, cu->cuStart, cu->cuEnd,
+                           lv->debug_info_img,     lv->debug_info_sz,
+                           lv->debug_types_img,    lv->debug_types_sz,
+                           lv->debug_abbv_img,     lv->debug_abbv_sz,
+                           lv->debug_line_img,     lv->debug_line_sz,
+                           lv->debug_str_img,      lv->debug_str_sz,
+                           lv->debug_ranges_img,   lv->debug_ranges_sz,
+                           lv->debug_loc_img,      lv->debug_loc_sz,
+                           lv->debug_info_alt_img, lv->debug_info_alt_sz,
+                           lv->debug_abbv_alt_img, lv->debug_abbv_alt_sz,
+                           lv->debug_line_alt_img, lv->debug_line_alt_sz,
+                           lv->debug_str_alt_img,  lv->debug_str_alt_sz );
+
+   cu->varinfo   = di->varinfo;
+   cu->tyents    = di->admin_tyents;
+   cu->gexprs    = di->admin_gexprs;
+   cu->strchunks = di->strchunks;
+   cu->resident  = True;
+   n_resident_lazy_CUs++;
+   di->strchunks = strchunks;
+   deselect_lazy_CU( lv );
+
+   if (!ok) {
+      free_lazy_CU( lv, cuIx );
+      cu->bad = True;
+      return;
+   }
+
+   evict_lazy_CUs( lv, cuIx );
+}
+
+/* Put CU cuIx's tables in the DebugInfo, reading it first if need
+   be; or, if cuIx is -1 or the CU can't be read, leave the
+   DebugInfo with no variable info. */
+static void select_lazy_CU ( struct _DebugInfoLazyVars* lv, Word cuIx )
+{
+   LazyCU* cu;
+
+   deselect_lazy_CU( lv );
+   if (cuIx < 0)
+      return;
+   cu = VG_(indexXA)( lv->cus, cuIx );
+   if (cu->bad)
+      return;
+   if (!cu->resident)
+      read_lazy_CU( lv, cuIx );
+   if (!cu->resident)
+      return;
+   cu->lastUsed         = ++lazy_CU_clock;
+   lv->di->varinfo      = cu->varinfo;
+   lv->di->admin_tyents = cu->tyents;
+   lv->di->admin_gexprs = cu->gexprs;
+   lv->selected         = cuIx;
 }
 
 
+Bool
+ML_(new_dwarf3_lazy_reader) (
+   struct _DebugInfo* di,
+   UChar* debug_info_img,   SizeT debug_info_sz,
+   UChar* debug_types_img,  SizeT debug_types_sz,
+   UChar* debug_abbv_img,   SizeT debug_abbv_sz,
+   UChar* debug_line_img,   SizeT debug_line_sz,
+   UChar* debug_str_img,    SizeT debug_str_sz,
+   UChar* debug_ranges_img, SizeT debug_ranges_sz,
+   UChar* debug_loc_img,    SizeT debug_loc_sz,
+   UChar* debug_info_alt_img, SizeT debug_info_alt_sz,
+   UChar* debug_abbv_alt_img, SizeT debug_abbv_alt_sz,
+   UChar* debug_line_alt_img, SizeT debug_line_alt_sz,
+   UChar* debug_str_alt_img,  SizeT debug_str_alt_sz
+)
+{
+   struct _DebugInfoLazyVars* lv;
+
+   vg_assert(di->lazy_vars == NULL);
+
+   lv = ML_(dinfo_zalloc)( "di.readdwarf3.ndlr.1",
+                           sizeof(struct _DebugInfoLazyVars) );
+   lv->di                 = di;
+   lv->debug_info_img     = debug_info_img;
+   lv->debug_info_sz      = debug_info_sz;
+   lv->debug_types_img    = debug_types_img;
+   lv->debug_types_sz     = debug_types_sz;
+   lv->debug_abbv_img     = debug_abbv_img;
+   lv->debug_abbv_sz      = debug_abbv_sz;
+   lv->debug_line_img     = debug_line_img;
+   lv->debug_line_sz      = debug_line_sz;
+   lv->debug_str_img      = debug_str_img;
+   lv->debug_str_sz       = debug_str_sz;
+   lv->debug_ranges_img   = debug_ranges_img;
+   lv->debug_ranges_sz    = debug_ranges_sz;
+   lv->debug_loc_img      = debug_loc_img;
+   lv->debug_loc_sz       = debug_loc_sz;
+   lv->debug_info_alt_img = debug_info_alt_img;
+   lv->debug_info_alt_sz  = debug_info_alt_sz;
+   lv->debug_abbv_alt_img = debug_abbv_alt_img;
+   lv->debug_abbv_alt_sz  = debug_abbv_alt_sz;
+   lv->debug_line_alt_img = debug_line_alt_img;
+   lv->debug_line_alt_sz  = debug_line_alt_sz;
+   lv->debug_str_alt_img  = debug_str_alt_img;
+   lv->debug_str_alt_sz   = debug_str_alt_sz;
+   lv->cus  = VG_(newXA)( ML_(dinfo_zalloc), "di.readdwarf3.ndlr.2",
+                          ML_(dinfo_free), sizeof(LazyCU) );
+   lv->code = VG_(newXA)( ML_(dinfo_zalloc), "di.readdwarf3.ndlr.3",
+                          ML_(dinfo_free), sizeof(LazyCURange) );
+   lv->globals  = NULL;
+   lv->selected = -1;
+
+   if (!index_lazy_CUs( lv, False/*!globals*/ )
+       || VG_(sizeXA)( lv->cus ) == 0) {
+      VG_(deleteXA)( lv->cus );
+      VG_(deleteXA)( lv->code );
+      ML_(dinfo_free)( lv );
+      return False;
+   }
+
+   TRACE_SYMTAB("lazy variable info: %ld CUs, %ld code ranges\n",
+                VG_(sizeXA)( lv->cus ), VG_(sizeXA)( lv->code ));
+   lv->next = lazy_vars_list;
+   lazy_vars_list = lv;
+   di->lazy_vars = lv;
+   return True;
+}
+
+void ML_(lazy_varinfo_discard) ( struct _DebugInfo* di )
+{
+   struct _DebugInfoLazyVars*  lv = di->lazy_vars;
+   struct _DebugInfoLazyVars** prev;
+   Word i, n;
+
+   vg_assert(lv);
+   for (prev = &lazy_vars_list; *prev != lv; prev = &(*prev)->next)
+      vg_assert(*prev != NULL);
+   *prev = lv->next;
+
+   n = VG_(sizeXA)( lv->cus );
+   for (i = 0; i < n; i++) {
+      LazyCU* cu = VG_(indexXA)( lv->cus, i );
+      if (cu->resident)
+         free_lazy_CU( lv, i );
+   }
+   deselect_lazy_CU( lv );
+   VG_(deleteXA)( lv->cus );
+   VG_(deleteXA)( lv->code );
+   if (lv->globals)
+      VG_(deleteXA)( lv->globals );
+   ML_(dinfo_free)( lv );
+   di->lazy_vars = NULL;
+}
+
+void ML_(lazy_varinfo_select_code) ( struct _DebugInfo* di, Addr ip )
+{
+   struct _DebugInfoLazyVars* lv = di->lazy_vars;
+   Word ix = find_LazyCURange( lv->code, ip );
+   if (ix >= 0) {
+      LazyCURange* r = VG_(indexXA)( lv->code, ix );
+      if (ip <= r->aMax) {
+         select_lazy_CU( lv, r->cuIx );
+         return;
+      }
+   }
+   select_lazy_CU( lv, -1 );
+}
+
+Bool ML_(lazy_varinfo_select_global) ( struct _DebugInfo* di,
+                                       Addr data_addr, Word nth )
+{
+   struct _DebugInfoLazyVars* lv = di->lazy_vars;
+   LazyCURange* r;
+   Word ix;
+
+   if (lv->globals == NULL) {
+      lv->globals = VG_(newXA)( ML_(dinfo_zalloc), "di.readdwarf3.lvsg.1",
+                                ML_(dinfo_free), sizeof(LazyCURange) );
+      /* If this fails part way, what has been found so far is still
+         good. */
+      (void)index_lazy_CUs( lv, True/*globals*/ );
+      TRACE_SYMTAB("lazy variable info: %ld fixed-address variables\n",
+                   VG_(sizeXA)( lv->globals ));
+   }
+
+   /* Variables don't overlap, so only the one(s) at the highest
+      address not above data_addr can contain it.  There can be more
+      than one: the same variable may be defined in several CUs. */
+   ix = find_LazyCURange( lv->globals, data_addr );
+   if (ix < 0 || ix - nth < 0)
+      return False;
+   r = VG_(indexXA)( lv->globals, ix - nth );
+   if (r->aMin != ((LazyCURange*)VG_(indexXA)( lv->globals, ix ))->aMin)
+      return False;
+   select_lazy_CU( lv, r->cuIx );
+   return True;
+}
+
+Word ML_(lazy_varinfo_n_cus) ( struct _DebugInfo* di )
+{
+   return VG_(sizeXA)( di->lazy_vars->cus );
+}
+
+void ML_(lazy_varinfo_select_cu) ( struct _DebugInfo* di, Word cuIx )
+{
+   vg_assert(cuIx >= 0 && cuIx < VG_(sizeXA)( di->lazy_vars->cus ));
+   select_lazy_CU( di->lazy_vars, cuIx );
+}
 
 /* --- Unused code fragments which might be useful one day. --- */
 
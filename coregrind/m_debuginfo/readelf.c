@@ -52,11 +52,21 @@
 #include "priv_readdwarf.h"        /* 'cos ELF contains DWARF */
 #include "priv_readdwarf3.h"
 #include "priv_readstabs.h"        /* and stabs, if we're unlucky */
+#include "priv_dicache.h"
+#include "priv_inflate.h"
 
 /* --- !!! --- EXTERNAL HEADERS start --- !!! --- */
 #include <elf.h>
 /* --- !!! --- EXTERNAL HEADERS end --- !!! --- */
 
+/* Older <elf.h>s know nothing of compressed sections. */
+#ifndef SHF_COMPRESSED
+#  define SHF_COMPRESSED    (1 << 11)
+#endif
+#ifndef ELFCOMPRESS_ZLIB
+#  define ELFCOMPRESS_ZLIB  1
+#endif
+
 /*------------------------------------------------------------*/
 /*--- 32/64-bit parameterisation                           ---*/
 /*------------------------------------------------------------*/
@@ -1189,6 +1199,9 @@ Bool find_ad_hoc_debug_image( struct _DebugInfo* di,
    if (VG_(clo_verbosity) > 1)
       VG_(dmsg)("  Using debuginfo from %s\n", nm);
 
+   /* Nothing ties it to the object, so it mustn't be cached. */
+   ML_(dicache_note_source)(di, nm, DIC_SRC_UNCHECKED, True);
+
    ML_(dinfo_free)(nm);
    return True;
 
@@ -1200,22 +1213,18 @@ Bool find_ad_hoc_debug_image( struct _DebugInfo* di,
 }
 
 
-/* Try to find a separate debug file for a given object file.  If
-   found, it will be mapped in and the address and size returned in
-   *dimage and *n_dimage.  If not, *dimage and *n_dimage will be
-   unchanged.  The caller should set them to zero before the call. */
+/* The places, in order, where find_debug_file looks for a separate
+   debug file for objpath: by build-id, then (unless rel_ok, which is
+   only set when looking for a dwz alternate file) by debuglink name.
+   Returns an XArray of HChar*, which free_debug_file_candidates
+   frees. */
 static
-void find_debug_file( struct _DebugInfo* di,
-                      Char* objpath, Char* buildid,
-                      Char* debugname, UInt crc, Bool rel_ok,
-                      /*OUT*/Addr*  dimage,
-                      /*OUT*/SizeT* n_dimage )
+XArray* debug_file_candidates( Char* objpath, Char* buildid,
+                               Char* debugname, Bool rel_ok )
 {
-   Char* debugpath = NULL;
-   Addr  addr = 0;
-   UWord size = 0;
-
-   vg_assert(*dimage == 0 && *n_dimage == 0);
+   XArray* cands = VG_(newXA)(ML_(dinfo_zalloc), "di.dfc.1",
+                              ML_(dinfo_free), sizeof(HChar*));
+   HChar*  debugpath;
 
    if (buildid != NULL) {
       debugpath = ML_(dinfo_zalloc)(
@@ -1224,38 +1233,79 @@ void find_debug_file( struct _DebugInfo* di,
 
       VG_(sprintf)(debugpath, "/usr/lib/debug/.build-id/%c%c/%s.debug",
                    buildid[0], buildid[1], buildid + 2);
-
-      if ((addr = open_debug_file(debugpath, buildid, 0,
-                                  rel_ok, &size)) == 0) {
-         ML_(dinfo_free)(debugpath);
-         debugpath = NULL;
-      }
+      VG_(addToXA)(cands, &debugpath);
    }
 
-   if (addr == 0 && debugname != NULL && !rel_ok) {
+   if (debugname != NULL && !rel_ok) {
       Char *objdir = ML_(dinfo_strdup)("di.fdf.2", objpath);
       Char *objdirptr;
+      Int  i;
 
       if ((objdirptr = VG_(strrchr)(objdir, '/')) != NULL)
          *objdirptr = '\0';
 
-      debugpath = ML_(dinfo_zalloc)(
-                     "di.fdf.3",
-                     VG_(strlen)(objdir) + VG_(strlen)(debugname) + 32);
-
-      VG_(sprintf)(debugpath, "%s/%s", objdir, debugname);
-
-      if ((addr = open_debug_file(debugpath, NULL, crc, rel_ok, &size)) == 0) {
-         VG_(sprintf)(debugpath, "%s/.debug/%s", objdir, debugname);
-         if ((addr = open_debug_file(debugpath, NULL, crc, rel_ok, &size)) == 0) {
-            VG_(sprintf)(debugpath, "/usr/lib/debug%s/%s", objdir, debugname);
-            addr = open_debug_file(debugpath, NULL, crc, rel_ok, &size);
+      for (i = 0; i < 3; i++) {
+         debugpath = ML_(dinfo_zalloc)(
+                        "di.fdf.3",
+                        VG_(strlen)(objdir) + VG_(strlen)(debugname) + 32);
+         switch (i) {
+            case 0: VG_(sprintf)(debugpath, "%s/%s", objdir, debugname);
+                    break;
+            case 1: VG_(sprintf)(debugpath, "%s/.debug/%s",
+                                 objdir, debugname);
+                    break;
+            case 2: VG_(sprintf)(debugpath, "/usr/lib/debug%s/%s",
+                                 objdir, debugname);
+                    break;
          }
+         VG_(addToXA)(cands, &debugpath);
       }
 
       ML_(dinfo_free)(objdir);
    }
 
+   return cands;
+}
+
+static void free_debug_file_candidates ( XArray* cands )
+{
+   Word i;
+   for (i = 0; i < VG_(sizeXA)(cands); i++)
+      ML_(dinfo_free)(*(HChar**)VG_(indexXA)(cands, i));
+   VG_(deleteXA)(cands);
+}
+
+/* Try to find a separate debug file for a given object file.  If
+   found, it will be mapped in and the address and size returned in
+   *dimage and *n_dimage.  If not, *dimage and *n_dimage will be
+   unchanged.  The caller should set them to zero before the call. */
+static
+void find_debug_file( struct _DebugInfo* di,
+                      Char* objpath, Char* buildid,
+                      Char* debugname, UInt crc, Bool rel_ok,
+                      /*OUT*/Addr*  dimage,
+                      /*OUT*/SizeT* n_dimage )
+{
+   XArray* cands;
+   Char*   debugpath = NULL;
+   Addr    addr = 0;
+   UWord   size = 0;
+   Word    i;
+
+   vg_assert(*dimage == 0 && *n_dimage == 0);
+
+   cands = debug_file_candidates(objpath, buildid, debugname, rel_ok);
+   for (i = 0; addr == 0 && i < VG_(sizeXA)(cands); i++) {
+      debugpath = *(Char**)VG_(indexXA)(cands, i);
+      /* The first is the build-id one, if there is a build-id. */
+      addr = open_debug_file(debugpath,
+                             buildid != NULL && i == 0 ? buildid : NULL,
+                             crc, rel_ok, &size);
+      ML_(dicache_note_source)(di, debugpath,
+                               rel_ok ? DIC_SRC_ALT : DIC_SRC_DEBUG,
+                               addr > 0 && size > 0);
+   }
+
    if (addr > 0 && size > 0) {
       TRACE_SYMTAB("\n");
       TRACE_SYMTAB("------ Found a debuginfo file: %s\n", debugpath);
@@ -1263,7 +1313,7 @@ void find_debug_file( struct _DebugInfo* di,
       *n_dimage = size;
    }
 
-   ML_(dinfo_free)(debugpath);
+   free_debug_file_candidates(cands);
 }
 
 
@@ -1310,6 +1360,425 @@ Word file_offset_from_svma ( /*OUT*/Bool* ok,
 }
 
 
+/* Compressed debug sections.  A .debug_* section may be stored
+   compressed, either as a .zdebug_* section holding "ZLIB", the
+   uncompressed size as a big-endian 8-byte number and then a zlib
+   stream, or as an SHF_COMPRESSED section holding an ElfXX_Chdr and
+   then the stream.  When such a section is found, it is noted here,
+   and the section pointer and size are those of the compressed
+   contents.  Just before the section is read, it is inflated into
+   the dinfo arena and the pointer and size are replaced by those of
+   the inflated copy. */
+#define N_ZSECTS 24
+
+typedef
+   struct {
+      UChar* img;        /* compressed contents, in an image */
+      SizeT  sz;
+      Bool   zdebug;     /* .zdebug_* rather than SHF_COMPRESSED */
+      UChar* inflated;   /* or NULL if not inflated (yet) */
+   }
+   ZSect;
+
+typedef
+   struct {
+      UInt  n_zsects;
+      ZSect zsects[N_ZSECTS];
+   }
+   ZSects;
+
+/* Is 'name' that of the section 'want', or of its compressed
+   .zdebug_* twin? */
+static Bool section_name_is ( const UChar* want, const UChar* name )
+{
+   if (0 == VG_(strcmp)(want, name))
+      return True;
+   return 0 == VG_(strncmp)(want, ".debug_", 7)
+          && 0 == VG_(strncmp)(name, ".zdebug_", 8)
+          && 0 == VG_(strcmp)(want + 7, name + 8);
+}
+
+/* Note the section with header 'shdr', called 'name' and found at
+   'img', if it is compressed.  Returns False if it is compressed but
+   there is no room to note it, in which case the caller must ignore
+   the section. */
+static Bool note_if_compressed ( struct _DebugInfo* di, ZSects* zs,
+                                 ElfXX_Shdr* shdr,
+                                 const UChar* name, UChar* img )
+{
+   UInt   i;
+   ZSect* z;
+   Bool   zdebug = 0 == VG_(strncmp)(name, ".zdebug_", 8);
+   if (!zdebug && (shdr->sh_flags & SHF_COMPRESSED) == 0)
+      return True;
+   if (shdr->sh_type == SHT_NOBITS || shdr->sh_size == 0)
+      return True;
+   for (i = 0; i < zs->n_zsects; i++) {
+      if (zs->zsects[i].img == img)
+         return True;   /* already noted */
+   }
+   if (zs->n_zsects == N_ZSECTS) {
+      ML_(symerr)(di, True, "Too many compressed debug sections; "
+                            "ignoring the rest");
+      return False;
+   }
+   z = &zs->zsects[zs->n_zsects++];
+   z->img      = img;
+   z->sz       = shdr->sh_size;
+   z->zdebug   = zdebug;
+   z->inflated = NULL;
+   return True;
+}
+
+/* If the section at *img is one of those in 'zs', inflate it and
+   point *img and *sz at the result.  If that can't be done, complain
+   and set them to NULL and zero, so that the section is ignored. */
+static void inflate_section ( struct _DebugInfo* di, ZSects* zs,
+                              UChar** img, SizeT* sz )
+{
+   UInt   i;
+   ZSect* z = NULL;
+   UChar* data;
+   SizeT  data_sz;
+   ULong  size;
+
+   if (*img == NULL)
+      return;
+   for (i = 0; i < zs->n_zsects; i++) {
+      if (zs->zsects[i].img == *img) {
+         z = &zs->zsects[i];
+         break;
+      }
+   }
+   if (z == NULL)
+      return;   /* not compressed */
+
+   if (z->inflated == NULL) {
+      if (z->zdebug) {
+         if (z->sz < 12 || 0 != VG_(memcmp)(z->img, "ZLIB", 4))
+            goto bad;
+         size = 0;
+         for (i = 4; i < 12; i++)
+            size = (size << 8) | z->img[i];
+         data    = z->img + 12;
+         data_sz = z->sz - 12;
+      } else {
+         /* The section may not be aligned in the image, so copy
+            the header out. */
+         ElfXX_Word ch_type;
+#        if VG_WORDSIZE == 8
+         /* Elf64_Chdr: ch_type, ch_reserved, ch_size, ch_addralign */
+         if (z->sz < 24)
+            goto bad;
+         VG_(memcpy)(&ch_type, z->img,     sizeof(ch_type));
+         VG_(memcpy)(&size,    z->img + 8, sizeof(size));
+         data    = z->img + 24;
+         data_sz = z->sz - 24;
+#        else
+         /* Elf32_Chdr: ch_type, ch_size, ch_addralign */
+         UInt size32;
+         if (z->sz < 12)
+            goto bad;
+         VG_(memcpy)(&ch_type, z->img,     sizeof(ch_type));
+         VG_(memcpy)(&size32,  z->img + 4, sizeof(size32));
+         size    = size32;
+         data    = z->img + 12;
+         data_sz = z->sz - 12;
+#        endif
+         if (ch_type != ELFCOMPRESS_ZLIB)
+            goto bad;
+      }
+      if (size == 0 || size != (ULong)(SizeT)size)
+         goto bad;
+      /* The size comes from the object, so don't believe it if the
+         data couldn't possibly inflate to that much (DEFLATE can't
+         do better than 1032:1): allocating it could run Valgrind out
+         of memory. */
+      if (size > (ULong)data_sz * 1032) {
+         ML_(symerr)(di, True, "Compressed debug section claims an "
+                               "impossible size; ignoring it");
+         goto ignore;
+      }
+      /* ML_(inflate_zlib) writes all of it, or fails. */
+      z->inflated = ML_(dinfo_malloc)("di.readelf.inflate", (SizeT)size);
+      if (!ML_(inflate_zlib)(z->inflated, (SizeT)size, data, data_sz)) {
+         ML_(dinfo_free)(z->inflated);
+         z->inflated = NULL;
+         goto bad;
+      }
+      TRACE_SYMTAB("inflated section at %p: %lu -> %llu bytes\n",
+                   z->img, z->sz, size);
+      z->sz = (SizeT)size;
+   }
+   *img = z->inflated;
+   *sz  = z->sz;
+   return;
+
+  bad:
+   ML_(symerr)(di, True, "Can't decompress compressed debug section");
+  ignore:
+   z->img = NULL;
+   *img   = NULL;
+   *sz    = 0;
+}
+
+/* Free whatever inflate_section allocated for 'zs'. */
+static void free_inflated_sections ( ZSects* zs )
+{
+   UInt i;
+   for (i = 0; i < zs->n_zsects; i++) {
+      if (zs->zsects[i].inflated) {
+         ML_(dinfo_free)(zs->zsects[i].inflated);
+         zs->zsects[i].inflated = NULL;
+      }
+   }
+   zs->n_zsects = 0;
+}
+
+
+/* The sections which are read after the symbol tables: call frame
+   info, stabs and DWARF.  The section pointers point into the
+   transiently mapped images of the object and its debuginfo files,
+   which are noted here too so they can be unmapped afterwards.  With
+   --read-debuginfo=lazy a copy of this is hung off the DebugInfo
+   (as .deferred) until the sections are first needed, and with
+   --read-var-info=lazy (as .kept_sections) for as long as the object
+   is mapped. */
+typedef
+   struct _DebugInfoDeferred {
+      Addr   oimage;
+      UWord  n_oimage;
+      Addr   dimage;
+      UWord  n_dimage;
+      Addr   aimage;
+      UWord  n_aimage;
+      UChar* ehframe_img[N_EHFRAME_SECTS];
+      SizeT  ehframe_sz[N_EHFRAME_SECTS];
+      UChar* debug_frame_img;
+      SizeT  debug_frame_sz;
+      UChar* stab_img;
+      SizeT  stab_sz;
+      UChar* stabstr_img;
+      SizeT  stabstr_sz;
+      UChar* debug_info_img;
+      SizeT  debug_info_sz;
+      UChar* debug_types_img;
+      SizeT  debug_types_sz;
+      UChar* debug_abbv_img;
+      SizeT  debug_abbv_sz;
+      UChar* debug_line_img;
+      SizeT  debug_line_sz;
+      UChar* debug_str_img;
+      SizeT  debug_str_sz;
+      UChar* debug_ranges_img;
+      SizeT  debug_ranges_sz;
+      UChar* debug_loc_img;
+      SizeT  debug_loc_sz;
+      UChar* debug_info_alt_img;
+      SizeT  debug_info_alt_sz;
+      UChar* debug_abbv_alt_img;
+      SizeT  debug_abbv_alt_sz;
+      UChar* debug_line_alt_img;
+      SizeT  debug_line_alt_sz;
+      UChar* debug_str_alt_img;
+      SizeT  debug_str_alt_sz;
+      UChar* dwarf1d_img;
+      SizeT  dwarf1d_sz;
+      UChar* dwarf1l_img;
+      SizeT  dwarf1l_sz;
+      ZSects zsects;     /* which of the above are compressed */
+   }
+   DebugSections;
+
+/* Read the call frame info and debug info described by 'ds' into
+   'di'.  Returns True if the variable info is to be read later, in
+   which case the images must be kept mapped. */
+static Bool read_debug_sections ( struct _DebugInfo* di,
+                                  DebugSections* ds )
+{
+   Word i;
+   Bool keep = False;
+
+   /* Inflate any compressed sections first.  .eh_frame is loaded, so
+      it never is. */
+#  define INFLATE(_sec) \
+      inflate_section( di, &ds->zsects, &ds->_sec##_img, &ds->_sec##_sz )
+   INFLATE(debug_frame);
+   INFLATE(debug_info);
+   INFLATE(debug_types);
+   INFLATE(debug_abbv);
+   INFLATE(debug_line);
+   INFLATE(debug_str);
+   INFLATE(debug_ranges);
+   INFLATE(debug_loc);
+   INFLATE(debug_info_alt);
+   INFLATE(debug_abbv_alt);
+   INFLATE(debug_line_alt);
+   INFLATE(debug_str_alt);
+#  undef INFLATE
+
+   /* Read .eh_frame and .debug_frame (call-frame-info) if any.  Do
+      the .eh_frame section(s) first. */
+   vg_assert(di->n_ehframe >= 0 && di->n_ehframe <= N_EHFRAME_SECTS);
+   for (i = 0; i < di->n_ehframe; i++) {
+      /* see Comment_on_EH_FRAME_MULTIPLE_INSTANCES above for why
+         this next assertion should hold. */
+      vg_assert(ds->ehframe_sz[i] == di->ehframe_size[i]);
+      ML_(read_callframe_info_dwarf3)( di,
+                                       ds->ehframe_img[i],
+                                       ds->ehframe_sz[i],
+                                       di->ehframe_avma[i],
+                                       True/*is_ehframe*/ );
+   }
+   if (ds->debug_frame_sz) {
+      ML_(read_callframe_info_dwarf3)( di,
+                                       ds->debug_frame_img,
+                                       ds->debug_frame_sz,
+                                       0/*assume zero avma*/,
+                                       False/*!is_ehframe*/ );
+   }
+
+   /* Read the stabs and/or dwarf2 debug information, if any.  It
+      appears reading stabs stuff on amd64-linux doesn't work, so
+      we ignore it.  On s390x stabs also doesnt work and we always
+      have the dwarf info in the eh_frame.  We also segfault on
+      ppc64-linux when reading stabs, so skip that.  ppc32-linux
+      seems OK though.  Also skip on Android. */
+#  if !defined(VGP_amd64_linux) \
+      && !defined(VGP_s390x_linux) \
+      && !defined(VGP_ppc64_linux) \
+      && !defined(VGPV_arm_linux_android) \
+      && !defined(VGPV_x86_linux_android)
+   if (ds->stab_img && ds->stabstr_img) {
+      ML_(read_debuginfo_stabs) ( di, ds->stab_img, ds->stab_sz, 
+                                      ds->stabstr_img, ds->stabstr_sz );
+   }
+#  endif
+   /* jrs 2006-01-01: icc-8.1 has been observed to generate
+      binaries without debug_str sections.  Don't preclude
+      debuginfo reading for that reason, but, in
+      read_unitinfo_dwarf2, do check that debugstr is non-NULL
+      before using it. */
+   if (ds->debug_info_img && ds->debug_abbv_img && ds->debug_line_img
+                                             /* && ds->debug_str_img */) {
+
+      /* The old reader: line numbers and unwind info only */
+      ML_(read_debuginfo_dwarf3) ( di,
+                                   ds->debug_info_img, ds->debug_info_sz,
+                                   ds->debug_types_img, ds->debug_types_sz,
+                                   ds->debug_abbv_img, ds->debug_abbv_sz,
+                                   ds->debug_line_img, ds->debug_line_sz,
+                                   ds->debug_str_img,  ds->debug_str_sz,
+                                   ds->debug_str_alt_img,
+                                   ds->debug_str_alt_sz );
+
+      /* The new reader: read the DIEs in .debug_info to acquire
+         information on variable types and locations.  But only if
+         the tool asks for it, or the user requests it on the
+         command line.  With --read-var-info=lazy, just index the
+         CUs, and read each one when it is needed. */
+      if ((VG_(needs).var_info /* the tool requires it */
+           || VG_(clo_read_var_info) /* the user asked for it */)
+          && VG_(clo_lazy_var_info)) {
+         keep = ML_(new_dwarf3_lazy_reader)(
+            di, ds->debug_info_img,   ds->debug_info_sz,
+                ds->debug_types_img,   ds->debug_types_sz,
+                ds->debug_abbv_img,   ds->debug_abbv_sz,
+                ds->debug_line_img,   ds->debug_line_sz,
+                ds->debug_str_img,    ds->debug_str_sz,
+                ds->debug_ranges_img, ds->debug_ranges_sz,
+                ds->debug_loc_img,    ds->debug_loc_sz,
+                ds->debug_info_alt_img, ds->debug_info_alt_sz,
+                ds->debug_abbv_alt_img, ds->debug_abbv_alt_sz,
+                ds->debug_line_alt_img, ds->debug_line_alt_sz,
+                ds->debug_str_alt_img,  ds->debug_str_alt_sz
+         );
+      }
+      if ((VG_(needs).var_info /* the tool requires it */
+           || VG_(clo_read_var_info) /* the user asked for it */)
+          && !keep) {
+         ML_(new_dwarf3_reader)(
+            di, ds->debug_info_img,   ds->debug_info_sz,
+                ds->debug_types_img,   ds->debug_types_sz,
+                ds->debug_abbv_img,   ds->debug_abbv_sz,
+                ds->debug_line_img,   ds->debug_line_sz,
+                ds->debug_str_img,    ds->debug_str_sz,
+                ds->debug_ranges_img, ds->debug_ranges_sz,
+                ds->debug_loc_img,    ds->debug_loc_sz,
+                ds->debug_info_alt_img, ds->debug_info_alt_sz,
+                ds->debug_abbv_alt_img, ds->debug_abbv_alt_sz,
+                ds->debug_line_alt_img, ds->debug_line_alt_sz,
+                ds->debug_str_alt_img,  ds->debug_str_alt_sz
+         );
+      }
+   }
+   if (ds->dwarf1d_img && ds->dwarf1l_img) {
+      ML_(read_debuginfo_dwarf1) ( di, ds->dwarf1d_img, ds->dwarf1d_sz, 
+                                       ds->dwarf1l_img, ds->dwarf1l_sz );
+   }
+   /* Unless the readers are going to come back for more, the
+      inflated sections are no longer needed. */
+   if (!keep)
+      free_inflated_sections( &ds->zsects );
+   return keep;
+}
+
+/* Unmap the images that 'ds' refers to. */
+static void unmap_debug_images ( DebugSections* ds )
+{
+   SysRes m_res;
+   free_inflated_sections( &ds->zsects );
+   if (ds->aimage) {
+      m_res = VG_(am_munmap_valgrind) ( ds->aimage, ds->n_aimage );
+      vg_assert(!sr_isError(m_res));
+   }
+   if (ds->dimage) {
+      m_res = VG_(am_munmap_valgrind) ( ds->dimage, ds->n_dimage );
+      vg_assert(!sr_isError(m_res));
+   }
+   m_res = VG_(am_munmap_valgrind) ( ds->oimage, ds->n_oimage );
+   vg_assert(!sr_isError(m_res));
+}
+
+void ML_(read_elf_deferred_debug_info) ( struct _DebugInfo* di )
+{
+   DebugSections* ds = di->deferred;
+
+   vg_assert(ds);
+   vg_assert(di->have_dinfo);
+   /* Clear this first, so that nothing below can get back here. */
+   di->deferred = NULL;
+
+   if (VG_(clo_verbosity) > 1 || VG_(clo_trace_redir))
+      VG_(message)(Vg_DebugMsg, "Reading debug info from %s\n",
+                                di->fsm.filename );
+   if (read_debug_sections( di, ds )) {
+      di->kept_sections = ds;
+   } else {
+      unmap_debug_images( ds );
+      ML_(dinfo_free)( ds );
+   }
+}
+
+void ML_(discard_elf_deferred_debug_info) ( struct _DebugInfo* di )
+{
+   if (di->deferred == NULL)
+      return;
+   unmap_debug_images( di->deferred );
+   ML_(dinfo_free)( di->deferred );
+   di->deferred = NULL;
+}
+
+void ML_(unmap_elf_kept_sections) ( struct _DebugInfo* di )
+{
+   if (di->kept_sections == NULL)
+      return;
+   unmap_debug_images( di->kept_sections );
+   ML_(dinfo_free)( di->kept_sections );
+   di->kept_sections = NULL;
+}
+
+
 /* The central function for reading ELF debug info.  For the
    object/exe specified by the DebugInfo, find ELF sections, then read
    the symbols, line number info, file name info, CFA (stack-unwind
@@ -1389,6 +1858,7 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
    vg_assert(!di->cfsi_exprs);
    vg_assert(!di->strchunks);
    vg_assert(!di->soname);
+   vg_assert(!di->deferred);
 
    {
       Bool has_nonempty_rx = False;
@@ -2183,6 +2653,10 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
       SizeT      opd_sz_unused   = 0;
       SizeT      ehframe_sz[N_EHFRAME_SECTS];
 
+      /* Which of the debug sections found are compressed. */
+      ZSects     zsects;
+      VG_(memset)(&zsects, 0, sizeof(zsects));
+
       for (i = 0; i < N_EHFRAME_SECTS; i++) {
          ehframe_img[i] = NULL;
          ehframe_sz[i]  = 0;
@@ -2211,11 +2685,17 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
 #        define FINDX(_sec_name, _sec_size, _sec_img, _post_fx)     \
          do { ElfXX_Shdr* shdr \
                  = INDEX_BIS( shdr_img, i, shdr_ent_szB ); \
-            if (0 == VG_(strcmp)(_sec_name, shdr_strtab_img \
-                                            + shdr->sh_name)) { \
+            if (section_name_is(_sec_name, shdr_strtab_img \
+                                           + shdr->sh_name)) { \
                Bool nobits; \
                _sec_img  = (void*)(oimage + shdr->sh_offset); \
                _sec_size = shdr->sh_size; \
+               if (!note_if_compressed(di, &zsects, shdr, \
+                                       shdr_strtab_img + shdr->sh_name, \
+                                       (UChar*)_sec_img)) { \
+                  _sec_img  = NULL; \
+                  _sec_size = 0; \
+               } \
                nobits    = shdr->sh_type == SHT_NOBITS; \
                TRACE_SYMTAB( "%18s:  img %p .. %p\n", \
                              _sec_name, (UChar*)_sec_img, \
@@ -2290,6 +2770,22 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
       /* Look for a build-id */
       buildid = find_buildid(oimage, n_oimage, False);
 
+      /* If the tables for this build-id were cached by an earlier
+         run, use them and skip the rest.  The cache doesn't hold
+         variable info, so it's no use if that is wanted. */
+      if (buildid != NULL && VG_(clo_debuginfo_cache_dir) != NULL
+          && !(VG_(needs).var_info || VG_(clo_read_var_info))) {
+         XArray* cands = debug_file_candidates( di->fsm.filename, buildid,
+                                                debuglink_img, False );
+         Bool    loaded = ML_(dicache_load)(di, buildid, cands);
+         free_debug_file_candidates(cands);
+         if (loaded) {
+            di->buildid = buildid;
+            res = True;
+            goto out;
+         }
+      }
+
       /* Look for a debug image */
       if (buildid != NULL || debuglink_img != NULL) {
          /* Do have a debuglink section? */
@@ -2312,10 +2808,9 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
          }
       }
 
-      if (buildid) {
-         ML_(dinfo_free)(buildid);
-         buildid = NULL; /* paranoia */
-      }
+      /* Keep the build-id; the DebugInfo owns it from now on. */
+      di->buildid = buildid;
+      buildid = NULL; /* paranoia */
 
       /* Still no luck?  Let's have one last roll of the dice. */
       if (dimage == 0) {
@@ -2472,13 +2967,23 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
             do { ElfXX_Shdr* shdr \
                     = INDEX_BIS( shdr_dimg, i, shdr_dent_szB ); \
                if (condition \
-                   && 0 == VG_(strcmp)(sec_name, \
-                                       shdr_strtab_dimg + shdr->sh_name)) { \
+                   && section_name_is(sec_name, \
+                                      shdr_strtab_dimg + shdr->sh_name)) { \
                   Bool nobits; \
-                  if (0 != sec_img) \
-                     VG_(core_panic)("repeated section!\n"); \
+                  /* Eg. both .debug_info and .zdebug_info. */ \
+                  if (0 != sec_img) { \
+                     ML_(symerr)(di, False, \
+                                 "   repeated section, ignored"); \
+                     break; \
+                  } \
                   sec_img  = (void*)(dimage + shdr->sh_offset); \
                   sec_size = shdr->sh_size; \
+                  if (!note_if_compressed(di, &zsects, shdr, \
+                                          shdr_strtab_dimg + shdr->sh_name, \
+                                          (UChar*)sec_img)) { \
+                     sec_img  = NULL; \
+                     sec_size = 0; \
+                  } \
                   nobits   = shdr->sh_type == SHT_NOBITS; \
                   TRACE_SYMTAB( "%18s: dimg %p .. %p\n", \
                                 sec_name, \
@@ -2589,12 +3094,22 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
 #           define FIND(sec_name, sec_size, sec_img) \
             do { ElfXX_Shdr* shdr \
                     = INDEX_BIS( shdr_aimg, i, shdr_dent_szB ); \
-               if (0 == VG_(strcmp)(sec_name, \
-                                    shdr_strtab_aimg + shdr->sh_name)) { \
-                  if (0 != sec_img) \
-                     VG_(core_panic)("repeated section!\n"); \
+               if (section_name_is(sec_name, \
+                                   shdr_strtab_aimg + shdr->sh_name)) { \
+                  /* Eg. both .debug_info and .zdebug_info. */ \
+                  if (0 != sec_img) { \
+                     ML_(symerr)(di, False, \
+                                 "   repeated section, ignored"); \
+                     break; \
+                  } \
                   sec_img  = (void*)(aimage + shdr->sh_offset); \
                   sec_size = shdr->sh_size; \
+                  if (!note_if_compressed(di, &zsects, shdr, \
+                                          shdr_strtab_aimg + shdr->sh_name, \
+                                          (UChar*)sec_img)) { \
+                     sec_img  = NULL; \
+                     sec_size = 0; \
+                  } \
                   TRACE_SYMTAB( "%18s: aimg %p .. %p\n", \
                                 sec_name, \
                                 (UChar*)sec_img, \
@@ -2644,83 +3159,69 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
       } /* Read symbols */
 
       /* TOPLEVEL */
-      /* Read .eh_frame and .debug_frame (call-frame-info) if any.  Do
-         the .eh_frame section(s) first. */
-      vg_assert(di->n_ehframe >= 0 && di->n_ehframe <= N_EHFRAME_SECTS);
-      for (i = 0; i < di->n_ehframe; i++) {
-         /* see Comment_on_EH_FRAME_MULTIPLE_INSTANCES above for why
-            this next assertion should hold. */
-         vg_assert(ehframe_sz[i] == di->ehframe_size[i]);
-         ML_(read_callframe_info_dwarf3)( di,
-                                          ehframe_img[i],
-                                          ehframe_sz[i],
-                                          di->ehframe_avma[i],
-                                          True/*is_ehframe*/ );
-      }
-      if (debug_frame_sz) {
-         ML_(read_callframe_info_dwarf3)( di,
-                                          debug_frame_img, debug_frame_sz,
-                                          0/*assume zero avma*/,
-                                          False/*!is_ehframe*/ );
-      }
-
-      /* Read the stabs and/or dwarf2 debug information, if any.  It
-         appears reading stabs stuff on amd64-linux doesn't work, so
-         we ignore it.  On s390x stabs also doesnt work and we always
-         have the dwarf info in the eh_frame.  We also segfault on
-         ppc64-linux when reading stabs, so skip that.  ppc32-linux
-         seems OK though.  Also skip on Android. */
-#     if !defined(VGP_amd64_linux) \
-         && !defined(VGP_s390x_linux) \
-         && !defined(VGP_ppc64_linux) \
-         && !defined(VGPV_arm_linux_android) \
-         && !defined(VGPV_x86_linux_android)
-      if (stab_img && stabstr_img) {
-         ML_(read_debuginfo_stabs) ( di, stab_img, stab_sz, 
-                                         stabstr_img, stabstr_sz );
-      }
-#     endif
-      /* jrs 2006-01-01: icc-8.1 has been observed to generate
-         binaries without debug_str sections.  Don't preclude
-         debuginfo reading for that reason, but, in
-         read_unitinfo_dwarf2, do check that debugstr is non-NULL
-         before using it. */
-      if (debug_info_img && debug_abbv_img && debug_line_img
-                                           /* && debug_str_img */) {
-
-         /* The old reader: line numbers and unwind info only */
-         ML_(read_debuginfo_dwarf3) ( di,
-                                      debug_info_img, debug_info_sz,
-                                      debug_types_img, debug_types_sz,
-                                      debug_abbv_img, debug_abbv_sz,
-                                      debug_line_img, debug_line_sz,
-                                      debug_str_img,  debug_str_sz,
-                                      debug_str_alt_img, debug_str_alt_sz );
-
-         /* The new reader: read the DIEs in .debug_info to acquire
-            information on variable types and locations.  But only if
-            the tool asks for it, or the user requests it on the
-            command line. */
-         if (VG_(needs).var_info /* the tool requires it */
-             || VG_(clo_read_var_info) /* the user asked for it */) {
-            ML_(new_dwarf3_reader)(
-               di, debug_info_img,   debug_info_sz,
-                   debug_types_img,   debug_types_sz,
-                   debug_abbv_img,   debug_abbv_sz,
-                   debug_line_img,   debug_line_sz,
-                   debug_str_img,    debug_str_sz,
-                   debug_ranges_img, debug_ranges_sz,
-                   debug_loc_img,    debug_loc_sz,
-                   debug_info_alt_img, debug_info_alt_sz,
-                   debug_abbv_alt_img, debug_abbv_alt_sz,
-                   debug_line_alt_img, debug_line_alt_sz,
-                   debug_str_alt_img,  debug_str_alt_sz
-            );
+      /* Now the call frame info and the debug info proper.  Read them
+         right away, or with --read-debuginfo=lazy, keep the images
+         and leave a note of where the sections are, for
+         ML_(read_elf_deferred_debug_info) to read them when they are
+         first needed. */
+      {
+         DebugSections ds;
+         VG_(memset)(&ds, 0, sizeof(ds));
+         ds.oimage   = oimage;
+         ds.n_oimage = n_oimage;
+         ds.dimage   = dimage;
+         ds.n_dimage = n_dimage;
+         ds.aimage   = aimage;
+         ds.n_aimage = n_aimage;
+         for (i = 0; i < N_EHFRAME_SECTS; i++) {
+            ds.ehframe_img[i] = ehframe_img[i];
+            ds.ehframe_sz[i]  = ehframe_sz[i];
+         }
+         ds.debug_frame_img    = debug_frame_img;
+         ds.debug_frame_sz     = debug_frame_sz;
+         ds.stab_img           = stab_img;
+         ds.stab_sz            = stab_sz;
+         ds.stabstr_img        = stabstr_img;
+         ds.stabstr_sz         = stabstr_sz;
+         ds.debug_info_img     = debug_info_img;
+         ds.debug_info_sz      = debug_info_sz;
+         ds.debug_types_img    = debug_types_img;
+         ds.debug_types_sz     = debug_types_sz;
+         ds.debug_abbv_img     = debug_abbv_img;
+         ds.debug_abbv_sz      = debug_abbv_sz;
+         ds.debug_line_img     = debug_line_img;
+         ds.debug_line_sz      = debug_line_sz;
+         ds.debug_str_img      = debug_str_img;
+         ds.debug_str_sz       = debug_str_sz;
+         ds.debug_ranges_img   = debug_ranges_img;
+         ds.debug_ranges_sz    = debug_ranges_sz;
+         ds.debug_loc_img      = debug_loc_img;
+         ds.debug_loc_sz       = debug_loc_sz;
+         ds.debug_info_alt_img = debug_info_alt_img;
+         ds.debug_info_alt_sz  = debug_info_alt_sz;
+         ds.debug_abbv_alt_img = debug_abbv_alt_img;
+         ds.debug_abbv_alt_sz  = debug_abbv_alt_sz;
+         ds.debug_line_alt_img = debug_line_alt_img;
+         ds.debug_line_alt_sz  = debug_line_alt_sz;
+         ds.debug_str_alt_img  = debug_str_alt_img;
+         ds.debug_str_alt_sz   = debug_str_alt_sz;
+         ds.dwarf1d_img        = dwarf1d_img;
+         ds.dwarf1d_sz         = dwarf1d_sz;
+         ds.dwarf1l_img        = dwarf1l_img;
+         ds.dwarf1l_sz         = dwarf1l_sz;
+         ds.zsects             = zsects;
+
+         /* Read it all now, regardless, if the result is going to be
+            saved in the debug info cache. */
+         if (VG_(clo_lazy_debuginfo)
+             && (VG_(clo_debuginfo_cache_dir) == NULL
+                 || di->buildid == NULL)) {
+            di->deferred = ML_(dinfo_zalloc)("di.redi.3", sizeof(ds));
+            *di->deferred = ds;
+         } else if (read_debug_sections( di, &ds )) {
+            di->kept_sections = ML_(dinfo_zalloc)("di.redi.4", sizeof(ds));
+            *di->kept_sections = ds;
          }
-      }
-      if (dwarf1d_img && dwarf1l_img) {
-         ML_(read_debuginfo_dwarf1) ( di, dwarf1d_img, dwarf1d_sz, 
-                                          dwarf1l_img, dwarf1l_sz );
       }
       /* TOPLEVEL */
 
@@ -2762,13 +3263,21 @@ Bool ML_(read_elf_debug_info) ( struct _DebugInfo* di )
   out: 
    {
       SysRes m_res;
-      /* Last, but not least, heave the image(s) back overboard. */
-      if (dimage) {
-         m_res = VG_(am_munmap_valgrind) ( dimage, n_dimage );
+      /* Last, but not least, heave the image(s) back overboard --
+         unless they are needed later for deferred or lazy
+         reading. */
+      if (di->deferred == NULL && di->kept_sections == NULL) {
+         if (aimage) {
+            m_res = VG_(am_munmap_valgrind) ( aimage, n_aimage );
+            vg_assert(!sr_isError(m_res));
+         }
+         if (dimage) {
+            m_res = VG_(am_munmap_valgrind) ( dimage, n_dimage );
+            vg_assert(!sr_isError(m_res));
+         }
+         m_res = VG_(am_munmap_valgrind) ( oimage, n_oimage );
          vg_assert(!sr_isError(m_res));
       }
-      m_res = VG_(am_munmap_valgrind) ( oimage, n_oimage );
-      vg_assert(!sr_isError(m_res));
 
       if (svma_ranges)
          VG_(deleteXA)(svma_ranges);
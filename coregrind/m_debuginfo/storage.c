@@ -1020,6 +1020,73 @@ void ML_(addVar)( struct _DebugInfo* di,
 }
 
 
+/* Free di's variable info, and the types and location expressions it
+   refers to, leaving .varinfo, .admin_tyents and .admin_gexprs
+   NULL. */
+void ML_(free_varinfo) ( struct _DebugInfo* di )
+{
+   Word   i, j, n;
+   TyEnt* ent;
+   GExpr* gexpr;
+
+   /* Delete the two admin arrays.  These lists exist primarily so
+      that we can visit each object exactly once when we need to
+      delete them. */
+   if (di->admin_tyents) {
+      n = VG_(sizeXA)(di->admin_tyents);
+      for (i = 0; i < n; i++) {
+         ent = (TyEnt*)VG_(indexXA)(di->admin_tyents, i);
+         /* Dump anything hanging off this ent */
+         ML_(TyEnt__make_EMPTY)(ent);
+      }
+      VG_(deleteXA)(di->admin_tyents);
+      di->admin_tyents = NULL;
+   }
+
+   if (di->admin_gexprs) {
+      n = VG_(sizeXA)(di->admin_gexprs);
+      for (i = 0; i < n; i++) {
+         gexpr = *(GExpr**)VG_(indexXA)(di->admin_gexprs, i);
+         ML_(dinfo_free)(gexpr);
+      }
+      VG_(deleteXA)(di->admin_gexprs);
+      di->admin_gexprs = NULL;
+   }
+
+   /* Dump the variable info.  This is kinda complex: we must take
+      care not to free items which reside in either the admin lists
+      (as we have just freed them) or which reside in the DebugInfo's
+      string table. */
+   if (di->varinfo) {
+      for (i = 0; i < VG_(sizeXA)(di->varinfo); i++) {
+         OSet* scope = *(OSet**)VG_(indexXA)(di->varinfo, i);
+         if (!scope) continue;
+         /* iterate over all entries in 'scope' */
+         VG_(OSetGen_ResetIter)(scope);
+         while (True) {
+            DiAddrRange* arange = VG_(OSetGen_Next)(scope);
+            if (!arange) break;
+            /* for each var in 'arange' */
+            vg_assert(arange->vars);
+            for (j = 0; j < VG_(sizeXA)( arange->vars ); j++) {
+               DiVariable* var = (DiVariable*)VG_(indexXA)(arange->vars,j);
+               vg_assert(var);
+               /* Nothing to free in var: all the pointer fields refer
+                  to stuff either on an admin list, or in
+                  .strchunks */
+            }
+            VG_(deleteXA)(arange->vars);
+            /* Don't free arange itself, as OSetGen_Destroy does
+               that */
+         }
+         VG_(OSetGen_Destroy)(scope);
+      }
+      VG_(deleteXA)(di->varinfo);
+      di->varinfo = NULL;
+   }
+}
+
+
 /* This really just checks the constructed data structure, as there is
    no canonicalisation to do. */
 static void canonicaliseVarInfo ( struct _DebugInfo* di )
@@ -1762,6 +1829,190 @@ void ML_(canonicaliseCFI) ( struct _DebugInfo* di )
       }
    }
 
+   ML_(build_cfsi_index)( di );
+}
+
+
+/* The compiled CFI index.  The cfsi array is what the readers produce
+   and what the debug info cache saves, but it is a poor thing to
+   search during unwinding: each record is several words, so the
+   binary search touches a new cache line at almost every step, and
+   neighbouring records very often carry exactly the same rule.  So
+   once the array is canonical, it is boiled down to a dense array of
+   range start addresses, with a parallel array of indices into a
+   table holding each distinct rule once, plus a page table which
+   narrows the search for an address down to the few ranges starting
+   near it. */
+
+/* Flatten the rule parts of a DiCfSI, ignoring base and len, into
+   KEY, returning the number of words written.  The fields are copied
+   one by one rather than the struct being treated as bytes, since
+   the readers build DiCfSIs on the stack and whatever happens to be
+   in the padding between the _how and _off fields is copied along
+   with them. */
+#define CFSI_RULE_KEY_MAX 16
+
+static UInt cfsi_rule_key ( const DiCfSI* c, /*OUT*/UInt* key )
+{
+   UInt n = 0;
+   key[n++] = c->cfa_how;  key[n++] = c->cfa_off;
+   key[n++] = c->ra_how;   key[n++] = c->ra_off;
+#  if defined(VGA_x86) || defined(VGA_amd64)
+   key[n++] = c->sp_how;   key[n++] = c->sp_off;
+   key[n++] = c->bp_how;   key[n++] = c->bp_off;
+#  elif defined(VGA_arm)
+   key[n++] = c->r14_how;  key[n++] = c->r14_off;
+   key[n++] = c->r13_how;  key[n++] = c->r13_off;
+   key[n++] = c->r12_how;  key[n++] = c->r12_off;
+   key[n++] = c->r11_how;  key[n++] = c->r11_off;
+   key[n++] = c->r7_how;   key[n++] = c->r7_off;
+#  elif defined(VGA_ppc32) || defined(VGA_ppc64)
+   /* nothing else */
+#  elif defined(VGA_s390x) || defined(VGA_mips32)
+   key[n++] = c->sp_how;   key[n++] = c->sp_off;
+   key[n++] = c->fp_how;   key[n++] = c->fp_off;
+#  else
+#    error "Unknown arch"
+#  endif
+   vg_assert(n <= CFSI_RULE_KEY_MAX);
+   return n;
+}
+
+static UWord cfsi_rule_hash ( const DiCfSI* c )
+{
+   UInt  key[CFSI_RULE_KEY_MAX];
+   UInt  i, n = cfsi_rule_key(c, key);
+   UWord h = 0;
+   for (i = 0; i < n; i++)
+      h = (h << 5) + h + key[i];
+   return h;
+}
+
+static Bool cfsi_rules_eq ( const DiCfSI* c1, const DiCfSI* c2 )
+{
+   UInt key1[CFSI_RULE_KEY_MAX], key2[CFSI_RULE_KEY_MAX];
+   UInt n1 = cfsi_rule_key(c1, key1);
+   UInt n2 = cfsi_rule_key(c2, key2);
+   vg_assert(n1 == n2);
+   return 0 == VG_(memcmp)(key1, key2, n1 * sizeof(UInt));
+}
+
+void ML_(free_cfsi_index) ( struct _DebugInfo* di )
+{
+   if (di->cfsi_bounds)     ML_(dinfo_free)(di->cfsi_bounds);
+   if (di->cfsi_bounds_rix) ML_(dinfo_free)(di->cfsi_bounds_rix);
+   if (di->cfsi_rules)      ML_(dinfo_free)(di->cfsi_rules);
+   if (di->cfsi_pages)      ML_(dinfo_free)(di->cfsi_pages);
+   di->cfsi_bounds      = NULL;
+   di->cfsi_bounds_rix  = NULL;
+   di->cfsi_bounds_used = 0;
+   di->cfsi_rules       = NULL;
+   di->cfsi_rules_used  = 0;
+   di->cfsi_pages       = NULL;
+   di->cfsi_pages_used  = 0;
+   di->cfsi_page_shift  = 0;
+}
+
+void ML_(build_cfsi_index) ( struct _DebugInfo* di )
+{
+   Word   i;
+   UWord  n_bounds, n_rules, n_htab, h, p;
+   UInt   r;
+   UInt*  htab;   /* rule index + 1, or 0 if empty */
+   Addr*  bounds;
+   UInt*  rix;
+   DiCfSI* rules;
+   Addr   prev_end = 0;
+
+   ML_(free_cfsi_index)( di );
+   if (di->cfsi_used == 0)
+      return;
+
+   /* At worst every record has a different rule and is followed by a
+      gap. */
+   bounds = ML_(dinfo_zalloc)("di.storage.bci.1",
+                              2 * di->cfsi_used * sizeof(Addr));
+   rix    = ML_(dinfo_zalloc)("di.storage.bci.2",
+                              2 * di->cfsi_used * sizeof(UInt));
+   rules  = ML_(dinfo_zalloc)("di.storage.bci.3",
+                              di->cfsi_used * sizeof(DiCfSI));
+   for (n_htab = 64; n_htab < 2 * di->cfsi_used; n_htab *= 2)
+      ;
+   htab   = ML_(dinfo_zalloc)("di.storage.bci.4", n_htab * sizeof(UInt));
+
+   n_bounds = n_rules = 0;
+   for (i = 0; i < (Word)di->cfsi_used; i++) {
+      DiCfSI* c = &di->cfsi[i];
+
+      /* Find the rule, or add it. */
+      h = cfsi_rule_hash(c) & (n_htab - 1);
+      while (htab[h] != 0 && !cfsi_rules_eq(&rules[htab[h] - 1], c))
+         h = (h + 1) & (n_htab - 1);
+      if (htab[h] == 0) {
+         rules[n_rules] = *c;
+         rules[n_rules].base = 0;
+         rules[n_rules].len  = 0;
+         htab[h] = ++n_rules;
+      }
+      r = htab[h] - 1;
+
+      if (i > 0 && c->base != prev_end) {
+         bounds[n_bounds] = prev_end;
+         rix[n_bounds]    = CFSI_NO_RULE;
+         n_bounds++;
+      }
+      if (n_bounds == 0 || rix[n_bounds-1] != r) {
+         bounds[n_bounds] = c->base;
+         rix[n_bounds]    = r;
+         n_bounds++;
+      }
+      prev_end = c->base + c->len;
+   }
+   ML_(dinfo_free)(htab);
+   vg_assert(bounds[0] == di->cfsi_minavma);
+
+   /* Keep exactly what is needed. */
+   di->cfsi_bounds     = ML_(dinfo_zalloc)("di.storage.bci.5",
+                                           n_bounds * sizeof(Addr));
+   di->cfsi_bounds_rix = ML_(dinfo_zalloc)("di.storage.bci.6",
+                                           n_bounds * sizeof(UInt));
+   di->cfsi_rules      = ML_(dinfo_zalloc)("di.storage.bci.7",
+                                           n_rules * sizeof(DiCfSI));
+   VG_(memcpy)(di->cfsi_bounds,     bounds, n_bounds * sizeof(Addr));
+   VG_(memcpy)(di->cfsi_bounds_rix, rix,    n_bounds * sizeof(UInt));
+   VG_(memcpy)(di->cfsi_rules,      rules,  n_rules * sizeof(DiCfSI));
+   di->cfsi_bounds_used = n_bounds;
+   di->cfsi_rules_used  = n_rules;
+   ML_(dinfo_free)(bounds);
+   ML_(dinfo_free)(rix);
+   ML_(dinfo_free)(rules);
+
+   /* The page table.  Pages are at least 4k, and big enough that
+      there are no more pages than ranges. */
+   di->cfsi_page_shift = 12;
+   while (di->cfsi_page_shift < 8 * sizeof(Addr) - 1
+          && ((di->cfsi_maxavma - di->cfsi_minavma)
+              >> di->cfsi_page_shift) + 1 > n_bounds)
+      di->cfsi_page_shift++;
+   di->cfsi_pages_used = ((di->cfsi_maxavma - di->cfsi_minavma)
+                          >> di->cfsi_page_shift) + 1;
+   di->cfsi_pages = ML_(dinfo_zalloc)("di.storage.bci.8",
+                                      (di->cfsi_pages_used + 1)
+                                      * sizeof(UInt));
+   i = 0;
+   for (p = 0; p < di->cfsi_pages_used; p++) {
+      Addr start = di->cfsi_minavma + (p << di->cfsi_page_shift);
+      while (i < (Word)n_bounds && di->cfsi_bounds[i] < start)
+         i++;
+      di->cfsi_pages[p] = i;
+   }
+   di->cfsi_pages[di->cfsi_pages_used] = n_bounds;
+
+   if (di->trace_cfi)
+      VG_(printf)("build_cfsi_index: %lu records -> %lu ranges, "
+                  "%lu rules, %lu pages of %u bits\n",
+                  di->cfsi_used, n_bounds, n_rules,
+                  di->cfsi_pages_used, di->cfsi_page_shift);
 }
 
 
@@ -1770,6 +2021,11 @@ void ML_(canonicaliseCFI) ( struct _DebugInfo* di )
 void ML_(canonicaliseTables) ( struct _DebugInfo* di )
 {
    canonicaliseSymtab ( di );
+   ML_(canonicaliseDebugTables) ( di );
+}
+
+void ML_(canonicaliseDebugTables) ( struct _DebugInfo* di )
+{
    canonicaliseLoctab ( di );
    ML_(canonicaliseCFI) ( di );
    canonicaliseVarInfo ( di );
@@ -1862,6 +2118,39 @@ Word ML_(search_one_cfitab) ( struct _DebugInfo* di, Addr ptr )
 }
 
 
+/* Find the rule for 'ptr' in the compiled CFI index, or -1 if there
+   is none.  The page table gives a short stretch of ranges, one of
+   which holds 'ptr'; binary search that for the last range starting
+   at or before it. */
+
+Word ML_(search_cfsi_index) ( struct _DebugInfo* di, Addr ptr )
+{
+   UWord p;
+   Word  lo, hi, mid;
+   UInt  r;
+
+   if (di->cfsi_bounds_used == 0
+       || ptr < di->cfsi_minavma || ptr > di->cfsi_maxavma)
+      return -1;
+   p  = (ptr - di->cfsi_minavma) >> di->cfsi_page_shift;
+   vg_assert(p < di->cfsi_pages_used);
+   lo = di->cfsi_pages[p];
+   hi = (Word)di->cfsi_pages[p+1] - 1;
+   if (lo > 0)
+      lo--;   /* the range covering the start of the page */
+   while (lo < hi) {
+      mid = (lo + hi + 1) / 2;
+      if (di->cfsi_bounds[mid] <= ptr)
+         lo = mid;
+      else
+         hi = mid - 1;
+   }
+   vg_assert(di->cfsi_bounds[lo] <= ptr);
+   r = di->cfsi_bounds_rix[lo];
+   return r == CFSI_NO_RULE ? -1 : (Word)r;
+}
+
+
 /* Find a FPO-table index containing the specified pointer, or -1
    if not found.  Binary search.  */
 
@@ -37,6 +37,7 @@
 #include "pub_core_errormgr.h"
 #include "pub_core_execontext.h"
 #include "pub_core_gdbserver.h"
+#include "pub_core_hashtable.h"
 #include "pub_core_libcbase.h"
 #include "pub_core_libcassert.h"
 #include "pub_core_libcfile.h"
@@ -68,14 +69,75 @@
 #define M_COLLECT_NO_ERRORS_AFTER_FOUND 10000000
 
 /* The list of error contexts found, both suppressed and unsuppressed.
-   Initially empty, and grows as errors are detected. */
+   Initially empty, and grows as errors are detected.  The most
+   recently found error is at the front. */
 static Error* errors = NULL;
 
+/* The same errors, indexed by a hash of their kind, the top frames of
+   their stack traces and (if the tool supplies one) a hash of the
+   tool-specific part, so that a new error needn't be compared with
+   every one seen so far.  Only the top two frames are hashed, since
+   that is all Vg_LowRes compares, so that errors which are equal at
+   any resolution land in the same bucket.  The table starts with
+   ERR_HTAB_MIN_SIZE buckets and doubles whenever there are more
+   errors than buckets. */
+#define ERR_HTAB_MIN_SIZE 1024
+#define ERR_HASH_N_IPS    2
+
+static Error** err_htab      = NULL;
+static UWord   err_htab_size = 0;
+static UWord   err_htab_used = 0;
+
+/* Bumped every time an error is found, so as to tell which of
+   several matching errors is nearest the front of 'errors'. */
+static ULong err_stamp = 0;
+
 /* The list of suppression directives, as read from the specified
-   suppressions file.  Note that the list gets rearranged as a result
-   of the searches done by is_suppressible_error(). */
+   suppressions file.  Searches are done through supp_htab and
+   supp_fallback rather than this list, but they behave as if each
+   suppression used were moved to the front of it; see
+   is_suppressible_error(). */
 static Supp* suppressions = NULL;
 
+/* The suppressions whose first frame is a fun: or obj: name without
+   wildcards, chained through their 'hnext' fields in buckets indexed
+   by a hash of that name.  Only the buckets for the name of the
+   function and the name of the object of an error's first frame need
+   be searched.  The rest, whose first frame is a wildcard pattern or
+   "...", are in supp_fallback and always have to be tried. */
+static Supp** supp_htab      = NULL;
+static UWord  supp_htab_size = 0;
+static Supp*  supp_fallback  = NULL;
+
+/* Nr of suppressions, and of those in supp_htab with a fun: and an
+   obj: first frame, so that a frame's function or object name need
+   not be looked up if no suppression could use it. */
+static UWord n_supps_loaded   = 0;
+static UWord n_supp_fun_first = 0;
+static UWord n_supp_obj_first = 0;
+
+/* For each ExeContext an error has been seen at, the suppressions
+   whose callers match it.  Matching the callers is by far the most
+   expensive part of deciding whether an error is suppressed, and does
+   not depend on anything else about the error, so it is done only
+   once per context.  Since the names of the frames may change when
+   debug info is read or discarded, the whole lot is thrown away when
+   that happens. */
+typedef
+   struct _SuppMemo {
+      struct _SuppMemo* next;
+      UWord  key;         /* the ExeContext* */
+      UInt   n_matches;
+      Supp** matches;
+   }
+   SuppMemo;
+
+static VgHashTable supp_memo     = NULL;
+static ULong       supp_memo_gen = 0;
+
+/* Bumped every time an error is suppressed; see Supp.used_stamp. */
+static ULong supp_stamp = 0;
+
 /* Running count of unsuppressed errors detected. */
 static UInt n_errs_found = 0;
 
@@ -104,6 +166,10 @@ static UWord em_errlist_searches = 0;
    searching. */
 static UWord em_errlist_cmps = 0;
 
+/* Stats: number of errors looked at in err_htab buckets, including
+   those skipped because their hash differed. */
+static UWord em_errhash_probes = 0;
+
 /* Stats: number of searches of the suppression list initiated. */
 static UWord em_supplist_searches = 0;
 
@@ -111,6 +177,11 @@ static UWord em_supplist_searches = 0;
    searching. */
 static UWord em_supplist_cmps = 0;
 
+/* Stats: number of suppression list searches answered from
+   supp_memo, and number of times it was thrown away. */
+static UWord em_suppmemo_hits    = 0;
+static UWord em_suppmemo_flushes = 0;
+
 /*------------------------------------------------------------*/
 /*--- Error type                                           ---*/
 /*------------------------------------------------------------*/
@@ -126,6 +197,12 @@ static UWord em_supplist_cmps = 0;
 */
 struct _Error {
    struct _Error* next;
+   struct _Error* prev;
+   // Next error in the same err_htab bucket, and the full hash value.
+   struct _Error* hnext;
+   UWord hkey;
+   // Value of err_stamp when this error was last found.
+   ULong stamp;
    // Unique tag.  This gives the error a unique identity (handle) by
    // which it can be referred to afterwords.  Currently only used for
    // XML printing.
@@ -236,6 +313,11 @@ struct _Supp {
    SuppKind skind;   // What kind of suppression.  Must use the range (0..).
    Char* string;     // String -- use is optional.  NULL by default.
    void* extra;      // Anything else -- use is optional.  NULL by default.
+
+   /* For searching; see is_suppressible_error(). */
+   struct _Supp* hnext; // Next in the same supp_htab bucket or supp_fallback
+   UInt  rank;          // Position in 'suppressions', from 0
+   ULong used_stamp;    // supp_stamp when last used, 0 if never
 };
 
 SuppKind VG_(get_supp_kind) ( Supp* su )
@@ -308,6 +390,23 @@ static Bool eq_Error ( VgRes res, Error* e1, Error* e2 )
 }
 
 
+/* Hash an error, such that errors which eq_Error considers equal at
+   any resolution hash the same. */
+static UWord hash_Error ( Error* err )
+{
+   UWord h = VG_(hash_ExeContext_top)(err->where, ERR_HASH_N_IPS);
+   h ^= (UWord)err->ekind;
+   if (VG_(needs).error_hash)
+      h ^= VG_TDICT_CALL(tool_hash_Error, err) * 0x9E3779B1UL;
+   /* The bucket is chosen from the low bits, so fold the high ones
+      in. */
+   h *= 0x9E3779B1UL;
+   h ^= h >> 15;
+   h ^= h >> 29;
+   return h;
+}
+
+
 /* Helper functions for suppression generation: print a single line of
    a suppression pseudo-stack-trace, either in XML or text mode.  It's
    important that the behaviour of these two functions exactly
@@ -350,6 +449,8 @@ static void gen_suppression(Error* err)
    Bool        anyXtra;
    Char*       name;
    ExeContext* ec;
+   StackTrace  ips;
+   Addr        ips_buf[VG_DEEPEST_BACKTRACE];
    XArray* /* HChar */ text;
 
    const HChar* dummy_name = "insert_a_suppression_name_here";
@@ -358,6 +459,7 @@ static void gen_suppression(Error* err)
 
    ec = VG_(get_error_where)(err);
    vg_assert(ec);
+   ips = VG_(get_ExeContext_StackTrace)(ec, ips_buf);
 
    name = VG_TDICT_CALL(tool_get_error_name, err);
    if (NULL == name) {
@@ -394,7 +496,7 @@ static void gen_suppression(Error* err)
       n_ips = VG_MAX_SUPP_CALLERS;
    VG_(apply_StackTrace)(printSuppForIp_nonXML,
                          text,
-                         VG_(get_ExeContext_StackTrace)(ec),
+                         ips,
                          n_ips);
 
    VG_(xaprintf)(text, "}\n");
@@ -423,7 +525,7 @@ static void gen_suppression(Error* err)
       // Print stack trace elements
       VG_(apply_StackTrace)(printSuppForIp_XML,
                             NULL,
-                            VG_(get_ExeContext_StackTrace)(ec),
+                            ips,
                             VG_(get_ExeContext_n_ips)(ec));
 
       // And now the cdata bit
@@ -628,6 +730,10 @@ void construct_error ( Error* err, ThreadId tid, ErrorKind ekind, Addr a,
    /* Core-only parts */
    err->unique   = unique_counter++;
    err->next     = NULL;
+   err->prev     = NULL;
+   err->hnext    = NULL;
+   err->hkey     = 0;
+   err->stamp    = 0;
    err->supp     = NULL;
    err->count    = 1;
    err->tid      = tid;
@@ -648,6 +754,46 @@ void construct_error ( Error* err, ThreadId tid, ErrorKind ekind, Addr a,
 
 
 
+static void init_err_htab ( void )
+{
+   UWord i;
+   err_htab_size = ERR_HTAB_MIN_SIZE;
+   err_htab = VG_(arena_malloc)(VG_AR_ERRORS, "errormgr.ieh.1",
+                                err_htab_size * sizeof(Error*));
+   for (i = 0; i < err_htab_size; i++)
+      err_htab[i] = NULL;
+}
+
+static void add_to_err_htab ( Error* err )
+{
+   UWord   i, new_size;
+   Error** new_htab;
+   Error   *e, *next;
+
+   if (err_htab_used >= err_htab_size) {
+      new_size = 2 * err_htab_size;
+      new_htab = VG_(arena_malloc)(VG_AR_ERRORS, "errormgr.aeh.1",
+                                   new_size * sizeof(Error*));
+      for (i = 0; i < new_size; i++)
+         new_htab[i] = NULL;
+      for (i = 0; i < err_htab_size; i++) {
+         for (e = err_htab[i]; e; e = next) {
+            next = e->hnext;
+            e->hnext = new_htab[e->hkey & (new_size-1)];
+            new_htab[e->hkey & (new_size-1)] = e;
+         }
+      }
+      VG_(arena_free)(VG_AR_ERRORS, err_htab);
+      err_htab      = new_htab;
+      err_htab_size = new_size;
+   }
+
+   i = err->hkey & (err_htab_size-1);
+   err->hnext  = err_htab[i];
+   err_htab[i] = err;
+   err_htab_used++;
+}
+
 /* Top-level entry point to the error management subsystem.
    All detected errors are notified here; this routine decides if/when the
    user should see the error. */
@@ -656,7 +802,7 @@ void VG_(maybe_record_error) ( ThreadId tid,
 {
           Error  err;
           Error* p;
-          Error* p_prev;
+          Error* q;
           UInt   extra_size;
           VgRes  exe_res          = Vg_MedRes;
    static Bool   stopping_message = False;
@@ -726,37 +872,52 @@ void VG_(maybe_record_error) ( ThreadId tid,
    /* Build ourselves the error */
    construct_error ( &err, tid, ekind, a, s, extra, NULL );
 
-   /* First, see if we've got an error record matching this one. */
+   /* First, see if we've got an error record matching this one.  At
+      Vg_LowRes more than one may match; take the one nearest the
+      front of the list, as a linear search of it would. */
    em_errlist_searches++;
-   p       = errors;
-   p_prev  = NULL;
-   while (p != NULL) {
+   err.hkey = hash_Error(&err);
+   if (err_htab == NULL)
+      init_err_htab();
+   p = NULL;
+   for (q = err_htab[err.hkey & (err_htab_size-1)]; q; q = q->hnext) {
+      em_errhash_probes++;
+      if (q->hkey != err.hkey || q->ekind != err.ekind)
+         continue;
+      if (p != NULL && q->stamp < p->stamp)
+         continue;
       em_errlist_cmps++;
-      if (eq_Error(exe_res, p, &err)) {
-         /* Found it. */
-         p->count++;
-	 if (p->supp != NULL) {
-            /* Deal correctly with suppressed errors. */
-            p->supp->count++;
-            n_errs_suppressed++;	 
-         } else {
-            n_errs_found++;
-         }
-
-         /* Move p to the front of the list so that future searches
-            for it are faster. It also allows to print the last
-            error (see VG_(show_last_error). */
-         if (p_prev != NULL) {
-            vg_assert(p_prev->next == p);
-            p_prev->next = p->next;
-            p->next      = errors;
-            errors       = p;
-	 }
+      if (eq_Error(exe_res, q, &err)) {
+         p = q;
+         if (exe_res != Vg_LowRes)
+            break;
+      }
+   }
+   if (p != NULL) {
+      /* Found it. */
+      p->count++;
+      if (p->supp != NULL) {
+         /* Deal correctly with suppressed errors. */
+         p->supp->count++;
+         n_errs_suppressed++;	 
+      } else {
+         n_errs_found++;
+      }
 
-         return;
+      /* Move p to the front of the list.  This allows to print the
+         last error (see VG_(show_last_error). */
+      p->stamp = ++err_stamp;
+      if (p != errors) {
+         p->prev->next = p->next;
+         if (p->next)
+            p->next->prev = p->prev;
+         p->prev       = NULL;
+         p->next       = errors;
+         errors->prev  = p;
+         errors        = p;
       }
-      p_prev = p;
-      p      = p->next;
+
+      return;
    }
 
    /* Didn't see it.  Copy and add. */
@@ -800,9 +961,14 @@ void VG_(maybe_record_error) ( ThreadId tid,
       p->extra = new_extra;
    }
 
-   p->next = errors;
-   p->supp = is_suppressible_error(&err);
-   errors  = p;
+   p->next  = errors;
+   p->prev  = NULL;
+   if (errors)
+      errors->prev = p;
+   p->supp  = is_suppressible_error(&err);
+   p->stamp = ++err_stamp;
+   errors   = p;
+   add_to_err_htab(p);
    if (p->supp == NULL) {
       /* update stats */
       n_err_contexts++;
@@ -880,18 +1046,41 @@ Bool VG_(unique_error) ( ThreadId tid, ErrorKind ekind, Addr a, Char* s,
 
 /* Show the used suppressions.  Returns False if no suppression
    got used. */
+static Int cmp_Supp_by_last_use ( void* v1, void* v2 )
+{
+   Supp* su1 = *(Supp**)v1;
+   Supp* su2 = *(Supp**)v2;
+   if (su1->used_stamp > su2->used_stamp) return -1;
+   if (su1->used_stamp < su2->used_stamp) return 1;
+   return 0;
+}
+
 static Bool show_used_suppressions ( void )
 {
    Supp  *su;
+   Supp  **used;
    Bool  any_supp;
+   UInt  i, n_used;
 
    if (VG_(clo_xml))
       VG_(printf_xml)("<suppcounts>\n");
 
+   /* Most recently used first, as they always have been. */
+   n_used = 0;
+   for (su = suppressions; su != NULL; su = su->next)
+      if (su->count > 0)
+         n_used++;
+   used = VG_(malloc)("errormgr.sus.1", (n_used > 0 ? n_used : 1)
+                                        * sizeof(Supp*));
+   n_used = 0;
+   for (su = suppressions; su != NULL; su = su->next)
+      if (su->count > 0)
+         used[n_used++] = su;
+   VG_(ssort)(used, n_used, sizeof(Supp*), cmp_Supp_by_last_use);
+
    any_supp = False;
-   for (su = suppressions; su != NULL; su = su->next) {
-      if (su->count <= 0)
-         continue;
+   for (i = 0; i < n_used; i++) {
+      su = used[i];
       if (VG_(clo_xml)) {
          VG_(printf_xml)( "  <pair>\n"
                                  "    <count>%d</count>\n"
@@ -906,6 +1095,7 @@ static Bool show_used_suppressions ( void )
       }
       any_supp = True;
    }
+   VG_(free)(used);
 
    if (VG_(clo_xml))
       VG_(printf_xml)("</suppcounts>\n");
@@ -967,7 +1157,9 @@ void VG_(show_all_errors) (  Int verbosity, Bool xml )
       vg_assert(! xml);
 
       if ((i+1 == VG_(clo_dump_error))) {
-         StackTrace ips = VG_(get_ExeContext_StackTrace)(p_min->where);
+         Addr       ips_buf[VG_DEEPEST_BACKTRACE];
+         StackTrace ips = VG_(get_ExeContext_StackTrace)(p_min->where,
+                                                         ips_buf);
          VG_(translate) ( 0 /* dummy ThreadId; irrelevant due to debugging*/,
                           ips[0], /*debugging*/True, 0xFE/*verbosity*/,
                           /*bbs_done*/0,
@@ -1219,6 +1411,9 @@ static void load_one_suppressions_file ( Char* filename )
       }
 
       supp->string = supp->extra = NULL;
+      supp->hnext = NULL;
+      supp->rank = 0;
+      supp->used_stamp = 0;
 
       eof = VG_(get_line) ( fd, &buf, &nBuf, &lineno );
       if (eof) {
@@ -1365,6 +1560,51 @@ static void load_one_suppressions_file ( Char* filename )
 }
 
 
+static UWord hash_SuppLoc_name ( SuppLocTy ty, Char* name )
+{
+   UWord h = ty;
+   while (*name)
+      h = (h << 5) + h + (UChar)*name++;
+   return h;
+}
+
+/* Sort the suppressions into supp_htab and supp_fallback. */
+static void index_suppressions ( void )
+{
+   Supp*    su;
+   SuppLoc* first;
+   UInt     rank;
+
+   n_supps_loaded = 0;
+   for (su = suppressions; su != NULL; su = su->next)
+      n_supps_loaded++;
+   supp_htab_size = 64;
+   while (supp_htab_size < 2 * n_supps_loaded)
+      supp_htab_size *= 2;
+   supp_htab = VG_(arena_calloc)(VG_AR_CORE, "errormgr.is.1",
+                                 supp_htab_size, sizeof(Supp*));
+
+   rank = 0;
+   for (su = suppressions; su != NULL; su = su->next) {
+      su->rank = rank++;
+      first = &su->callers[0];
+      if ((first->ty == FunName || first->ty == ObjName)
+          && first->name_is_simple_str) {
+         UWord b = hash_SuppLoc_name(first->ty, first->name)
+                   & (supp_htab_size - 1);
+         su->hnext = supp_htab[b];
+         supp_htab[b] = su;
+         if (first->ty == FunName)
+            n_supp_fun_first++;
+         else
+            n_supp_obj_first++;
+      } else {
+         su->hnext = supp_fallback;
+         supp_fallback = su;
+      }
+   }
+}
+
 void VG_(load_suppressions) ( void )
 {
    Int i;
@@ -1376,6 +1616,7 @@ void VG_(load_suppressions) ( void )
       }
       load_one_suppressions_file( VG_(clo_suppressions)[i] );
    }
+   index_suppressions();
 }
 
 
@@ -1589,16 +1830,29 @@ Bool supp_matches_error(Supp* su, Error* err)
 
 /////////////////////////////////////////////////////
 
-/* Does an error context match a suppression?  ie is this a suppressible
-   error?  If so, return a pointer to the Supp record, otherwise NULL.
-   Tries to minimise the number of symbol searches since they are expensive.  
-*/
-static Supp* is_suppressible_error ( Error* err )
+/* Try one suppression against the callers of a context, adding it to
+   'matches' if they match. */
+static void try_supp_callers ( IPtoFunOrObjCompleter* ip2fo, Supp* su,
+                               XArray* matches )
+{
+   em_supplist_cmps++;
+   if (supp_matches_callers(ip2fo, su))
+      VG_(addToXA)(matches, &su);
+}
+
+/* Find the suppressions whose callers match the stack trace of 'ec',
+   looking at only those whose first frame could match it.  Tries to
+   minimise the number of symbol searches since they are expensive. */
+static SuppMemo* make_SuppMemo ( ExeContext* ec )
 {
-   Supp* su;
-   Supp* su_prev;
+   SuppMemo* memo;
+   Supp*     su;
+   XArray*   matches;
+   Char*     name;
+   UWord     b;
 
    IPtoFunOrObjCompleter ip2fo;
+   Addr                  ips_buf[VG_DEEPEST_BACKTRACE];
    /* Conceptually, ip2fo contains an array of function names and an array of
       object names, corresponding to the array of IP of err->where.
       These names are just computed 'on demand' (so once maximum),
@@ -1612,39 +1866,107 @@ static Supp* is_suppressible_error ( Error* err )
       IP is needed (i.e. for the matching with the next suppr pattern), then
       the fun or obj name will not be searched again in the debug info. */
 
-   /* stats gathering */
-   em_supplist_searches++;
-
    /* Prepare the lazy input completer. */
-   ip2fo.ips = VG_(get_ExeContext_StackTrace)(err->where);
-   ip2fo.n_ips = VG_(get_ExeContext_n_ips)(err->where);
+   ip2fo.ips = VG_(get_ExeContext_StackTrace)(ec, ips_buf);
+   ip2fo.n_ips = VG_(get_ExeContext_n_ips)(ec);
    ip2fo.fun_offsets = NULL;
    ip2fo.obj_offsets = NULL;
    ip2fo.names = NULL;
    ip2fo.names_szB = 0;
    ip2fo.names_free = 0;
+   vg_assert(ip2fo.n_ips > 0);
 
-   /* See if the error context matches any suppression. */
-   su_prev = NULL;
-   for (su = suppressions; su != NULL; su = su->next) {
-      em_supplist_cmps++;
-      if (supp_matches_error(su, err) 
-          && supp_matches_callers(&ip2fo, su)) {
-         /* got a match.  Move this entry to the head of the list
-            in the hope of making future searches cheaper. */
-         if (su_prev) {
-            vg_assert(su_prev->next == su);
-            su_prev->next = su->next;
-            su->next = suppressions;
-            suppressions = su;
-         }
-         clearIPtoFunOrObjCompleter(&ip2fo);
-         return su;
-      }
-      su_prev = su;
+   matches = VG_(newXA)(VG_(malloc), "errormgr.mSM.1", VG_(free),
+                        sizeof(Supp*));
+
+   for (su = supp_fallback; su != NULL; su = su->hnext)
+      try_supp_callers(&ip2fo, su, matches);
+
+   if (n_supp_fun_first > 0) {
+      name = foComplete(&ip2fo, ip2fo.ips[0], 0, True /*needFun*/);
+      b = hash_SuppLoc_name(FunName, name) & (supp_htab_size - 1);
+      for (su = supp_htab[b]; su != NULL; su = su->hnext)
+         if (su->callers[0].ty == FunName
+             && VG_STREQ(su->callers[0].name, name))
+            try_supp_callers(&ip2fo, su, matches);
+   }
+   if (n_supp_obj_first > 0) {
+      name = foComplete(&ip2fo, ip2fo.ips[0], 0, False /*needFun*/);
+      b = hash_SuppLoc_name(ObjName, name) & (supp_htab_size - 1);
+      for (su = supp_htab[b]; su != NULL; su = su->hnext)
+         if (su->callers[0].ty == ObjName
+             && VG_STREQ(su->callers[0].name, name))
+            try_supp_callers(&ip2fo, su, matches);
    }
    clearIPtoFunOrObjCompleter(&ip2fo);
-   return NULL;      /* no matches */
+
+   memo = VG_(malloc)("errormgr.mSM.2", sizeof(SuppMemo)
+                      + VG_(sizeXA)(matches) * sizeof(Supp*));
+   memo->key       = (UWord)ec;
+   memo->n_matches = VG_(sizeXA)(matches);
+   memo->matches   = (Supp**)(memo + 1);
+   for (b = 0; b < memo->n_matches; b++)
+      memo->matches[b] = *(Supp**)VG_(indexXA)(matches, b);
+   VG_(deleteXA)(matches);
+   return memo;
+}
+
+/* Does an error context match a suppression?  ie is this a suppressible
+   error?  If so, return a pointer to the Supp record, otherwise NULL.
+
+   Of the suppressions which match, the one returned is the first in
+   the order the list would have if each suppression were moved to
+   the front of it when used: those used so far, most recent first,
+   then the others in list order.  That is what searching the list
+   did before supp_htab and supp_memo came along, and it decides which
+   suppression gets the credit when several match.
+*/
+static Supp* is_suppressible_error ( Error* err )
+{
+   SuppMemo* memo;
+   Supp*     su;
+   Supp*     best;
+   ULong     gen;
+   UInt      i;
+
+   /* stats gathering */
+   em_supplist_searches++;
+
+   if (suppressions == NULL)
+      return NULL;
+
+   gen = VG_(CF_info_generation)();
+   if (supp_memo == NULL || gen != supp_memo_gen) {
+      if (supp_memo != NULL) {
+         VG_(HT_destruct)(supp_memo, VG_(free));
+         em_suppmemo_flushes++;
+      }
+      supp_memo = VG_(HT_construct)("errormgr.supp_memo");
+      supp_memo_gen = gen;
+   }
+
+   memo = VG_(HT_lookup)(supp_memo, (UWord)err->where);
+   if (memo != NULL) {
+      em_suppmemo_hits++;
+   } else {
+      memo = make_SuppMemo(err->where);
+      VG_(HT_add_node)(supp_memo, memo);
+   }
+
+   best = NULL;
+   for (i = 0; i < memo->n_matches; i++) {
+      su = memo->matches[i];
+      if (best != NULL
+          && (su->used_stamp < best->used_stamp
+              || (su->used_stamp == best->used_stamp
+                  && su->rank > best->rank)))
+         continue;
+      if (supp_matches_error(su, err))
+         best = su;
+   }
+   if (best != NULL)
+      best->used_stamp = ++supp_stamp;
+   return best;
 }
 
 /* Show accumulated error-list and suppression-list search stats. 
@@ -1655,10 +1977,20 @@ void VG_(print_errormgr_stats) ( void )
       " errormgr: %'lu supplist searches, %'lu comparisons during search\n",
       em_supplist_searches, em_supplist_cmps
    );
+   VG_(dmsg)(
+      " errormgr: %'lu supplist searches memoised, %'lu memo flushes, "
+      "%'lu of %'lu supps indexed by first frame\n",
+      em_suppmemo_hits, em_suppmemo_flushes,
+      n_supp_fun_first + n_supp_obj_first, n_supps_loaded
+   );
    VG_(dmsg)(
       " errormgr: %'lu errlist searches, %'lu comparisons during search\n",
       em_errlist_searches, em_errlist_cmps
    );
+   VG_(dmsg)(
+      " errormgr: %'lu errors in %'lu buckets, %'lu looked at during search\n",
+      err_htab_used, err_htab_size, em_errhash_probes
+   );
 }
 
 /*--------------------------------------------------------------------*/
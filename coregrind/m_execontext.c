@@ -34,6 +34,7 @@
 #include "pub_core_libcprint.h"     // For VG_(message)()
 #include "pub_core_mallocfree.h"
 #include "pub_core_options.h"
+#include "pub_tool_poolalloc.h"
 #include "pub_core_stacktrace.h"
 #include "pub_core_machine.h"       // VG_(get_IP)
 #include "pub_core_vki.h"           // To keep pub_core_threadstate.h happy
@@ -55,7 +56,19 @@
    to keep the load factor below 1.0.
 
    The idea is only to ever store any one context once, so as to save
-   space and make exact comparisons faster. */
+   space and make exact comparisons faster.
+
+   With --execontext-storage=trie, contexts are instead stored as the
+   nodes of a trie rooted at the outermost callers.  A node holds one
+   IP and a pointer to the node for its callers, so contexts share
+   the nodes for whatever frames they have in common with contexts
+   from the same callers, and each (parent, IP) pair is stored only
+   once.  The nodes are found via a hash table keyed on (parent, IP)
+   which grows in the same way.  Only nodes which have been handed
+   out as contexts are given ECUs, so ECUs are issued in the same
+   order in both modes.  VG_(get_ExeContext_StackTrace) copies a
+   context into a buffer given by the caller, so that nothing but the
+   nodes is ever stored. */
 
 
 /* Primes for the hash table */
@@ -90,11 +103,39 @@ struct _ExeContext {
 };
 
 
+/* In trie mode, each ExeContext is really one of these.  The first
+   three fields are laid out as in struct _ExeContext, so that code
+   which only looks at 'ecu' and 'n_ips' works in both modes. */
+
+typedef
+   struct _ECNode {
+      struct _ECNode* chain;
+      /* The ECU, or zero if this node has never been handed out as
+         an ExeContext. */
+      UInt ecu;
+      /* Number of frames in the context: 1 for a node with no
+         parent. */
+      UInt n_ips;
+      /* The callers of 'ip', or NULL if it is the outermost frame. */
+      struct _ECNode* parent;
+      Addr ip;
+   }
+   ECNode;
+
+
 /* This is the dynamically expanding hash table. */
 static ExeContext** ec_htab; /* array [ec_htab_size] of ExeContext* */
 static SizeT        ec_htab_size;     /* one of the values in ec_primes */
 static SizeT        ec_htab_size_idx; /* 0 .. N_EC_PRIMES-1 */
 
+/* In trie mode, the hash table of nodes, which is used instead of
+   ec_htab, and where the nodes come from. */
+static Bool       ec_trie = False;
+static ECNode**   ec_node_htab;          /* array [ec_node_htab_size] */
+static SizeT      ec_node_htab_size;     /* one of the values in ec_primes */
+static SizeT      ec_node_htab_size_idx; /* 0 .. N_EC_PRIMES-1 */
+static PoolAlloc* ec_node_pa;
+
 /* ECU serial number */
 static UInt ec_next_ecu = 4; /* We must never issue zero */
 
@@ -114,12 +155,30 @@ static ULong ec_cmp2s;
 static ULong ec_cmp4s;
 static ULong ec_cmpAlls;
 
+/* Stats only: bytes the stored contexts would take as flat arrays. */
+static ULong ec_flat_bytes;
+
+/* Stats only, trie mode: number of trie nodes, and nodes looked at
+   while searching the node hash table. */
+static ULong ec_trie_nodes;
+static ULong ec_trie_probes;
+
 
 /*------------------------------------------------------------*/
 /*--- Exported functions.                                  ---*/
 /*------------------------------------------------------------*/
 
 
+static void* ec_node_alloc ( HChar* cc, SizeT szB )
+{
+   return VG_(arena_malloc)(VG_AR_EXECTXT, cc, szB);
+}
+
+static void ec_node_free ( void* p )
+{
+   VG_(arena_free)(VG_AR_EXECTXT, p);
+}
+
 /* Initialise this subsystem. */
 static void init_ExeContext_storage ( void )
 {
@@ -133,6 +192,9 @@ static void init_ExeContext_storage ( void )
    ec_cmp2s = 0;
    ec_cmp4s = 0;
    ec_cmpAlls = 0;
+   ec_flat_bytes = 0;
+   ec_trie_nodes = 0;
+   ec_trie_probes = 0;
 
    ec_htab_size_idx = 0;
    ec_htab_size = ec_primes[ec_htab_size_idx];
@@ -141,6 +203,21 @@ static void init_ExeContext_storage ( void )
    for (i = 0; i < ec_htab_size; i++)
       ec_htab[i] = NULL;
 
+   ec_trie = VG_(clo_execontext_trie);
+   if (ec_trie) {
+      vg_assert(offsetof(ECNode, ecu) == offsetof(ExeContext, ecu));
+      vg_assert(offsetof(ECNode, n_ips) == offsetof(ExeContext, n_ips));
+      ec_node_htab_size_idx = 0;
+      ec_node_htab_size = ec_primes[ec_node_htab_size_idx];
+      ec_node_htab = VG_(arena_malloc)(VG_AR_EXECTXT, "execontext.iEs2",
+                                       sizeof(ECNode*) * ec_node_htab_size);
+      for (i = 0; i < ec_node_htab_size; i++)
+         ec_node_htab[i] = NULL;
+      ec_node_pa = VG_(newPA)(sizeof(ECNode), 1000,
+                              ec_node_alloc, "execontext.iEs3",
+                              ec_node_free);
+   }
+
    init_done = True;
 }
 
@@ -149,17 +226,39 @@ static void init_ExeContext_storage ( void )
 void VG_(print_ExeContext_stats) ( void )
 {
    init_ExeContext_storage();
-   VG_(message)(Vg_DebugMsg, 
-      "   exectx: %'lu lists, %'llu contexts (avg %'llu per list)\n",
-      ec_htab_size, ec_totstored, ec_totstored / (ULong)ec_htab_size
-   );
-   VG_(message)(Vg_DebugMsg, 
-      "   exectx: %'llu searches, %'llu full compares (%'llu per 1000)\n",
-      ec_searchreqs, ec_searchcmps, 
-      ec_searchreqs == 0 
-         ? 0ULL 
-         : ( (ec_searchcmps * 1000ULL) / ec_searchreqs ) 
-   );
+   if (ec_trie) {
+      VG_(message)(Vg_DebugMsg,
+         "   exectx: %'lu lists, %'llu contexts in a trie of %'llu nodes\n",
+         ec_node_htab_size, ec_totstored, ec_trie_nodes
+      );
+      VG_(message)(Vg_DebugMsg,
+         "   exectx: %'llu searches, %'llu node compares (%'llu per 1000)\n",
+         ec_searchreqs, ec_trie_probes,
+         ec_searchreqs == 0
+            ? 0ULL
+            : ( (ec_trie_probes * 1000ULL) / ec_searchreqs )
+      );
+      VG_(message)(Vg_DebugMsg,
+         "   exectx: %'llu bytes in nodes; %'llu if stored flat\n",
+         ec_trie_nodes * (ULong)sizeof(ECNode), ec_flat_bytes
+      );
+   } else {
+      VG_(message)(Vg_DebugMsg, 
+         "   exectx: %'lu lists, %'llu contexts (avg %'llu per list)\n",
+         ec_htab_size, ec_totstored, ec_totstored / (ULong)ec_htab_size
+      );
+      VG_(message)(Vg_DebugMsg, 
+         "   exectx: %'llu searches, %'llu full compares (%'llu per 1000)\n",
+         ec_searchreqs, ec_searchcmps, 
+         ec_searchreqs == 0 
+            ? 0ULL 
+            : ( (ec_searchcmps * 1000ULL) / ec_searchreqs ) 
+      );
+      VG_(message)(Vg_DebugMsg,
+         "   exectx: %'llu bytes in contexts\n",
+         ec_flat_bytes
+      );
+   }
    VG_(message)(Vg_DebugMsg, 
       "   exectx: %'llu cmp2, %'llu cmp4, %'llu cmpAll\n",
       ec_cmp2s, ec_cmp4s, ec_cmpAlls 
@@ -167,13 +266,44 @@ void VG_(print_ExeContext_stats) ( void )
 }
 
 
+/* Copy the IPs of the context ending at 'node' into 'ips'. */
+static void get_ECNode_ips ( ECNode* node, /*OUT*/Addr* ips )
+{
+   UInt i = 0;
+   for (; node != NULL; node = node->parent)
+      ips[i++] = node->ip;
+}
+
+
 /* Print an ExeContext. */
 void VG_(pp_ExeContext) ( ExeContext* ec )
 {
+   if (ec_trie) {
+      ECNode* node = (ECNode*)ec;
+      Addr    ips[node->n_ips];
+      get_ECNode_ips( node, ips );
+      VG_(pp_StackTrace)( ips, node->n_ips );
+      return;
+   }
    VG_(pp_StackTrace)( ec->ips, ec->n_ips );
 }
 
 
+/* Trie mode: are the top 'n' frames of e1 and e2 the same? */
+static Bool eq_ECNode_top ( ECNode* e1, ECNode* e2, Int n )
+{
+   Int i;
+   for (i = 0; i < n; i++) {
+      if (e1 == e2)                   return True;
+      if (e1 == NULL || e2 == NULL)   return False;
+      if (e1->ip != e2->ip)           return False;
+      e1 = e1->parent;
+      e2 = e2->parent;
+   }
+   return True;
+}
+
+
 /* Compare two ExeContexts.  Number of callers considered depends on res. */
 Bool VG_(eq_ExeContext) ( VgRes res, ExeContext* e1, ExeContext* e2 )
 {
@@ -189,6 +319,8 @@ Bool VG_(eq_ExeContext) ( VgRes res, ExeContext* e1, ExeContext* e2 )
    case Vg_LowRes:
       /* Just compare the top two callers. */
       ec_cmp2s++;
+      if (ec_trie)
+         return eq_ECNode_top( (ECNode*)e1, (ECNode*)e2, 2 );
       for (i = 0; i < 2; i++) {
          if ( (e1->n_ips <= i) &&  (e2->n_ips <= i)) return True;
          if ( (e1->n_ips <= i) && !(e2->n_ips <= i)) return False;
@@ -200,6 +332,8 @@ Bool VG_(eq_ExeContext) ( VgRes res, ExeContext* e1, ExeContext* e2 )
    case Vg_MedRes:
       /* Just compare the top four callers. */
       ec_cmp4s++;
+      if (ec_trie)
+         return eq_ECNode_top( (ECNode*)e1, (ECNode*)e2, 4 );
       for (i = 0; i < 4; i++) {
          if ( (e1->n_ips <= i) &&  (e2->n_ips <= i)) return True;
          if ( (e1->n_ips <= i) && !(e2->n_ips <= i)) return False;
@@ -290,6 +424,120 @@ static void resize_ec_htab ( void )
    ec_htab_size_idx++;
 }
 
+/* Issue the next ECU. */
+static UInt new_ECU ( void )
+{
+   UInt ecu = ec_next_ecu;
+   vg_assert(VG_(is_plausible_ECU)(ecu));
+   ec_next_ecu += 4;
+   if (ec_next_ecu == 0) {
+      /* Urr.  Now we're hosed; we emitted 2^30 ExeContexts already
+         and have run out of numbers.  Not sure what to do. */
+      VG_(core_panic)("m_execontext: more than 2^30 ExeContexts created");
+   }
+   return ecu;
+}
+
+/* Trie mode: the node hash table is indexed by (parent, ip). */
+static UWord calc_node_hash ( ECNode* parent, Addr ip, UWord htab_sz )
+{
+   UWord hash = ROLW((UWord)parent, 19) ^ ip;
+   vg_assert(htab_sz > 0);
+   return hash % htab_sz;
+}
+
+static void resize_ec_node_htab ( void )
+{
+   SizeT    i;
+   SizeT    new_size;
+   ECNode** new_htab;
+
+   vg_assert(ec_node_htab_size_idx >= 0
+             && ec_node_htab_size_idx < N_EC_PRIMES);
+   if (ec_node_htab_size_idx == N_EC_PRIMES-1)
+      return; /* out of primes - can't resize further */
+
+   new_size = ec_primes[ec_node_htab_size_idx + 1];
+   new_htab = VG_(arena_malloc)(VG_AR_EXECTXT, "execontext.reh2",
+                                sizeof(ECNode*) * new_size);
+
+   VG_(debugLog)(
+      1, "execontext",
+         "resizing node htab from size %lu to %lu (idx %lu)  "
+         "Total#nodes=%llu\n",
+         ec_node_htab_size, new_size, ec_node_htab_size_idx + 1,
+         ec_trie_nodes);
+
+   for (i = 0; i < new_size; i++)
+      new_htab[i] = NULL;
+
+   for (i = 0; i < ec_node_htab_size; i++) {
+      ECNode* cur = ec_node_htab[i];
+      while (cur) {
+         ECNode* next = cur->chain;
+         UWord hash = calc_node_hash(cur->parent, cur->ip, new_size);
+         vg_assert(hash < new_size);
+         cur->chain = new_htab[hash];
+         new_htab[hash] = cur;
+         cur = next;
+      }
+   }
+
+   VG_(arena_free)(VG_AR_EXECTXT, ec_node_htab);
+   ec_node_htab      = new_htab;
+   ec_node_htab_size = new_size;
+   ec_node_htab_size_idx++;
+}
+
+/* Trie mode: find the node for 'ip' called from 'parent', making it
+   if it doesn't exist yet. */
+static ECNode* intern_ECNode ( ECNode* parent, Addr ip )
+{
+   UWord   hash = calc_node_hash( parent, ip, ec_node_htab_size );
+   ECNode* node;
+
+   for (node = ec_node_htab[hash]; node; node = node->chain) {
+      ec_trie_probes++;
+      if (node->ip == ip && node->parent == parent)
+         return node;
+   }
+
+   node = VG_(allocEltPA)(ec_node_pa);
+   node->ecu    = 0;
+   node->n_ips  = parent ? parent->n_ips + 1 : 1;
+   node->parent = parent;
+   node->ip     = ip;
+   node->chain  = ec_node_htab[hash];
+   ec_node_htab[hash] = node;
+   ec_trie_nodes++;
+
+   if (ec_trie_nodes > (ULong)ec_node_htab_size)
+      resize_ec_node_htab();
+
+   return node;
+}
+
+/* Trie mode: the equivalent of record_ExeContext_wrk2.  Walk down
+   the trie from the outermost caller, adding nodes as needed, and
+   hand out the final one. */
+static ExeContext* record_ExeContext_trie ( Addr* ips, UInt n_ips )
+{
+   Int     i;
+   ECNode* node = NULL;
+
+   ec_searchreqs++;
+   for (i = n_ips-1; i >= 0; i--)
+      node = intern_ECNode( node, ips[i] );
+   vg_assert(node->n_ips == n_ips);
+
+   if (node->ecu == 0) {
+      ec_totstored++;
+      ec_flat_bytes += sizeof(struct _ExeContext) + n_ips * sizeof(Addr);
+      node->ecu = new_ECU();
+   }
+   return (ExeContext*)node;
+}
+
 /* Do the first part of getting a stack trace: actually unwind the
    stack, and hand the results off to the duplicate-trace-finder
    (_wrk2). */
@@ -337,6 +585,9 @@ static ExeContext* record_ExeContext_wrk2 ( Addr* ips, UInt n_ips )
 
    tl_assert(n_ips >= 1 && n_ips <= VG_(clo_backtrace_size));
 
+   if (ec_trie)
+      return record_ExeContext_trie( ips, n_ips );
+
    /* Now figure out if we've seen this one before.  First hash it so
       as to determine the list number. */
    hash = calc_hash( ips, n_ips, ec_htab_size );
@@ -392,6 +643,7 @@ static ExeContext* record_ExeContext_wrk2 ( Addr* ips, UInt n_ips )
 
    /* Bummer.  We have to allocate a new context record. */
    ec_totstored++;
+   ec_flat_bytes += sizeof(struct _ExeContext) + n_ips * sizeof(Addr);
 
    new_ec = VG_(arena_malloc)( VG_AR_EXECTXT, "execontext.rEw2.2",
                                sizeof(struct _ExeContext) 
@@ -400,14 +652,7 @@ static ExeContext* record_ExeContext_wrk2 ( Addr* ips, UInt n_ips )
    for (i = 0; i < n_ips; i++)
       new_ec->ips[i] = ips[i];
 
-   vg_assert(VG_(is_plausible_ECU)(ec_next_ecu));
-   new_ec->ecu = ec_next_ecu;
-   ec_next_ecu += 4;
-   if (ec_next_ecu == 0) {
-      /* Urr.  Now we're hosed; we emitted 2^30 ExeContexts already
-         and have run out of numbers.  Not sure what to do. */
-      VG_(core_panic)("m_execontext: more than 2^30 ExeContexts created");
-   }
+   new_ec->ecu = new_ECU();
 
    new_ec->n_ips = n_ips;
    new_ec->chain = ec_htab[hash];
@@ -439,10 +684,36 @@ ExeContext* VG_(make_depth_1_ExeContext_from_Addr)( Addr a ) {
    return record_ExeContext_wrk2( &a, 1 );
 }
 
-StackTrace VG_(get_ExeContext_StackTrace) ( ExeContext* e ) {
+StackTrace VG_(get_ExeContext_StackTrace) ( ExeContext* e, Addr* buf ) {
+   if (ec_trie) {
+      get_ECNode_ips( (ECNode*)e, buf );
+      return buf;
+   }
    return e->ips;
 }  
 
+UWord VG_(hash_ExeContext_top) ( ExeContext* e, UInt n_ips )
+{
+   UInt  i;
+   UWord hash = 0;
+
+   if (e == NULL)
+      return 0;
+   if (ec_trie) {
+      ECNode* node = (ECNode*)e;
+      for (i = 0; i < n_ips && node != NULL; i++, node = node->parent) {
+         hash ^= node->ip;
+         hash = ROLW(hash, 19);
+      }
+   } else {
+      for (i = 0; i < n_ips && i < e->n_ips; i++) {
+         hash ^= e->ips[i];
+         hash = ROLW(hash, 19);
+      }
+   }
+   return hash;
+}
+
 UInt VG_(get_ECU_from_ExeContext)( ExeContext* e ) {
    vg_assert(VG_(is_plausible_ECU)(e->ecu));
    return e->ecu;
@@ -458,6 +729,16 @@ ExeContext* VG_(get_ExeContext_from_ECU)( UInt ecu )
    UWord i;
    ExeContext* ec;
    vg_assert(VG_(is_plausible_ECU)(ecu));
+   if (ec_trie) {
+      ECNode* node;
+      for (i = 0; i < ec_node_htab_size; i++) {
+         for (node = ec_node_htab[i]; node; node = node->chain) {
+            if (node->ecu == ecu)
+               return (ExeContext*)node;
+         }
+      }
+      return NULL;
+   }
    vg_assert(ec_htab_size > 0);
    for (i = 0; i < ec_htab_size; i++) {
       for (ec = ec_htab[i]; ec; ec = ec->chain) {
@@ -50,6 +50,7 @@
 #include "pub_core_tooliface.h"       /* VG_TRACK */
 #include "pub_core_libcsetjmp.h"      // to keep _threadstate.h happy
 #include "pub_core_threadstate.h"     /* ThreadArchState */
+#include "pub_core_vdso.h"            /* VG_(vdso_init) */
 #include "priv_initimg_pathscan.h"
 #include "pub_core_initimg.h"         /* self */
 
@@ -752,10 +753,14 @@ Addr setup_client_stack( void*  init_sp,
 
 #        if !defined(VGP_ppc32_linux) && !defined(VGP_ppc64_linux)
          case AT_SYSINFO_EHDR: {
-            /* Trash this, because we don't reproduce it */
+            /* Trash this, because we don't reproduce it.  The vDSO
+               itself is kept, though, if m_vdso wants it for the
+               time syscalls (--vdso-time=yes). */
             const NSegment* ehdrseg = VG_(am_find_nsegment)((Addr)auxv->u.a_ptr);
             vg_assert(ehdrseg);
-            VG_(am_munmap_valgrind)(ehdrseg->start, ehdrseg->end - ehdrseg->start);
+            if (!VG_(vdso_init)((Addr)auxv->u.a_ptr))
+               VG_(am_munmap_valgrind)(ehdrseg->start,
+                                       ehdrseg->end - ehdrseg->start);
             auxv->a_type = AT_IGNORE;
             break;
          }
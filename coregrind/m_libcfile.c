@@ -74,6 +74,23 @@ Int VG_(safe_fd)(Int oldfd)
    return newfd;
 }
 
+/* Close every fd, the client's and Valgrind's, except keep_fd and
+   the log and XML output fds. */
+void VG_(close_fds_except)(Int keep_fd)
+{
+   Int fd;
+
+   /* Valgrind's own fds are the few just above VG_(fd_hard_limit). */
+   vg_assert(VG_(fd_hard_limit) != -1);
+   for (fd = 0; fd < VG_(fd_hard_limit) + 64; fd++) {
+      if (fd == keep_fd
+          || fd == VG_(log_output_sink).fd
+          || fd == VG_(xml_output_sink).fd)
+         continue;
+      VG_(close)(fd);
+   }
+}
+
 /* Given a file descriptor, attempt to deduce its filename.  To do
    this, we use /proc/self/fd/<FD>.  If this doesn't point to a file,
    or if it doesn't exist, we return False. */
@@ -604,13 +604,33 @@ Int VG_(fork) ( void )
 #  endif
 }
 
+Int VG_(fork_quietly) ( void )
+{
+#  if defined(VGO_linux)
+   /* clone with no flags and no exit signal.  Passing zero for every
+      argument means the differing argument orders of the various
+      clone ABIs don't matter. */
+   SysRes res;
+   res = VG_(do_syscall5)(__NR_clone, 0, 0, 0, 0, 0);
+   if (sr_isError(res))
+      return -1;
+   return sr_Res(res);
+
+#  elif defined(VGO_darwin)
+   return -1;
+
+#  else
+#    error "Unknown OS"
+#  endif
+}
+
 /* ---------------------------------------------------------------------
    Timing stuff
    ------------------------------------------------------------------ */
 
-UInt VG_(read_millisecond_timer) ( void )
+ULong VG_(read_nanosecond_timer) ( void )
 {
-   /* 'now' and 'base' are in microseconds */
+   /* 'now' and 'base' are in nanoseconds */
    static ULong base = 0;
    ULong  now;
 
@@ -620,12 +640,12 @@ UInt VG_(read_millisecond_timer) ( void )
      res = VG_(do_syscall2)(__NR_clock_gettime, VKI_CLOCK_MONOTONIC,
                             (UWord)&ts_now);
      if (sr_isError(res) == 0) {
-        now = ts_now.tv_sec * 1000000ULL + ts_now.tv_nsec / 1000;
+        now = ts_now.tv_sec * 1000000000ULL + ts_now.tv_nsec;
      } else {
        struct vki_timeval tv_now;
        res = VG_(do_syscall2)(__NR_gettimeofday, (UWord)&tv_now, (UWord)NULL);
        vg_assert(! sr_isError(res));
-       now = tv_now.tv_sec * 1000000ULL + tv_now.tv_usec;
+       now = (tv_now.tv_sec * 1000000ULL + tv_now.tv_usec) * 1000ULL;
      }
    }
 
@@ -638,7 +658,7 @@ UInt VG_(read_millisecond_timer) ( void )
      struct vki_timeval tv_now = { 0, 0 };
      res = VG_(do_syscall2)(__NR_gettimeofday, (UWord)&tv_now, (UWord)NULL);
      vg_assert(! sr_isError(res));
-     now = sr_Res(res) * 1000000ULL + sr_ResHI(res);
+     now = (sr_Res(res) * 1000000ULL + sr_ResHI(res)) * 1000ULL;
    }
 
 #  else
@@ -649,7 +669,17 @@ UInt VG_(read_millisecond_timer) ( void )
    if (base == 0)
       base = now;
 
-   return (now - base) / 1000;
+   return now - base;
+}
+
+ULong VG_(read_microsecond_timer) ( void )
+{
+   return VG_(read_nanosecond_timer)() / 1000;
+}
+
+UInt VG_(read_millisecond_timer) ( void )
+{
+   return (UInt)(VG_(read_nanosecond_timer)() / 1000000);
 }
 
 
@@ -60,11 +60,14 @@
 #include "pub_core_seqmatch.h"      // For VG_(string_match)
 #include "pub_core_signals.h"
 #include "pub_core_stacks.h"        // For VG_(register_stack)
+#include "pub_core_stacktrace.h"    // For VG_(print_stacktrace_stats)
 #include "pub_core_syswrap.h"
 #include "pub_core_tooliface.h"
 #include "pub_core_translate.h"     // For VG_(translate)
 #include "pub_core_trampoline.h"
 #include "pub_core_transtab.h"
+#include "pub_core_transcache.h"
+#include "pub_core_vdso.h"          // VG_(print_vdso_stats)
 #include "pub_tool_inner.h"
 #if defined(ENABLE_INNER_CLIENT_REQUEST)
 #include "valgrind.h"
@@ -79,7 +82,12 @@ static void print_all_stats ( void )
 {
    VG_(print_translation_stats)();
    VG_(print_tt_tc_stats)();
+   VG_(print_transcache_stats)();
    VG_(print_scheduler_stats)();
+   VG_(print_syscall_stats)();
+   VG_(print_vdso_stats)();
+   VG_(print_debuginfo_stats)();
+   VG_(print_stacktrace_stats)();
    VG_(print_ExeContext_stats)();
    VG_(print_errormgr_stats)();
 
@@ -172,14 +180,48 @@ static void usage_NORETURN ( Bool debug_help )
 "                              part of the path after 'string'.  Allows removal\n"
 "                              of path prefixes.  Use this flag multiple times\n"
 "                              to specify a set of prefixes to remove.\n"
-"    --smc-check=none|stack|all|all-non-file [stack]\n"
+"    --smc-check=none|stack|all|all-non-file|pageprot [stack]\n"
 "                              checks for self-modifying code: none, only for\n"
-"                              code found in stacks, for all code, or for all\n"
-"                              code except that from file-backed mappings\n"
-"    --read-var-info=yes|no    read debug info on stack and global variables\n"
-"                              and use it to print better error messages in\n"
-"                              tools that make use of it (Memcheck, Helgrind,\n"
-"                              DRD) [no]\n"
+"                              code found in stacks, for all code, for all\n"
+"                              code except that from file-backed mappings,\n"
+"                              or by write-protecting code pages\n"
+"    --translation-cache-dir=<dir>  save translations in <dir> at exit and\n"
+"                              reuse them in later runs [none]\n"
+"    --num-transtab-sectors=<number> size of translated code cache, in\n"
+"                              sectors [8]\n"
+"    --max-transtab-sectors=<number> let the cache grow to this many sectors\n"
+"                              if code is repeatedly retranslated [0=no]\n"
+"    --transtab-sector-entries=<number> translations per sector [65521]\n"
+"    --transtab-survivors=no|yes  keep the most used translations when the\n"
+"                              cache is full [no]\n"
+"    --per-thread-fast-cache=no|yes  give each thread its own translation\n"
+"                              lookup cache [no]\n"
+"    --tiered-translation=no|yes  translate code quickly at first, and\n"
+"                              again more thoroughly once it is hot [no]\n"
+"    --tier-up-threshold=<number> executions after which a block is\n"
+"                              hot [1000]\n"
+"    --parallel-execution=no|yes  run threads in parallel, if the tool\n"
+"                              supports it; needs --vgdb=no [no]\n"
+"    --vdso-time=no|yes        do clock_gettime and gettimeofday via the\n"
+"                              vDSO rather than by syscalls [no]\n"
+"    --read-var-info=yes|no|lazy  read debug info on stack and global\n"
+"                              variables and use it to print better error\n"
+"                              messages in tools that make use of it\n"
+"                              (Memcheck, Helgrind, DRD); lazy reads it one\n"
+"                              compilation unit at a time, as needed [no]\n"
+"    --read-var-info-cus=<number>  with --read-var-info=lazy, keep the info\n"
+"                              of at most <number> compilation units [64]\n"
+"    --read-debuginfo=eager|lazy  read line numbers, unwind info and\n"
+"                              variable info when objects are mapped, or\n"
+"                              when first needed [eager]\n"
+"    --debuginfo-cache-dir=<dir>  keep debug info tables in <dir> for\n"
+"                              reuse by later runs [none]\n"
+"    --debuginfo-workers=<number>  read the variable info of large objects\n"
+"                              with <number> helper processes [0]\n"
+"    --unwind-memo=no|yes      reuse the outer frames of a thread's last\n"
+"                              stack trace when they are unchanged [yes]\n"
+"    --execontext-storage=hash|trie  store each stack trace separately, or\n"
+"                              share the frames traces have in common [hash]\n"
 "    --vgdb-poll=<number>      gdbserver poll max every <number> basic blocks [%d] \n"
 "    --vgdb-shadow-registers=no|yes   let gdb see the shadow registers [no]\n"
 "    --vgdb-prefix=<prefix>    prefix for vgdb FIFOs [%s]\n"
@@ -187,6 +229,7 @@ static void usage_NORETURN ( Bool debug_help )
 "    --sim-hints=hint1,hint2,...  known hints:\n"
 "                                 lax-ioctls, enable-outer, fuse-compatible [none]\n"
 "    --fair-sched=no|yes|try   schedule threads fairly on multicore systems [no]\n"
+"    --adaptive-sched=no|yes   adapt timeslices to how threads behave [no]\n"
 "    --kernel-variant=variant1,variant2,...  known variants: bproc [none]\n"
 "                              handle non-standard kernel variants\n"
 "    --show-emwarns=no|yes     show warnings about emulation limits? [no]\n"
@@ -226,6 +269,9 @@ static void usage_NORETURN ( Bool debug_help )
 "    --wait-for-gdb=yes|no     pause on startup to wait for gdb attach\n"
 "    --sym-offsets=yes|no      show syms in form 'name+offset' ? [no]\n"
 "    --command-line-only=no|yes  only use command line options [no]\n"
+"    --debuginfo-workers-min-size=<number>  with --debuginfo-workers, only\n"
+"                              divide up .debug_info sections of at least\n"
+"                              <number> bytes [4194304]\n"
 "\n"
 "  Vex options for all Valgrind tools:\n"
 "    --vex-iropt-verbosity=<0..9>           [0]\n"
@@ -326,6 +372,7 @@ static void usage_NORETURN ( Bool debug_help )
    - set VG_(clo_max_stackframe) (--max-stackframe=)
    - set VG_(clo_main_stacksize) (--main-stacksize=)
    - set VG_(clo_sim_hints) (--sim-hints=)
+   - set VG_(clo_vdso_time) (--vdso-time=)
 
    That's all it does.  The main command line processing is done below
    by main_process_cmd_line_options.  Note that
@@ -371,6 +418,16 @@ static void early_process_cmd_line_options ( /*OUT*/Int* need_help,
       // running in an outer, to have "no-inner-prefix" enabled
       // as early as possible.
       else if VG_STR_CLO (str, "--sim-hints",     VG_(clo_sim_hints)) {}
+
+      // Set up VG_(clo_vdso_time).  VG_(ii_create_image) needs it to
+      // decide whether to keep the vDSO.
+      else if VG_BOOL_CLO(str, "--vdso-time",     VG_(clo_vdso_time)) {
+#        if !defined(VGP_x86_linux) && !defined(VGP_amd64_linux)
+         if (VG_(clo_vdso_time))
+            VG_(fmsg_bad_option)(str,
+               "--vdso-time is not supported on this platform.\n");
+#        endif
+      }
    }
 }
 
@@ -489,6 +546,7 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
       else if VG_STREQN(16, arg, "--max-stackframe")     {}
       else if VG_STREQN(16, arg, "--main-stacksize")     {}
       else if VG_STREQN(11, arg,  "--sim-hints")         {}
+      else if VG_STREQN(11, arg,  "--vdso-time")         {}
       else if VG_STREQN(14, arg, "--profile-heap")       {}
       else if VG_STREQN(14, arg, "--core-redzone-size")  {}
       else if VG_STREQN(14, arg, "--redzone-size")       {}
@@ -543,6 +601,13 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
 
       else if VG_BOOL_CLO(arg, "--run-libc-freeres", VG_(clo_run_libc_freeres)) {}
       else if VG_BOOL_CLO(arg, "--show-below-main",  VG_(clo_show_below_main)) {}
+      else if VG_BOOL_CLO(arg, "--unwind-memo",      VG_(clo_unwind_memo)) {}
+      else if VG_XACT_CLO(arg, "--execontext-storage=hash",
+                                                    VG_(clo_execontext_trie),
+                                                    False) {}
+      else if VG_XACT_CLO(arg, "--execontext-storage=trie",
+                                                    VG_(clo_execontext_trie),
+                                                    True) {}
       else if VG_BOOL_CLO(arg, "--time-stamp",       VG_(clo_time_stamp)) {}
       else if VG_BOOL_CLO(arg, "--track-fds",        VG_(clo_track_fds)) {}
       else if VG_BOOL_CLO(arg, "--trace-children",   VG_(clo_trace_children)) {}
@@ -559,6 +624,7 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
             VG_(fmsg_bad_option)(arg, "");
 
       }
+      else if VG_BOOL_CLO(arg, "--adaptive-sched",   VG_(clo_adaptive_sched)) {}
       else if VG_BOOL_CLO(arg, "--trace-sched",      VG_(clo_trace_sched)) {}
       else if VG_BOOL_CLO(arg, "--trace-signals",    VG_(clo_trace_signals)) {}
       else if VG_BOOL_CLO(arg, "--trace-symtab",     VG_(clo_trace_symtab)) {}
@@ -576,7 +642,30 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
       else if VG_BOOL_CLO(arg, "--wait-for-gdb",     VG_(clo_wait_for_gdb)) {}
       else if VG_STR_CLO (arg, "--db-command",       VG_(clo_db_command)) {}
       else if VG_BOOL_CLO(arg, "--sym-offsets",      VG_(clo_sym_offsets)) {}
-      else if VG_BOOL_CLO(arg, "--read-var-info",    VG_(clo_read_var_info)) {}
+      else if VG_XACT_CLO(arg, "--read-var-info=lazy",
+                                                    VG_(clo_lazy_var_info),
+                                                    True) {
+         VG_(clo_read_var_info) = True;
+      }
+      else if VG_BOOL_CLO(arg, "--read-var-info",    VG_(clo_read_var_info)) {
+         VG_(clo_lazy_var_info) = False;
+      }
+      else if VG_BINT_CLO(arg, "--read-var-info-cus",
+                                                    VG_(clo_read_var_info_cus),
+                                                    1, 1000000) {}
+      else if VG_XACT_CLO(arg, "--read-debuginfo=eager",
+                                                    VG_(clo_lazy_debuginfo),
+                                                    False) {}
+      else if VG_XACT_CLO(arg, "--read-debuginfo=lazy",
+                                                    VG_(clo_lazy_debuginfo),
+                                                    True) {}
+      else if VG_STR_CLO (arg, "--debuginfo-cache-dir",
+                                                    VG_(clo_debuginfo_cache_dir)) {}
+      else if VG_BINT_CLO(arg, "--debuginfo-workers",
+                                                    VG_(clo_debuginfo_workers), 0, 64) {}
+      else if VG_BINT_CLO(arg, "--debuginfo-workers-min-size",
+                                                    VG_(clo_debuginfo_workers_min_szB),
+                                                    0, 1 << 30) {}
 
       else if VG_INT_CLO (arg, "--dump-error",       VG_(clo_dump_error))   {}
       else if VG_INT_CLO (arg, "--input-fd",         VG_(clo_input_fd))     {}
@@ -593,6 +682,43 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
       else if VG_XACT_CLO(arg, "--smc-check=all-non-file",
                                                     VG_(clo_smc_check),
                                                     Vg_SmcAllNonFile);
+      else if VG_XACT_CLO(arg, "--smc-check=pageprot",
+                                                    VG_(clo_smc_check),
+                                                    Vg_SmcPageProt);
+      else if VG_STR_CLO (arg, "--translation-cache-dir",
+                                                    VG_(clo_translation_cache_dir)) {}
+      else if VG_BINT_CLO(arg, "--num-transtab-sectors",
+                                                    VG_(clo_num_transtab_sectors),
+                                                    1, MAX_N_SECTORS) {}
+      else if VG_BINT_CLO(arg, "--max-transtab-sectors",
+                                                    VG_(clo_max_transtab_sectors),
+                                                    0, MAX_N_SECTORS) {}
+      else if VG_BINT_CLO(arg, "--transtab-sector-entries",
+                                                    VG_(clo_transtab_sector_entries),
+                                                    1000, MAX_N_TTES_PER_SECTOR) {}
+      else if VG_BOOL_CLO(arg, "--transtab-survivors",
+                                                    VG_(clo_transtab_survivors)) {}
+      else if VG_BOOL_CLO(arg, "--per-thread-fast-cache",
+                                                    VG_(clo_per_thread_fast_cache)) {
+#        if !defined(VGP_x86_linux) && !defined(VGP_amd64_linux)
+         if (VG_(clo_per_thread_fast_cache))
+            VG_(fmsg_bad_option)(arg,
+               "Per-thread fast caches are not supported on this platform.\n");
+#        endif
+      }
+      else if VG_BOOL_CLO(arg, "--tiered-translation",
+                                                    VG_(clo_tiered_translation)) {}
+      else if VG_BINT_CLO(arg, "--tier-up-threshold",
+                                                    VG_(clo_tier_up_threshold),
+                                                    1, 1000000000) {}
+      else if VG_BOOL_CLO(arg, "--parallel-execution",
+                                                    VG_(clo_parallel_execution)) {
+#        if !defined(VGP_x86_linux) && !defined(VGP_amd64_linux)
+         if (VG_(clo_parallel_execution))
+            VG_(fmsg_bad_option)(arg,
+               "Parallel execution is not supported on this platform.\n");
+#        endif
+      }
 
       else if VG_STR_CLO (arg, "--kernel-variant",  VG_(clo_kernel_variant)) {}
 
@@ -802,6 +928,13 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
 
    VG_(dyn_vgdb_error) = VG_(clo_vgdb_error);
 
+   /* Quick translations count their executions using the same
+      mechanism as --profile-flags. */
+   if (VG_(clo_tiered_translation) && VG_(clo_profile_flags) > 0) {
+      VG_(fmsg_bad_option)("--tiered-translation=yes",
+         "Can't use --tiered-translation=yes with --profile-flags.\n");
+   }
+
    if (VG_(clo_gen_suppressions) > 0 && 
        !VG_(needs).core_errors && !VG_(needs).tool_errors) {
       VG_(fmsg_bad_option)("--gen-suppressions=yes",
@@ -1986,6 +2119,24 @@ Int valgrind_main ( Int argc, HChar **argv, HChar **envp )
       }
    }
 
+   /* Now we know whether the tool can run threads in parallel.  If
+      so, they will need a fast cache each, since the dispatcher
+      updates it. */
+   if (VG_(clo_parallel_execution)) {
+      const HChar* why = NULL;
+      if (!VG_(needs).thread_safe_instrumentation)
+         why = "this tool does not support it";
+      else if (VG_(clo_vgdb) != Vg_VgdbNo)
+         why = "it needs --vgdb=no";
+      if (why) {
+         VG_(umsg)("Warning: ignoring --parallel-execution=yes, "
+                   "since %s\n", why);
+         VG_(clo_parallel_execution) = False;
+      } else {
+         VG_(clo_per_thread_fast_cache) = True;
+      }
+   }
+
    //--------------------------------------------------------------
    // Initialise translation table and translation cache
    //   p: aspacem         [??]
@@ -1994,6 +2145,14 @@ Int valgrind_main ( Int argc, HChar **argv, HChar **envp )
    VG_(debugLog)(1, "main", "Initialise TT/TC\n");
    VG_(init_tt_tc)();
 
+   //--------------------------------------------------------------
+   // Initialise the persistent translation cache
+   //   p: init_tt_tc                [so translations can be added]
+   //   p: post_clo_init             [so the tool's needs are known]
+   //--------------------------------------------------------------
+   VG_(debugLog)(1, "main", "Initialise persistent translation cache\n");
+   VG_(init_transcache)();
+
    //--------------------------------------------------------------
    // Initialise the redirect table.
    //   p: init_tt_tc [so it can call VG_(search_transtab) safely]
@@ -2484,6 +2643,9 @@ void shutdown_actions_NORETURN( ThreadId tid,
 
    VG_(sanity_check_general)( True /*include expensive checks*/ );
 
+   /* Keep this run's translations for the next one. */
+   VG_(transcache_save)();
+
    if (VG_(clo_stats))
       print_all_stats();
 
@@ -38,6 +38,7 @@
 #include "pub_core_libcproc.h"
 #include "pub_core_mallocfree.h"
 #include "pub_core_seqmatch.h"     // VG_(string_match)
+#include "pub_core_transtab.h"     // N_SECTORS_DEFAULT
 
 // See pub_{core,tool}_options.h for explanations of all these.
 
@@ -94,6 +95,7 @@ Bool   VG_(clo_debug_dump_frames) = False;
 Bool   VG_(clo_trace_redir)    = False;
 enum FairSchedType
        VG_(clo_fair_sched)     = disable_fair_sched;
+Bool   VG_(clo_adaptive_sched) = False;
 Bool   VG_(clo_trace_sched)    = False;
 Bool   VG_(clo_profile_heap)   = False;
 Int    VG_(clo_core_redzone_size) = CORE_REDZONE_DEFAULT_SZB;
@@ -105,6 +107,12 @@ Int    VG_(clo_backtrace_size) = 12;
 Char*  VG_(clo_sim_hints)      = NULL;
 Bool   VG_(clo_sym_offsets)    = False;
 Bool   VG_(clo_read_var_info)  = False;
+Bool   VG_(clo_lazy_var_info)  = False;
+Int    VG_(clo_read_var_info_cus) = 64;
+Bool   VG_(clo_lazy_debuginfo) = False;
+HChar* VG_(clo_debuginfo_cache_dir) = NULL;
+Int    VG_(clo_debuginfo_workers) = 0;
+Int    VG_(clo_debuginfo_workers_min_szB) = 4 * 1024 * 1024;
 Int    VG_(clo_n_req_tsyms)    = 0;
 HChar* VG_(clo_req_tsyms)[VG_CLO_MAX_REQ_TSYMS];
 HChar* VG_(clo_require_text_symbol) = NULL;
@@ -114,8 +122,20 @@ Bool   VG_(clo_show_below_main)= False;
 Bool   VG_(clo_show_emwarns)   = False;
 Word   VG_(clo_max_stackframe) = 2000000;
 Word   VG_(clo_main_stacksize) = 0; /* use client's rlimit.stack */
+Bool   VG_(clo_unwind_memo)    = True;
+Bool   VG_(clo_execontext_trie) = False;
 Bool   VG_(clo_wait_for_gdb)   = False;
 VgSmc  VG_(clo_smc_check)      = Vg_SmcStack;
+HChar* VG_(clo_translation_cache_dir) = NULL;
+Int    VG_(clo_num_transtab_sectors) = N_SECTORS_DEFAULT;
+Int    VG_(clo_max_transtab_sectors) = 0;
+Int    VG_(clo_transtab_sector_entries) = MAX_N_TTES_PER_SECTOR;
+Bool   VG_(clo_transtab_survivors) = False;
+Bool   VG_(clo_per_thread_fast_cache) = False;
+Bool   VG_(clo_tiered_translation) = False;
+Int    VG_(clo_tier_up_threshold) = 1000;
+Bool   VG_(clo_parallel_execution) = False;
+Bool   VG_(clo_vdso_time)      = False;
 HChar* VG_(clo_kernel_variant) = NULL;
 Bool   VG_(clo_dsymutil)       = False;
 
@@ -39,8 +39,46 @@ struct sched_lock_ops {
    int (*get_sched_lock_owner)(struct sched_lock *p);
    void (*acquire_sched_lock)(struct sched_lock *p);
    void (*release_sched_lock)(struct sched_lock *p);
+   Bool (*sched_lock_has_waiters)(struct sched_lock *p);
 };
 
+/*
+ * A thread which finds the lock taken first spins for a while, since the
+ * owner often releases it soon, and sleeping costs two context switches:
+ * one to go to sleep and one to be woken up.  How long to spin adapts to
+ * how often spinning has paid off: the limit moves towards twice the
+ * spin count which worked, and halves when spinning didn't help, so that
+ * hardly any time is wasted spinning on a uniprocessor, or when the lock
+ * is held for long periods.
+ */
+#define SCHED_LOCK_MIN_SPIN 16
+#define SCHED_LOCK_MAX_SPIN 4096
+
+static inline void sched_lock_spin_pause(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+   __asm__ __volatile__("pause" : : : "memory");
+#else
+   __asm__ __volatile__("" : : : "memory");
+#endif
+}
+
+static inline void sched_lock_adapt_spin(volatile Int *spin_limit, Int spins,
+                                         Bool got_it)
+{
+   Int limit = *spin_limit;
+
+   if (got_it)
+      limit += (2 * spins + SCHED_LOCK_MIN_SPIN - limit) / 8;
+   else
+      limit /= 2;
+   if (limit < SCHED_LOCK_MIN_SPIN)
+      limit = SCHED_LOCK_MIN_SPIN;
+   if (limit > SCHED_LOCK_MAX_SPIN)
+      limit = SCHED_LOCK_MAX_SPIN;
+   *spin_limit = limit;
+}
+
 extern const struct sched_lock_ops ML_(generic_sched_lock_ops);
 extern const struct sched_lock_ops ML_(linux_ticket_lock_ops);
 
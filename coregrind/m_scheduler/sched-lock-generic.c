@@ -39,6 +39,8 @@
 
 struct sched_lock {
    vg_sema_t sema;
+   volatile Int n_waiting;   /* threads in acquire_sched_lock() */
+   volatile Int spin_limit;
 };
 
 static const Char *get_sched_lock_name(void)
@@ -51,8 +53,11 @@ static struct sched_lock *create_sched_lock(void)
    struct sched_lock *p;
 
    p = VG_(malloc)("sched_lock", sizeof(*p));
-   if (p)
+   if (p) {
       ML_(sema_init)(&p->sema);
+      p->n_waiting = 0;
+      p->spin_limit = SCHED_LOCK_MIN_SPIN;
+   }
    return p;
 }
 
@@ -67,9 +72,24 @@ static int get_sched_lock_owner(struct sched_lock *p)
    return p->sema.owner_lwpid;
 }
 
+/*
+ * Spin while the lock is held before reading the token from the pipe.  If
+ * the owner gives the lock up meanwhile, the token is there, or about to
+ * be, and the read doesn't put this thread to sleep.
+ */
 static void acquire_sched_lock(struct sched_lock *p)
 {
+   Int spins, limit;
+
+   __sync_fetch_and_add(&p->n_waiting, 1);
+   limit = p->spin_limit;
+   for (spins = 0; spins < limit && p->sema.owner_lwpid > 0; spins++)
+      sched_lock_spin_pause();
+   if (spins > 0)
+      sched_lock_adapt_spin(&p->spin_limit, spins,
+                            p->sema.owner_lwpid <= 0);
    ML_(sema_down)(&p->sema, False);
+   __sync_fetch_and_sub(&p->n_waiting, 1);
 }
 
 static void release_sched_lock(struct sched_lock *p)
@@ -77,6 +97,11 @@ static void release_sched_lock(struct sched_lock *p)
    ML_(sema_up)(&p->sema, False);
 }
 
+static Bool sched_lock_has_waiters(struct sched_lock *p)
+{
+   return p->n_waiting > 0;
+}
+
 const struct sched_lock_ops ML_(generic_sched_lock_ops) = {
    .get_sched_lock_name  = get_sched_lock_name,
    .create_sched_lock    = create_sched_lock,
@@ -84,4 +109,5 @@ const struct sched_lock_ops ML_(generic_sched_lock_ops) = {
    .get_sched_lock_owner = get_sched_lock_owner,
    .acquire_sched_lock   = acquire_sched_lock,
    .release_sched_lock   = release_sched_lock,
+   .sched_lock_has_waiters = sched_lock_has_waiters,
 };
@@ -94,3 +94,13 @@ void ML_(release_sched_lock)(struct sched_lock *p)
 {
    return (sched_lock_ops->release_sched_lock)(p);
 }
+
+/**
+ * Whether any thread is waiting for the lock.  Only meaningful when
+ * called by the owner, and then only as a hint: a thread may start
+ * waiting just after this returns.
+ */
+Bool ML_(sched_lock_has_waiters)(struct sched_lock *p)
+{
+   return (sched_lock_ops->sched_lock_has_waiters)(p);
+}
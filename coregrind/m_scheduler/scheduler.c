@@ -106,6 +106,11 @@
    give finer interleaving but much increased scheduling overheads. */
 #define SCHEDULING_QUANTUM   100000
 
+/* With --adaptive-sched=yes, the bounds within which each thread's
+   timeslice is adjusted. */
+#define SCHED_MIN_QUANTUM      5000
+#define SCHED_MAX_QUANTUM    400000
+
 /* If False, a fault is Valgrind-internal (ie, a bug) */
 Bool VG_(in_generated_code) = False;
 
@@ -128,16 +133,45 @@ static void mostly_clear_thread_record ( ThreadId tid );
 static ULong n_scheduling_events_MINOR = 0;
 static ULong n_scheduling_events_MAJOR = 0;
 
-/* Stats: number of XIndirs, and number that missed in the fast
-   cache. */
+/* Number of times VG_(acquire_BigLock) has been called.  Lets the
+   scheduler see whether other threads ran while a thread was in a
+   syscall. */
+static ULong n_BigLock_acquires = 0;
+
+/* Stats for --adaptive-sched=yes: timeslices at the end of which
+   the_BigLock was kept since nobody else wanted it, and changes to
+   timeslice lengths. */
+static ULong stats__n_timeslices_kept = 0;
+static ULong stats__n_quantum_grows   = 0;
+static ULong stats__n_quantum_shrinks = 0;
+
+/* Stats, with --stats=yes only since they need the time: handoffs of
+   the_BigLock to a thread which was already waiting for it, and how
+   long the waiter took to get going, in microseconds.
+   last_BigLock_release is when VG_(release_BigLock) last ran. */
+static ULong last_BigLock_release = 0;
+static ULong stats__n_handoffs     = 0;
+static ULong stats__handoff_usecs  = 0;
+static ULong stats__max_handoff_usecs = 0;
+
+/* Stats: number of XIndirs, number that missed in the fast cache,
+   and number that hit in the fast cache but not in the first way of
+   their set (only counted where the fast cache is set-associative;
+   roughly, what a direct mapped cache would have missed). */
 static ULong stats__n_xindirs = 0;
 static ULong stats__n_xindir_misses = 0;
+static ULong stats__n_xindir_later_hits = 0;
+
+/* Stats: with --parallel-execution=yes, number of times threads had
+   to be kicked out of translated code. */
+static ULong stats__n_code_exclusives = 0;
 
 /* And 32-bit temp bins for the above, so that 32-bit platforms don't
    have to do 64 bit incs on the hot path through
    VG_(cp_disp_xindir). */
 /*global*/ UInt VG_(stats__n_xindirs_32) = 0;
 /*global*/ UInt VG_(stats__n_xindir_misses_32) = 0;
+/*global*/ UInt VG_(stats__n_xindir_later_hits_32) = 0;
 
 /* Sanity checking counts. */
 static UInt sanity_fast_count = 0;
@@ -152,9 +186,34 @@ void VG_(print_scheduler_stats)(void)
                 stats__n_xindirs, stats__n_xindir_misses,
                 stats__n_xindirs / (stats__n_xindir_misses 
                                     ? stats__n_xindir_misses : 1));
+   if (VG_TT_FAST_WAYS > 1)
+      VG_(message)(Vg_DebugMsg,
+                   "scheduler: fast cache hit rate %llu%%, "
+                   "%'llu hits not in way 0\n",
+                   stats__n_xindirs == 0 ? 0 :
+                      100 - (100 * stats__n_xindir_misses) / stats__n_xindirs,
+                   stats__n_xindir_later_hits);
    VG_(message)(Vg_DebugMsg,
       "scheduler: %'llu/%'llu major/minor sched events.\n",
       n_scheduling_events_MAJOR, n_scheduling_events_MINOR);
+   VG_(message)(Vg_DebugMsg,
+      "scheduler: %'llu event checks per timeslice on average\n",
+      bbs_done / (n_scheduling_events_MAJOR + 1));
+   if (VG_(clo_adaptive_sched))
+      VG_(message)(Vg_DebugMsg,
+         "scheduler: %'llu timeslices kept the lock, "
+         "%'llu/%'llu timeslices lengthened/shortened\n",
+         stats__n_timeslices_kept,
+         stats__n_quantum_grows, stats__n_quantum_shrinks);
+   VG_(message)(Vg_DebugMsg,
+      "scheduler: %'llu lock handoffs, latency %'llu us avg, %'llu us max\n",
+      stats__n_handoffs,
+      stats__handoff_usecs / (stats__n_handoffs ? stats__n_handoffs : 1),
+      stats__max_handoff_usecs);
+   if (VG_(clo_parallel_execution))
+      VG_(message)(Vg_DebugMsg,
+                   "scheduler: %'llu times threads kicked out of "
+                   "parallel code\n", stats__n_code_exclusives);
    VG_(message)(Vg_DebugMsg, 
                 "   sanity: %d cheap, %d expensive checks.\n",
                 sanity_fast_count, sanity_slow_count );
@@ -253,6 +312,7 @@ ThreadId VG_(alloc_ThreadState) ( void )
 void VG_(acquire_BigLock)(ThreadId tid, HChar* who)
 {
    ThreadState *tst;
+   ULong wait_start = 0;
 
 #if 0
    if (VG_(clo_trace_sched)) {
@@ -266,8 +326,20 @@ void VG_(acquire_BigLock)(ThreadId tid, HChar* who)
    /* First, acquire the_BigLock.  We can't do anything else safely
       prior to this point.  Even doing debug printing prior to this
       point is, technically, wrong. */
+   if (VG_(clo_stats))
+      wait_start = VG_(read_microsecond_timer)();
    VG_(acquire_BigLock_LL)(NULL);
 
+   n_BigLock_acquires++;
+   if (VG_(clo_stats) && last_BigLock_release > wait_start) {
+      /* It was released while we were waiting: a handoff. */
+      ULong usecs = VG_(read_microsecond_timer)() - last_BigLock_release;
+      stats__n_handoffs++;
+      stats__handoff_usecs += usecs;
+      if (usecs > stats__max_handoff_usecs)
+         stats__max_handoff_usecs = usecs;
+   }
+
    tst = VG_(get_ThreadState)(tid);
 
    vg_assert(tst->status != VgTs_Runnable);
@@ -320,6 +392,9 @@ void VG_(release_BigLock)(ThreadId tid, ThreadStatus sleepstate, HChar* who)
       print_sched_event(tid, buf);
    }
 
+   if (VG_(clo_stats))
+      last_BigLock_release = VG_(read_microsecond_timer)();
+
    /* Release the_BigLock; this will reschedule any runnable
       thread. */
    VG_(release_BigLock_LL)(NULL);
@@ -443,6 +518,109 @@ void VG_(vg_yield)(void)
 }
 
 
+/* ---------------------------------------------------------------------
+   Parallel execution.
+   ------------------------------------------------------------------ */
+
+/* With --parallel-execution=yes, a thread gives up the_BigLock while
+   it runs translated code, and takes it back when it returns to the
+   scheduler (or takes a fault).  That is only safe if the tool's
+   instrumentation is (VG_(needs).thread_safe_instrumentation), and
+   if nothing changes the translated code or the fast caches under
+   the feet of the threads running it.  So anything which does must
+   first call VG_(acquire_code_exclusive), which kicks all such
+   threads back to the scheduler and waits until they have left.
+   Since entering parallel code needs the_BigLock, which the caller
+   of VG_(acquire_code_exclusive) holds, nobody can get back in
+   until it is done.  Chaining doesn't do that each time: see
+   VG_(tt_tc_do_chaining). */
+
+/* Number of threads currently running translated code without
+   the_BigLock. */
+static volatile Int n_parallel_threads = 0;
+
+/* Nesting depth of VG_(acquire_code_exclusive) calls. */
+static Int code_exclusive_depth = 0;
+
+/* Called with the_BigLock held, just before 'tid' runs translated
+   code. */
+void VG_(enter_parallel_code) ( ThreadId tid )
+{
+   ThreadState* tst = VG_(get_ThreadState)(tid);
+
+   vg_assert(VG_(clo_parallel_execution));
+   vg_assert(VG_(running_tid) == tid);
+   vg_assert(!tst->in_parallel_code);
+
+   tst->in_parallel_code = True;
+   __sync_fetch_and_add(&n_parallel_threads, 1);
+   VG_(in_generated_code) = False;
+   VG_(running_tid) = VG_INVALID_THREADID;
+   VG_(release_BigLock_LL)(NULL);
+}
+
+/* Matching function to VG_(enter_parallel_code): returns with
+   the_BigLock held and 'tid' the running thread again. */
+void VG_(leave_parallel_code) ( ThreadId tid )
+{
+   ThreadState* tst = VG_(get_ThreadState)(tid);
+
+   vg_assert(tst->in_parallel_code);
+
+   tst->in_parallel_code = False;
+   __sync_fetch_and_sub(&n_parallel_threads, 1);
+   VG_(acquire_BigLock_LL)(NULL);
+   vg_assert(VG_(running_tid) == VG_INVALID_THREADID);
+   VG_(running_tid) = tid;
+   VG_(in_generated_code) = True;
+}
+
+/* Get every other thread out of translated code.  Must be called
+   with the_BigLock held.  Calls nest. */
+void VG_(acquire_code_exclusive) ( void )
+{
+   ThreadId tid;
+
+   if (!VG_(clo_parallel_execution))
+      return;
+   if (code_exclusive_depth++ > 0)
+      return;
+
+   __sync_synchronize();
+   if (n_parallel_threads > 0) {
+      stats__n_code_exclusives++;
+      while (n_parallel_threads > 0) {
+         /* Make their next event check fail. */
+         for (tid = 1; tid < VG_N_THREADS; tid++) {
+            if (VG_(threads)[tid].in_parallel_code)
+               VG_(threads)[tid].arch.vex.host_EvC_COUNTER = 0;
+         }
+         VG_(do_syscall0)(__NR_sched_yield);
+      }
+   }
+
+   /* Chaining put off while they were running can be done now, and
+      must be, before the caller changes the translations it refers
+      to. */
+   VG_(tt_tc_do_queued_chaining)();
+}
+
+Bool VG_(parallel_code_running) ( void )
+{
+   /* Threads only enter parallel code with the_BigLock, which our
+      caller holds, so this can only go down until it is released. */
+   return VG_(clo_parallel_execution) && n_parallel_threads > 0;
+}
+
+void VG_(release_code_exclusive) ( void )
+{
+   if (!VG_(clo_parallel_execution))
+      return;
+   vg_assert(code_exclusive_depth > 0);
+   code_exclusive_depth--;
+}
+
+
 /* Set the standard set of blocked signals, used whenever we're not
    running a client syscall. */
 static void block_signals(void)
@@ -837,9 +1015,14 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
    do_pre_run_checks( (ThreadState*)tst );
    /* end Paranoia */
 
-   /* Futz with the XIndir stats counters. */
-   vg_assert(VG_(stats__n_xindirs_32) == 0);
-   vg_assert(VG_(stats__n_xindir_misses_32) == 0);
+   /* Futz with the XIndir stats counters.  With parallel execution
+      other threads update them at the same time, so they are only
+      approximate. */
+   if (!VG_(clo_parallel_execution)) {
+      vg_assert(VG_(stats__n_xindirs_32) == 0);
+      vg_assert(VG_(stats__n_xindir_misses_32) == 0);
+      vg_assert(VG_(stats__n_xindir_later_hits_32) == 0);
+   }
 
    /* Clear return area. */
    two_words[0] = two_words[1] = 0;
@@ -850,12 +1033,12 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
       host_code_addr = alt_host_addr;
    } else {
       /* normal case -- redir translation */
-      UInt cno = (UInt)VG_TT_FAST_HASH((Addr)tst->arch.vex.VG_INSTR_PTR);
-      if (LIKELY(VG_(tt_fast)[cno].guest == (Addr)tst->arch.vex.VG_INSTR_PTR))
-         host_code_addr = VG_(tt_fast)[cno].host;
+      AddrH res = 0;
+      if (LIKELY(VG_(lookup_fast_cache)(&res, tid,
+                                        (Addr)tst->arch.vex.VG_INSTR_PTR)))
+         host_code_addr = res;
       else {
-         AddrH res   = 0;
-         /* not found in VG_(tt_fast). Searching here the transtab
+         /* not found in the fast cache. Searching here the transtab
             improves the performance compared to returning directly
             to the scheduler. */
          Bool  found = VG_(search_transtab)(&res, NULL, NULL,
@@ -904,16 +1087,25 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
    vg_assert(VG_(in_generated_code) == False);
    VG_(in_generated_code) = True;
 
+   if (VG_(clo_parallel_execution))
+      VG_(enter_parallel_code)(tid);
+
    SCHEDSETJMP(
       tid, 
       jumped, 
       VG_(disp_run_translations)( 
          two_words,
          (void*)&tst->arch.vex,
-         host_code_addr
+         host_code_addr,
+         VG_(get_fast_cache)(tid)
       )
    );
 
+   /* If we came back via a fault, the signal handler has already
+      taken the_BigLock back. */
+   if (tst->in_parallel_code)
+      VG_(leave_parallel_code)(tid);
+
    vg_assert(VG_(in_generated_code) == True);
    VG_(in_generated_code) = False;
 
@@ -933,6 +1125,8 @@ void run_thread_for_a_while ( /*OUT*/HWord* two_words,
    VG_(stats__n_xindirs_32) = 0;
    stats__n_xindir_misses += (ULong)VG_(stats__n_xindir_misses_32);
    VG_(stats__n_xindir_misses_32) = 0;
+   stats__n_xindir_later_hits += (ULong)VG_(stats__n_xindir_later_hits_32);
+   VG_(stats__n_xindir_later_hits_32) = 0;
 
    /* Inspect the event counter. */
    vg_assert((Int)tst->arch.vex.host_EvC_COUNTER >= -1);
@@ -1004,6 +1198,24 @@ static void handle_tt_miss ( ThreadId tid )
    }
 }
 
+/* With --tiered-translation=yes, replace quick translations which
+   have turned out to be hot with proper ones.  Done at the end of a
+   timeslice, when no translated code is running.  If a block can't
+   be retranslated now, it gets a quick translation again next time it
+   is needed. */
+#define N_TIER_UPS 16
+
+static void tier_up_hot_translations ( ThreadId tid )
+{
+   Addr64 hot[N_TIER_UPS];
+   ULong  counts[N_TIER_UPS];
+   UInt   i, n;
+
+   n = VG_(take_hot_translations)( hot, counts, N_TIER_UPS );
+   for (i = 0; i < n; i++)
+      VG_(translate_hot)( tid, hot[i], counts[i], bbs_done );
+}
+
 static
 void handle_chain_me ( ThreadId tid, void* place_to_chain, Bool toFastEP )
 {
@@ -1125,6 +1337,15 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
    /* Holds the remaining size of this thread's "timeslice". */
    Int dispatch_ctr = 0;
 
+   /* The size of this thread's timeslices.  With --adaptive-sched=yes,
+      it shrinks each time the thread blocks, giving the lock up to
+      others, and grows each time the thread uses a whole timeslice
+      without doing so. */
+   Int quantum = SCHEDULING_QUANTUM;
+
+   /* Has the thread blocked or yielded since its timeslice started? */
+   Bool slice_interrupted = False;
+
    ThreadState *tst = VG_(get_ThreadState)(tid);
    static Bool vgdb_startup_action_done = False;
 
@@ -1183,7 +1404,7 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
    
    vg_assert(VG_(is_running_thread)(tid));
 
-   dispatch_ctr = SCHEDULING_QUANTUM;
+   dispatch_ctr = quantum;
 
    while (!VG_(is_exiting)(tid)) {
 
@@ -1207,12 +1428,21 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
 	 /* 3 Aug 06: doing sys__nsleep works but crashes some apps.
             sys_yield also helps the problem, whilst not crashing apps. */
 
-	 VG_(release_BigLock)(tid, VgTs_Yielding, 
-                                   "VG_(scheduler):timeslice");
-	 /* ------------ now we don't have The Lock ------------ */
+         /* With --adaptive-sched=yes, don't bother passing the lock
+            round if nobody is waiting for it.  Threads which are about
+            to want it can't be waiting for long, since the next
+            timeslice will be over in a bounded time. */
+         if (VG_(clo_adaptive_sched)
+             && !ML_(sched_lock_has_waiters)(the_BigLock)) {
+            stats__n_timeslices_kept++;
+         } else {
+	    VG_(release_BigLock)(tid, VgTs_Yielding, 
+                                      "VG_(scheduler):timeslice");
+	    /* ------------ now we don't have The Lock ------------ */
 
-	 VG_(acquire_BigLock)(tid, "VG_(scheduler):timeslice");
-	 /* ------------ now we do have The Lock ------------ */
+	    VG_(acquire_BigLock)(tid, "VG_(scheduler):timeslice");
+	    /* ------------ now we do have The Lock ------------ */
+         }
 
 	 /* OK, do some relatively expensive housekeeping stuff */
 	 scheduler_sanity(tid);
@@ -1236,7 +1466,8 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
 	    decrement is done before the bb is actually run, so you
 	    always get at least one decrement even if nothing happens. */
          // FIXME is this right?
-         dispatch_ctr = SCHEDULING_QUANTUM;
+         dispatch_ctr = quantum;
+         slice_interrupted = False;
 
 	 /* paranoia ... */
 	 vg_assert(tst->tid == tid);
@@ -1255,6 +1486,11 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
                               &dispatch_ctr,
                               tid, 0/*ignored*/, False );
 
+      /* Client writes to protected code pages are noted by the
+         signal handler; their translations are discarded here. */
+      if (VG_(clo_smc_check) == Vg_SmcPageProt)
+         VG_(pageprot_discard_pending)();
+
       if (VG_(clo_trace_sched) && VG_(clo_verbosity) > 2) {
 	 HChar buf[50];
 	 VG_(sprintf)(buf, "TRC: %s", name_of_sched_event(trc[0]));
@@ -1285,6 +1521,9 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
                               tid );
          vg_assert(trc[0] != VEX_TRC_JMP_NOREDIR);
 
+         if (VG_(clo_smc_check) == Vg_SmcPageProt)
+            VG_(pageprot_discard_pending)();
+
          /* This can't be allowed to happen, since it means the block
             didn't execute, and we have no way to resume-as-noredir
             after we get more timeslice.  But I don't think it ever
@@ -1332,10 +1571,28 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
       case VEX_TRC_JMP_SYS_INT129:  /* x86-darwin */
       case VEX_TRC_JMP_SYS_INT130:  /* x86-darwin */
       case VEX_TRC_JMP_SYS_SYSCALL: /* amd64-linux, ppc32-linux, amd64-darwin */
+      {
+         ULong acquires_before = n_BigLock_acquires;
 	 handle_syscall(tid, trc[0]);
 	 if (VG_(clo_sanity_level) > 2)
 	    VG_(sanity_check_general)(True); /* sanity-check every syscall */
+         /* If other threads got the lock while this one was in the
+            syscall, it blocked: most likely it is waiting for them, so
+            it should not hold them up for long once it is woken. */
+         if (VG_(clo_adaptive_sched)
+             && n_BigLock_acquires > acquires_before + 1) {
+            slice_interrupted = True;
+            if (quantum > SCHED_MIN_QUANTUM) {
+               quantum /= 2;
+               if (quantum < SCHED_MIN_QUANTUM)
+                  quantum = SCHED_MIN_QUANTUM;
+               stats__n_quantum_shrinks++;
+            }
+            if (dispatch_ctr > quantum)
+               dispatch_ctr = quantum;
+         }
 	 break;
+      }
 
       case VEX_TRC_JMP_YIELD:
 	 /* Explicit yield, because this thread is in a spin-lock
@@ -1347,11 +1604,24 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
             thread swap. */
 	 if (dispatch_ctr > 2000) 
             dispatch_ctr = 2000;
+         slice_interrupted = True;
 	 break;
 
       case VG_TRC_INNER_COUNTERZERO:
 	 /* Timeslice is out.  Let a new thread be scheduled. */
 	 vg_assert(dispatch_ctr == 0);
+         if (VG_(clo_tiered_translation))
+            tier_up_hot_translations(tid);
+         /* A thread which runs for a whole timeslice without waiting
+            for anything is compute bound, and switching it out less
+            often costs other threads little. */
+         if (VG_(clo_adaptive_sched) && !slice_interrupted
+             && quantum < SCHED_MAX_QUANTUM) {
+            quantum *= 2;
+            if (quantum > SCHED_MAX_QUANTUM)
+               quantum = SCHED_MAX_QUANTUM;
+            stats__n_quantum_grows++;
+         }
 	 break;
 
       case VG_TRC_FAULT_SIGNAL:
@@ -1556,6 +1826,11 @@ void VG_(nuke_all_threads_except) ( ThreadId me, VgSchedReturnCode src )
          VG_(threads)[tid].os_state.fatalsig = VKI_SIGKILL;
       VG_(get_thread_out_of_syscall)(tid);
    }
+
+   /* Threads running translated code in parallel don't see
+      SIGVGKILL; send them back to the scheduler to notice. */
+   VG_(acquire_code_exclusive)();
+   VG_(release_code_exclusive)();
 }
 
 
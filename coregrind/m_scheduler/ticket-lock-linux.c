@@ -59,6 +59,8 @@ struct sched_lock {
    volatile unsigned head;
    volatile unsigned tail;
    volatile unsigned futex[TL_FUTEX_COUNT];
+   volatile unsigned n_sleepers;
+   volatile Int spin_limit;
    int owner;
 };
 
@@ -85,6 +87,8 @@ static struct sched_lock *create_sched_lock(void)
       p->head = 0;
       p->tail = 0;
       VG_(memset)((void*)p->futex, 0, sizeof(p->futex));
+      p->n_sleepers = 0;
+      p->spin_limit = SCHED_LOCK_MIN_SPIN;
       p->owner = 0;
    }
    INNER_REQUEST(ANNOTATE_RWLOCK_CREATE(p));
@@ -113,35 +117,50 @@ static int get_sched_lock_owner(struct sched_lock *p)
  *
  * See also Nick Piggin, x86: FIFO ticket spinlocks, Linux kernel mailing list
  * (http://lkml.org/lkml/2007/11/1/125) for more info.
+ *
+ * Before sleeping, spin for a while in the hope that our turn comes soon.
+ * Threads only sleep after announcing it in n_sleepers, so that the
+ * releaser can skip the futex wakeup if the next thread is still
+ * spinning.
  */
 static void acquire_sched_lock(struct sched_lock *p)
 {
    unsigned ticket, futex_value;
    volatile unsigned *futex;
    SysRes sres;
+   Int spins, limit;
 
    ticket = __sync_fetch_and_add(&p->tail, 1);
    futex = &p->futex[ticket & TL_FUTEX_MASK];
    if (s_debug)
       VG_(printf)("[%d/%d] acquire: ticket %d\n", VG_(getpid)(),
                   VG_(gettid)(), ticket);
-   for (;;) {
-      futex_value = *futex;
-      __sync_synchronize();
-      if (ticket == p->head)
-         break;
-      if (s_debug)
-         VG_(printf)("[%d/%d] acquire: ticket %d - waiting until"
-                     " futex[%ld] != %d\n", VG_(getpid)(),
-                     VG_(gettid)(), ticket, (long)(futex - p->futex),
-                     futex_value);
-      sres = VG_(do_syscall3)(__NR_futex, (UWord)futex,
-                              VKI_FUTEX_WAIT | VKI_FUTEX_PRIVATE_FLAG,
-                              futex_value);
-      if (sr_isError(sres) && sres._val != VKI_EAGAIN) {
-         VG_(printf)("futex_wait() returned error code %ld\n", sres._val);
-         vg_assert(False);
+   limit = p->spin_limit;
+   for (spins = 0; spins < limit && ticket != p->head; spins++)
+      sched_lock_spin_pause();
+   if (spins > 0)
+      sched_lock_adapt_spin(&p->spin_limit, spins, ticket == p->head);
+   if (ticket != p->head) {
+      __sync_fetch_and_add(&p->n_sleepers, 1);
+      for (;;) {
+         futex_value = *futex;
+         __sync_synchronize();
+         if (ticket == p->head)
+            break;
+         if (s_debug)
+            VG_(printf)("[%d/%d] acquire: ticket %d - waiting until"
+                        " futex[%ld] != %d\n", VG_(getpid)(),
+                        VG_(gettid)(), ticket, (long)(futex - p->futex),
+                        futex_value);
+         sres = VG_(do_syscall3)(__NR_futex, (UWord)futex,
+                                 VKI_FUTEX_WAIT | VKI_FUTEX_PRIVATE_FLAG,
+                                 futex_value);
+         if (sr_isError(sres) && sres._val != VKI_EAGAIN) {
+            VG_(printf)("futex_wait() returned error code %ld\n", sres._val);
+            vg_assert(False);
+         }
       }
+      __sync_fetch_and_sub(&p->n_sleepers, 1);
    }
    __sync_synchronize();
    INNER_REQUEST(ANNOTATE_RWLOCK_ACQUIRED(p, /*is_w*/1));
@@ -152,7 +171,8 @@ static void acquire_sched_lock(struct sched_lock *p)
 /*
  * Release a ticket lock by incrementing the head of the queue. Only generate
  * a thread wakeup signal if at least one thread is waiting. If the queue tail
- * matches the wakeup_ticket value, no threads have to be woken up.
+ * matches the wakeup_ticket value, no threads have to be woken up, and
+ * neither do they if all waiters are still spinning.
  *
  * Note: tail will only be read after head has been incremented since both are
  * declared as volatile and since the __sync...() functions imply a memory
@@ -171,6 +191,12 @@ static void release_sched_lock(struct sched_lock *p)
    if (p->tail != wakeup_ticket) {
       futex = &p->futex[wakeup_ticket & TL_FUTEX_MASK];
       futex_value = __sync_fetch_and_add(futex, 1);
+      if (p->n_sleepers == 0) {
+         if (s_debug)
+            VG_(printf)("[%d/%d] release: ticket %d is spinning\n",
+                        VG_(getpid)(), VG_(gettid)(), wakeup_ticket);
+         return;
+      }
       if (s_debug)
          VG_(printf)("[%d/%d] release: waking up ticket %d (futex[%ld] = %d)"
                      "\n", VG_(getpid)(), VG_(gettid)(), wakeup_ticket,
@@ -186,6 +212,13 @@ static void release_sched_lock(struct sched_lock *p)
    }
 }
 
+/* The owner has a ticket too, so there are waiters if more than one
+   ticket has been handed out since head. */
+static Bool sched_lock_has_waiters(struct sched_lock *p)
+{
+   return p->tail - p->head > 1;
+}
+
 const struct sched_lock_ops ML_(linux_ticket_lock_ops) = {
    .get_sched_lock_name  = get_sched_lock_name,
    .create_sched_lock    = create_sched_lock,
@@ -193,4 +226,5 @@ const struct sched_lock_ops ML_(linux_ticket_lock_ops) = {
    .get_sched_lock_owner = get_sched_lock_owner,
    .acquire_sched_lock   = acquire_sched_lock,
    .release_sched_lock   = release_sched_lock,
+   .sched_lock_has_waiters = sched_lock_has_waiters,
 };
@@ -226,6 +226,7 @@
 #include "pub_core_syscall.h"
 #include "pub_core_syswrap.h"
 #include "pub_core_tooliface.h"
+#include "pub_core_transtab.h"      // For VG_(pageprot_handle_fault)()
 #include "pub_core_coredump.h"
 
 
@@ -2394,6 +2395,24 @@ void sync_signalhandler_from_kernel ( ThreadId tid,
          so carry on panicking. */
    }
 
+   /* With --smc-check=pageprot, client writes to code pages fault.
+      The page is made writable here and the write restarted; the
+      page's translations are discarded by the scheduler, which we
+      make the thread return to at its next block entry.  Syscalls
+      and Valgrind itself unprotect pages before writing to them, so
+      a fault from anywhere else is not ours to handle. */
+   if (VG_(clo_smc_check) == Vg_SmcPageProt
+       && VG_(in_generated_code)
+       && sigNo == VKI_SIGSEGV
+       && info->si_code == VKI_SEGV_ACCERR
+       && VG_(pageprot_handle_fault)( (Addr)info->VKI_SIGINFO_si_addr )) {
+      if (VG_(clo_trace_signals))
+         VG_(dmsg)("       -> write to protected code page %#lx\n",
+                   (Addr)info->VKI_SIGINFO_si_addr);
+      VG_(threads)[tid].arch.vex.host_EvC_COUNTER = 0;
+      return;
+   }
+
    if (extend_stack_if_appropriate(tid, info)) {
       /* Stack extension occurred, so we don't need to do anything else; upon
          returning from this function, we'll restart the host (hence guest)
@@ -2458,10 +2477,20 @@ void sync_signalhandler ( Int sigNo,
 {
    ThreadId tid = VG_(lwpid_to_vgtid)(VG_(gettid)());
    Bool from_user;
+   Bool was_parallel = False;
 
    if (0) 
       VG_(printf)("sync_sighandler(%d, %p, %p)\n", sigNo, info, uc);
 
+   /* With --parallel-execution=yes the thread may have been running
+      translated code without the lock.  Take it back before looking
+      at anything.  If the handlers below longjmp back to the
+      scheduler, that's where it stays. */
+   if (tid != VG_INVALID_THREADID && VG_(threads)[tid].in_parallel_code) {
+      VG_(leave_parallel_code)(tid);
+      was_parallel = True;
+   }
+
    vg_assert(info != NULL);
    vg_assert(info->si_signo == sigNo);
    vg_assert(sigNo == VKI_SIGSEGV ||
@@ -2504,6 +2533,10 @@ void sync_signalhandler ( Int sigNo,
    } else {
       sync_signalhandler_from_kernel(tid, sigNo, info, uc);
    }
+
+   /* The faulting instruction is about to be restarted. */
+   if (was_parallel)
+      VG_(enter_parallel_code)(tid);
 }
 
 
@@ -38,6 +38,7 @@
 #include "pub_core_libcassert.h"
 #include "pub_core_libcprint.h"
 #include "pub_core_machine.h"
+#include "pub_core_mallocfree.h"
 #include "pub_core_options.h"
 #include "pub_core_stacks.h"        // VG_(stack_limits)
 #include "pub_core_stacktrace.h"
@@ -62,6 +63,296 @@
    traces on ppc64-linux and has no effect on other platforms.
 */
 
+/* ------------------ x86/amd64 unwind memo ------------------ */
+
+#if defined(VGP_x86_linux) || defined(VGP_x86_darwin) \
+    || defined(VGP_amd64_linux) || defined(VGP_amd64_darwin)
+
+/* Tools such as Memcheck and Massif take a stack trace at every
+   allocation, and most of those traces share their outer frames with
+   the one taken just before.  So for each thread we remember the
+   frames found by its last unwind, and for each frame, how the next
+   one was derived from it: the method used, plus every stack word
+   read and the value found there.
+
+   Each step of an unwind is a function only of the unwinder state
+   (ip, sp, fp), the CFI in force, the stack limits, and the stack
+   words it reads.  Hence when a new unwind arrives at a state which
+   the previous one also passed through, it can take the next frame
+   from the memo, provided that the CFI has not changed since, the
+   remembered reads lie inside the current stack limits and still
+   give the same values, and (on x86, where the %ebp chain is tried
+   before CFI) the choice between the two methods would come out the
+   same way.  If any check fails, the step is done the usual way, and
+   later frames may fall into step with the memo again.
+
+   Steps whose inputs can't all be recorded -- CFI expressions, FPO
+   and the amd64 last-ditch *sp hack -- end a run of memoised frames.
+   A frame's sp must not be below that of the frame before it, so the
+   frames can be binary-searched by sp. */
+
+#define MEMO_READS   3    /* a CFI step reads at most ra, sp and fp */
+#define MEMO_FRAMES  100
+#define N_MEMO_SLOTS 16
+
+typedef
+   enum { MemoEnd=0, MemoCFI, MemoFP }
+   MemoHow;
+
+typedef
+   struct {
+      /* Unwinder state for this frame. */
+      Addr  ip;
+      Addr  sp;
+      Addr  fp;
+      /* How the next frame was found from it. */
+      UChar how;       /* a MemoHow */
+      UChar n_reads;
+      Addr  read_at[MEMO_READS];
+      UWord read_val[MEMO_READS];
+   }
+   MemoFrame;
+
+typedef
+   struct {
+      ThreadId  tid;
+      ULong     cf_gen;  /* VG_(CF_info_generation) when made */
+      Int       n_frames;
+      MemoFrame frames[MEMO_FRAMES];
+   }
+   UnwindMemo;
+
+/* Memos are kept per thread, double buffered: 'cur' is the last
+   unwind, and 'spare' is filled in by the next one.  Threads whose
+   numbers collide modulo N_MEMO_SLOTS share a slot, which costs only
+   reuse. */
+typedef
+   struct { UnwindMemo* cur; UnwindMemo* spare; }
+   MemoSlot;
+
+static MemoSlot memo_slots[N_MEMO_SLOTS];
+
+/* The state of one unwind with respect to the memos. */
+typedef
+   struct {
+      Bool        active;
+      ThreadId    tid;
+      MemoSlot*   slot;
+      UnwindMemo* old;    /* previous unwind, or NULL if unusable */
+      UnwindMemo* new;    /* this unwind */
+      Int         at;     /* old frame in step with us, or -1 */
+      Bool        recording;
+      ULong       cf_gen;
+   }
+   MemoCtx;
+
+static ULong n_memo_unwinds       = 0;
+static ULong n_memo_frames        = 0;
+static ULong n_memo_frames_reused = 0;
+static ULong n_memo_verify_fails  = 0;
+
+/* Find, in the old memo, a frame with state (ip,sp,fp), and note it
+   as the one we're in step with. */
+static void memo_sync ( MemoCtx* mc, Addr ip, Addr sp, Addr fp )
+{
+   Int lo, hi, mid;
+   MemoFrame* fr;
+
+   mc->at = -1;
+   if (mc->old == NULL)
+      return;
+   lo = 0;
+   hi = mc->old->n_frames;
+   while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (mc->old->frames[mid].sp < sp)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   for (; lo < mc->old->n_frames; lo++) {
+      fr = &mc->old->frames[lo];
+      if (fr->sp != sp)
+         break;
+      if (fr->ip == ip && fr->fp == fp) {
+         mc->at = lo;
+         return;
+      }
+   }
+}
+
+/* Append a frame to the new memo; 'step' (if non-NULL) says how it
+   was found from the previous frame. */
+static void memo_push ( MemoCtx* mc, const MemoFrame* step,
+                        Addr ip, Addr sp, Addr fp )
+{
+   MemoFrame* fr;
+   UnwindMemo* nw = mc->new;
+
+   if (!mc->recording)
+      return;
+   if (nw->n_frames == MEMO_FRAMES
+       || (nw->n_frames > 0 && sp < nw->frames[nw->n_frames-1].sp)) {
+      mc->recording = False;
+      return;
+   }
+   if (step && nw->n_frames > 0) {
+      fr = &nw->frames[nw->n_frames-1];
+      fr->how     = step->how;
+      fr->n_reads = step->n_reads;
+      VG_(memcpy)(fr->read_at,  step->read_at,  sizeof(fr->read_at));
+      VG_(memcpy)(fr->read_val, step->read_val, sizeof(fr->read_val));
+   }
+   fr = &nw->frames[nw->n_frames++];
+   fr->ip      = ip;
+   fr->sp      = sp;
+   fr->fp      = fp;
+   fr->how     = MemoEnd;
+   fr->n_reads = 0;
+}
+
+static void memo_begin ( /*OUT*/MemoCtx* mc, ThreadId tid,
+                         Addr ip, Addr sp, Addr fp )
+{
+   MemoSlot* slot;
+
+   mc->active = VG_(clo_unwind_memo) && tid != VG_INVALID_THREADID;
+   if (!mc->active)
+      return;
+
+   slot = &memo_slots[tid % N_MEMO_SLOTS];
+   if (slot->cur == NULL) {
+      slot->cur   = VG_(arena_malloc)(VG_AR_CORE, "stacktrace.memo.1",
+                                      sizeof(UnwindMemo));
+      slot->spare = VG_(arena_malloc)(VG_AR_CORE, "stacktrace.memo.2",
+                                      sizeof(UnwindMemo));
+      slot->cur->tid = slot->spare->tid = VG_INVALID_THREADID;
+      slot->cur->n_frames = slot->spare->n_frames = 0;
+   }
+   mc->tid       = tid;
+   mc->slot      = slot;
+   mc->cf_gen    = VG_(CF_info_generation)();
+   mc->old       = (slot->cur->tid == tid && slot->cur->cf_gen == mc->cf_gen)
+                   ? slot->cur : NULL;
+   mc->new       = slot->spare;
+   mc->new->n_frames = 0;
+   mc->recording = True;
+   n_memo_unwinds++;
+
+   memo_push(mc, NULL, ip, sp, fp);
+   memo_sync(mc, ip, sp, fp);
+}
+
+/* Note a frame found by the unwinder proper.  'how' and 'log' say
+   how it was found, or 'log' is NULL if it can't be memoised. */
+static void memo_step ( MemoCtx* mc, MemoHow how, const CFReadLog* log,
+                        Addr ip, Addr sp, Addr fp )
+{
+   MemoFrame step;
+
+   if (!mc->active)
+      return;
+   n_memo_frames++;
+   step.how     = MemoEnd;
+   step.n_reads = 0;
+   VG_(memset)(step.read_at,  0, sizeof(step.read_at));
+   VG_(memset)(step.read_val, 0, sizeof(step.read_val));
+   if (log && log->n_reads >= 0 && log->n_reads <= MEMO_READS) {
+      step.how     = how;
+      step.n_reads = log->n_reads;
+      VG_(memcpy)(step.read_at,  log->read_at,
+                  log->n_reads * sizeof(Addr));
+      VG_(memcpy)(step.read_val, log->read_val,
+                  log->n_reads * sizeof(UWord));
+   }
+   memo_push(mc, &step, ip, sp, fp);
+   if (mc->old)
+      memo_sync(mc, ip, sp, fp);
+}
+
+/* If we're in step with the old memo, try to take the next frame
+   from it.  Returns True, with *uregs updated, if that worked. */
+static Bool memo_replay ( MemoCtx* mc, /*MOD*/D3UnwindRegs* uregs,
+                          Addr fp_min, Addr fp_max )
+{
+   MemoFrame *fr, *next;
+   Bool fp_ok;
+   Int  r;
+
+   if (!mc->active || mc->at < 0)
+      return False;
+   fr = &mc->old->frames[mc->at];
+   if (fr->how == MemoEnd || mc->at + 1 >= mc->old->n_frames) {
+      mc->at = -1;
+      return False;
+   }
+
+   fp_ok = fp_min <= fr->fp && fr->fp <= fp_max - 1 * sizeof(UWord);
+#  if defined(VGA_x86)
+   /* The %ebp chain is tried first, so a CFI step is only repeatable
+      if the chain still looks unusable. */
+   if (fr->how == MemoCFI && fp_ok)
+      goto fail;
+#  endif
+   if (fr->how == MemoFP && !fp_ok)
+      goto fail;
+   for (r = 0; r < fr->n_reads; r++) {
+      Addr a = fr->read_at[r];
+      if (fr->how == MemoCFI
+          && (a < fp_min || a > fp_max - sizeof(Addr)))
+         goto fail;
+      if (*(UWord*)a != fr->read_val[r])
+         goto fail;
+   }
+
+   next = &mc->old->frames[mc->at + 1];
+   memo_push(mc, fr, next->ip, next->sp, next->fp);
+   uregs->xip = next->ip;
+   uregs->xsp = next->sp;
+   uregs->xbp = next->fp;
+   mc->at++;
+   n_memo_frames++;
+   n_memo_frames_reused++;
+   return True;
+
+  fail:
+   n_memo_verify_fails++;
+   mc->at = -1;
+   return False;
+}
+
+/* Make a log of the reads done by a step along the frame pointer
+   chain from 'fp'. */
+static const CFReadLog* memo_fp_log ( /*OUT*/CFReadLog* log, Addr fp )
+{
+   log->n_reads     = 2;
+   log->read_at[0]  = fp + sizeof(UWord);
+   log->read_val[0] = ((UWord*)fp)[1];
+   log->read_at[1]  = fp;
+   log->read_val[1] = ((UWord*)fp)[0];
+   log->no_info     = False;
+   return log;
+}
+
+static void memo_end ( MemoCtx* mc )
+{
+   UnwindMemo* tmp;
+
+   if (!mc->active || mc->new->n_frames == 0)
+      return;
+   /* If CFI came or went during the unwind, don't trust what we
+      found. */
+   if (VG_(CF_info_generation)() != mc->cf_gen)
+      return;
+   mc->new->tid    = mc->tid;
+   mc->new->cf_gen = mc->cf_gen;
+   tmp             = mc->slot->cur;
+   mc->slot->cur   = mc->new;
+   mc->slot->spare = tmp;
+}
+
+#endif
+
 /* ------------------------ x86 ------------------------- */
 
 #if defined(VGP_x86_linux) || defined(VGP_x86_darwin)
@@ -76,6 +367,8 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
    Int   i;
    Addr  fp_max;
    UInt  n_found = 0;
+   MemoCtx   memo;
+   CFReadLog log;
 
    vg_assert(sizeof(Addr) == sizeof(UWord));
    vg_assert(sizeof(Addr) == sizeof(void*));
@@ -125,6 +418,7 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
    if (fps) fps[0] = uregs.xbp;
    ips[0] = uregs.xip;
    i = 1;
+   memo_begin(&memo, tid_if_known, uregs.xip, uregs.xsp, uregs.xbp);
 
    /* Loop unwinding the stack. Note that the IP value we get on
     * each pass (whether from CFI info or a stack frame) is a
@@ -146,6 +440,18 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
       if (i >= max_n_ips)
          break;
 
+      /* If the last unwind of this thread went through the same
+         state, and nothing it depended on has changed, take the
+         next frame from it. */
+      if (memo_replay(&memo, &uregs, fp_min, fp_max)) {
+         if (sps) sps[i] = uregs.xsp;
+         if (fps) fps[i] = uregs.xbp;
+         ips[i++] = uregs.xip;
+         if (debug)
+            VG_(printf)("     ipsM[%d]=%#08lx\n", i-1, ips[i-1]);
+         continue;
+      }
+
       /* Try to derive a new (ip,sp,fp) triple from the current
          set. */
 
@@ -160,6 +466,7 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
           uregs.xbp <= fp_max - 1 * sizeof(UWord)/*see comment below*/)
       {
          /* fp looks sane, so use it. */
+         Addr fp = uregs.xbp;
          uregs.xip = (((UWord*)uregs.xbp)[1]);
          // We stop if we hit a zero (the traditional end-of-stack
          // marker) or a one -- these correspond to recorded IPs of 0 or -1.
@@ -178,12 +485,14 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
             VG_(printf)("     ipsF[%d]=0x%08lx\n", i-1, ips[i-1]);
          uregs.xip = uregs.xip - 1;
             /* as per comment at the head of this loop */
+         memo_step(&memo, MemoFP, memo_fp_log(&log, fp),
+                   uregs.xip, uregs.xsp, uregs.xbp);
          continue;
       }
 
       /* That didn't work out, so see if there is any CF info to hand
          which can be used. */
-      if ( VG_(use_CF_info)( &uregs, fp_min, fp_max ) ) {
+      if ( VG_(use_CF_info_logged)( &uregs, fp_min, fp_max, &log ) ) {
          if (0 == uregs.xip || 1 == uregs.xip) break;
          if (sps) sps[i] = uregs.xsp;
          if (fps) fps[i] = uregs.xbp;
@@ -192,6 +501,7 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
             VG_(printf)("     ipsC[%d]=0x%08lx\n", i-1, ips[i-1]);
          uregs.xip = uregs.xip - 1;
             /* as per comment at the head of this loop */
+         memo_step(&memo, MemoCFI, &log, uregs.xip, uregs.xsp, uregs.xbp);
          continue;
       }
 
@@ -205,6 +515,7 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
          if (debug)
             VG_(printf)("     ipsC[%d]=0x%08lx\n", i-1, ips[i-1]);
          uregs.xip = uregs.xip - 1;
+         memo_step(&memo, MemoEnd, NULL, uregs.xip, uregs.xsp, uregs.xbp);
          continue;
       }
 
@@ -212,6 +523,7 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
       break;
    }
 
+   memo_end(&memo);
    n_found = i;
    return n_found;
 }
@@ -232,6 +544,8 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
    Int   i;
    Addr  fp_max;
    UInt  n_found = 0;
+   MemoCtx   memo;
+   CFReadLog log;
 
    vg_assert(sizeof(Addr) == sizeof(UWord));
    vg_assert(sizeof(Addr) == sizeof(void*));
@@ -281,6 +595,7 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
    if (sps) sps[0] = uregs.xsp;
    if (fps) fps[0] = uregs.xbp;
    i = 1;
+   memo_begin(&memo, tid_if_known, uregs.xip, uregs.xsp, uregs.xbp);
 
    /* Loop unwinding the stack. Note that the IP value we get on
     * each pass (whether from CFI info or a stack frame) is a
@@ -302,11 +617,23 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
       if (i >= max_n_ips)
          break;
 
+      /* If the last unwind of this thread went through the same
+         state, and nothing it depended on has changed, take the
+         next frame from it. */
+      if (memo_replay(&memo, &uregs, fp_min, fp_max)) {
+         if (sps) sps[i] = uregs.xsp;
+         if (fps) fps[i] = uregs.xbp;
+         ips[i++] = uregs.xip;
+         if (debug)
+            VG_(printf)("     ipsM[%d]=%#08lx\n", i-1, ips[i-1]);
+         continue;
+      }
+
       /* Try to derive a new (ip,sp,fp) triple from the current set. */
 
       /* First off, see if there is any CFI info to hand which can
          be used. */
-      if ( VG_(use_CF_info)( &uregs, fp_min, fp_max ) ) {
+      if ( VG_(use_CF_info_logged)( &uregs, fp_min, fp_max, &log ) ) {
          if (0 == uregs.xip || 1 == uregs.xip) break;
          if (sps) sps[i] = uregs.xsp;
          if (fps) fps[i] = uregs.xbp;
@@ -314,6 +641,7 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
          if (debug)
             VG_(printf)("     ipsC[%d]=%#08lx\n", i-1, ips[i-1]);
          uregs.xip = uregs.xip - 1; /* as per comment at the head of this loop */
+         memo_step(&memo, MemoCFI, &log, uregs.xip, uregs.xsp, uregs.xbp);
          continue;
       }
 
@@ -330,7 +658,11 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
          adjust the limit check accordingly.  Omitting this has been
          observed to cause segfaults on rare occasions. */
       if (fp_min <= uregs.xbp && uregs.xbp <= fp_max - 1 * sizeof(UWord)) {
-         /* fp looks sane, so use it. */
+         /* fp looks sane, so use it.  Since CFI was tried first, this
+            step is only repeatable if there was no CFI at all for
+            ip. */
+         Bool memoisable = log.no_info;
+         Addr fp = uregs.xbp;
          uregs.xip = (((UWord*)uregs.xbp)[1]);
          if (0 == uregs.xip || 1 == uregs.xip) break;
          uregs.xsp = uregs.xbp + sizeof(Addr) /*saved %rbp*/ 
@@ -342,6 +674,9 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
          if (debug)
             VG_(printf)("     ipsF[%d]=%#08lx\n", i-1, ips[i-1]);
          uregs.xip = uregs.xip - 1; /* as per comment at the head of this loop */
+         memo_step(&memo, MemoFP,
+                   memoisable ? memo_fp_log(&log, fp) : NULL,
+                   uregs.xip, uregs.xsp, uregs.xbp);
          continue;
       }
 
@@ -371,6 +706,7 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
             VG_(printf)("     ipsH[%d]=%#08lx\n", i-1, ips[i-1]);
          uregs.xip = uregs.xip - 1; /* as per comment at the head of this loop */
          uregs.xsp += 8;
+         memo_step(&memo, MemoEnd, NULL, uregs.xip, uregs.xsp, uregs.xbp);
          continue;
       }
 
@@ -378,6 +714,7 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
       break;
    }
 
+   memo_end(&memo);
    n_found = i;
    return n_found;
 }
@@ -1092,6 +1429,23 @@ UInt VG_(get_StackTrace) ( ThreadId tid,
                                        stack_highest_word);
 }
 
+void VG_(print_stacktrace_stats) ( void )
+{
+#  if defined(VGP_x86_linux) || defined(VGP_x86_darwin) \
+      || defined(VGP_amd64_linux) || defined(VGP_amd64_darwin)
+   VG_(message)(Vg_DebugMsg,
+      "   unwind: %'llu memoised unwinds, %'llu frames, "
+      "%'llu reused (%'llu per 1000)\n",
+      n_memo_unwinds, n_memo_frames, n_memo_frames_reused,
+      n_memo_frames == 0
+         ? 0ULL
+         : (n_memo_frames_reused * 1000ULL) / n_memo_frames );
+   VG_(message)(Vg_DebugMsg,
+      "   unwind: %'llu memo checks failed\n",
+      n_memo_verify_fails );
+#  endif
+}
+
 static void printIpDesc(UInt n, Addr ip, void* uu_opaque)
 {
    #define BUF_LEN   4096
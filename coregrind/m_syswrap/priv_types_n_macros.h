@@ -34,6 +34,7 @@
 
 /* requires #include "pub_core_options.h" */
 /* requires #include "pub_core_signals.h" */
+/* requires #include "pub_core_transtab.h" */
 
 /* This header defines types and macros which are useful for writing
    syscall wrappers.  It does not give prototypes for any such
@@ -600,8 +601,29 @@ static inline UWord getERR ( SyscallStatus* st ) {
 #define PRE_MEM_RASCIIZ(zzname, zzaddr) \
    VG_TRACK( pre_mem_read_asciiz, Vg_CoreSysCall, tid, zzname, zzaddr)
 
+/* The kernel won't fault on code pages write-protected for
+   --smc-check=pageprot; it fails the syscall instead.  So unprotect
+   them first, until the syscall is over.  A wrapper for a syscall
+   which may write memory it doesn't give to PRE_MEM_WRITE must use
+   PRE_MEM_WRITE_UNKNOWN, or PRE_MEM_WRITE_PAGEPROT if it does know
+   where but doesn't want the tool told. */
+#define PRE_MEM_WRITE_PAGEPROT(zzaddr, zzlen) \
+   do { \
+      if (VG_(clo_smc_check) == Vg_SmcPageProt) \
+         VG_(pageprot_pre_write)( tid, (Addr)(zzaddr), (SizeT)(zzlen) ); \
+   } while (0)
+
+#define PRE_MEM_WRITE_UNKNOWN() \
+   do { \
+      if (VG_(clo_smc_check) == Vg_SmcPageProt) \
+         VG_(pageprot_pre_write_unknown)( tid ); \
+   } while (0)
+
 #define PRE_MEM_WRITE(zzname, zzaddr, zzlen) \
-   VG_TRACK( pre_mem_write, Vg_CoreSysCall, tid, zzname, zzaddr, zzlen)
+   do { \
+      PRE_MEM_WRITE_PAGEPROT(zzaddr, zzlen); \
+      VG_TRACK( pre_mem_write, Vg_CoreSysCall, tid, zzname, zzaddr, zzlen); \
+   } while (0)
 
 #define POST_MEM_WRITE(zzaddr, zzlen) \
    VG_TRACK( post_mem_write, Vg_CoreSysCall, tid, zzaddr, zzlen)
@@ -50,6 +50,7 @@
 #include "pub_core_syswrap.h"
 #include "pub_core_tooliface.h"
 #include "pub_core_stacks.h"        // VG_(register_stack)
+#include "pub_core_transtab.h"      // for PRE_MEM_WRITE
 
 #include "priv_types_n_macros.h"
 #include "priv_syswrap-generic.h"   /* for decls of generic wrappers */
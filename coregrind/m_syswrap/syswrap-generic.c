@@ -53,6 +53,7 @@
 #include "pub_core_machine.h"       // VG_(get_SP)
 #include "pub_core_mallocfree.h"
 #include "pub_core_options.h"
+#include "pub_core_vdso.h"         // VG_(vdso_gettimeofday)
 #include "pub_core_scheduler.h"
 #include "pub_core_signals.h"
 #include "pub_core_stacktrace.h"    // For VG_(get_and_pp_StackTrace)()
@@ -3262,6 +3263,19 @@ PRE(sys_gettimeofday)
       PRE_timeval_WRITE( "gettimeofday(tv)", ARG1 );
    if (ARG2 != 0)
       PRE_MEM_WRITE( "gettimeofday(tz)", ARG2, sizeof(struct vki_timezone) );
+   /* With --vdso-time=yes, ask the vDSO rather than the kernel. */
+   if (VG_(clo_vdso_time)
+       && (ARG1 == 0
+           || VG_(am_is_valid_for_client)(ARG1, sizeof(struct vki_timeval),
+                                          VKI_PROT_WRITE))
+       && (ARG2 == 0
+           || VG_(am_is_valid_for_client)(ARG2, sizeof(struct vki_timezone),
+                                          VKI_PROT_WRITE))) {
+      SysRes res;
+      if (VG_(vdso_gettimeofday)( (struct vki_timeval*)ARG1,
+                                  (struct vki_timezone*)ARG2, &res ))
+         SET_STATUS_from_SysRes(res);
+   }
 }
 
 POST(sys_gettimeofday)
@@ -3307,6 +3321,10 @@ void ML_(PRE_unknown_ioctl)(ThreadId tid, UWord request, UWord arg)
    
    UInt dir  = _VKI_IOC_DIR(request);
    UInt size = _VKI_IOC_SIZE(request);
+
+   /* Whatever the hints say, the driver may write anywhere. */
+   PRE_MEM_WRITE_UNKNOWN();
+
    if (VG_(strstr)(VG_(clo_sim_hints), "lax-ioctls") != NULL) {
       /* 
        * Be very lax about ioctl handling; the only
@@ -51,6 +51,7 @@
 #include "pub_core_mallocfree.h"
 #include "pub_core_tooliface.h"
 #include "pub_core_options.h"
+#include "pub_core_vdso.h"         // VG_(vdso_clock_gettime)
 #include "pub_core_scheduler.h"
 #include "pub_core_signals.h"
 #include "pub_core_syscall.h"
@@ -1083,6 +1084,23 @@ PRE(sys_futex)
       SET_STATUS_Failure( VKI_ENOSYS );   // some futex function we don't understand
       break;
    }
+
+   /* Some ops have the kernel write the futex words, although the
+      tool needn't care. */
+   switch(ARG2 & ~(VKI_FUTEX_PRIVATE_FLAG|VKI_FUTEX_CLOCK_REALTIME)) {
+   case VKI_FUTEX_LOCK_PI:
+   case VKI_FUTEX_TRYLOCK_PI:
+   case VKI_FUTEX_UNLOCK_PI:
+      PRE_MEM_WRITE_PAGEPROT( ARG1, sizeof(Int) );
+      break;
+   case VKI_FUTEX_WAKE_OP:
+   case VKI_FUTEX_CMP_REQUEUE_PI:
+   case VKI_FUTEX_WAIT_REQUEUE_PI:
+      PRE_MEM_WRITE_PAGEPROT( ARG5, sizeof(Int) );
+      break;
+   default:
+      break;
+   }
 }
 POST(sys_futex)
 {
@@ -1979,6 +1997,17 @@ PRE(sys_clock_gettime)
    PRE_REG_READ2(long, "clock_gettime", 
                  vki_clockid_t, clk_id, struct timespec *, tp);
    PRE_MEM_WRITE( "clock_gettime(tp)", ARG2, sizeof(struct vki_timespec) );
+   /* With --vdso-time=yes, ask the vDSO rather than the kernel.  The
+      post-handler still runs, since the call completes successfully
+      here. */
+   if (VG_(clo_vdso_time)
+       && VG_(am_is_valid_for_client)(ARG2, sizeof(struct vki_timespec),
+                                      VKI_PROT_WRITE)) {
+      SysRes res;
+      if (VG_(vdso_clock_gettime)( (Int)ARG1, (struct vki_timespec*)ARG2,
+                                   &res ))
+         SET_STATUS_from_SysRes(res);
+   }
 }
 POST(sys_clock_gettime)
 {
@@ -50,6 +50,7 @@
 #include "pub_core_syscall.h"
 #include "pub_core_machine.h"
 #include "pub_core_syswrap.h"
+#include "pub_core_transtab.h"      // For VG_(pageprot_post_syscall)
 
 #include "priv_types_n_macros.h"
 #include "priv_syswrap-main.h"
@@ -621,6 +622,35 @@ void getSyscallArgsFromGuestState ( /*OUT*/SyscallArgs*       canonical,
 #endif
 }
 
+/* Read just the syscall number from the guest state, without touching
+   any argument which may live in guest memory.  Only used to filter
+   the root-thread stack check in VG_(client_syscall), so a number
+   which is indirected (mips32 syscall()) is returned as-is; that
+   merely means the check isn't skipped. */
+#if defined(VGO_linux)
+static
+Word peekSyscallNumberFromGuestState ( /*IN*/ VexGuestArchState* gst_vanilla )
+{
+#  if defined(VGP_x86_linux)
+   return ((VexGuestX86State*)gst_vanilla)->guest_EAX;
+#  elif defined(VGP_amd64_linux)
+   return ((VexGuestAMD64State*)gst_vanilla)->guest_RAX;
+#  elif defined(VGP_ppc32_linux)
+   return ((VexGuestPPC32State*)gst_vanilla)->guest_GPR0;
+#  elif defined(VGP_ppc64_linux)
+   return ((VexGuestPPC64State*)gst_vanilla)->guest_GPR0;
+#  elif defined(VGP_arm_linux)
+   return ((VexGuestARMState*)gst_vanilla)->guest_R7;
+#  elif defined(VGP_mips32_linux)
+   return ((VexGuestMIPS32State*)gst_vanilla)->guest_r2;
+#  elif defined(VGP_s390x_linux)
+   return ((VexGuestS390XState*)gst_vanilla)->guest_SYSNO;
+#  else
+#    error "peekSyscallNumberFromGuestState: unknown arch"
+#  endif
+}
+#endif
+
 static 
 void putSyscallArgsIntoGuestState ( /*IN*/ SyscallArgs*       canonical,
                                     /*OUT*/VexGuestArchState* gst_vanilla )
@@ -1154,6 +1184,198 @@ void getSyscallArgLayout ( /*OUT*/SyscallArgLayout* layout )
 }
 
 
+/* ---------------------------------------------------------------------
+   Syscalls which cannot block, and syscall statistics
+   ------------------------------------------------------------------ */
+
+/* Pre-handlers say SfMayBlock for any syscall which might block, and
+   such calls are run with the_BigLock dropped and the client's signal
+   mask installed.  That costs two sigprocmasks and a lock handoff,
+   which is a lot for a call like futex(FUTEX_WAKE) or a zero-timeout
+   poll, which never block whatever the pre-handler said.  So after
+   the pre-handler has run, VG_(client_syscall) asks here whether the
+   call can in fact block, and if not runs it directly. */
+static Bool syscall_cannot_block ( SyscallArgs* args )
+{
+#  if defined(VGO_linux)
+   switch (args->sysno) {
+      case __NR_futex:
+         switch (args->arg2 & ~(VKI_FUTEX_PRIVATE_FLAG
+                                | VKI_FUTEX_CLOCK_REALTIME)) {
+            case VKI_FUTEX_WAKE:
+            case VKI_FUTEX_WAKE_BITSET:
+            case VKI_FUTEX_WAKE_OP:
+            case VKI_FUTEX_REQUEUE:
+            case VKI_FUTEX_CMP_REQUEUE:
+            case VKI_FUTEX_UNLOCK_PI:
+               return True;
+            default:
+               return False;
+         }
+#     if defined(__NR_poll)
+      case __NR_poll:
+         return (Int)args->arg3 == 0;
+#     endif
+#     if defined(__NR_epoll_wait)
+      case __NR_epoll_wait:
+         return (Int)args->arg4 == 0;
+#     endif
+#     if defined(__NR_epoll_pwait)
+      case __NR_epoll_pwait:
+         return (Int)args->arg4 == 0;
+#     endif
+#     if defined(__NR_wait4)
+      case __NR_wait4:
+         return (args->arg3 & VKI_WNOHANG) != 0;
+#     endif
+#     if defined(__NR_waitid)
+      case __NR_waitid:
+         return (args->arg4 & VKI_WNOHANG) != 0;
+#     endif
+      default:
+         return False;
+   }
+#  else
+   return False;
+#  endif
+}
+
+/* Syscalls which take no pointer arguments, and so can't be affected
+   by the state of the root thread's stack.  These are common enough
+   (getpid and friends are used as cheap thread identifiers and in
+   logging) that the check at the start of VG_(client_syscall) shows
+   up. */
+static Bool syscall_takes_no_pointers ( Word sysno )
+{
+#  if defined(VGO_linux)
+   switch (sysno) {
+      case __NR_getpid:
+      case __NR_getppid:
+      case __NR_gettid:
+      case __NR_getuid:
+      case __NR_geteuid:
+      case __NR_getgid:
+      case __NR_getegid:
+#     if defined(__NR_getuid32)
+      case __NR_getuid32:
+      case __NR_geteuid32:
+      case __NR_getgid32:
+      case __NR_getegid32:
+#     endif
+#     if defined(__NR_getpgrp)
+      case __NR_getpgrp:
+#     endif
+         return True;
+      default:
+         return False;
+   }
+#  else
+   return False;
+#  endif
+}
+
+/* Per-syscall statistics, gathered with --stats=yes: how often each
+   syscall was made, how often it went through the blocking path, and
+   how long the kernel took over it (including any time it was blocked
+   for).  Indexed by a hash of the syscall number; the few syscall
+   numbers any program uses won't come near filling it. */
+#define N_SYSCALL_STATS 1024
+
+typedef
+   struct {
+      Word  sysno;     /* -1 if unused */
+      ULong n_calls;
+      ULong n_blocking;
+      ULong nsecs;     /* total time in the kernel */
+      ULong max_nsecs;
+   }
+   SyscallStats;
+
+static SyscallStats syscall_stats[N_SYSCALL_STATS];
+static Bool         syscall_stats_init = False;
+
+/* Number of syscalls the pre-handler said might block, but which were
+   run directly since syscall_cannot_block said otherwise. */
+static ULong stats__n_unblocked_syscalls = 0;
+
+static void record_syscall ( Word sysno, Bool blocking, ULong nsecs )
+{
+   UInt i, h;
+   SyscallStats* st;
+
+   if (!syscall_stats_init) {
+      for (i = 0; i < N_SYSCALL_STATS; i++)
+         syscall_stats[i].sysno = -1;
+      syscall_stats_init = True;
+   }
+
+   h = (UInt)((UWord)sysno * 2654435761UL) % N_SYSCALL_STATS;
+   for (i = 0; i < N_SYSCALL_STATS; i++) {
+      st = &syscall_stats[(h + i) % N_SYSCALL_STATS];
+      if (st->sysno == sysno)
+         break;
+      if (st->sysno == -1) {
+         st->sysno = sysno;
+         break;
+      }
+   }
+   if (i == N_SYSCALL_STATS)
+      return; /* full; can't happen */
+
+   st->n_calls++;
+   if (blocking)
+      st->n_blocking++;
+   st->nsecs += nsecs;
+   if (nsecs > st->max_nsecs)
+      st->max_nsecs = nsecs;
+}
+
+void VG_(print_syscall_stats) ( void )
+{
+   Int   i, j, n = 0;
+   ULong n_calls = 0, n_blocking = 0, nsecs = 0;
+   SyscallStats* top[10];
+   Char  buf[50];
+
+   if (!syscall_stats_init)
+      return;
+
+   for (i = 0; i < N_SYSCALL_STATS; i++) {
+      SyscallStats* st = &syscall_stats[i];
+      if (st->sysno == -1)
+         continue;
+      n_calls    += st->n_calls;
+      n_blocking += st->n_blocking;
+      nsecs      += st->nsecs;
+      /* Keep top[] sorted by total time, longest first. */
+      if (n < 10)
+         n++;
+      else if (top[9]->nsecs >= st->nsecs)
+         continue;
+      for (j = n - 1; j > 0 && top[j-1]->nsecs < st->nsecs; j--)
+         top[j] = top[j-1];
+      top[j] = st;
+   }
+
+   VG_(message)(Vg_DebugMsg,
+      "syscalls: %'llu calls, %'llu blocking, %'llu ran directly "
+      "since they could not block\n",
+      n_calls, n_blocking, stats__n_unblocked_syscalls);
+   VG_(message)(Vg_DebugMsg,
+      "syscalls: %'llu us in the kernel; most time spent in:\n",
+      nsecs / 1000);
+   for (i = 0; i < n; i++) {
+      VG_(message)(Vg_DebugMsg,
+         "   syscall %s: %'llu calls (%'llu blocking), "
+         "%'llu us total, %'llu ns avg, %'llu us max\n",
+         VG_(sysnum_string)(top[i]->sysno, sizeof(buf), buf),
+         top[i]->n_calls, top[i]->n_blocking,
+         top[i]->nsecs / 1000, top[i]->nsecs / top[i]->n_calls,
+         top[i]->max_nsecs / 1000);
+   }
+}
+
+
 /* ---------------------------------------------------------------------
    The main driver logic
    ------------------------------------------------------------------ */
@@ -1275,6 +1497,7 @@ void VG_(client_syscall) ( ThreadId tid, UInt trc )
    const SyscallTableEntry* ent;
    SyscallArgLayout         layout;
    SyscallInfo*             sci;
+   ULong                    start_nsecs = 0, end_nsecs = 0;
 
    ensure_initialised();
 
@@ -1356,9 +1579,17 @@ void VG_(client_syscall) ( ThreadId tid, UInt trc )
       necessary to fix the corresponding test in VG_(extend_stack).
 
       All this guff is of course Linux-specific.  Hence the ifdef.
+
+      A few very common syscalls don't take any pointers, so can't be
+      affected, and skip the check.  The full argument set can't be
+      fetched yet -- on some platforms it lives on the very stack we
+      are about to extend -- so only the syscall number register is
+      looked at.
    */
 #  if defined(VGO_linux)
-   if (tid == 1/*ROOT THREAD*/) {
+   if (tid == 1/*ROOT THREAD*/
+       && !syscall_takes_no_pointers(
+              peekSyscallNumberFromGuestState(&tst->arch.vex))) {
       Addr     stackMin   = VG_(get_SP)(tid) - VG_STACK_REDZONE_SZB;
       NSegment const* seg = VG_(am_find_nsegment)(stackMin);
       if (seg && seg->kind == SkAnonC) {
@@ -1494,6 +1725,8 @@ void VG_(client_syscall) ( ThreadId tid, UInt trc )
       vg_assert(0 == (sci->flags 
                       & ~(SfPollAfter | SfYieldAfter | SfNoWriteResult)));
       vg_assert(eq_SyscallArgs(&sci->args, &sci->orig_args));
+      if (VG_(clo_stats))
+         record_syscall(sysno, False, 0);
    }
 
    else
@@ -1505,6 +1738,8 @@ void VG_(client_syscall) ( ThreadId tid, UInt trc )
          allowed. */
       vg_assert(0 == (sci->flags & ~(SfMayBlock | SfPostOnFail | SfPollAfter)));
       vg_assert(eq_SyscallArgs(&sci->args, &sci->orig_args));
+      if (VG_(clo_stats))
+         record_syscall(sysno, False, 0);
    }
 
    else
@@ -1528,6 +1763,13 @@ void VG_(client_syscall) ( ThreadId tid, UInt trc )
          and PostOnFail are ok. */
       vg_assert(0 == (sci->flags & ~(SfMayBlock | SfPostOnFail | SfPollAfter)));
 
+      /* The pre-handler can only say whether a syscall might block in
+         general.  Some, with the args they've been given, can't. */
+      if ((sci->flags & SfMayBlock) && syscall_cannot_block(&sci->args)) {
+         sci->flags &= ~SfMayBlock;
+         stats__n_unblocked_syscalls++;
+      }
+
       if (sci->flags & SfMayBlock) {
 
          /* Syscall may block, so run it asynchronously */
@@ -1557,6 +1799,8 @@ void VG_(client_syscall) ( ThreadId tid, UInt trc )
 
          /* Do the call, which operates directly on the guest state,
             not on our abstracted copies of the args/result. */
+         if (VG_(clo_stats))
+            start_nsecs = VG_(read_nanosecond_timer)();
          do_syscall_for_client(sysno, tst, &mask);
 
          /* do_syscall_for_client may not return if the syscall was
@@ -1574,9 +1818,15 @@ void VG_(client_syscall) ( ThreadId tid, UInt trc )
             calls ML_(wqthread_continue), which is similar to 
             VG_(fixup_guest_state_after_syscall_interrupted). */
 
+         if (VG_(clo_stats))
+            end_nsecs = VG_(read_nanosecond_timer)();
+
          /* Reacquire the lock */
          VG_(acquire_BigLock)(tid, "VG_(client_syscall)[async]");
 
+         if (VG_(clo_stats))
+            record_syscall(sysno, True, end_nsecs - start_nsecs);
+
          /* Even more impedance matching.  Extract the syscall status
             from the guest state. */
          getSyscallStatusFromGuestState( &sci->status, &tst->arch.vex );
@@ -1606,11 +1856,16 @@ void VG_(client_syscall) ( ThreadId tid, UInt trc )
             kernel, there's no point in flushing them back to the
             guest state.  Indeed doing so could be construed as
             incorrect. */
-         SysRes sres 
-            = VG_(do_syscall)(sysno, sci->args.arg1, sci->args.arg2, 
-                                     sci->args.arg3, sci->args.arg4, 
-                                     sci->args.arg5, sci->args.arg6,
-                                     sci->args.arg7, sci->args.arg8 );
+         SysRes sres;
+         if (VG_(clo_stats))
+            start_nsecs = VG_(read_nanosecond_timer)();
+         sres = VG_(do_syscall)(sysno, sci->args.arg1, sci->args.arg2, 
+                                       sci->args.arg3, sci->args.arg4, 
+                                       sci->args.arg5, sci->args.arg6,
+                                       sci->args.arg7, sci->args.arg8 );
+         if (VG_(clo_stats))
+            record_syscall(sysno, False,
+                           VG_(read_nanosecond_timer)() - start_nsecs);
          sci->status = convert_SysRes_to_SyscallStatus(sres);
 
          /* Be decorative, if required. */
@@ -1683,6 +1938,8 @@ void VG_(post_syscall) (ThreadId tid)
       a syscall. */
    if (sci->status.what == SsIdle || sci->status.what == SsHandToKernel) {
       sci->status.what = SsIdle;
+      if (VG_(clo_smc_check) == Vg_SmcPageProt)
+         VG_(pageprot_post_syscall)(tid);
       return;
    }
 
@@ -1754,6 +2011,11 @@ void VG_(post_syscall) (ThreadId tid)
    vg_assert(sci->status.what == SsComplete);
    sci->status.what = SsIdle;
 
+   /* Code pages the kernel may have written can be protected again,
+      now that the post handler has seen them. */
+   if (VG_(clo_smc_check) == Vg_SmcPageProt)
+      VG_(pageprot_post_syscall)(tid);
+
    /* The pre/post wrappers may have concluded that pending signals
       might have been created, and will have set SfPollAfter to
       request a poll for them once the syscall is done. */
@@ -100,6 +100,17 @@ ThreadId VG_(get_running_tid)(void)
    return VG_(running_tid);
 }
 
+// This function is for tools to call, from helpers which have been
+// passed the guest state pointer.
+ThreadId VG_(get_tid_from_guest_state)(void* gst)
+{
+   ThreadId tid = ((Addr)gst - (Addr)&VG_(threads)[0].arch.vex)
+                  / sizeof(ThreadState);
+   vg_assert(tid > 0 && tid < VG_N_THREADS);
+   vg_assert((void*)&VG_(threads)[tid].arch.vex == gst);
+   return tid;
+}
+
 Bool VG_(is_running_thread)(ThreadId tid)
 {
    ThreadState *tst = VG_(get_ThreadState)(tid);
@@ -85,6 +85,7 @@ DETAILS(UInt,  avg_translation_sizeB)
 VgNeeds VG_(needs) = {
    .core_errors          = False,
    .tool_errors          = False,
+   .error_hash           = False,
    .libc_freeres         = False,
    .superblock_discards  = False,
    .command_line_options = False,
@@ -94,7 +95,9 @@ VgNeeds VG_(needs) = {
    .var_info	         = False,
    .malloc_replacement   = False,
    .xml_output           = False,
-   .final_IR_tidy_pass   = False
+   .final_IR_tidy_pass   = False,
+   .persistent_translations = False,
+   .thread_safe_instrumentation = False
 };
 
 /* static */
@@ -198,6 +201,11 @@ Bool VG_(sanity_check_needs)(Char** failmsg)
       return False;
    }
 
+   if (VG_(needs).error_hash && !VG_(needs).tool_errors) {
+      *failmsg = "Tool error: 'error_hash' needed, but not 'tool_errors'\n";
+      return False;
+   }
+
    return True;
 
 #undef CHECK_NOT
@@ -249,6 +257,14 @@ void VG_(needs_tool_errors)(
    VG_(tdict).tool_get_extra_suppression_info   = get_xtra_si;
 }
 
+void VG_(needs_error_hash)(
+   UWord (*hash)(Error*)
+)
+{
+   VG_(needs).error_hash = True;
+   VG_(tdict).tool_hash_Error = hash;
+}
+
 void VG_(needs_command_line_options)(
    Bool (*process)(Char*),
    void (*usage)(void),
@@ -330,6 +346,16 @@ void VG_(needs_final_IR_tidy_pass)(
    VG_(tdict).tool_final_IR_tidy_pass = final_tidy;
 }
 
+void VG_(needs_persistent_translations)( void )
+{
+   VG_(needs).persistent_translations = True;
+}
+
+void VG_(needs_thread_safe_instrumentation)( void )
+{
+   VG_(needs).thread_safe_instrumentation = True;
+}
+
 /*--------------------------------------------------------------------*/
 /* Tracked events.  Digit 'n' on DEFn is the REGPARMness. */
 
@@ -0,0 +1,561 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Persistent (on-disk) cache of translations.                  ---*/
+/*---                                                m_transcache.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2000-2012 Julian Seward
+      jseward@acm.org
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "pub_core_basics.h"
+#include "pub_core_vki.h"
+#include "pub_core_aspacemgr.h"
+#include "pub_core_xarray.h"
+#include "pub_core_clientstate.h"  // VG_(args_for_valgrind)
+#include "pub_core_hashtable.h"
+#include "pub_core_libcbase.h"
+#include "pub_core_libcassert.h"
+#include "pub_core_libcfile.h"
+#include "pub_core_libcprint.h"
+#include "pub_core_libcproc.h"     // VG_(getpid)
+#include "pub_core_machine.h"      // VG_(machine_get_VexArchInfo)
+#include "pub_core_mallocfree.h"
+#include "pub_core_options.h"
+#include "pub_core_tooliface.h"
+#include "pub_core_transtab.h"
+#include "pub_core_transcache.h"
+
+/* How this works.
+
+   Translations are a function of the guest code, the tool and its
+   options, the Vex settings and the host CPU; of where redirections
+   and self-checks are in force at the time; and (because helper
+   addresses are baked into the generated code) of the exact tool
+   executable.  Everything except the guest code and the
+   redirection/self-check state is folded into a 64-bit
+   configuration key at startup, and that key names the cache file:
+
+      <dir>/vgtc-<toolname>-<key>.bin
+
+   Only translations whose first extent lies in a file-backed client
+   mapping are kept.  Each record notes the identity of that mapping
+   (device, inode, file offset of the entry point), a copy of the
+   guest bytes covered, the self-check bitmask and the redirection
+   which was in force, and the host code exactly as Vex produced it,
+   before m_transtab patched anything into it.  Vex-generated code is
+   position independent with respect to where it sits in the
+   translation cache, but it does contain absolute guest addresses,
+   so a record is only ever reused at the address it was made for.
+   Objects which get mapped somewhere else, or whose contents
+   changed, simply miss.
+
+   The file is read in one go at the first TT/TC miss, into a hash
+   table keyed by the unredirected guest address.  A hit is only
+   used after re-checking the mapping, the guest bytes and (via a
+   callback into m_translate) the chase/self-check/gdbserver
+   conditions; a record which fails any check is thrown away, and
+   the ensuing fresh translation replaces it.
+   VG_(discard_translations) also calls here, so anything the eclass
+   machinery throws away is forgotten too.  At exit, whatever is left
+   in the table is written to a temporary file which is then renamed
+   over the old one, so concurrent runs don't see half-written files.
+*/
+
+/*------------------------------------------------------------*/
+/*--- Types and state                                      ---*/
+/*------------------------------------------------------------*/
+
+#define TC_MAGIC   0x43544756U   /* "VGTC" */
+#define TC_VERSION 1
+
+typedef
+   struct {
+      UInt  magic;
+      UInt  version;
+      ULong key;
+      UInt  n_recs;
+      UInt  pad;
+   }
+   TCFileHdr;
+
+typedef
+   struct {
+      ULong  nraddr;
+      ULong  addr;      /* redirected-to address */
+      ULong  dev;       /* identity of the mapping containing nraddr */
+      ULong  ino;
+      ULong  foff;      /* file offset of nraddr */
+      ULong  base[3];   /* the VexGuestExtents, flattened */
+      UShort len[3];
+      UShort n_used;
+      UInt   kind;
+      UInt   sc_bitset;
+      UInt   n_guest_instrs;
+      UInt   guest_len; /* sum of len[] */
+      UInt   code_len;
+   }
+   TCRec;
+
+/* Nodes in the in-memory table.  'data' holds 'guest_len' bytes of
+   guest code followed by 'code_len' bytes of host code. */
+typedef
+   struct _TCNode {
+      struct _TCNode* next;
+      UWord           key;      /* == rec.nraddr */
+      TCRec           rec;
+      UChar*          data;
+   }
+   TCNode;
+
+static VgHashTable tc_table = NULL;
+
+static ULong tc_key      = 0;
+static Bool  tc_loaded   = False;
+static HChar* tc_file    = NULL;
+
+/* Bounds of guest addresses covered by tc_table, so that the common
+   case in VG_(transcache_discard) is quick. */
+static Addr64 tc_min_addr = ~(Addr64)0;
+static Addr64 tc_max_addr = 0;
+
+/* Stats */
+static UInt n_tc_loaded    = 0;
+static UInt n_tc_reused    = 0;
+static UInt n_tc_rejected  = 0;
+static UInt n_tc_recorded  = 0;
+static UInt n_tc_discarded = 0;
+static UInt n_tc_saved     = 0;
+
+
+/*------------------------------------------------------------*/
+/*--- Helpers                                              ---*/
+/*------------------------------------------------------------*/
+
+/* 64-bit FNV-1a. */
+static ULong hash_bytes ( ULong h, const void* p, SizeT n )
+{
+   const UChar* b = p;
+   SizeT i;
+   for (i = 0; i < n; i++) {
+      h ^= (ULong)b[i];
+      h *= 0x100000001b3ULL;
+   }
+   return h;
+}
+
+static ULong hash_str ( ULong h, const HChar* s )
+{
+   return hash_bytes(h, s, VG_(strlen)(s) + 1);
+}
+
+static void note_range ( TCRec* rec )
+{
+   UInt i;
+   for (i = 0; i < rec->n_used; i++) {
+      if (rec->base[i] < tc_min_addr)
+         tc_min_addr = rec->base[i];
+      if (rec->base[i] + rec->len[i] > tc_max_addr)
+         tc_max_addr = rec->base[i] + rec->len[i];
+   }
+}
+
+static void free_node ( void* p )
+{
+   TCNode* n = p;
+   VG_(free)(n->data);
+   VG_(free)(n);
+}
+
+static void replace_node ( TCNode* n )
+{
+   TCNode* old = VG_(HT_remove)(tc_table, n->key);
+   if (old)
+      free_node(old);
+   VG_(HT_add_node)(tc_table, n);
+   note_range(&n->rec);
+}
+
+/* Does 'rec' still describe what is in memory?  Checks the mapping
+   containing the entry point, then that each extent is readable and
+   holds the same bytes as before. */
+static Bool guest_matches ( TCRec* rec, UChar* guest )
+{
+   UInt i;
+   NSegment const* seg = VG_(am_find_nsegment)( (Addr)rec->nraddr );
+
+   if (seg == NULL || seg->kind != SkFileC
+       || seg->dev != rec->dev || seg->ino != rec->ino
+       || seg->offset + (rec->nraddr - seg->start) != rec->foff)
+      return False;
+
+   for (i = 0; i < rec->n_used; i++) {
+      Addr a = (Addr)rec->base[i];
+      seg = VG_(am_find_nsegment)(a);
+      if (seg == NULL || !seg->hasR
+          || (rec->len[i] > 0 && a + rec->len[i] - 1 > seg->end))
+         return False;
+      if (VG_(memcmp)( (void*)a, guest, rec->len[i] ) != 0)
+         return False;
+      guest += rec->len[i];
+   }
+   return True;
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Reading and writing the cache file                   ---*/
+/*------------------------------------------------------------*/
+
+static void load_cache_file ( void )
+{
+   SysRes    sres;
+   Int       fd;
+   UInt      i;
+   TCFileHdr fh;
+
+   tc_loaded = True;
+
+   sres = VG_(open)( tc_file, VKI_O_RDONLY, 0 );
+   if (sr_isError(sres))
+      return;
+   fd = sr_Res(sres);
+
+   if (VG_(read)(fd, &fh, sizeof(fh)) != sizeof(fh)
+       || fh.magic != TC_MAGIC || fh.version != TC_VERSION
+       || fh.key != tc_key)
+      goto out;
+
+   for (i = 0; i < fh.n_recs; i++) {
+      TCNode* n = VG_(malloc)("transcache.lcf.1", sizeof(TCNode));
+      Int     sz;
+      if (VG_(read)(fd, &n->rec, sizeof(TCRec)) != sizeof(TCRec)
+          || n->rec.n_used < 1 || n->rec.n_used > 3
+          || n->rec.code_len == 0 || n->rec.code_len >= 65536
+          || n->rec.guest_len > 3 * 65536) {
+         VG_(free)(n);
+         break;
+      }
+      sz = n->rec.guest_len + n->rec.code_len;
+      n->data = VG_(malloc)("transcache.lcf.2", sz);
+      if (VG_(read)(fd, n->data, sz) != sz) {
+         free_node(n);
+         break;
+      }
+      n->key = (UWord)n->rec.nraddr;
+      replace_node(n);
+      n_tc_loaded++;
+   }
+
+  out:
+   VG_(close)(fd);
+   if (VG_(clo_verbosity) > 1)
+      VG_(message)(Vg_DebugMsg,
+                   "transcache: loaded %u translations from %s\n",
+                   n_tc_loaded, tc_file);
+}
+
+void VG_(transcache_save) ( void )
+{
+   SysRes    sres;
+   Int       fd;
+   HChar*    tmp;
+   TCFileHdr fh;
+   TCNode*   n;
+   Bool      ok;
+
+   if (VG_(clo_translation_cache_dir) == NULL)
+      return;
+
+   /* Nothing new was made and nothing was thrown away, so the file
+      on disk is already up to date. */
+   if (tc_loaded && n_tc_recorded == 0 && n_tc_discarded == 0
+       && n_tc_rejected == 0)
+      return;
+
+   tmp = VG_(malloc)("transcache.save.1", VG_(strlen)(tc_file) + 32);
+   VG_(sprintf)(tmp, "%s.%d.tmp", tc_file, VG_(getpid)());
+
+   sres = VG_(open)( tmp, VKI_O_CREAT|VKI_O_WRONLY|VKI_O_TRUNC,
+                     VKI_S_IRUSR|VKI_S_IWUSR );
+   if (sr_isError(sres)) {
+      VG_(umsg)("Warning: can't create translation cache file '%s'\n", tmp);
+      VG_(free)(tmp);
+      return;
+   }
+   fd = sr_Res(sres);
+
+   VG_(memset)(&fh, 0, sizeof(fh));
+   fh.magic   = TC_MAGIC;
+   fh.version = TC_VERSION;
+   fh.key     = tc_key;
+   fh.n_recs  = VG_(HT_count_nodes)(tc_table);
+   ok = VG_(write)(fd, &fh, sizeof(fh)) == sizeof(fh);
+
+   VG_(HT_ResetIter)(tc_table);
+   while (ok && (n = VG_(HT_Next)(tc_table))) {
+      Int sz = n->rec.guest_len + n->rec.code_len;
+      ok = VG_(write)(fd, &n->rec, sizeof(TCRec)) == sizeof(TCRec)
+           && VG_(write)(fd, n->data, sz) == sz;
+      if (ok)
+         n_tc_saved++;
+   }
+   VG_(close)(fd);
+
+   if (ok && VG_(rename)(tmp, tc_file) == 0) {
+      if (VG_(clo_verbosity) > 1)
+         VG_(message)(Vg_DebugMsg,
+                      "transcache: saved %u translations to %s\n",
+                      n_tc_saved, tc_file);
+   } else {
+      VG_(umsg)("Warning: can't write translation cache file '%s'\n",
+                tc_file);
+      VG_(unlink)(tmp);
+   }
+   VG_(free)(tmp);
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Top level                                            ---*/
+/*------------------------------------------------------------*/
+
+void VG_(init_transcache) ( void )
+{
+   VexArch         arch;
+   VexArchInfo     archinfo;
+   struct vg_stat  st;
+   SysRes          sres;
+   UInt            i;
+   ULong           h;
+   const HChar*    dir = VG_(clo_translation_cache_dir);
+   const HChar*    why = NULL;
+
+   if (dir == NULL)
+      return;
+
+   /* Translations containing run-specific constants can't be
+      reused. */
+   if (!VG_(needs).persistent_translations)
+      why = "the tool does not support it";
+   else if (VG_(clo_profile_flags) > 0)
+      why = "--profile-flags is in use";
+   else if (VG_(tdict).track_new_mem_stack_4_w_ECU
+            || VG_(tdict).track_new_mem_stack_8_w_ECU
+            || VG_(tdict).track_new_mem_stack_12_w_ECU
+            || VG_(tdict).track_new_mem_stack_16_w_ECU
+            || VG_(tdict).track_new_mem_stack_32_w_ECU
+            || VG_(tdict).track_new_mem_stack_112_w_ECU
+            || VG_(tdict).track_new_mem_stack_128_w_ECU
+            || VG_(tdict).track_new_mem_stack_144_w_ECU
+            || VG_(tdict).track_new_mem_stack_160_w_ECU
+            || VG_(tdict).track_new_mem_stack_w_ECU)
+      why = "origin tracking is in use";
+
+   /* Helper function addresses are baked into translations, so the
+      key must pin down the exact tool executable. */
+   if (why == NULL) {
+      sres = VG_(stat)( "/proc/self/exe", &st );
+      if (sr_isError(sres))
+         why = "the tool executable can't be identified";
+   }
+
+   if (why) {
+      VG_(umsg)("Warning: --translation-cache-dir ignored: %s\n", why);
+      VG_(clo_translation_cache_dir) = NULL;
+      return;
+   }
+
+   VG_(machine_get_VexArchInfo)( &arch, &archinfo );
+
+   h = 0xcbf29ce484222325ULL;
+   h = hash_str  (h, VERSION);
+   h = hash_str  (h, VG_(details).name);
+   h = hash_bytes(h, &st.dev,   sizeof(st.dev));
+   h = hash_bytes(h, &st.ino,   sizeof(st.ino));
+   h = hash_bytes(h, &st.size,  sizeof(st.size));
+   h = hash_bytes(h, &st.mtime, sizeof(st.mtime));
+   h = hash_bytes(h, &arch,     sizeof(arch));
+   h = hash_bytes(h, &archinfo, sizeof(archinfo));
+   h = hash_bytes(h, &VG_(clo_vex_control), sizeof(VG_(clo_vex_control)));
+   /* All of the command line, tool options included.  This is
+      conservative -- eg. --log-file= changes the key -- but it means
+      we never have to know which options affect instrumentation. */
+   for (i = 0; i < VG_(sizeXA)( VG_(args_for_valgrind) ); i++)
+      h = hash_str(h, * (HChar**) VG_(indexXA)( VG_(args_for_valgrind), i ));
+   tc_key = h;
+
+   tc_file = VG_(malloc)("transcache.init.1",
+                         VG_(strlen)(dir) + VG_(strlen)(VG_(details).name)
+                         + 32);
+   VG_(sprintf)(tc_file, "%s/vgtc-%s-%016llx.bin",
+                dir, VG_(details).name, tc_key);
+   for (i = VG_(strlen)(dir) + 1; tc_file[i]; i++)
+      if (tc_file[i] >= 'A' && tc_file[i] <= 'Z')
+         tc_file[i] += 'a' - 'A';
+
+   tc_table = VG_(HT_construct)("transcache");
+
+   if (VG_(clo_verbosity) > 1)
+      VG_(message)(Vg_DebugMsg, "transcache: using %s\n", tc_file);
+}
+
+Bool VG_(transcache_install) ( Addr64 nraddr, Addr64 addr, UInt kind,
+                               TransCacheCheckFn ok, void* opaque,
+                               /*OUT*/VexGuestExtents* vge )
+{
+   TCNode*     n;
+   UInt        i;
+   VexArch     arch;
+   VexArchInfo archinfo;
+
+   vg_assert(VG_(clo_translation_cache_dir) != NULL);
+
+   if (!tc_loaded)
+      load_cache_file();
+
+   n = VG_(HT_lookup)(tc_table, (UWord)nraddr);
+   if (n == NULL)
+      return False;
+
+   vge->n_used = n->rec.n_used;
+   for (i = 0; i < 3; i++) {
+      vge->base[i] = n->rec.base[i];
+      vge->len[i]  = n->rec.len[i];
+   }
+
+   if (n->rec.addr != addr || n->rec.kind != kind
+       || !guest_matches(&n->rec, n->data)
+       || !ok(opaque, vge, n->rec.sc_bitset)) {
+      VG_(HT_remove)(tc_table, n->key);
+      free_node(n);
+      n_tc_rejected++;
+      return False;
+   }
+
+   VG_(machine_get_VexArchInfo)( &arch, &archinfo );
+   VG_(add_to_transtab)( vge,
+                         nraddr,
+                         (Addr)(n->data + n->rec.guest_len),
+                         n->rec.code_len,
+                         n->rec.sc_bitset != 0,
+                         -1/*offs_profInc*/,
+                         n->rec.n_guest_instrs,
+                         arch );
+   n_tc_reused++;
+   return True;
+}
+
+void VG_(transcache_record) ( Addr64 nraddr, Addr64 addr, UInt kind,
+                              VexGuestExtents* vge, UInt sc_bitset,
+                              UChar* code, UInt code_len,
+                              UInt n_guest_instrs )
+{
+   TCNode* n;
+   UInt    i, guest_len;
+   UChar*  p;
+   NSegment const* seg = VG_(am_find_nsegment)( (Addr)nraddr );
+
+   vg_assert(VG_(clo_translation_cache_dir) != NULL);
+
+   /* JIT-generated and other anonymous code is not worth keeping. */
+   if (seg == NULL || seg->kind != SkFileC)
+      return;
+
+   guest_len = 0;
+   for (i = 0; i < vge->n_used; i++)
+      guest_len += vge->len[i];
+
+   n = VG_(malloc)("transcache.rec.1", sizeof(TCNode));
+   VG_(memset)(&n->rec, 0, sizeof(TCRec));
+   n->key                = (UWord)nraddr;
+   n->rec.nraddr         = nraddr;
+   n->rec.addr           = addr;
+   n->rec.dev            = seg->dev;
+   n->rec.ino            = seg->ino;
+   n->rec.foff           = seg->offset + (nraddr - seg->start);
+   n->rec.n_used         = vge->n_used;
+   for (i = 0; i < vge->n_used; i++) {
+      n->rec.base[i] = vge->base[i];
+      n->rec.len[i]  = vge->len[i];
+   }
+   n->rec.kind           = kind;
+   n->rec.sc_bitset      = sc_bitset;
+   n->rec.n_guest_instrs = n_guest_instrs;
+   n->rec.guest_len      = guest_len;
+   n->rec.code_len       = code_len;
+
+   n->data = p = VG_(malloc)("transcache.rec.2", guest_len + code_len);
+   for (i = 0; i < vge->n_used; i++) {
+      VG_(memcpy)(p, (void*)(Addr)vge->base[i], vge->len[i]);
+      p += vge->len[i];
+   }
+   VG_(memcpy)(p, code, code_len);
+
+   replace_node(n);
+   n_tc_recorded++;
+}
+
+void VG_(transcache_discard) ( Addr64 start, ULong range )
+{
+   TCNode** arr;
+   UInt     n_arr, i, j;
+
+   if (VG_(clo_translation_cache_dir) == NULL || tc_table == NULL)
+      return;
+   if (start >= tc_max_addr || start + range <= tc_min_addr)
+      return;
+
+   arr = (TCNode**)VG_(HT_to_array)(tc_table, &n_arr);
+   for (i = 0; i < n_arr; i++) {
+      TCRec* rec = &arr[i]->rec;
+      for (j = 0; j < rec->n_used; j++) {
+         if (rec->base[j] < start + range
+             && rec->base[j] + rec->len[j] > start)
+            break;
+      }
+      if (j < rec->n_used) {
+         VG_(HT_remove)(tc_table, arr[i]->key);
+         free_node(arr[i]);
+         n_tc_discarded++;
+      }
+   }
+   VG_(free)(arr);
+}
+
+void VG_(print_transcache_stats) ( void )
+{
+   if (VG_(clo_translation_cache_dir) == NULL)
+      return;
+   VG_(message)(Vg_DebugMsg,
+      "transcache: %'u loaded, %'u reused, %'u rejected\n",
+      n_tc_loaded, n_tc_reused, n_tc_rejected);
+   VG_(message)(Vg_DebugMsg,
+      "transcache: %'u recorded, %'u discarded, %'u saved\n",
+      n_tc_recorded, n_tc_discarded, n_tc_saved);
+}
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
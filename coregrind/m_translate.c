@@ -50,6 +50,7 @@
 
 #include "pub_core_translate.h"
 #include "pub_core_transtab.h"
+#include "pub_core_transcache.h"
 #include "pub_core_dispatch.h" // VG_(run_innerloop__dispatch_{un}profiled)
                                // VG_(run_a_noredir_translation__return_point)
 
@@ -737,6 +738,11 @@ static Bool translations_allowable_from_seg ( NSegment const* seg )
 }
 
 
+/* The value most recently returned by needs_self_check.  Vex calls
+   it exactly once per translation, so after LibVEX_Translate this
+   says which extents the new code actually checks. */
+static UInt last_sc_bitset = 0;
+
 /* Produce a bitmask stating which of the supplied extents needs a
    self-check.  See documentation of
    VexTranslateArgs::needs_self_check for more details about the
@@ -801,6 +807,23 @@ static UInt needs_self_check ( void* closureV,
                }
                break;
             }
+            case Vg_SmcPageProt: {
+               /* Code in this thread's stack is checked, as for
+                  Vg_SmcStack: the stack is written far too often to
+                  protect, not least by Valgrind when it builds signal
+                  frames.  Elsewhere, write-protect the code, unless
+                  that can't be done. */
+               Addr sp = VG_(get_SP)(closure->tid);
+               if (!segA) {
+                  segA = VG_(am_find_nsegment)(addr);
+               }
+               NSegment const* segSP = VG_(am_find_nsegment)(sp);
+               if (segA && segSP && segA == segSP)
+                  check = True;
+               else
+                  check = !VG_(pageprot_cover)(addr, len);
+               break;
+            }
             default:
                vg_assert(0);
          }
@@ -810,6 +833,7 @@ static UInt needs_self_check ( void* closureV,
          bitset |= (1 << i);
    }
 
+   last_sc_bitset = bitset;
    return bitset;
 }
 
@@ -874,6 +898,55 @@ static Bool chase_into_ok ( void* closureV, Addr64 addr64 )
 }
 
 
+/* Used instead of chase_into_ok for quick (tier 0) translations made
+   with --tiered-translation=yes: each ends at its first branch. */
+static Bool chase_never ( void* closureV, Addr64 addr64 )
+{
+   return False;
+}
+
+/* Set by VG_(translate_hot): how often a block must have run for a
+   hot trace to be continued into it. */
+static ULong hot_trace_min_count = 0;
+
+/* Used instead of chase_into_ok when a hot block is retranslated:
+   the trace only goes on into code which TT says has itself run
+   often, so that it follows the paths actually taken rather than
+   whatever Vex guesses. */
+static Bool chase_into_hot ( void* closureV, Addr64 addr64 )
+{
+   ULong count;
+
+   return chase_into_ok(closureV, addr64)
+          && VG_(get_tier_count)(addr64, &count)
+          && count >= hot_trace_min_count;
+}
+
+
+/* Callback for VG_(transcache_install): would a translation of VGE
+   made right now chase into the same places and carry the same
+   self-checks as the saved one, and does gdbserver not want to see
+   it? */
+static Bool cached_translation_ok ( void* closureV,
+                                    VexGuestExtents* vge, UInt sc_bitset )
+{
+   UInt i;
+
+   for (i = 1; i < vge->n_used; i++)
+      if (!chase_into_ok(closureV, vge->base[i]))
+         return False;
+
+   if (needs_self_check(closureV, vge) != sc_bitset)
+      return False;
+
+   if (VG_(clo_vgdb) != Vg_VgdbNo
+       && VG_(gdbserver_instrumentation_needed)(vge) != Vg_VgdbNo)
+      return False;
+
+   return True;
+}
+
+
 /* --------------- helpers for with-TOC platforms --------------- */
 
 /* NOTE: with-TOC platforms are: ppc64-linux. */
@@ -1275,6 +1348,10 @@ typedef
    }
    T_Kind;
 
+/* Set by VG_(translate_hot) while it is retranslating a block which
+   has turned out to be hot. */
+static Bool translating_hot = False;
+
 /* Translate the basic block beginning at NRADDR, and add it to the
    translation cache & translation table.  Unless
    DEBUGGING_TRANSLATION is true, in which case the call is being done
@@ -1297,6 +1374,8 @@ Bool VG_(translate) ( ThreadId tid,
    Addr64             addr;
    T_Kind             kind;
    Int                tmpbuf_used, verbosity, i;
+   Bool               tier0;
+   VexControl         tier_control;
    Bool (*preamble_fn)(void*,IRSB*);
    VexArch            vex_arch;
    VexArchInfo        vex_archinfo;
@@ -1339,6 +1418,14 @@ Bool VG_(translate) ( ThreadId tid,
 
    /* Established: (nraddr, addr, kind) */
 
+   /* With --tiered-translation=yes, unredirected code is translated
+      quickly to start with (tier 0): no chasing, no IR optimisation,
+      and an entry counter which m_transtab watches to find out when
+      the block is worth translating again properly (see
+      VG_(translate_hot)). */
+   tier0 = VG_(clo_tiered_translation) && !translating_hot
+           && !debugging_translation && kind == T_Normal;
+
    /* Printing redirection info. */
 
    if ((kind == T_Redir_Wrap || kind == T_Redir_Replace)
@@ -1425,6 +1512,27 @@ Bool VG_(translate) ( ThreadId tid,
       verbosity = VG_(clo_trace_flags);
    }
 
+   /* Set up closure args. */
+   closure.tid    = tid;
+   closure.nraddr = nraddr;
+   closure.readdr = addr;
+
+   /* Perhaps a previous run left us a usable translation, in which
+      case we don't need to bother Vex at all. */
+   if (VG_(clo_translation_cache_dir) != NULL
+       && !debugging_translation && verbosity == 0 && kind != T_NoRedir
+       && VG_(transcache_install)( nraddr, addr, kind,
+                                   cached_translation_ok, &closure,
+                                   &vge )) {
+      vg_assert( vge.base[0] == (Addr64)addr );
+      VG_(am_set_segment_hasT_if_SkFileC_or_SkAnonC)( (NSegment*)seg );
+      for (i = 1; i < vge.n_used; i++) {
+         NSegment const* seg2 = VG_(am_find_nsegment)( vge.base[i] );
+         VG_(am_set_segment_hasT_if_SkFileC_or_SkAnonC)( (NSegment*)seg2 );
+      }
+      return True;
+   }
+
    /* Figure out which preamble-mangling callback to send. */
    preamble_fn = NULL;
    if (kind == T_Redir_Replace)
@@ -1477,11 +1585,6 @@ Bool VG_(translate) ( ThreadId tid,
    vex_abiinfo.host_ppc_calls_use_fndescrs    = True;
 #  endif
 
-   /* Set up closure args. */
-   closure.tid    = tid;
-   closure.nraddr = nraddr;
-   closure.readdr = addr;
-
    /* Set up args for LibVEX_Translate. */
    vta.arch_guest       = vex_arch;
    vta.archinfo_guest   = vex_archinfo;
@@ -1491,7 +1594,9 @@ Bool VG_(translate) ( ThreadId tid,
    vta.callback_opaque  = (void*)&closure;
    vta.guest_bytes      = (UChar*)ULong_to_Ptr(addr);
    vta.guest_bytes_addr = (Addr64)addr;
-   vta.chase_into_ok    = chase_into_ok;
+   vta.chase_into_ok    = tier0           ? chase_never
+                          : translating_hot ? chase_into_hot
+                          :                   chase_into_ok;
    vta.guest_extents    = &vge;
    vta.host_bytes       = tmpbuf;
    vta.host_bytes_size  = N_TMPBUF;
@@ -1524,8 +1629,9 @@ Bool VG_(translate) ( ThreadId tid,
    vta.needs_self_check  = needs_self_check;
    vta.preamble_function = preamble_fn;
    vta.traceflags        = verbosity;
-   vta.addProfInc        = VG_(clo_profile_flags) > 0
-                           && kind != T_NoRedir;
+   vta.addProfInc        = (VG_(clo_profile_flags) > 0
+                            && kind != T_NoRedir)
+                           || tier0;
 
    /* Set up the dispatch continuation-point info.  If this is a
       no-redir translation then it cannot be chained, and the chain-me
@@ -1555,11 +1661,31 @@ Bool VG_(translate) ( ThreadId tid,
    vta.disp_cp_xassisted
       = VG_(fnptr_to_fnentry)( &VG_(disp_cp_xassisted) );
 
+   /* A tier 0 translation is made as cheaply as possible.  A hot one
+      is a trace: Vex may go on past up to guest_max_insns
+      instructions' worth of branches, including conditional ones,
+      as long as chase_into_hot agrees, and the result is optimised
+      and instrumented as one block. */
+   tier_control = VG_(clo_vex_control);
+   if (tier0) {
+      tier_control.iropt_level         = 0;
+      tier_control.iropt_unroll_thresh = 0;
+      tier_control.guest_chase_cond    = False;
+   } else if (translating_hot) {
+      tier_control.guest_chase_thresh  = tier_control.guest_max_insns - 1;
+      tier_control.guest_chase_cond    = True;
+   }
+   /* NULL means "as given to LibVEX_Init", which is what untiered
+      translations get. */
+   vta.vex_control = (tier0 || translating_hot) ? &tier_control : NULL;
+
    /* Sheesh.  Finally, actually _do_ the translation! */
+   last_sc_bitset = 0;
    tres = LibVEX_Translate ( &vta );
 
    vg_assert(tres.status == VexTransOK);
    vg_assert(tres.n_sc_extents >= 0 && tres.n_sc_extents <= 3);
+   vg_assert((tres.n_sc_extents > 0) == (last_sc_bitset != 0));
    vg_assert(tmpbuf_used <= N_TMPBUF);
    vg_assert(tmpbuf_used > 0);
 
@@ -1590,6 +1716,17 @@ Bool VG_(translate) ( ThreadId tid,
           // Put it into the normal TT/TC structures.  This is the
           // normal case.
 
+          // Keep a copy for later runs, if asked to.
+          if (VG_(clo_translation_cache_dir) != NULL
+              && tres.offs_profInc == -1
+              && (VG_(clo_vgdb) == Vg_VgdbNo
+                  || VG_(gdbserver_instrumentation_needed)(&vge)
+                     == Vg_VgdbNo))
+             VG_(transcache_record)( nraddr, addr, kind, &vge,
+                                     last_sc_bitset,
+                                     tmpbuf, tmpbuf_used,
+                                     tres.n_guest_instrs );
+
           // Note that we use nraddr (the non-redirected address), not
           // addr, which might have been changed by the redirection
           VG_(add_to_transtab)( &vge,
@@ -1612,6 +1749,35 @@ Bool VG_(translate) ( ThreadId tid,
    return True;
 }
 
+
+/* Translate NRADDR again, after its tier 0 translation has run COUNT
+   times and been thrown away.  This time Vex may chase along the
+   successors which have run at least half as often as NRADDR itself.
+   Unlike VG_(translate), a failure is silent: this is not done on
+   behalf of any particular thread, and if the code has become
+   untranslatable in the meantime the thread which next jumps to it
+   will get the fault. */
+Bool VG_(translate_hot) ( ThreadId tid, Addr64 nraddr, ULong count,
+                          ULong bbs_done )
+{
+   Bool   ok;
+   Addr64 addr = VG_(redir_do_lookup)( nraddr, NULL );
+
+   if (!translations_allowable_from_seg( VG_(am_find_nsegment)(nraddr) )
+       || !translations_allowable_from_seg( VG_(am_find_nsegment)(addr) )
+       || nraddr == TRANSTAB_BOGUS_GUEST_ADDR
+       || addr == TRANSTAB_BOGUS_GUEST_ADDR)
+      return False;
+
+   vg_assert(!translating_hot);
+   translating_hot     = True;
+   hot_trace_min_count = count / 2;
+   ok = VG_(translate)( tid, nraddr, False/*debug*/, 0/*not verbose*/,
+                        bbs_done, True/*allow redirection*/ );
+   translating_hot = False;
+   return ok;
+}
+
 /*--------------------------------------------------------------------*/
 /*--- end                                                          ---*/
 /*--------------------------------------------------------------------*/
@@ -40,10 +40,16 @@
 #include "pub_core_options.h"
 #include "pub_core_tooliface.h"  // For VG_(details).avg_translation_sizeB
 #include "pub_core_transtab.h"
+#include "pub_core_transcache.h"  // VG_(transcache_discard)
 #include "pub_core_aspacemgr.h"
 #include "pub_core_mallocfree.h" // VG_(out_of_memory_NORETURN)
 #include "pub_core_xarray.h"
+#include "pub_core_wordfm.h"
+#include "pub_core_hashtable.h"
 #include "pub_core_dispatch.h"   // For VG_(disp_cp*) addresses
+#include "pub_core_libcsetjmp.h"  // to keep _threadstate.h happy
+#include "pub_core_threadstate.h" // VG_(running_tid)
+#include "pub_core_scheduler.h"   // VG_(acquire_code_exclusive)
 
 
 /* #define DEBUG_TRANSTAB */
@@ -55,16 +61,20 @@
 
 /*------------------ CONSTANTS ------------------*/
 
-/* Number of sectors the TC is divided into.  If you need a larger
-   overall translation cache, increase this value. */
-#define N_SECTORS 8
+/* Number of sectors the TC is divided into.  This is initially
+   VG_(clo_num_transtab_sectors) (default N_SECTORS_DEFAULT), and may
+   grow at run time up to VG_(clo_max_transtab_sectors) if the
+   program keeps retranslating code thrown out by sector recycling.
+   MAX_N_SECTORS (see pub_core_transtab.h) is the hard limit. */
+static Int n_sectors = 0;
+static Int max_n_sectors = 0;
 
 /* Number of TC entries in each sector.  This needs to be a prime
    number to work properly, it must be <= 65535 (so that a TT index
-   fits in a UShort, leaving room for 0xFFFF(EC2TTE_DELETED) to denote
-   'deleted') and it is strongly recommended not to change this.
-   65521 is the largest prime <= 65535. */
-#define N_TTES_PER_SECTOR /*10007*/ /*30011*/ /*40009*/ 65521
+   fits in a UShort).  It is VG_(clo_transtab_sector_entries) rounded down
+   to a prime; MAX_N_TTES_PER_SECTOR, the default, is the largest
+   prime <= 65535. */
+static UInt n_ttes_per_sector = 0;
 
 /* Because each sector contains a hash table of TTEntries, we need to
    specify the maximum allowable loading, after which the sector is
@@ -72,19 +82,24 @@
 #define SECTOR_TT_LIMIT_PERCENT 65
 
 /* The sector is deemed full when this many entries are in it. */
-#define N_TTES_PER_SECTOR_USABLE \
-           ((N_TTES_PER_SECTOR * SECTOR_TT_LIMIT_PERCENT) / 100)
+static UInt n_ttes_per_sector_usable = 0;
 
-/* Equivalence classes for fast address range deletion.  There are 1 +
-   2^ECLASS_WIDTH bins.  The highest one, ECLASS_MISC, describes an
-   address range which does not fall cleanly within any specific bin.
-   Note that ECLASS_SHIFT + ECLASS_WIDTH must be < 32. */
-#define ECLASS_SHIFT 11
-#define ECLASS_WIDTH 8
-#define ECLASS_MISC  (1 << ECLASS_WIDTH)
-#define ECLASS_N     (1 + ECLASS_MISC)
+/* Generational eviction: when a sector is recycled, translations in
+   it which have been used at least SURVIVOR_MIN_USES times (see
+   TTEntry.usecount) are copied into the fresh sector rather than
+   being thrown away, up to SURVIVOR_MAX_PERCENT of its capacity.
+   Only done if VG_(clo_transtab_survivors) is set. */
+#define SURVIVOR_MIN_USES    4
+#define SURVIVOR_MAX_PERCENT 25
 
-#define EC2TTE_DELETED  0xFFFF /* 16-bit special value */
+/* Grow the number of sectors (if allowed) when, over one full cycle
+   of sector use, at least this percentage of new translations were
+   of code previously evicted by sector recycling. */
+#define GROW_RETRANS_PERCENT 10
+
+/* Size of the direct-mapped table of recently evicted entry
+   addresses, used to spot (most) retranslations. */
+#define N_EVICTED 16384
 
 
 /*------------------ TYPES ------------------*/
@@ -143,6 +158,18 @@ typedef
       ULong    count;
       UShort   weight;
 
+      /* Approximate use count, maintained whether or not we are
+         profiling: bumped each time the translation is found by
+         VG_(search_transtab) and each time a jump to it is chained.
+         Decides which translations survive sector recycling. */
+      UInt     usecount;
+
+      /* --tiered-translation=yes only: this is a quick translation,
+         and .count is its entry count.  Once that reaches
+         VG_(clo_tier_up_threshold) the translation is thrown away, to
+         be replaced by a proper one (see VG_(take_hot_translations)). */
+      Bool     tier0;
+
       /* Status of the slot.  Note, we need to be able to do lazy
          deletion, hence the Deleted state. */
       enum { InUse, Deleted, Empty } status;
@@ -165,23 +192,11 @@ typedef
       /* This structure describes precisely what ranges of guest code
          the translation covers, so we can decide whether or not to
          delete it when translations of a given address range are
-         invalidated. */
+         invalidated.  While the entry is InUse, each of its extents
+         is listed in the containing Sector's guest_extents index,
+         which refers back to the .base[] slots here. */
       VexGuestExtents vge;
 
-      /* Address range summary info: these are pointers back to
-         eclass[] entries in the containing Sector.  Those entries in
-         turn point back here -- the two structures are mutually
-         redundant but both necessary to make fast deletions work.
-         The eclass info is similar to, and derived from, this entry's
-         'vge' field, but it is not the same */
-      UShort n_tte2ec;      // # tte2ec pointers (1 to 3)
-      UShort tte2ec_ec[3];  // for each, the eclass #
-      UInt   tte2ec_ix[3];  // and the index within the eclass.
-      // for i in 0 .. n_tte2ec-1
-      //    sec->ec2tte[ tte2ec_ec[i] ][ tte2ec_ix[i] ] 
-      // should be the index 
-      // of this TTEntry in the containing Sector's tt array.
-
       /* Admin information for chaining.  'in_edges' is a set of the
          patch points which jump to this translation -- hence are
          predecessors in the control flow graph.  'out_edges' points
@@ -309,7 +324,7 @@ typedef
       ULong* tc;
 
       /* The TTEntry array.  This is a fixed size, always containing
-         exactly N_TTES_PER_SECTOR entries. */
+         exactly n_ttes_per_sector entries. */
       TTEntry* tt;
 
       /* This points to the current allocation point in tc. */
@@ -318,13 +333,14 @@ typedef
       /* The count of tt entries with state InUse. */
       Int tt_n_inuse;
 
-      /* Expandable arrays of tt indices for each of the ECLASS_N
-         address range equivalence classes.  These hold indices into
-         the containing sector's tt array, which in turn should point
-         back here. */
-      Int     ec2tte_size[ECLASS_N];
-      Int     ec2tte_used[ECLASS_N];
-      UShort* ec2tte[ECLASS_N];
+      /* Index of the guest code ranges covered by the translations
+         in tt, so that those intersecting a given range can be found
+         quickly: a WordFM of pointers to the .vge.base[] slots of the
+         InUse entries, ordered by guest address.  No extent in it is
+         longer than guest_extents_maxlen.  See "Guest address range
+         index" below. */
+      WordFM* guest_extents;
+      UInt    guest_extents_maxlen;
 
       /* The host extents.  The [start, +len) ranges are constructed
          in strictly non-overlapping order, so we can binary search
@@ -348,7 +364,7 @@ typedef
    N_TC_SECTORS.  The initial -1 value indicates the TT/TC system is
    not yet initialised. 
 */
-static Sector sectors[N_SECTORS];
+static Sector sectors[MAX_N_SECTORS];
 static Int    youngest_sector = -1;
 
 /* The number of ULongs in each TCEntry area.  This is computed once
@@ -360,12 +376,15 @@ static Int    tc_sector_szQ;
    searched to find translations.  This is an optimisation to be used
    when searching for translations and should not affect
    correctness.  -1 denotes "no entry". */
-static Int sector_search_order[N_SECTORS];
+static Int sector_search_order[MAX_N_SECTORS];
 
 
-/* Fast helper for the TC.  A direct-mapped cache which holds a set of
-   recently used (guest address, host address) pairs.  This array is
-   referred to directly from m_dispatch/dispatch-<platform>.S.
+/* Fast helper for the TC.  A small cache which holds a set of
+   recently used (guest address, host address) pairs; see
+   pub_core_transtab_asm.h for its organisation.  This array is
+   referred to directly from m_dispatch/dispatch-<platform>.S, or is
+   handed to VG_(disp_run_translations) on platforms which support
+   per-thread fast caches.
 
    Entries in tt_fast may refer to any valid TC entry, regardless of
    which sector it's in.  Consequently we must be very careful to
@@ -385,18 +404,27 @@ typedef
    }
    FastCacheEntry;
 */
-/*global*/ __attribute__((aligned(16)))
+/*global*/ __attribute__((aligned(64)))
            FastCacheEntry VG_(tt_fast)[VG_TT_FAST_SIZE];
 
+/* With --per-thread-fast-cache=yes, each thread gets its own copy of
+   the above, allocated when it first runs, and VG_(tt_fast) itself
+   is unused.  Slots are reused by later threads with the same
+   ThreadId; the contents stay valid since all copies are maintained
+   together. */
+static FastCacheEntry* thread_fast_cache[VG_N_THREADS];
+
 /* Make sure we're not used before initialisation. */
 static Bool init_done = False;
 
 
 /*------------------ STATS DECLS ------------------*/
 
-/* Number of fast-cache updates and flushes done. */
+/* Number of fast-cache updates and flushes done, and of entries
+   removed individually when translations are discarded. */
 static ULong n_fast_flushes = 0;
 static ULong n_fast_updates = 0;
+static ULong n_fast_removals = 0;
 
 /* Number of full lookups done. */
 static ULong n_full_lookups = 0;
@@ -417,6 +445,34 @@ static ULong n_dump_osize = 0;
 static ULong n_disc_count = 0;
 static ULong n_disc_osize = 0;
 
+/* Number of translations of code previously evicted by sector
+   recycling (approximate, see evicted_entries[]); number of
+   translations which survived recycling; number of times the
+   number of sectors was grown. */
+static ULong n_retrans_count = 0;
+static ULong n_survivor_count = 0;
+static ULong n_sector_grows = 0;
+
+/* Number of quick (tier 0) translations made, and number of those
+   later thrown away for being hot. */
+static ULong n_tier0_count = 0;
+static ULong n_tier_up_count = 0;
+
+/* Where VG_(take_hot_translations) got to in its walk over TT. */
+static Int tier_scan_sno   = 0;
+static Int tier_scan_tteNo = 0;
+
+/* Counts of new translations and retranslations since the
+   youngest sector last wrapped around; used to decide whether to
+   grow. */
+static ULong n_in_cycle = 0;
+static ULong n_retrans_cycle = 0;
+
+/* Entry addresses of translations recently evicted by sector
+   recycling, direct-mapped on the entry address.  Slots not in use
+   hold TRANSTAB_BOGUS_GUEST_ADDR. */
+static Addr64 evicted_entries[N_EVICTED];
+
 
 /*-------------------------------------------------------------*/
 /*--- Misc                                                  ---*/
@@ -439,8 +495,8 @@ static void ttaux_free ( void* p )
 
 static inline TTEntry* index_tte ( UInt sNo, UInt tteNo )
 {
-   vg_assert(sNo < N_SECTORS);
-   vg_assert(tteNo < N_TTES_PER_SECTOR);
+   vg_assert(sNo < n_sectors);
+   vg_assert(tteNo < n_ttes_per_sector);
    Sector* s = &sectors[sNo];
    vg_assert(s->tt);
    TTEntry* tte = &s->tt[tteNo];
@@ -640,7 +696,7 @@ Bool find_TTEntry_from_hcode( /*OUT*/UInt* from_sNo,
    Int i;
 
    /* Search order logic copied from VG_(search_transtab). */
-   for (i = 0; i < N_SECTORS; i++) {
+   for (i = 0; i < n_sectors; i++) {
       Int sno = sector_search_order[i];
       if (UNLIKELY(sno == -1))
          return False; /* run out of sectors to search */
@@ -663,7 +719,7 @@ Bool find_TTEntry_from_hcode( /*OUT*/UInt* from_sNo,
          HostExtent* hx = VG_(indexXA)(host_extents, firstW);
          UInt tteNo = hx->tteNo;
          /* Do some additional sanity checks. */
-         vg_assert(tteNo <= N_TTES_PER_SECTOR);
+         vg_assert(tteNo <= n_ttes_per_sector);
          /* Entry might have been invalidated. Consider this
             as not found. */
          if (sec->tt[tteNo].status == Deleted)
@@ -689,7 +745,7 @@ Bool find_TTEntry_from_hcode( /*OUT*/UInt* from_sNo,
 static Bool is_in_the_main_TC ( void* hcode )
 {
    Int i, sno;
-   for (i = 0; i < N_SECTORS; i++) {
+   for (i = 0; i < n_sectors; i++) {
       sno = sector_search_order[i];
       if (sno == -1)
          break; /* run out of sectors to search */
@@ -705,10 +761,10 @@ static Bool is_in_the_main_TC ( void* hcode )
 /* Fulfill a chaining request, and record admin info so we
    can undo it later, if required.
 */
-void VG_(tt_tc_do_chaining) ( void* from__patch_addr,
-                              UInt  to_sNo,
-                              UInt  to_tteNo,
-                              Bool  to_fastEP )
+static void do_chaining ( void* from__patch_addr,
+                          UInt  to_sNo,
+                          UInt  to_tteNo,
+                          Bool  to_fastEP )
 {
    /* Get the CPU info established at startup. */
    VexArch vex_arch = VexArch_INVALID;
@@ -749,6 +805,11 @@ void VG_(tt_tc_do_chaining) ( void* from__patch_addr,
 
    TTEntry* from_tte = index_tte(from_sNo, from_tteNo);
 
+   /* Other threads may be running the code we are about to patch. */
+   VG_(acquire_code_exclusive)();
+
+   to_tte->usecount++;
+
    /* Get VEX to do the patching itself.  We have to hand it off
       since it is host-dependent. */
    VexInvalRange vir
@@ -788,6 +849,91 @@ void VG_(tt_tc_do_chaining) ( void* from__patch_addr,
    /* Add .. */
    InEdgeArr__add(&to_tte->in_edges, &ie);
    OutEdgeArr__add(&from_tte->out_edges, &oe);
+
+   VG_(release_code_exclusive)();
+}
+
+
+/* With --parallel-execution=yes, patching code which other threads
+   may be running means stopping them all first.  Doing that for
+   every chaining request would stop the world every time a thread
+   reaches a new exit.  So while other threads are running, requests
+   are queued instead, and done in one go when the queue fills up, or
+   when VG_(acquire_code_exclusive) is called for some other reason.
+   Since everything which changes the translations acquires the code
+   exclusively first, queued requests are still valid when they are
+   done.  Meanwhile the requesting thread carries on unchained, which
+   only costs it a trip through the scheduler for each exit taken;
+   it may ask again, so requests for a patch address already in the
+   queue are dropped. */
+
+#define N_QUEUED_CHAINS 64
+
+typedef
+   struct {
+      void* from__patch_addr;
+      UInt  to_sNo;
+      UInt  to_tteNo;
+      Bool  to_fastEP;
+   }
+   QueuedChain;
+
+static QueuedChain queued_chains[N_QUEUED_CHAINS];
+static Int         n_queued_chains = 0;
+
+/* Stats only: chaining requests queued, and batches done. */
+static ULong n_chain_queued  = 0;
+static ULong n_chain_batches = 0;
+
+void VG_(tt_tc_do_chaining) ( void* from__patch_addr,
+                              UInt  to_sNo,
+                              UInt  to_tteNo,
+                              Bool  to_fastEP )
+{
+   Int i;
+
+   if (!VG_(parallel_code_running)()) {
+      do_chaining( from__patch_addr, to_sNo, to_tteNo, to_fastEP );
+      return;
+   }
+
+   for (i = 0; i < n_queued_chains; i++) {
+      if (queued_chains[i].from__patch_addr == from__patch_addr)
+         return;
+   }
+
+   vg_assert(n_queued_chains < N_QUEUED_CHAINS);
+   queued_chains[n_queued_chains].from__patch_addr = from__patch_addr;
+   queued_chains[n_queued_chains].to_sNo           = to_sNo;
+   queued_chains[n_queued_chains].to_tteNo         = to_tteNo;
+   queued_chains[n_queued_chains].to_fastEP        = to_fastEP;
+   n_queued_chains++;
+   n_chain_queued++;
+
+   if (n_queued_chains == N_QUEUED_CHAINS) {
+      /* This does them. */
+      VG_(acquire_code_exclusive)();
+      VG_(release_code_exclusive)();
+      vg_assert(n_queued_chains == 0);
+   }
+}
+
+void VG_(tt_tc_do_queued_chaining) ( void )
+{
+   Int i, n = n_queued_chains;
+
+   if (n == 0)
+      return;
+
+   /* Empty the queue first: do_chaining calls
+      VG_(acquire_code_exclusive) too. */
+   n_queued_chains = 0;
+   n_chain_batches++;
+   for (i = 0; i < n; i++)
+      do_chaining( queued_chains[i].from__patch_addr,
+                   queued_chains[i].to_sNo,
+                   queued_chains[i].to_tteNo,
+                   queued_chains[i].to_fastEP );
 }
 
 
@@ -889,278 +1035,216 @@ void unchain_in_preparation_for_deletion ( VexArch vex_arch,
 }
 
 
-/*-------------------------------------------------------------*/
-/*--- Address-range equivalence class stuff                 ---*/
-/*-------------------------------------------------------------*/
-
-/* Return equivalence class number for a range. */
-
-static Int range_to_eclass ( Addr64 start, UInt len )
-{
-   UInt mask   = (1 << ECLASS_WIDTH) - 1;
-   UInt lo     = (UInt)start;
-   UInt hi     = lo + len - 1;
-   UInt loBits = (lo >> ECLASS_SHIFT) & mask;
-   UInt hiBits = (hi >> ECLASS_SHIFT) & mask;
-   if (loBits == hiBits) {
-      vg_assert(loBits < ECLASS_N-1);
-      return loBits;
-   } else {
-      return ECLASS_MISC;
-   }
-}
-
-
-/* Calculates the equivalence class numbers for any VexGuestExtent.
-   These are written in *eclasses, which must be big enough to hold 3
-   Ints.  The number written, between 1 and 3, is returned.  The
-   eclasses are presented in order, and any duplicates are removed.
-*/
-
-static 
-Int vexGuestExtents_to_eclasses ( /*OUT*/Int* eclasses,
-                                  VexGuestExtents* vge )
+/* Undo all the chained jumps out of the specified block, so that its
+   code is once again as it was when added, and remove it from the
+   preds of the blocks it was chained to.  Used to prepare a block's
+   code for copying elsewhere. */
+static
+void unchain_out_edges ( VexArch vex_arch, UInt here_sNo, UInt here_tteNo )
 {
-#  define SWAP(_lv1,_lv2) \
-      do { Int t = _lv1; _lv1 = _lv2; _lv2 = t; } while (0)
-
-   Int i, j, n_ec, r;
-
-   vg_assert(vge->n_used >= 1 && vge->n_used <= 3);
+   UWord    i, j, n, m;
+   Int      evCheckSzB = LibVEX_evCheckSzB(vex_arch);
+   TTEntry* here_tte   = index_tte(here_sNo, here_tteNo);
 
-   n_ec = 0;
-   for (i = 0; i < vge->n_used; i++) {
-      r = range_to_eclass( vge->base[i], (UInt)vge->len[i] );
-      if (r == ECLASS_MISC) 
-         goto bad;
-      /* only add if we haven't already seen it */
-      for (j = 0; j < n_ec; j++)
-         if (eclasses[j] == r)
-            break;
-      if (j == n_ec)
-         eclasses[n_ec++] = r;
+   n = OutEdgeArr__size(&here_tte->out_edges);
+   for (i = 0; i < n; i++) {
+      OutEdge* oe = OutEdgeArr__index(&here_tte->out_edges, i);
+      TTEntry* to_tte = index_tte(oe->to_sNo, oe->to_tteNo);
+      m = InEdgeArr__size(&to_tte->in_edges);
+      vg_assert(m > 0); // it must have at least one entry
+      for (j = 0; j < m; j++) {
+         InEdge* ie = InEdgeArr__index(&to_tte->in_edges, j);
+         if (ie->from_sNo == here_sNo && ie->from_tteNo == here_tteNo
+             && ie->from_offs == oe->from_offs)
+           break;
+      }
+      vg_assert(j < m); // "ie must be findable"
+      UChar* to_slow_EP = (UChar*)to_tte->tcptr;
+      UChar* to_fast_EP = to_slow_EP + evCheckSzB;
+      unchain_one(vex_arch, InEdgeArr__index(&to_tte->in_edges, j),
+                  to_fast_EP, to_slow_EP);
+      InEdgeArr__deleteIndex(&to_tte->in_edges, j);
    }
 
-   if (n_ec == 1)
-      return 1;
-
-   if (n_ec == 2) {
-      /* sort */
-      if (eclasses[0] > eclasses[1])
-         SWAP(eclasses[0], eclasses[1]);
-      return 2;
-   }
+   OutEdgeArr__makeEmpty(&here_tte->out_edges);
+}
 
-   if (n_ec == 3) {
-      /* sort */
-      if (eclasses[0] > eclasses[2])
-         SWAP(eclasses[0], eclasses[2]);
-      if (eclasses[0] > eclasses[1])
-         SWAP(eclasses[0], eclasses[1]);
-      if (eclasses[1] > eclasses[2])
-         SWAP(eclasses[1], eclasses[2]);
-      return 3;
-   }
 
-   /* NOTREACHED */
-   vg_assert(0);
+/*-------------------------------------------------------------*/
+/*--- Guest address range index                             ---*/
+/*-------------------------------------------------------------*/
 
-  bad:
-   eclasses[0] = ECLASS_MISC;
-   return 1;
+/* Each sector's guest_extents has one key for each extent of each
+   InUse translation: a pointer to the extent's .vge.base[] slot in
+   the TTEntry.  Keys are ordered by the guest address they point at,
+   then (to make them unique) by the pointer itself; values are
+   unused.  Since no extent is longer than guest_extents_maxlen, all
+   those intersecting [start, start+range) begin in
+   [start - guest_extents_maxlen + 1, start + range), and so can be
+   found by one range iteration, in O(log n + k) time. */
 
-#  undef SWAP
+static inline
+Bool overlap1 ( Addr64 s1, ULong r1, Addr64 s2, ULong r2 )
+{
+   Addr64 e1 = s1 + r1 - 1ULL;
+   Addr64 e2 = s2 + r2 - 1ULL;
+   if (e1 < s2 || e2 < s1) 
+      return False;
+   return True;
 }
 
-
-/* Add tteno to the set of entries listed for equivalence class ec in
-   this sector.  Returns used location in eclass array. */
-
-static 
-UInt addEClassNo ( /*MOD*/Sector* sec, Int ec, UShort tteno )
+static inline
+Bool overlaps ( Addr64 start, ULong range, VexGuestExtents* vge )
 {
-   Int    old_sz, new_sz, i, r;
-   UShort *old_ar, *new_ar;
-
-   vg_assert(ec >= 0 && ec < ECLASS_N);
-   vg_assert(tteno < N_TTES_PER_SECTOR);
-
-   if (0) VG_(printf)("ec %d  gets %d\n", ec, (Int)tteno);
+   if (overlap1(start, range, vge->base[0], (UInt)vge->len[0]))
+      return True;
+   if (vge->n_used < 2)
+      return False;
+   if (overlap1(start, range, vge->base[1], (UInt)vge->len[1]))
+      return True;
+   if (vge->n_used < 3)
+      return False;
+   if (overlap1(start, range, vge->base[2], (UInt)vge->len[2]))
+      return True;
+   return False;
+}
 
-   if (sec->ec2tte_used[ec] >= sec->ec2tte_size[ec]) {
 
-      vg_assert(sec->ec2tte_used[ec] == sec->ec2tte_size[ec]);
+static Word cmp_guest_extent_keys ( UWord k1, UWord k2 )
+{
+   Addr64 a1 = *(Addr64*)k1;
+   Addr64 a2 = *(Addr64*)k2;
+   if (a1 < a2) return -1;
+   if (a1 > a2) return 1;
+   if (k1 < k2) return -1;
+   if (k1 > k2) return 1;
+   return 0;
+}
 
-      old_sz = sec->ec2tte_size[ec];
-      old_ar = sec->ec2tte[ec];
-      new_sz = old_sz==0 ? 8 : old_sz<64 ? 2*old_sz : (3*old_sz)/2;
-      new_ar = ttaux_malloc("transtab.aECN.1",
-                            new_sz * sizeof(UShort));
-      for (i = 0; i < old_sz; i++)
-         new_ar[i] = old_ar[i];
-      if (old_ar)
-         ttaux_free(old_ar);
-      sec->ec2tte_size[ec] = new_sz;
-      sec->ec2tte[ec] = new_ar;
+/* Which TTEntry of sec does this key point into? */
+static UInt guest_extent_key_to_tteNo ( Sector* sec, UWord key )
+{
+   UInt tteNo;
+   vg_assert(key >= (UWord)&sec->tt[0]);
+   tteNo = (key - (UWord)&sec->tt[0]) / sizeof(TTEntry);
+   vg_assert(tteNo < n_ttes_per_sector);
+   return tteNo;
+}
 
-      if (0) VG_(printf)("expand ec %d to %d\n", ec, new_sz);
+/* Add the extents of sec->tt[tteNo] to the index. */
+static void add_guest_extents ( Sector* sec, UInt tteNo )
+{
+   TTEntry* tte = &sec->tt[tteNo];
+   UInt     i;
+   vg_assert(tte->vge.n_used >= 1 && tte->vge.n_used <= 3);
+   for (i = 0; i < tte->vge.n_used; i++) {
+      Bool present = VG_(addToFM)( sec->guest_extents,
+                                   (UWord)&tte->vge.base[i], 0 );
+      vg_assert(!present);
+      if (tte->vge.len[i] > sec->guest_extents_maxlen)
+         sec->guest_extents_maxlen = tte->vge.len[i];
    }
-
-   /* Common case */
-   r = sec->ec2tte_used[ec]++;
-   vg_assert(r >= 0 && r < sec->ec2tte_size[ec]);
-   sec->ec2tte[ec][r] = tteno;
-   return (UInt)r;
 }
 
-
-/* 'vge' is being added to 'sec' at TT entry 'tteno'.  Add appropriate
-   eclass entries to 'sec'. */
-
-static 
-void upd_eclasses_after_add ( /*MOD*/Sector* sec, Int tteno )
+/* Remove the extents of sec->tt[tteNo] from the index. */
+static void del_guest_extents ( Sector* sec, UInt tteNo )
 {
-   Int i, r, eclasses[3];
-   TTEntry* tte;
-   vg_assert(tteno >= 0 && tteno < N_TTES_PER_SECTOR);
-
-   tte = &sec->tt[tteno];
-   r = vexGuestExtents_to_eclasses( eclasses, &tte->vge );
+   TTEntry* tte = &sec->tt[tteNo];
+   UInt     i;
+   for (i = 0; i < tte->vge.n_used; i++) {
+      Bool found = VG_(delFromFM)( sec->guest_extents, NULL, NULL,
+                                   (UWord)&tte->vge.base[i] );
+      vg_assert(found);
+   }
+}
 
-   vg_assert(r >= 1 && r <= 3);
-   tte->n_tte2ec = r;
+/* Append to 'hits' (an XArray of UInt) the tt index of each InUse
+   translation in sec which intersects [start, start+range).  A
+   translation may be listed more than once. */
+static void find_guest_extents ( /*MOD*/XArray* hits, Sector* sec,
+                                 Addr64 start, ULong range )
+{
+   UWord  key, val;
+   Addr64 lo, hi;
+
+   vg_assert(range > 0);
+   hi = start + range - 1;
+   if (hi < start)
+      hi = ~(Addr64)0;
+
+   /* Keys for 'lo' itself may or may not be visited, depending on
+      where the tie-break puts them, but they can't intersect the
+      range anyway. */
+   if (start > sec->guest_extents_maxlen) {
+      lo = start - sec->guest_extents_maxlen;
+      VG_(initIterAtFM)( sec->guest_extents, (UWord)&lo );
+   } else {
+      VG_(initIterFM)( sec->guest_extents );
+   }
 
-   for (i = 0; i < r; i++) {
-      tte->tte2ec_ec[i] = eclasses[i];
-      tte->tte2ec_ix[i] = addEClassNo( sec, eclasses[i], (UShort)tteno );
+   while (VG_(nextIterFM)( sec->guest_extents, &key, &val )) {
+      UInt     tteNo;
+      TTEntry* tte;
+      if (*(Addr64*)key > hi)
+         break;
+      tteNo = guest_extent_key_to_tteNo(sec, key);
+      tte   = &sec->tt[tteNo];
+      vg_assert(tte->status == InUse);
+      if (overlaps( start, range, &tte->vge ))
+         VG_(addToXA)( hits, &tteNo );
    }
+   VG_(doneIterFM)( sec->guest_extents );
 }
 
 
-/* Check the eclass info in 'sec' to ensure it is consistent.  Returns
-   True if OK, False if something's not right.  Expensive. */
+/* Check the guest_extents index of 'sec' is consistent with its tt.
+   Returns True if OK, False if something's not right. */
 
-static Bool sanity_check_eclasses_in_sector ( Sector* sec )
+static Bool sanity_check_guest_extents_in_sector ( Sector* sec )
 {
 #  define BAD(_str) do { whassup = (_str); goto bad; } while (0)
 
-   HChar*   whassup = NULL;
-   Int      i, j, k, n, ec_num, ec_idx;
-   TTEntry* tte;
-   UShort   tteno;
-   ULong*   tce;
-
-   /* Basic checks on this sector */
-   if (sec->tt_n_inuse < 0 || sec->tt_n_inuse > N_TTES_PER_SECTOR_USABLE)
-      BAD("invalid sec->tt_n_inuse");
-   tce = sec->tc_next;
-   if (tce < &sec->tc[0] || tce > &sec->tc[tc_sector_szQ])
-      BAD("sec->tc_next points outside tc");
-
-   /* For each eclass ... */
-   for (i = 0; i < ECLASS_N; i++) {
-      if (sec->ec2tte_size[i] == 0 && sec->ec2tte[i] != NULL)
-         BAD("ec2tte_size/ec2tte mismatch(1)");
-      if (sec->ec2tte_size[i] != 0 && sec->ec2tte[i] == NULL)
-         BAD("ec2tte_size/ec2tte mismatch(2)");
-      if (sec->ec2tte_used[i] < 0 
-          || sec->ec2tte_used[i] > sec->ec2tte_size[i])
-         BAD("implausible ec2tte_used");
-      if (sec->ec2tte_used[i] == 0)
-         continue;
+   HChar* whassup = NULL;
+   UWord  key, val, nKeys = 0, nExtents = 0;
+   UInt   i, tteNo;
 
-      /* For each tt reference in each eclass .. ensure the reference
-         is to a valid tt entry, and that the entry's address ranges
-         really include this eclass. */
+   if (sec->guest_extents == NULL)
+      BAD("no guest_extents");
 
-      for (j = 0; j < sec->ec2tte_used[i]; j++) {
-         tteno = sec->ec2tte[i][j];
-         if (tteno == EC2TTE_DELETED)
-            continue;
-         if (tteno >= N_TTES_PER_SECTOR)
-            BAD("implausible tteno");
-         tte = &sec->tt[tteno];
-         if (tte->status != InUse)
-            BAD("tteno points to non-inuse tte");
-         if (tte->n_tte2ec < 1 || tte->n_tte2ec > 3)
-            BAD("tte->n_tte2ec out of range");
-         /* Exactly least one of tte->eclasses[0 .. tte->n_eclasses-1]
-            must equal i.  Inspect tte's eclass info. */
-         n = 0;
-         for (k = 0; k < tte->n_tte2ec; k++) {
-            if (k < tte->n_tte2ec-1
-                && tte->tte2ec_ec[k] >= tte->tte2ec_ec[k+1])
-               BAD("tte->tte2ec_ec[..] out of order");
-            ec_num = tte->tte2ec_ec[k];
-            if (ec_num < 0 || ec_num >= ECLASS_N)
-               BAD("tte->tte2ec_ec[..] out of range");
-            if (ec_num != i)
-               continue;
-            ec_idx = tte->tte2ec_ix[k];
-            if (ec_idx < 0 || ec_idx >= sec->ec2tte_used[i])
-               BAD("tte->tte2ec_ix[..] out of range");
-            if (ec_idx == j)
-               n++;
-         }
-         if (n != 1)
-            BAD("tteno does not point back at eclass");
-      }
+   VG_(initIterFM)( sec->guest_extents );
+   while (VG_(nextIterFM)( sec->guest_extents, &key, &val )) {
+      TTEntry* tte;
+      nKeys++;
+      tteNo = guest_extent_key_to_tteNo(sec, key);
+      tte   = &sec->tt[tteNo];
+      if (tte->status != InUse)
+         { VG_(doneIterFM)( sec->guest_extents );
+           BAD("guest_extents key for unused tte"); }
+      for (i = 0; i < tte->vge.n_used; i++)
+         if (key == (UWord)&tte->vge.base[i])
+            break;
+      if (i == tte->vge.n_used)
+         { VG_(doneIterFM)( sec->guest_extents );
+           BAD("guest_extents key is not a .vge.base[] slot"); }
+      if (tte->vge.len[i] > sec->guest_extents_maxlen)
+         { VG_(doneIterFM)( sec->guest_extents );
+           BAD("extent longer than guest_extents_maxlen"); }
    }
+   VG_(doneIterFM)( sec->guest_extents );
 
-   /* That establishes that for each forward pointer from TTEntrys
-      there is a corresponding backward pointer from the eclass[]
-      arrays.  However, it doesn't rule out the possibility of other,
-      bogus pointers in the eclass[] arrays.  So do those similarly:
-      scan through them and check the TTEntryies they point at point
-      back. */
-
-   for (i = 0; i < N_TTES_PER_SECTOR_USABLE; i++) {
-
-      tte = &sec->tt[i];
-      if (tte->status == Empty || tte->status == Deleted) {
-         if (tte->n_tte2ec != 0)
-            BAD("tte->n_eclasses nonzero for unused tte");
-         continue;
-      }
-
-      vg_assert(tte->status == InUse);
-
-      if (tte->n_tte2ec < 1 || tte->n_tte2ec > 3)
-         BAD("tte->n_eclasses out of range(2)");
-
-      for (j = 0; j < tte->n_tte2ec; j++) {
-         ec_num = tte->tte2ec_ec[j];
-         if (ec_num < 0 || ec_num >= ECLASS_N)
-            BAD("tte->eclass[..] out of range");
-         ec_idx = tte->tte2ec_ix[j];
-         if (ec_idx < 0 || ec_idx >= sec->ec2tte_used[ec_num])
-            BAD("tte->ec_idx[..] out of range(2)");
-         if (sec->ec2tte[ec_num][ec_idx] != i)
-            BAD("ec2tte does not point back to tte");
-      }
+   for (i = 0; i < n_ttes_per_sector; i++) {
+      if (sec->tt[i].status == InUse)
+         nExtents += sec->tt[i].vge.n_used;
    }
+   if (nKeys != nExtents)
+      BAD("guest_extents is missing some extents");
 
    return True;
 
   bad:
    if (whassup)
-      VG_(debugLog)(0, "transtab", "eclass sanity fail: %s\n", whassup);
-
-#  if 0
-   VG_(printf)("eclass = %d\n", i);
-   VG_(printf)("tteno = %d\n", (Int)tteno);
-   switch (tte->status) {
-      case InUse:   VG_(printf)("InUse\n"); break;
-      case Deleted: VG_(printf)("Deleted\n"); break;
-      case Empty:   VG_(printf)("Empty\n"); break;
-   }
-   if (tte->status != Empty) {
-      for (k = 0; k < tte->vge.n_used; k++)
-         VG_(printf)("0x%llx %d\n", tte->vge.base[k], 
-                                    (Int)tte->vge.len[k]);
-   }
-#  endif
-
+      VG_(debugLog)(0, "transtab", "guest_extents sanity fail: %s\n",
+                       whassup);
    return False;
 
 #  undef BAD
@@ -1176,32 +1260,32 @@ static Bool sanity_check_sector_search_order ( void )
 {
    Int i, j, nListed;
    /* assert the array is the right size */
-   vg_assert(N_SECTORS == (sizeof(sector_search_order) 
-                           / sizeof(sector_search_order[0])));
+   vg_assert(MAX_N_SECTORS == (sizeof(sector_search_order) 
+                               / sizeof(sector_search_order[0])));
    /* Check it's of the form  valid_sector_numbers ++ [-1, -1, ..] */
-   for (i = 0; i < N_SECTORS; i++) {
-      if (sector_search_order[i] < 0 || sector_search_order[i] >= N_SECTORS)
+   for (i = 0; i < n_sectors; i++) {
+      if (sector_search_order[i] < 0 || sector_search_order[i] >= n_sectors)
          break;
    }
    nListed = i;
-   for (/* */; i < N_SECTORS; i++) {
+   for (/* */; i < n_sectors; i++) {
       if (sector_search_order[i] != -1)
          break;
    }
-   if (i != N_SECTORS)
+   if (i != n_sectors)
       return False;
    /* Check each sector number only appears once */
-   for (i = 0; i < N_SECTORS; i++) {
+   for (i = 0; i < n_sectors; i++) {
       if (sector_search_order[i] == -1)
          continue;
-      for (j = i+1; j < N_SECTORS; j++) {
+      for (j = i+1; j < n_sectors; j++) {
          if (sector_search_order[j] == sector_search_order[i])
             return False;
       }
    }
    /* Check that the number of listed sectors equals the number
       in use, by counting nListed back down. */
-   for (i = 0; i < N_SECTORS; i++) {
+   for (i = 0; i < n_sectors; i++) {
       if (sectors[i].tc != NULL)
          nListed--;
    }
@@ -1215,11 +1299,11 @@ static Bool sanity_check_all_sectors ( void )
    Int     sno;
    Bool    sane;
    Sector* sec;
-   for (sno = 0; sno < N_SECTORS; sno++) {
+   for (sno = 0; sno < n_sectors; sno++) {
       sec = &sectors[sno];
       if (sec->tc == NULL)
          continue;
-      sane = sanity_check_eclasses_in_sector( sec );
+      sane = sanity_check_guest_extents_in_sector( sec );
       if (!sane)
          return False;
    }
@@ -1246,7 +1330,7 @@ static UInt vge_osize ( VexGuestExtents* vge )
 
 static Bool isValidSector ( Int sector )
 {
-   if (sector < 0 || sector >= N_SECTORS)
+   if (sector < 0 || sector >= n_sectors)
       return False;
    return True;
 }
@@ -1259,44 +1343,268 @@ static inline UInt HASH_TT ( Addr64 key )
    UInt ror = 7;
    if (ror > 0)
       k32 = (k32 >> ror) | (k32 << (32-ror));
-   return k32 % N_TTES_PER_SECTOR;
+   return k32 % n_ttes_per_sector;
+}
+
+static void invalidateFastCacheArray ( FastCacheEntry* fc )
+{
+   UInt j;
+   /* This loop is popular enough to make it worth unrolling a
+      bit, at least on ppc32. */
+   vg_assert(VG_TT_FAST_SIZE > 0 && (VG_TT_FAST_SIZE % 4) == 0);
+   for (j = 0; j < VG_TT_FAST_SIZE; j += 4) {
+      fc[j+0].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+      fc[j+1].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+      fc[j+2].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+      fc[j+3].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+   }
+   vg_assert(j == VG_TT_FAST_SIZE);
+}
+
+/* Find the fast cache for tid, or NULL if it doesn't have one (yet).
+   tid may be VG_INVALID_THREADID. */
+static inline FastCacheEntry* fastCacheFor ( ThreadId tid )
+{
+   if (LIKELY(!VG_(clo_per_thread_fast_cache)))
+      return &VG_(tt_fast)[0];
+   if (tid == VG_INVALID_THREADID || tid >= VG_N_THREADS)
+      return NULL;
+   return thread_fast_cache[tid];
+}
+
+FastCacheEntry* VG_(get_fast_cache) ( ThreadId tid )
+{
+   FastCacheEntry* fc = fastCacheFor(tid);
+   if (UNLIKELY(fc == NULL)) {
+      SysRes sres;
+      vg_assert(tid > 0 && tid < VG_N_THREADS);
+      sres = VG_(am_mmap_anon_float_valgrind)
+                ( VG_TT_FAST_SIZE * sizeof(FastCacheEntry) );
+      if (sr_isError(sres)) {
+         VG_(out_of_memory_NORETURN)("VG_(get_fast_cache)",
+                                     VG_TT_FAST_SIZE
+                                        * sizeof(FastCacheEntry));
+         /*NOTREACHED*/
+      }
+      fc = (FastCacheEntry*)(AddrH)sr_Res(sres);
+      invalidateFastCacheArray(fc);
+      thread_fast_cache[tid] = fc;
+   }
+   return fc;
+}
+
+Bool VG_(lookup_fast_cache) ( /*OUT*/AddrH* res_hcode,
+                              ThreadId tid, Addr guest_addr )
+{
+   FastCacheEntry* fc = fastCacheFor(tid);
+   FastCacheEntry* set;
+   UInt            w;
+   if (fc == NULL)
+      return False;
+   set = &fc[VG_TT_FAST_HASH(guest_addr) * VG_TT_FAST_WAYS];
+   for (w = 0; w < VG_TT_FAST_WAYS; w++) {
+      if (set[w].guest == guest_addr) {
+         *res_hcode = set[w].host;
+         return True;
+      }
+   }
+   return False;
 }
 
+/* Make key -> tcptr the most recently used entry in its set.  If key
+   is already present, it is moved up; if not, the least recently
+   used entry in the set is lost. */
 static void setFastCacheEntry ( Addr64 key, ULong* tcptr )
 {
-   UInt cno = (UInt)VG_TT_FAST_HASH(key);
-   VG_(tt_fast)[cno].guest = (Addr)key;
-   VG_(tt_fast)[cno].host  = (Addr)tcptr;
-   n_fast_updates++;
+   FastCacheEntry* fc = fastCacheFor(VG_(running_tid));
+   FastCacheEntry* set;
+   UInt            w;
+
    /* This shouldn't fail.  It should be assured by m_translate
       which should reject any attempt to make translation of code
       starting at TRANSTAB_BOGUS_GUEST_ADDR. */
-   vg_assert(VG_(tt_fast)[cno].guest != TRANSTAB_BOGUS_GUEST_ADDR);
+   vg_assert((Addr)key != TRANSTAB_BOGUS_GUEST_ADDR);
+
+   /* No thread running, and we have no shared cache.  Never mind;
+      this is only a hint. */
+   if (fc == NULL)
+      return;
+
+   set = &fc[VG_TT_FAST_HASH(key) * VG_TT_FAST_WAYS];
+   for (w = 0; w < VG_TT_FAST_WAYS - 1; w++) {
+      if (set[w].guest == (Addr)key)
+         break;
+   }
+   for (; w > 0; w--)
+      set[w] = set[w-1];
+   set[0].guest = (Addr)key;
+   set[0].host  = (Addr)tcptr;
+   n_fast_updates++;
 }
 
-/* Invalidate the fast cache VG_(tt_fast). */
-static void invalidateFastCache ( void )
+/* Remove any fast cache entries for key, in all the fast caches.  Used
+   when the translation for key is discarded, so as to avoid flushing
+   everything. */
+static void removeFastCacheEntry ( Addr64 key )
 {
-   UInt j;
-   /* This loop is popular enough to make it worth unrolling a
-      bit, at least on ppc32. */
-   vg_assert(VG_TT_FAST_SIZE > 0 && (VG_TT_FAST_SIZE % 4) == 0);
-   for (j = 0; j < VG_TT_FAST_SIZE; j += 4) {
-      VG_(tt_fast)[j+0].guest = TRANSTAB_BOGUS_GUEST_ADDR;
-      VG_(tt_fast)[j+1].guest = TRANSTAB_BOGUS_GUEST_ADDR;
-      VG_(tt_fast)[j+2].guest = TRANSTAB_BOGUS_GUEST_ADDR;
-      VG_(tt_fast)[j+3].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+   UInt i, w, h = VG_TT_FAST_HASH(key) * VG_TT_FAST_WAYS;
+   for (i = 0; i < VG_N_THREADS; i++) {
+      FastCacheEntry* fc = VG_(clo_per_thread_fast_cache)
+                              ? thread_fast_cache[i] : &VG_(tt_fast)[0];
+      if (fc == NULL)
+         continue;
+      for (w = 0; w < VG_TT_FAST_WAYS; w++) {
+         if (fc[h + w].guest == (Addr)key) {
+            fc[h + w].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+            n_fast_removals++;
+         }
+      }
+      if (!VG_(clo_per_thread_fast_cache))
+         break;
    }
+}
 
-   vg_assert(j == VG_TT_FAST_SIZE);
+/* Invalidate the fast cache VG_(tt_fast), and any per-thread ones. */
+static void invalidateFastCache ( void )
+{
+   UInt i;
+   if (VG_(clo_per_thread_fast_cache)) {
+      for (i = 0; i < VG_N_THREADS; i++) {
+         if (thread_fast_cache[i])
+            invalidateFastCacheArray(thread_fast_cache[i]);
+      }
+   } else {
+      invalidateFastCacheArray(&VG_(tt_fast)[0]);
+   }
    n_fast_flushes++;
 }
 
+static inline UInt HASH_EVICTED ( Addr64 key )
+{
+   UInt k32 = (UInt)(key >> 32) ^ (UInt)key;
+   return (k32 ^ (k32 >> 14)) % N_EVICTED;
+}
+
+/* A translation which is to survive the recycling of its sector.  Its
+   (unchained) code is copied out while the sector is emptied, and
+   then added back to it. */
+typedef
+   struct {
+      VexGuestExtents vge;
+      Addr64          entry;
+      UShort          weight;
+      UInt            code_len;
+      UChar*          code;
+   }
+   Survivor;
+
+typedef
+   struct {
+      UInt usecount;
+      UInt tteNo;
+   }
+   SurvivorCand;
+
+static Int cmp_SurvivorCand_by_usecount ( void* v1, void* v2 )
+{
+   SurvivorCand* c1 = (SurvivorCand*)v1;
+   SurvivorCand* c2 = (SurvivorCand*)v2;
+   /* Most used first. */
+   if (c1->usecount > c2->usecount) return -1;
+   if (c1->usecount < c2->usecount) return 1;
+   return 0;
+}
+
+/* Sector sno is about to be recycled.  Choose the most used of its
+   translations, up to SURVIVOR_MAX_PERCENT of the sector's capacity,
+   unchain them and copy them out.  Returns an XArray of Survivor, or
+   NULL if there are none.  The TT entries themselves are left alone,
+   to be dumped along with the rest. */
+static XArray* collect_survivors ( VexArch vex_arch, Int sno )
+{
+   Sector* sec = &sectors[sno];
+   XArray* cands;
+   XArray* survivors = NULL;
+   Word    n_cands, i;
+   UInt    max_n   = (n_ttes_per_sector_usable * SURVIVOR_MAX_PERCENT) / 100;
+   Int     max_szQ = (tc_sector_szQ / 100) * SURVIVOR_MAX_PERCENT;
+   Int     szQ     = 0;
+
+   cands = VG_(newXA)(ttaux_malloc, "transtab.collect_survivors.1",
+                      ttaux_free, sizeof(SurvivorCand));
+   for (i = 0; i < n_ttes_per_sector; i++) {
+      /* Quick translations can't be moved, since their entry
+         counter address is patched into the code. */
+      if (sec->tt[i].status == InUse
+          && !sec->tt[i].tier0
+          && sec->tt[i].usecount >= SURVIVOR_MIN_USES) {
+         SurvivorCand c;
+         c.usecount = sec->tt[i].usecount;
+         c.tteNo    = i;
+         VG_(addToXA)(cands, &c);
+      }
+   }
+   VG_(setCmpFnXA)(cands, cmp_SurvivorCand_by_usecount);
+   VG_(sortXA)(cands);
+
+   n_cands = VG_(sizeXA)(cands);
+   for (i = 0; i < n_cands && i < max_n; i++) {
+      SurvivorCand* c   = VG_(indexXA)(cands, i);
+      TTEntry*      tte = &sec->tt[c->tteNo];
+
+      /* Find the code length from the host extents. */
+      HostExtent key;
+      VG_(memset)(&key, 0, sizeof(key));
+      key.start = (UChar*)tte->tcptr;
+      key.len   = 1;
+      Word firstW = -1, lastW = -1;
+      Bool found  = VG_(lookupXA_UNSAFE)(
+                       sec->host_extents, &key, &firstW, &lastW,
+                       (Int(*)(void*,void*))HostExtent__cmpOrd
+                    );
+      vg_assert(found);
+      HostExtent* hx = VG_(indexXA)(sec->host_extents, firstW);
+      vg_assert(hx->start == (UChar*)tte->tcptr);
+      vg_assert(hx->tteNo == c->tteNo);
+
+      szQ += (hx->len + 7) >> 3;
+      if (szQ > max_szQ)
+         break;
+
+      /* Put the code back the way it was generated, so it can be
+         copied, then copy it. */
+      unchain_out_edges(vex_arch, sno, c->tteNo);
+
+      Survivor sv;
+      sv.vge      = tte->vge;
+      sv.entry    = tte->entry;
+      sv.weight   = tte->weight;
+      sv.code_len = hx->len;
+      sv.code     = ttaux_malloc("transtab.collect_survivors.2", hx->len);
+      VG_(memcpy)(sv.code, hx->start, hx->len);
+
+      if (survivors == NULL)
+         survivors = VG_(newXA)(ttaux_malloc, "transtab.collect_survivors.3",
+                                ttaux_free, sizeof(Survivor));
+      VG_(addToXA)(survivors, &sv);
+   }
+
+   VG_(deleteXA)(cands);
+   return survivors;
+}
+
+/* forward */
+static void add_to_sector ( Int y, VexGuestExtents* vge, Addr64 entry,
+                            AddrH code, UInt code_len, Int offs_profInc,
+                            UShort weight, VexArch arch_host );
+
 static void initialiseSector ( Int sno )
 {
    Int     i;
    SysRes  sres;
    Sector* sec;
+   XArray* survivors = NULL;
+   VexArch vex_arch  = VexArch_INVALID;
    vg_assert(isValidSector(sno));
 
    { Bool sane = sanity_check_sector_search_order();
@@ -1311,11 +1619,7 @@ static void initialiseSector ( Int sno )
       vg_assert(sec->tt == NULL);
       vg_assert(sec->tc_next == NULL);
       vg_assert(sec->tt_n_inuse == 0);
-      for (i = 0; i < ECLASS_N; i++) {
-         vg_assert(sec->ec2tte_size[i] == 0);
-         vg_assert(sec->ec2tte_used[i] == 0);
-         vg_assert(sec->ec2tte[i] == NULL);
-      }
+      vg_assert(sec->guest_extents == NULL);
       vg_assert(sec->host_extents == NULL);
 
       VG_(debugLog)(1,"transtab", "allocate sector %d\n", sno);
@@ -1329,31 +1633,34 @@ static void initialiseSector ( Int sno )
       sec->tc = (ULong*)(AddrH)sr_Res(sres);
 
       sres = VG_(am_mmap_anon_float_valgrind)
-                ( N_TTES_PER_SECTOR * sizeof(TTEntry) );
+                ( n_ttes_per_sector * sizeof(TTEntry) );
       if (sr_isError(sres)) {
          VG_(out_of_memory_NORETURN)("initialiseSector(TT)", 
-                                     N_TTES_PER_SECTOR * sizeof(TTEntry) );
+                                     n_ttes_per_sector * sizeof(TTEntry) );
 	 /*NOTREACHED*/
       }
       sec->tt = (TTEntry*)(AddrH)sr_Res(sres);
 
-      for (i = 0; i < N_TTES_PER_SECTOR; i++) {
-         sec->tt[i].status   = Empty;
-         sec->tt[i].n_tte2ec = 0;
-      }
+      for (i = 0; i < n_ttes_per_sector; i++)
+         sec->tt[i].status = Empty;
+
+      /* Set up the guest_extents index and the host_extents array. */
+      sec->guest_extents
+         = VG_(newFM)(ttaux_malloc, "transtab.initialiseSector(guest_extents)",
+                      ttaux_free, cmp_guest_extent_keys);
+      sec->guest_extents_maxlen = 0;
 
-      /* Set up the host_extents array. */
       sec->host_extents
          = VG_(newXA)(ttaux_malloc, "transtab.initialiseSector(host_extents)",
                       ttaux_free,
                       sizeof(HostExtent));
 
       /* Add an entry in the sector_search_order */
-      for (i = 0; i < N_SECTORS; i++) {
+      for (i = 0; i < n_sectors; i++) {
          if (sector_search_order[i] == -1)
             break;
       }
-      vg_assert(i >= 0 && i < N_SECTORS);
+      vg_assert(i >= 0 && i < n_sectors);
       sector_search_order[i] = sno;
 
       if (VG_(clo_verbosity) > 2)
@@ -1365,18 +1672,30 @@ static void initialiseSector ( Int sno )
       VG_(debugLog)(1,"transtab", "recycle sector %d\n", sno);
       vg_assert(sec->tt != NULL);
       vg_assert(sec->tc_next != NULL);
-      n_dump_count += sec->tt_n_inuse;
 
-      VexArch vex_arch = VexArch_INVALID;
       VG_(machine_get_VexArchInfo)( &vex_arch, NULL );
 
-      /* Visit each just-about-to-be-abandoned translation. */
-      if (0) VG_(printf)("QQQ unlink-entire-sector: %d START\n", sno);
-      for (i = 0; i < N_TTES_PER_SECTOR; i++) {
+      /* Rescue the most used translations first, if asked to.  Not
+         possible if the tool keeps per-superblock info (which it
+         is about to be told to throw away), nor if profiling, since
+         the profile counter addresses are patched into the code. */
+      if (VG_(clo_transtab_survivors)
+          && !VG_(needs).superblock_discards
+          && VG_(clo_profile_flags) == 0)
+         survivors = collect_survivors(vex_arch, sno);
+
+      n_dump_count += sec->tt_n_inuse;
+      if (survivors)
+         n_dump_count -= VG_(sizeXA)(survivors);
+
+      /* Visit each just-about-to-be-abandoned translation. */
+      if (0) VG_(printf)("QQQ unlink-entire-sector: %d START\n", sno);
+      for (i = 0; i < n_ttes_per_sector; i++) {
          if (sec->tt[i].status == InUse) {
-            vg_assert(sec->tt[i].n_tte2ec >= 1);
-            vg_assert(sec->tt[i].n_tte2ec <= 3);
             n_dump_osize += vge_osize(&sec->tt[i].vge);
+            /* Remember it, so we can tell if it comes back. */
+            evicted_entries[HASH_EVICTED(sec->tt[i].entry)]
+               = sec->tt[i].entry;
             /* Tell the tool too. */
             if (VG_(needs).superblock_discards) {
                VG_TDICT_CALL( tool_discard_superblock_info,
@@ -1384,27 +1703,19 @@ static void initialiseSector ( Int sno )
                               sec->tt[i].vge );
             }
             unchain_in_preparation_for_deletion(vex_arch, sno, i);
-         } else {
-            vg_assert(sec->tt[i].n_tte2ec == 0);
          }
-         sec->tt[i].status   = Empty;
-         sec->tt[i].n_tte2ec = 0;
+         sec->tt[i].status = Empty;
       }
       if (0) VG_(printf)("QQQ unlink-entire-sector: %d END\n", sno);
 
-      /* Free up the eclass structures. */
-      for (i = 0; i < ECLASS_N; i++) {
-         if (sec->ec2tte_size[i] == 0) {
-            vg_assert(sec->ec2tte_used[i] == 0);
-            vg_assert(sec->ec2tte[i] == NULL);
-         } else {
-            vg_assert(sec->ec2tte[i] != NULL);
-            ttaux_free(sec->ec2tte[i]);
-            sec->ec2tte[i] = NULL;
-            sec->ec2tte_size[i] = 0;
-            sec->ec2tte_used[i] = 0;
-         }
-      }
+      /* Start a new guest_extents index; it's quicker than removing
+         everything from the old one. */
+      vg_assert(sec->guest_extents != NULL);
+      VG_(deleteFM)(sec->guest_extents, NULL, NULL);
+      sec->guest_extents
+         = VG_(newFM)(ttaux_malloc, "transtab.initialiseSector(guest_extents)",
+                      ttaux_free, cmp_guest_extent_keys);
+      sec->guest_extents_maxlen = 0;
 
       /* Empty out the host extents array. */
       vg_assert(sec->host_extents != NULL);
@@ -1413,11 +1724,11 @@ static void initialiseSector ( Int sno )
 
       /* Sanity check: ensure it is already in
          sector_search_order[]. */
-      for (i = 0; i < N_SECTORS; i++) {
+      for (i = 0; i < n_sectors; i++) {
          if (sector_search_order[i] == sno)
             break;
       }
-      vg_assert(i >= 0 && i < N_SECTORS);
+      vg_assert(i >= 0 && i < n_sectors);
 
       if (VG_(clo_verbosity) > 2)
          VG_(message)(Vg_DebugMsg, "TT/TC: recycle sector %d\n", sno);
@@ -1428,6 +1739,24 @@ static void initialiseSector ( Int sno )
 
    invalidateFastCache();
 
+   /* Put the survivors back, into the now-empty sector.  They were
+      evicted above, but that doesn't count. */
+   if (survivors) {
+      Word n = VG_(sizeXA)(survivors);
+      for (i = 0; i < n; i++) {
+         Survivor* sv = VG_(indexXA)(survivors, i);
+         evicted_entries[HASH_EVICTED(sv->entry)] = TRANSTAB_BOGUS_GUEST_ADDR;
+         add_to_sector( sno, &sv->vge, sv->entry, (AddrH)sv->code,
+                        sv->code_len, -1/*offs_profInc*/, sv->weight,
+                        vex_arch );
+         ttaux_free(sv->code);
+      }
+      n_survivor_count += n;
+      VG_(debugLog)(1,"transtab", "%ld translations survived recycling "
+                                  "of sector %d\n", n, sno);
+      VG_(deleteXA)(survivors);
+   }
+
    { Bool sane = sanity_check_sector_search_order();
      vg_assert(sane);
    }
@@ -1449,10 +1778,8 @@ void VG_(add_to_transtab)( VexGuestExtents* vge,
                            UInt             n_guest_instrs,
                            VexArch          arch_host )
 {
-   Int    tcAvailQ, reqdQ, y, i;
-   ULong  *tcptr, *tcptr2;
-   UChar* srcP;
-   UChar* dstP;
+   Int    tcAvailQ, reqdQ, y;
+   UInt   h;
 
    vg_assert(init_done);
    vg_assert(vge->n_used >= 1 && vge->n_used <= 3);
@@ -1473,6 +1800,15 @@ void VG_(add_to_transtab)( VexGuestExtents* vge,
    if (is_self_checking)
       n_in_sc_count++;
 
+   /* Is this something we threw away when recycling a sector? */
+   n_in_cycle++;
+   h = HASH_EVICTED(entry);
+   if (evicted_entries[h] == entry) {
+      evicted_entries[h] = TRANSTAB_BOGUS_GUEST_ADDR;
+      n_retrans_count++;
+      n_retrans_cycle++;
+   }
+
    y = youngest_sector;
    vg_assert(isValidSector(y));
 
@@ -1489,7 +1825,7 @@ void VG_(add_to_transtab)( VexGuestExtents* vge,
    vg_assert(tcAvailQ <= tc_sector_szQ);
 
    if (tcAvailQ < reqdQ 
-       || sectors[y].tt_n_inuse >= N_TTES_PER_SECTOR_USABLE) {
+       || sectors[y].tt_n_inuse >= n_ttes_per_sector_usable) {
       /* No.  So move on to the next sector.  Either it's never been
          used before, in which case it will get its tt/tc allocated
          now, or it has been used before, in which case it is set to be
@@ -1500,23 +1836,60 @@ void VG_(add_to_transtab)( VexGuestExtents* vge,
                       "(TT loading %2d%%, TC loading %2d%%)\n",
                       y,
                       (100 * sectors[y].tt_n_inuse) 
-                         / N_TTES_PER_SECTOR,
+                         / n_ttes_per_sector,
                       (100 * (tc_sector_szQ - tcAvailQ)) 
                          / tc_sector_szQ);
       youngest_sector++;
-      if (youngest_sector >= N_SECTORS)
-         youngest_sector = 0;
+      if (youngest_sector >= n_sectors) {
+         /* We've been round all the sectors.  If too much of what we
+            translated on the way was stuff recycling had thrown out,
+            take on a new sector rather than recycle the oldest. */
+         if (n_sectors < max_n_sectors
+             && n_retrans_cycle > 0
+             && n_retrans_cycle * 100 >= GROW_RETRANS_PERCENT * n_in_cycle) {
+            n_sectors++;
+            n_sector_grows++;
+            VG_(debugLog)(1,"transtab", 
+                            "%llu of %llu translations were retranslations; "
+                            "growing to %d sectors\n",
+                            n_retrans_cycle, n_in_cycle, n_sectors);
+         } else {
+            youngest_sector = 0;
+         }
+         n_in_cycle      = 0;
+         n_retrans_cycle = 0;
+      }
       y = youngest_sector;
+      VG_(acquire_code_exclusive)();
       initialiseSector(y);
+      VG_(release_code_exclusive)();
    }
 
+   add_to_sector( y, vge, entry, code, code_len, offs_profInc,
+                  n_guest_instrs == 0 ? 1 : n_guest_instrs, arch_host );
+}
+
+
+/* Copy a translation into sector y, which must have room for it, and
+   make a TT entry for it. */
+static void add_to_sector ( Int y, VexGuestExtents* vge, Addr64 entry,
+                            AddrH code, UInt code_len, Int offs_profInc,
+                            UShort weight, VexArch arch_host )
+{
+   Int    tcAvailQ, reqdQ, i;
+   ULong  *tcptr, *tcptr2;
+   UChar* srcP;
+   UChar* dstP;
+
+   reqdQ = (code_len + 7) >> 3;
+
    /* Be sure ... */
    tcAvailQ = ((ULong*)(&sectors[y].tc[tc_sector_szQ]))
               - ((ULong*)(sectors[y].tc_next));
    vg_assert(tcAvailQ >= 0);
    vg_assert(tcAvailQ <= tc_sector_szQ);
    vg_assert(tcAvailQ >= reqdQ);
-   vg_assert(sectors[y].tt_n_inuse < N_TTES_PER_SECTOR_USABLE);
+   vg_assert(sectors[y].tt_n_inuse < n_ttes_per_sector_usable);
    vg_assert(sectors[y].tt_n_inuse >= 0);
  
    /* Copy into tc. */
@@ -1538,13 +1911,13 @@ void VG_(add_to_transtab)( VexGuestExtents* vge,
    /* Find an empty tt slot, and use it.  There must be such a slot
       since tt is never allowed to get completely full. */
    i = HASH_TT(entry);
-   vg_assert(i >= 0 && i < N_TTES_PER_SECTOR);
+   vg_assert(i >= 0 && i < n_ttes_per_sector);
    while (True) {
       if (sectors[y].tt[i].status == Empty
           || sectors[y].tt[i].status == Deleted)
          break;
       i++;
-      if (i >= N_TTES_PER_SECTOR)
+      if (i >= n_ttes_per_sector)
          i = 0;
    }
 
@@ -1552,9 +1925,11 @@ void VG_(add_to_transtab)( VexGuestExtents* vge,
    sectors[y].tt[i].status = InUse;
    sectors[y].tt[i].tcptr  = tcptr;
    sectors[y].tt[i].count  = 0;
-   sectors[y].tt[i].weight = n_guest_instrs == 0 ? 1 : n_guest_instrs;
+   sectors[y].tt[i].weight = weight;
    sectors[y].tt[i].vge    = *vge;
    sectors[y].tt[i].entry  = entry;
+   sectors[y].tt[i].tier0  = offs_profInc != -1
+                             && VG_(clo_tiered_translation);
 
    /* Patch in the profile counter location, if necessary. */
    if (offs_profInc != -1) {
@@ -1588,8 +1963,11 @@ void VG_(add_to_transtab)( VexGuestExtents* vge,
    /* Update the fast-cache. */
    setFastCacheEntry( entry, tcptr );
 
-   /* Note the eclass numbers for this translation. */
-   upd_eclasses_after_add( &sectors[y], i );
+   /* Note the guest ranges covered by this translation. */
+   add_guest_extents( &sectors[y], i );
+
+   if (sectors[y].tt[i].tier0)
+      n_tier0_count++;
 }
 
 
@@ -1611,22 +1989,23 @@ Bool VG_(search_transtab) ( /*OUT*/AddrH* res_hcode,
    n_full_lookups++;
    k      = -1;
    kstart = HASH_TT(guest_addr);
-   vg_assert(kstart >= 0 && kstart < N_TTES_PER_SECTOR);
+   vg_assert(kstart >= 0 && kstart < n_ttes_per_sector);
 
    /* Search in all the sectors,using sector_search_order[] as a
       heuristic guide as to what order to visit the sectors. */
-   for (i = 0; i < N_SECTORS; i++) {
+   for (i = 0; i < n_sectors; i++) {
 
       sno = sector_search_order[i];
       if (UNLIKELY(sno == -1))
          return False; /* run out of sectors to search */
 
       k = kstart;
-      for (j = 0; j < N_TTES_PER_SECTOR; j++) {
+      for (j = 0; j < n_ttes_per_sector; j++) {
          n_lookup_probes++;
          if (sectors[sno].tt[k].status == InUse
              && sectors[sno].tt[k].entry == guest_addr) {
             /* found it */
+            sectors[sno].tt[k].usecount++;
             if (upd_cache)
                setFastCacheEntry( 
                   guest_addr, sectors[sno].tt[k].tcptr );
@@ -1649,7 +2028,7 @@ Bool VG_(search_transtab) ( /*OUT*/AddrH* res_hcode,
          if (sectors[sno].tt[k].status == Empty)
             break; /* not found in this sector */
          k++;
-         if (k == N_TTES_PER_SECTOR)
+         if (k == n_ttes_per_sector)
             k = 0;
       }
 
@@ -1669,73 +2048,37 @@ Bool VG_(search_transtab) ( /*OUT*/AddrH* res_hcode,
 
 /* forward */
 static void unredir_discard_translations( Addr64, ULong );
+static void pageprot_forget_range ( Addr64 start, ULong range );
 
 /* Stuff for deleting translations which intersect with a given
-   address range.  Unfortunately, to make this run at a reasonable
-   speed, it is complex. */
-
-static inline
-Bool overlap1 ( Addr64 s1, ULong r1, Addr64 s2, ULong r2 )
-{
-   Addr64 e1 = s1 + r1 - 1ULL;
-   Addr64 e2 = s2 + r2 - 1ULL;
-   if (e1 < s2 || e2 < s1) 
-      return False;
-   return True;
-}
-
-static inline
-Bool overlaps ( Addr64 start, ULong range, VexGuestExtents* vge )
-{
-   if (overlap1(start, range, vge->base[0], (UInt)vge->len[0]))
-      return True;
-   if (vge->n_used < 2)
-      return False;
-   if (overlap1(start, range, vge->base[1], (UInt)vge->len[1]))
-      return True;
-   if (vge->n_used < 3)
-      return False;
-   if (overlap1(start, range, vge->base[2], (UInt)vge->len[2]))
-      return True;
-   return False;
-}
+   address range.  The guest_extents index does the hard work. */
 
-
-/* Delete a tt entry, and update all the eclass data accordingly. */
+/* Delete a tt entry, and update the guest_extents index
+   accordingly. */
 
 static void delete_tte ( /*MOD*/Sector* sec, UInt secNo, Int tteno,
                          VexArch vex_arch )
 {
-   Int      i, ec_num, ec_idx;
    TTEntry* tte;
 
    /* sec and secNo are mutually redundant; cross-check. */
    vg_assert(sec == &sectors[secNo]);
 
-   vg_assert(tteno >= 0 && tteno < N_TTES_PER_SECTOR);
+   vg_assert(tteno >= 0 && tteno < n_ttes_per_sector);
    tte = &sec->tt[tteno];
    vg_assert(tte->status == InUse);
-   vg_assert(tte->n_tte2ec >= 1 && tte->n_tte2ec <= 3);
 
    /* Unchain .. */
    unchain_in_preparation_for_deletion(vex_arch, secNo, tteno);
 
-   /* Deal with the ec-to-tte links first. */
-   for (i = 0; i < tte->n_tte2ec; i++) {
-      ec_num = (Int)tte->tte2ec_ec[i];
-      ec_idx = tte->tte2ec_ix[i];
-      vg_assert(ec_num >= 0 && ec_num < ECLASS_N);
-      vg_assert(ec_idx >= 0);
-      vg_assert(ec_idx < sec->ec2tte_used[ec_num]);
-      /* Assert that the two links point at each other. */
-      vg_assert(sec->ec2tte[ec_num][ec_idx] == (UShort)tteno);
-      /* "delete" the pointer back to here. */
-      sec->ec2tte[ec_num][ec_idx] = EC2TTE_DELETED;
-   }
+   /* Take it out of the index. */
+   del_guest_extents(sec, tteno);
+
+   /* Make sure the fast cache doesn't lead anybody here. */
+   removeFastCacheEntry(tte->entry);
 
    /* Now fix up this TTEntry. */
    tte->status   = Deleted;
-   tte->n_tte2ec = 0;
 
    /* Stats .. */
    sec->tt_n_inuse--;
@@ -1751,66 +2094,32 @@ static void delete_tte ( /*MOD*/Sector* sec, UInt secNo, Int tteno,
 }
 
 
-/* Delete translations from sec which intersect specified range, but
-   only consider translations in the specified eclass. */
+/* Delete translations from sec which intersect specified range. */
 
 static 
-Bool delete_translations_in_sector_eclass ( /*MOD*/Sector* sec, UInt secNo,
-                                            Addr64 guest_start, ULong range,
-                                            Int ec,
-                                            VexArch vex_arch )
+void delete_translations_in_sector ( /*MOD*/Sector* sec, UInt secNo,
+                                     Addr64 guest_start, ULong range,
+                                     VexArch vex_arch )
 {
-   Int      i;
-   UShort   tteno;
-   Bool     anyDeld = False;
-   TTEntry* tte;
-
-   vg_assert(ec >= 0 && ec < ECLASS_N);
+   static XArray* hits = NULL; /* of UInt */
+   Word i, n;
 
-   for (i = 0; i < sec->ec2tte_used[ec]; i++) {
+   if (hits == NULL)
+      hits = VG_(newXA)(ttaux_malloc, "transtab.delete_translations_in_sector",
+                        ttaux_free, sizeof(UInt));
+   VG_(dropTailXA)(hits, VG_(sizeXA)(hits));
 
-      tteno = sec->ec2tte[ec][i];
-      if (tteno == EC2TTE_DELETED) {
-         /* already deleted */
-         continue;
-      }
+   /* Find them all first, since the index can't be changed while
+      we're iterating over it. */
+   find_guest_extents( hits, sec, guest_start, range );
 
-      vg_assert(tteno < N_TTES_PER_SECTOR);
-
-      tte = &sec->tt[tteno];
-      vg_assert(tte->status == InUse);
-
-      if (overlaps( guest_start, range, &tte->vge )) {
-         anyDeld = True;
+   n = VG_(sizeXA)(hits);
+   for (i = 0; i < n; i++) {
+      UInt tteno = *(UInt*)VG_(indexXA)(hits, i);
+      /* It may be listed more than once. */
+      if (sec->tt[tteno].status == InUse)
          delete_tte( sec, secNo, (Int)tteno, vex_arch );
-      }
-
-   }
-
-   return anyDeld;
-}
-
-
-/* Delete translations from sec which intersect specified range, the
-   slow way, by inspecting all translations in sec. */
-
-static 
-Bool delete_translations_in_sector ( /*MOD*/Sector* sec, UInt secNo,
-                                     Addr64 guest_start, ULong range,
-                                     VexArch vex_arch )
-{
-   Int  i;
-   Bool anyDeld = False;
-
-   for (i = 0; i < N_TTES_PER_SECTOR; i++) {
-      if (sec->tt[i].status == InUse
-          && overlaps( guest_start, range, &sec->tt[i].vge )) {
-         anyDeld = True;
-         delete_tte( sec, secNo, i, vex_arch );
-      }
    }
-
-   return anyDeld;
 } 
 
 
@@ -1818,8 +2127,7 @@ void VG_(discard_translations) ( Addr64 guest_start, ULong range,
                                  HChar* who )
 {
    Sector* sec;
-   Int     sno, ec;
-   Bool    anyDeleted = False;
+   Int     sno;
 
    vg_assert(init_done);
 
@@ -1836,76 +2144,30 @@ void VG_(discard_translations) ( Addr64 guest_start, ULong range,
    if (range == 0)
       return;
 
-   VexArch vex_arch = VexArch_INVALID;
-   VG_(machine_get_VexArchInfo)( &vex_arch, NULL );
-
-   /* There are two different ways to do this.
-
-      If the range fits within a single address-range equivalence
-      class, as will be the case for a cache line sized invalidation,
-      then we only have to inspect the set of translations listed in
-      that equivalence class, and also in the "sin-bin" equivalence
-      class ECLASS_MISC.
-
-      Otherwise, the invalidation is of a larger range and probably
-      results from munmap.  In this case it's (probably!) faster just
-      to inspect all translations, dump those we don't want, and
-      regenerate the equivalence class information (since modifying it
-      in-situ is even more expensive).
-   */
-
-   /* First off, figure out if the range falls within a single class, 
-      and if so which one. */
-
-   ec = ECLASS_MISC;
-   if (range < (1ULL << ECLASS_SHIFT))
-      ec = range_to_eclass( guest_start, (UInt)range );
-
-   /* if ec is ECLASS_MISC then we aren't looking at just a single
-      class, so use the slow scheme.  Else use the fast scheme,
-      examining 'ec' and ECLASS_MISC. */
-
-   if (ec != ECLASS_MISC) {
-
-      VG_(debugLog)(2, "transtab",
-                       "                    FAST, ec = %d\n", ec);
-
-      /* Fast scheme */
-      vg_assert(ec >= 0 && ec < ECLASS_MISC);
-
-      for (sno = 0; sno < N_SECTORS; sno++) {
-         sec = &sectors[sno];
-         if (sec->tc == NULL)
-            continue;
-         anyDeleted |= delete_translations_in_sector_eclass( 
-                          sec, sno, guest_start, range, ec, 
-                          vex_arch
-                       );
-         anyDeleted |= delete_translations_in_sector_eclass( 
-                          sec, sno, guest_start, range, ECLASS_MISC,
-                          vex_arch
-                       );
-      }
-
-   } else {
+   VG_(acquire_code_exclusive)();
 
-      /* slow scheme */
+   /* Saved translations of this range are no good either. */
+   VG_(transcache_discard)( guest_start, range );
 
-      VG_(debugLog)(2, "transtab",
-                       "                    SLOW, ec = %d\n", ec);
+   /* Once the translations are gone, the pages they came from don't
+      need write-protecting, and may not be any more. */
+   if (VG_(clo_smc_check) == Vg_SmcPageProt)
+      pageprot_forget_range( guest_start, range );
 
-      for (sno = 0; sno < N_SECTORS; sno++) {
-         sec = &sectors[sno];
-         if (sec->tc == NULL)
-            continue;
-         anyDeleted |= delete_translations_in_sector( 
-                          sec, sno, guest_start, range, vex_arch );
-      }
+   VexArch vex_arch = VexArch_INVALID;
+   VG_(machine_get_VexArchInfo)( &vex_arch, NULL );
 
+   /* Each sector's guest_extents index leads us straight to the
+      translations that need to go, whatever the size of the range. */
+   for (sno = 0; sno < n_sectors; sno++) {
+      sec = &sectors[sno];
+      if (sec->tc == NULL)
+         continue;
+      delete_translations_in_sector( sec, sno, guest_start, range, vex_arch );
    }
 
-   if (anyDeleted)
-      invalidateFastCache();
+   /* delete_tte has removed the fast cache entries for what was
+      deleted, so there is no need to flush the fast cache. */
 
    /* don't forget the no-redir cache */
    unredir_discard_translations( guest_start, range );
@@ -1918,11 +2180,11 @@ void VG_(discard_translations) ( Addr64 guest_start, ULong range,
       vg_assert(sane);
       /* But now, also check the requested address range isn't
          present anywhere. */
-      for (sno = 0; sno < N_SECTORS; sno++) {
+      for (sno = 0; sno < n_sectors; sno++) {
          sec = &sectors[sno];
          if (sec->tc == NULL)
             continue;
-         for (i = 0; i < N_TTES_PER_SECTOR; i++) {
+         for (i = 0; i < n_ttes_per_sector; i++) {
             tte = &sec->tt[i];
             if (tte->status != InUse)
                continue;
@@ -1930,6 +2192,463 @@ void VG_(discard_translations) ( Addr64 guest_start, ULong range,
          }
       }
    }
+
+   VG_(release_code_exclusive)();
+}
+
+
+/*------------------------------------------------------------*/
+/*--- SMC detection by page protection                     ---*/
+/*------------------------------------------------------------*/
+
+/* With --smc-check=pageprot, each writable client page that code is
+   translated from is write-protected (VG_(pageprot_cover)).  A write
+   to it from translated code faults.  VG_(pageprot_handle_fault),
+   called from the signal handler, just makes the page writable,
+   queues it for VG_(pageprot_discard_pending) and gets the thread
+   back to the scheduler at its next event check; the scheduler then
+   throws away the page's translations before anything else is run.
+   Nothing in the signal handler allocates memory or touches TT/TC.
+
+   Writes done by the kernel on the client's behalf would fail with
+   EFAULT instead.  So syscall wrappers call VG_(pageprot_pre_write)
+   for memory they know is about to be written, or
+   VG_(pageprot_pre_write_unknown) if they can't tell.  Such pages
+   have their translations discarded, are made writable, and are
+   pinned -- not protected again -- until VG_(pageprot_post_syscall)
+   says the syscall is over.  Until then, code translated from them
+   checks itself.  That matters because a syscall which blocks drops
+   the big lock, and another thread could otherwise translate from
+   the page and protect it again under the kernel's feet.
+
+   Pages are remembered in pageprot_pages.  A page which has been
+   written PAGEPROT_MAX_WRITES times is written too often for this to
+   pay off, and isn't protected again; translations from it get
+   self-checks instead.
+
+   .isProt says whether the page has been protected since its
+   translations were last discarded.  It is only a hint: any discard
+   clears it, whether or not the page is still protected, so that the
+   next translation from the page makes sure it is.  .mayBeProt is
+   cleared only when the page is made writable here, so it is False
+   only if the page is definitely not protected.  A fault on any page
+   in pageprot_pages in a mapping the client can write to is taken to
+   be ours. */
+
+#define PAGEPROT_MAX_WRITES 8
+
+typedef
+   struct _PageProt {
+      struct _PageProt* next;
+      UWord             key;       /* page address */
+      UInt              n_writes;  /* times written so far */
+      Bool              isProt;    /* write-protected since last discard */
+      Bool              mayBeProt; /* possibly write-protected */
+      Bool              isPending; /* queued for discarding */
+   }
+   PageProt;
+
+static VgHashTable pageprot_pages = NULL;
+
+/* Pages written to by translated code whose translations have yet to
+   be discarded.  If there are more than fit, pageprot_n_pending is
+   PAGEPROT_N_PENDING+1 and all of pageprot_pages must be looked at. */
+#define PAGEPROT_N_PENDING 64
+
+static Addr pageprot_pending[PAGEPROT_N_PENDING];
+static UInt pageprot_n_pending = 0;
+
+/* Address ranges which syscalls in progress may write, and which
+   therefore must not be protected. */
+typedef
+   struct {
+      ThreadId tid;
+      Addr     start;
+      Addr     last;
+   }
+   PagePin;
+
+static XArray* pageprot_pins = NULL;
+
+/* Number of times pages were write-protected; number of writes to
+   protected pages; number of pages written too often to protect. */
+static ULong n_pageprot_protects = 0;
+static ULong n_pageprot_writes   = 0;
+static ULong n_pageprot_given_up = 0;
+
+/* Call fn on each page in pageprot_pages which intersects
+   [start, start+range).  Looks up each page in the range, or visits
+   every page in the table, whichever is less work.  fn must not add
+   or remove pages, but may call back here (via
+   VG_(discard_translations)), so when walking the table the pages are
+   collected first. */
+static void pageprot_apply_in_range ( Addr64 start, ULong range,
+                                      Bool (*fn)(PageProt*) )
+{
+   PageProt* pp;
+   Addr64    a, last;
+   ULong     n_pages;
+   XArray*   pps;
+   Word      i;
+
+   if (pageprot_pages == NULL || range == 0)
+      return;
+
+   last    = start + range - 1;
+   if (last < start)
+      last = ~(Addr64)0;
+   n_pages = ((last - start) >> VKI_PAGE_SHIFT) + 2;
+
+   if (n_pages <= (ULong)VG_(HT_count_nodes)(pageprot_pages)) {
+      for (a = VG_PGROUNDDN(start); ; a += VKI_PAGE_SIZE) {
+         pp = VG_(HT_lookup)(pageprot_pages, (UWord)a);
+         if (pp)
+            fn(pp);
+         if (a >= VG_PGROUNDDN(last))
+            break;
+      }
+   } else {
+      pps = VG_(newXA)(ttaux_malloc, "transtab.pageprot_apply_in_range.1",
+                       ttaux_free, sizeof(PageProt*));
+      VG_(HT_ResetIter)(pageprot_pages);
+      while ( (pp = VG_(HT_Next)(pageprot_pages)) ) {
+         if ((Addr64)pp->key + VKI_PAGE_SIZE - 1 >= start
+             && (Addr64)pp->key <= last)
+            VG_(addToXA)(pps, &pp);
+      }
+      for (i = 0; i < VG_(sizeXA)(pps); i++)
+         fn( *(PageProt**)VG_(indexXA)(pps, i) );
+      VG_(deleteXA)(pps);
+   }
+}
+
+static Bool pageprot_forget ( PageProt* pp )
+{
+   pp->isProt = False;
+   return True;
+}
+
+static void pageprot_forget_range ( Addr64 start, ULong range )
+{
+   pageprot_apply_in_range( start, range, pageprot_forget );
+}
+
+/* Is the page at 'a' in a range that a syscall in progress may
+   write? */
+static Bool pageprot_is_pinned ( Addr a )
+{
+   Word     i;
+   PagePin* pin;
+
+   if (pageprot_pins == NULL)
+      return False;
+   for (i = 0; i < VG_(sizeXA)(pageprot_pins); i++) {
+      pin = VG_(indexXA)(pageprot_pins, i);
+      if (a + VKI_PAGE_SIZE - 1 >= pin->start && a <= pin->last)
+         return True;
+   }
+   return False;
+}
+
+static void pageprot_note_write ( PageProt* pp )
+{
+   pp->n_writes++;
+   n_pageprot_writes++;
+   if (pp->n_writes == PAGEPROT_MAX_WRITES) {
+      n_pageprot_given_up++;
+      VG_(debugLog)(1, "transtab", "page 0x%lx written too often to "
+                                   "write-protect\n", pp->key);
+   }
+}
+
+/* Page pp is about to be written by the kernel or by Valgrind.  Throw
+   away its translations and make it writable.  Returns False if it
+   couldn't be made writable. */
+static Bool pageprot_unprotect ( PageProt* pp )
+{
+   NSegment const* seg = VG_(am_find_nsegment)(pp->key);
+
+   if (seg == NULL || !seg->hasW)
+      return False;
+   if (pp->mayBeProt || pp->isPending)
+      pageprot_note_write(pp);
+   pp->isPending = False;
+   VG_(discard_translations)( (Addr64)pp->key, VKI_PAGE_SIZE,
+                              "pageprot_unprotect" );
+   if (!pp->mayBeProt)
+      return True;
+   if (!VG_(am_set_client_page_writable)( pp->key, True ))
+      return False;
+   pp->mayBeProt = False;
+   return True;
+}
+
+/* Code in [start, start+len) is being translated.  Write-protect the
+   pages it is in, if the client could write to them.  Returns False
+   if that isn't possible for some page, in which case the
+   translation needs to check the code itself. */
+Bool VG_(pageprot_cover) ( Addr start, SizeT len )
+{
+   NSegment const* seg;
+   PageProt*       pp;
+   Addr            a, last;
+
+   vg_assert(VG_(clo_smc_check) == Vg_SmcPageProt);
+
+   if (pageprot_pages == NULL)
+      pageprot_pages = VG_(HT_construct)( "transtab.pageprot_pages" );
+
+   last = start + (len == 0 ? 0 : len - 1);
+   for (a = VG_PGROUNDDN(start); ; a += VKI_PAGE_SIZE) {
+      seg = VG_(am_find_nsegment)(a);
+      if (seg == NULL)
+         return False;
+
+      /* Pages the client can't write to don't need protecting.  If it
+         makes them writable, VG_(am_notify_mprotect) will have us
+         discard their translations. */
+      if (seg->hasW) {
+         pp = VG_(HT_lookup)(pageprot_pages, a);
+         if (pp == NULL) {
+            pp = ttaux_malloc( "transtab.pageprot_cover.1",
+                               sizeof(PageProt) );
+            pp->key       = a;
+            pp->n_writes  = 0;
+            pp->isProt    = False;
+            pp->mayBeProt = False;
+            pp->isPending = False;
+            VG_(HT_add_node)(pageprot_pages, pp);
+         }
+         if (pp->n_writes >= PAGEPROT_MAX_WRITES || pp->isPending)
+            return False;
+         /* A syscall may be about to write it. */
+         if (pageprot_is_pinned(a))
+            return False;
+         if (!pp->isProt) {
+            pp->mayBeProt = True;
+            if (!VG_(am_set_client_page_writable)( a, False ))
+               return False;
+            pp->isProt = True;
+            n_pageprot_protects++;
+         }
+      }
+
+      if (a >= VG_PGROUNDDN(last))
+         break;
+   }
+   return True;
+}
+
+/* Called from the SIGSEGV handler for a permissions fault at 'a' in
+   translated code.  Returns True if it was due to write-protection of
+   a code page, in which case the page has been made writable and the
+   faulting instruction can be restarted, but the caller must get the
+   thread back to the scheduler before it runs any more translations,
+   so that VG_(pageprot_discard_pending) can throw away those of the
+   page.  Runs in signal context, so only looks at things. */
+Bool VG_(pageprot_handle_fault) ( Addr a )
+{
+   NSegment const* seg;
+   PageProt*       pp;
+
+   if (pageprot_pages == NULL)
+      return False;
+   pp = VG_(HT_lookup)(pageprot_pages, VG_PGROUNDDN(a));
+   if (pp == NULL)
+      return False;
+   seg = VG_(am_find_nsegment)(a);
+   if (seg == NULL || !seg->hasW)
+      return False; /* a real fault */
+
+   if (!VG_(am_set_client_page_writable)( pp->key, True ))
+      return False;
+   pp->isProt    = False;
+   pp->mayBeProt = False;
+
+   if (!pp->isPending) {
+      pp->isPending = True;
+      if (pageprot_n_pending < PAGEPROT_N_PENDING)
+         pageprot_pending[pageprot_n_pending++] = pp->key;
+      else
+         pageprot_n_pending = PAGEPROT_N_PENDING + 1;
+   }
+   return True;
+}
+
+static Bool pageprot_discard_if_pending ( PageProt* pp )
+{
+   if (!pp->isPending)
+      return False;
+   pp->isPending = False;
+   pageprot_note_write(pp);
+   VG_(discard_translations)( (Addr64)pp->key, VKI_PAGE_SIZE,
+                              "pageprot_discard_pending" );
+   return True;
+}
+
+/* Throw away the translations of pages written to by translated code
+   since the last call.  Called by the scheduler whenever a thread
+   stops running translations. */
+void VG_(pageprot_discard_pending) ( void )
+{
+   PageProt* pp;
+   UInt      i, n;
+
+   if (pageprot_n_pending == 0)
+      return;
+
+   n = pageprot_n_pending;
+   pageprot_n_pending = 0;
+   if (n <= PAGEPROT_N_PENDING) {
+      for (i = 0; i < n; i++) {
+         pp = VG_(HT_lookup)(pageprot_pages, pageprot_pending[i]);
+         vg_assert(pp);
+         pageprot_discard_if_pending(pp);
+      }
+   } else {
+      pageprot_apply_in_range( 0, ~(ULong)0, pageprot_discard_if_pending );
+   }
+}
+
+static void pageprot_pin ( ThreadId tid, Addr start, Addr last )
+{
+   PagePin pin;
+
+   if (pageprot_pins == NULL)
+      pageprot_pins = VG_(newXA)(ttaux_malloc, "transtab.pageprot_pin.1",
+                                 ttaux_free, sizeof(PagePin));
+   pin.tid   = tid;
+   pin.start = start;
+   pin.last  = last;
+   VG_(addToXA)(pageprot_pins, &pin);
+}
+
+/* Thread tid's syscall is about to write [start, start+len). */
+void VG_(pageprot_pre_write) ( ThreadId tid, Addr start, SizeT len )
+{
+   vg_assert(VG_(clo_smc_check) == Vg_SmcPageProt);
+   if (len == 0)
+      return;
+   pageprot_pin( tid, start, start + len - 1 < start ? ~(Addr)0
+                                                     : start + len - 1 );
+   pageprot_apply_in_range( start, len, pageprot_unprotect );
+}
+
+/* Thread tid's syscall may write client memory, but it isn't known
+   where: unprotect everything. */
+void VG_(pageprot_pre_write_unknown) ( ThreadId tid )
+{
+   vg_assert(VG_(clo_smc_check) == Vg_SmcPageProt);
+   pageprot_pin( tid, 0, ~(Addr)0 );
+   pageprot_apply_in_range( 0, ~(ULong)0, pageprot_unprotect );
+}
+
+/* Thread tid's syscall, including its post-handler, is done; its
+   pages may be protected again. */
+void VG_(pageprot_post_syscall) ( ThreadId tid )
+{
+   Word     i;
+   PagePin* pin;
+
+   vg_assert(VG_(clo_smc_check) == Vg_SmcPageProt);
+   if (pageprot_pins == NULL)
+      return;
+   for (i = VG_(sizeXA)(pageprot_pins) - 1; i >= 0; i--) {
+      pin = VG_(indexXA)(pageprot_pins, i);
+      if (pin->tid == tid)
+         VG_(removeIndexXA)(pageprot_pins, i);
+   }
+}
+
+
+/*------------------------------------------------------------*/
+/*--- Tiered translation                                   ---*/
+/*------------------------------------------------------------*/
+
+/* Number of TT entries looked at per call of
+   VG_(take_hot_translations). */
+#define TIER_SCAN_SLICE 4096
+
+/* Look at the next TIER_SCAN_SLICE entries of TT for quick (tier 0)
+   translations which have been run at least
+   VG_(clo_tier_up_threshold) times.  Delete up to max_n of them, and
+   put their entry addresses in hot[] and their entry counts in
+   counts[], for the caller to translate again properly.  Returns the
+   number found.  Deleting a translation unchains all jumps to it, so
+   they get chained to its replacement through VG_(tt_tc_do_chaining)
+   the next time they are taken. */
+UInt VG_(take_hot_translations) ( /*OUT*/Addr64* hot,
+                                  /*OUT*/ULong* counts, UInt max_n )
+{
+   Int      i;
+   UInt     n    = 0;
+   ULong    thr  = (ULong)VG_(clo_tier_up_threshold);
+   VexArch  vex_arch = VexArch_INVALID;
+   Sector*  sec;
+   TTEntry* tte;
+
+   vg_assert(init_done);
+   vg_assert(VG_(clo_tiered_translation));
+
+   for (i = 0; i < TIER_SCAN_SLICE && n < max_n; i++) {
+      if (tier_scan_tteNo >= n_ttes_per_sector) {
+         tier_scan_tteNo = 0;
+         tier_scan_sno++;
+      }
+      if (tier_scan_sno >= n_sectors)
+         tier_scan_sno = 0;
+
+      sec = &sectors[tier_scan_sno];
+      if (sec->tc == NULL) {
+         /* Never used, so nothing to see here. */
+         tier_scan_tteNo = n_ttes_per_sector;
+         continue;
+      }
+
+      tte = &sec->tt[tier_scan_tteNo];
+      if (tte->status == InUse && tte->tier0 && tte->count >= thr) {
+         /* Only unredirected code gets quick translations. */
+         vg_assert(tte->entry == tte->vge.base[0]);
+         if (vex_arch == VexArch_INVALID) {
+            VG_(machine_get_VexArchInfo)( &vex_arch, NULL );
+            VG_(acquire_code_exclusive)();
+         }
+         hot[n]    = tte->entry;
+         counts[n] = tte->count;
+         n++;
+         delete_tte( sec, tier_scan_sno, tier_scan_tteNo, vex_arch );
+         /* That wasn't a discard in the usual sense. */
+         n_disc_count--;
+         n_disc_osize -= vge_osize(&tte->vge);
+         n_tier_up_count++;
+      }
+      tier_scan_tteNo++;
+   }
+
+   if (vex_arch != VexArch_INVALID)
+      VG_(release_code_exclusive)();
+   return n;
+}
+
+
+/* How often has the code at GUEST_ADDR been run, as far as TT knows?
+   Returns False if it has no translation.  Only quick translations
+   count their entries; any other translation of unredirected code
+   was either hot already or came from the persistent cache, and is
+   reported as having reached VG_(clo_tier_up_threshold). */
+Bool VG_(get_tier_count) ( Addr64 guest_addr, /*OUT*/ULong* count )
+{
+   UInt     sno, tteNo;
+   TTEntry* tte;
+
+   vg_assert(VG_(clo_tiered_translation));
+
+   if (!VG_(search_transtab)( NULL, &sno, &tteNo, guest_addr, False ))
+      return False;
+
+   tte = &sectors[sno].tt[tteNo];
+   *count = tte->tier0 ? tte->count : (ULong)VG_(clo_tier_up_threshold);
+   return True;
 }
 
 
@@ -2036,7 +2755,9 @@ void VG_(add_to_unredir_transtab)( VexGuestExtents* vge,
 
    if (i >= N_UNREDIR_TT || code_szQ > (N_UNREDIR_TCQ - unredir_tc_used)) {
       /* It's full; dump everything we currently have */
+      VG_(acquire_code_exclusive)();
       init_unredir_tt_tc();
+      VG_(release_code_exclusive)();
       i = 0;
    }
 
@@ -2101,9 +2822,19 @@ static void unredir_discard_translations( Addr64 guest_start, ULong range )
 /*--- Initialisation.                                      ---*/
 /*------------------------------------------------------------*/
 
+static Bool is_prime ( UInt n )
+{
+   UInt i;
+   if (n < 2) return False;
+   for (i = 2; i * i <= n; i++)
+      if (n % i == 0)
+         return False;
+   return True;
+}
+
 void VG_(init_tt_tc) ( void )
 {
-   Int i, j, avg_codeszQ;
+   Int i, avg_codeszQ;
 
    vg_assert(!init_done);
    init_done = True;
@@ -2116,42 +2847,62 @@ void VG_(init_tt_tc) ( void )
    vg_assert(sizeof(FastCacheEntry) == 2 * sizeof(Addr));
    /* check fast cache entries are packed back-to-back with no spaces */
    vg_assert(sizeof( VG_(tt_fast) ) == VG_TT_FAST_SIZE * sizeof(FastCacheEntry));
+   vg_assert(VG_TT_FAST_WAYS * (1 << VG_TT_FAST_SET_BITS) == VG_TT_FAST_SIZE);
    /* check fast cache is aligned as we requested.  Not fatal if it
       isn't, but we might as well make sure. */
    vg_assert(VG_IS_16_ALIGNED( ((Addr) & VG_(tt_fast)[0]) ));
+   for (i = 0; i < VG_N_THREADS; i++)
+      thread_fast_cache[i] = NULL;
 
    if (VG_(clo_verbosity) > 2)
       VG_(message)(Vg_DebugMsg, 
                    "TT/TC: VG_(init_tt_tc) "
                    "(startup of code management)\n");
 
+   /* Figure out how many sectors, and how big each one is. */
+   n_sectors = VG_(clo_num_transtab_sectors);
+   vg_assert(n_sectors >= 1 && n_sectors <= MAX_N_SECTORS);
+   max_n_sectors = VG_(clo_max_transtab_sectors);
+   if (max_n_sectors < n_sectors)
+      max_n_sectors = n_sectors;
+   vg_assert(max_n_sectors <= MAX_N_SECTORS);
+
+   n_ttes_per_sector = VG_(clo_transtab_sector_entries);
+   vg_assert(n_ttes_per_sector >= 2 
+             && n_ttes_per_sector <= MAX_N_TTES_PER_SECTOR);
+   while (!is_prime(n_ttes_per_sector))
+      n_ttes_per_sector--;
+   n_ttes_per_sector_usable 
+      = (SECTOR_TT_LIMIT_PERCENT * n_ttes_per_sector) / 100;
+
    /* Figure out how big each tc area should be.  */
    avg_codeszQ   = (VG_(details).avg_translation_sizeB + 7) / 8;
-   tc_sector_szQ = N_TTES_PER_SECTOR_USABLE * (1 + avg_codeszQ);
+   tc_sector_szQ = n_ttes_per_sector_usable * (1 + avg_codeszQ);
 
    /* Ensure the calculated value is not way crazy. */
-   vg_assert(tc_sector_szQ >= 2 * N_TTES_PER_SECTOR_USABLE);
-   vg_assert(tc_sector_szQ <= 100 * N_TTES_PER_SECTOR_USABLE);
+   vg_assert(tc_sector_szQ >= 2 * n_ttes_per_sector_usable);
+   vg_assert(tc_sector_szQ <= 100 * n_ttes_per_sector_usable);
 
    /* Initialise the sectors */
    youngest_sector = 0;
-   for (i = 0; i < N_SECTORS; i++) {
+   for (i = 0; i < MAX_N_SECTORS; i++) {
       sectors[i].tc = NULL;
       sectors[i].tt = NULL;
       sectors[i].tc_next = NULL;
       sectors[i].tt_n_inuse = 0;
-      for (j = 0; j < ECLASS_N; j++) {
-         sectors[i].ec2tte_size[j] = 0;
-         sectors[i].ec2tte_used[j] = 0;
-         sectors[i].ec2tte[j] = NULL;
-      }
+      sectors[i].guest_extents = NULL;
+      sectors[i].guest_extents_maxlen = 0;
       sectors[i].host_extents = NULL;
    }
 
    /* Initialise the sector_search_order hint table. */
-   for (i = 0; i < N_SECTORS; i++)
+   for (i = 0; i < MAX_N_SECTORS; i++)
       sector_search_order[i] = -1;
 
+   /* Nothing has been evicted yet. */
+   for (i = 0; i < N_EVICTED; i++)
+      evicted_entries[i] = TRANSTAB_BOGUS_GUEST_ADDR;
+
    /* Initialise the fast cache. */
    invalidateFastCache();
 
@@ -2161,23 +2912,23 @@ void VG_(init_tt_tc) ( void )
    if (VG_(clo_verbosity) > 2) {
       VG_(message)(Vg_DebugMsg,
          "TT/TC: cache: %d sectors of %d bytes each = %d total\n", 
-          N_SECTORS, 8 * tc_sector_szQ,
-          N_SECTORS * 8 * tc_sector_szQ );
+          n_sectors, 8 * tc_sector_szQ,
+          n_sectors * 8 * tc_sector_szQ );
       VG_(message)(Vg_DebugMsg,
          "TT/TC: table: %d total entries, max occupancy %d (%d%%)\n",
-         N_SECTORS * N_TTES_PER_SECTOR,
-         N_SECTORS * N_TTES_PER_SECTOR_USABLE, 
+         n_sectors * n_ttes_per_sector,
+         n_sectors * n_ttes_per_sector_usable, 
          SECTOR_TT_LIMIT_PERCENT );
    }
 
    VG_(debugLog)(2, "transtab",
       "cache: %d sectors of %d bytes each = %d total\n", 
-       N_SECTORS, 8 * tc_sector_szQ,
-       N_SECTORS * 8 * tc_sector_szQ );
+       n_sectors, 8 * tc_sector_szQ,
+       n_sectors * 8 * tc_sector_szQ );
    VG_(debugLog)(2, "transtab",
       "table: %d total entries, max occupancy %d (%d%%)\n",
-      N_SECTORS * N_TTES_PER_SECTOR,
-      N_SECTORS * N_TTES_PER_SECTOR_USABLE, 
+      n_sectors * n_ttes_per_sector,
+      n_sectors * n_ttes_per_sector_usable, 
       SECTOR_TT_LIMIT_PERCENT );
 }
 
@@ -2202,8 +2953,13 @@ void VG_(print_tt_tc_stats) ( void )
       "    tt/tc: %'llu tt lookups requiring %'llu probes\n",
       n_full_lookups, n_lookup_probes );
    VG_(message)(Vg_DebugMsg,
-      "    tt/tc: %'llu fast-cache updates, %'llu flushes\n",
-      n_fast_updates, n_fast_flushes );
+      "    tt/tc: %'llu fast-cache updates, %'llu flushes, "
+      "%'llu entries removed\n",
+      n_fast_updates, n_fast_flushes, n_fast_removals );
+   VG_(message)(Vg_DebugMsg,
+      "    tt/tc: fast-cache is %d-way, %d sets%s\n",
+      VG_TT_FAST_WAYS, 1 << VG_TT_FAST_SET_BITS,
+      VG_(clo_per_thread_fast_cache) ? ", one per thread" : "" );
 
    VG_(message)(Vg_DebugMsg,
                 " transtab: new        %'lld "
@@ -2217,17 +2973,28 @@ void VG_(print_tt_tc_stats) ( void )
    VG_(message)(Vg_DebugMsg,
                 " transtab: discarded  %'llu (%'llu -> ?" "?)\n",
                 n_disc_count, n_disc_osize );
-
-   if (0) {
-      Int i;
-      VG_(printf)("\n");
-      for (i = 0; i < ECLASS_N; i++) {
-         VG_(printf)(" %4d", sectors[0].ec2tte_used[i]);
-         if (i % 16 == 15)
-            VG_(printf)("\n");
-      }
-      VG_(printf)("\n\n");
-   }
+   VG_(message)(Vg_DebugMsg,
+                " transtab: retrans    %'llu after dump, "
+                "%'llu survived dumps\n",
+                n_retrans_count, n_survivor_count );
+   VG_(message)(Vg_DebugMsg,
+                " transtab: sectors    %d in use (max %d), %'llu grows\n",
+                n_sectors, max_n_sectors, n_sector_grows );
+   if (VG_(clo_parallel_execution))
+      VG_(message)(Vg_DebugMsg,
+                   " transtab: chaining   %'llu requests queued, "
+                   "%'llu batches\n",
+                   n_chain_queued, n_chain_batches );
+   if (VG_(clo_tiered_translation))
+      VG_(message)(Vg_DebugMsg,
+                   " transtab: tiered     %'llu quick, %'llu tier-ups\n",
+                   n_tier0_count, n_tier_up_count );
+   if (VG_(clo_smc_check) == Vg_SmcPageProt)
+      VG_(message)(Vg_DebugMsg,
+                   " transtab: pageprot   %'llu protects, %'llu writes, "
+                   "%'llu pages given up\n",
+                   n_pageprot_protects, n_pageprot_writes,
+                   n_pageprot_given_up );
 }
 
 /*------------------------------------------------------------*/
@@ -2254,10 +3021,10 @@ ULong VG_(get_BB_profile) ( BBProfEntry tops[], UInt n_tops )
 
    score_total = 0;
 
-   for (sno = 0; sno < N_SECTORS; sno++) {
+   for (sno = 0; sno < n_sectors; sno++) {
       if (sectors[sno].tc == NULL)
          continue;
-      for (i = 0; i < N_TTES_PER_SECTOR; i++) {
+      for (i = 0; i < n_ttes_per_sector; i++) {
          if (sectors[sno].tt[i].status != InUse)
             continue;
          score_total += score(&sectors[sno].tt[i]);
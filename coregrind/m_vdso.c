@@ -0,0 +1,327 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Use of the host's vDSO for time syscalls.                    ---*/
+/*---                                                     m_vdso.c ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2000-2012 Julian Seward
+      jseward@acm.org
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "pub_core_basics.h"
+#include "pub_core_vki.h"
+#include "pub_core_aspacemgr.h"
+#include "pub_core_debuglog.h"
+#include "pub_core_libcbase.h"
+#include "pub_core_libcassert.h"
+#include "pub_core_libcprint.h"
+#include "pub_core_options.h"
+#include "pub_core_syscall.h"      // VG_(mk_SysRes_Success)
+#include "pub_core_vdso.h"         /* self */
+
+/* How this works.
+
+   The kernel maps a small shared object, the vDSO, into every
+   process and tells it where via AT_SYSINFO_EHDR.  glibc uses it to
+   read the clocks without entering the kernel.  Valgrind removes
+   AT_SYSINFO_EHDR from the client's auxv and unmaps the vDSO (running
+   it as guest code would be pointless, since it only saves the cost
+   of a syscall which Valgrind then has to simulate anyway), so under
+   Valgrind every gettimeofday and clock_gettime is a real syscall,
+   which, together with the wrapper overhead, costs several hundred
+   times what it does natively.  Programs which timestamp everything
+   slow down badly.
+
+   With --vdso-time=yes we instead keep the vDSO mapped, as a Valgrind
+   mapping, look up __vdso_clock_gettime and __vdso_gettimeofday in
+   its dynamic symbol table, and have the syscall wrappers for those
+   two syscalls call them directly, on the host side.  The results are
+   the same ones the kernel would have given, and the wrappers still
+   do all the usual checks and tool notifications for the client's
+   buffers.
+
+   The vDSO functions use the ordinary C calling convention, so this
+   only needs to know that the vDSO was built for the same ABI as
+   Valgrind itself.  That is only checked (and so only enabled) on
+   x86 and amd64 Linux. */
+
+#if defined(VGP_x86_linux) || defined(VGP_amd64_linux)
+
+#include <elf.h>
+
+#if VG_WORDSIZE == 4
+#  define  ElfXX_Ehdr     Elf32_Ehdr
+#  define  ElfXX_Shdr     Elf32_Shdr
+#  define  ElfXX_Phdr     Elf32_Phdr
+#  define  ElfXX_Sym      Elf32_Sym
+#  define  ELFXX_ST_TYPE  ELF32_ST_TYPE
+#  define  ELFCLASSXX     ELFCLASS32
+#elif VG_WORDSIZE == 8
+#  define  ElfXX_Ehdr     Elf64_Ehdr
+#  define  ElfXX_Shdr     Elf64_Shdr
+#  define  ElfXX_Phdr     Elf64_Phdr
+#  define  ElfXX_Sym      Elf64_Sym
+#  define  ELFXX_ST_TYPE  ELF64_ST_TYPE
+#  define  ELFCLASSXX     ELFCLASS64
+#else
+#  error "VG_WORDSIZE should be 4 or 8"
+#endif
+
+#if defined(VGA_x86)
+#  define ELF_MACHINE     EM_386
+#else
+#  define ELF_MACHINE     EM_X86_64
+#endif
+
+typedef Int (*VdsoClockGettimeFn) ( Int, struct vki_timespec* );
+typedef Int (*VdsoGettimeofdayFn) ( struct vki_timeval*,
+                                    struct vki_timezone* );
+
+static VdsoClockGettimeFn vdso_clock_gettime = NULL;
+static VdsoGettimeofdayFn vdso_gettimeofday  = NULL;
+
+/* Stats */
+static ULong n_vdso_clock_gettime = 0;
+static ULong n_vdso_gettimeofday  = 0;
+static ULong n_vdso_declined      = 0;
+
+
+/* Is [off, off+len) inside an image of size 'size'? */
+static Bool in_image ( SizeT size, ULong off, ULong len )
+{
+   return off <= size && len <= size - off;
+}
+
+/* Find the function 'name' in the vDSO image at 'base'.  'bias' is
+   added to symbol values to get run-time addresses.  Returns 0 if it
+   is not there. */
+static Addr find_vdso_fn ( Addr base, SizeT size, Addr bias,
+                           ElfXX_Sym* syms, UWord n_syms,
+                           const HChar* strtab, UWord strtab_szB,
+                           const HChar* name )
+{
+   UWord i;
+   Addr  a;
+
+   for (i = 1; i < n_syms; i++) {
+      if (syms[i].st_shndx == SHN_UNDEF)
+         continue;
+      if (ELFXX_ST_TYPE(syms[i].st_info) != STT_FUNC)
+         continue;
+      if (syms[i].st_name >= strtab_szB)
+         continue;
+      if (0 != VG_(strcmp)(strtab + syms[i].st_name, name))
+         continue;
+      a = bias + syms[i].st_value;
+      if (a < base || a >= base + size)
+         return 0;
+      return a;
+   }
+   return 0;
+}
+
+Bool VG_(vdso_init) ( Addr ehdr_addr )
+{
+   const NSegment* seg;
+   ElfXX_Ehdr* ehdr;
+   ElfXX_Phdr* phdrs;
+   ElfXX_Shdr* shdrs;
+   ElfXX_Shdr* dynsym;
+   ElfXX_Shdr* dynstr;
+   Addr  base, bias, cg, gtod;
+   SizeT size;
+   Bool  have_bias;
+   UWord i;
+
+   if (!VG_(clo_vdso_time))
+      return False;
+
+   seg = VG_(am_find_nsegment)(ehdr_addr);
+   if (seg == NULL || seg->start != ehdr_addr
+       || !seg->hasR || !seg->hasX)
+      return False;
+   base = seg->start;
+   size = seg->end + 1 - seg->start;
+
+   /* The vDSO is a complete ELF image, section headers and all.
+      Check every offset before following it. */
+   ehdr = (ElfXX_Ehdr*)base;
+   if (size < sizeof(ElfXX_Ehdr)
+       || 0 != VG_(memcmp)(ehdr->e_ident, ELFMAG, SELFMAG)
+       || ehdr->e_ident[EI_CLASS] != ELFCLASSXX
+       || ehdr->e_type != ET_DYN
+       || ehdr->e_machine != ELF_MACHINE
+       || ehdr->e_phentsize != sizeof(ElfXX_Phdr)
+       || ehdr->e_shentsize != sizeof(ElfXX_Shdr)
+       || !in_image(size, ehdr->e_phoff,
+                    (ULong)ehdr->e_phnum * sizeof(ElfXX_Phdr))
+       || !in_image(size, ehdr->e_shoff,
+                    (ULong)ehdr->e_shnum * sizeof(ElfXX_Shdr)))
+      goto bad;
+   phdrs = (ElfXX_Phdr*)(base + ehdr->e_phoff);
+   shdrs = (ElfXX_Shdr*)(base + ehdr->e_shoff);
+
+   /* The load bias is wherever the segment containing the ELF header
+      ended up, less where it was linked to go. */
+   have_bias = False;
+   bias = 0;
+   for (i = 0; i < ehdr->e_phnum; i++) {
+      if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_offset == 0) {
+         bias = base - phdrs[i].p_vaddr;
+         have_bias = True;
+         break;
+      }
+   }
+   if (!have_bias)
+      goto bad;
+
+   dynsym = NULL;
+   for (i = 0; i < ehdr->e_shnum; i++) {
+      if (shdrs[i].sh_type == SHT_DYNSYM) {
+         dynsym = &shdrs[i];
+         break;
+      }
+   }
+   if (dynsym == NULL || dynsym->sh_link >= ehdr->e_shnum)
+      goto bad;
+   dynstr = &shdrs[dynsym->sh_link];
+   if (dynstr->sh_type != SHT_STRTAB
+       || dynstr->sh_size == 0
+       || dynsym->sh_entsize != sizeof(ElfXX_Sym)
+       || !in_image(size, dynsym->sh_offset, dynsym->sh_size)
+       || !in_image(size, dynstr->sh_offset, dynstr->sh_size)
+       || ((HChar*)base)[dynstr->sh_offset + dynstr->sh_size - 1] != 0)
+      goto bad;
+
+   cg = find_vdso_fn(base, size, bias,
+                     (ElfXX_Sym*)(base + dynsym->sh_offset),
+                     dynsym->sh_size / sizeof(ElfXX_Sym),
+                     (HChar*)(base + dynstr->sh_offset), dynstr->sh_size,
+                     "__vdso_clock_gettime");
+   gtod = find_vdso_fn(base, size, bias,
+                       (ElfXX_Sym*)(base + dynsym->sh_offset),
+                       dynsym->sh_size / sizeof(ElfXX_Sym),
+                       (HChar*)(base + dynstr->sh_offset), dynstr->sh_size,
+                       "__vdso_gettimeofday");
+   if (cg == 0 && gtod == 0)
+      goto bad;
+
+   vdso_clock_gettime = (VdsoClockGettimeFn)cg;
+   vdso_gettimeofday  = (VdsoGettimeofdayFn)gtod;
+   VG_(debugLog)(1, "vdso", "using vDSO at %#lx: clock_gettime %#lx, "
+                            "gettimeofday %#lx\n", base, cg, gtod);
+   return True;
+
+  bad:
+   VG_(debugLog)(1, "vdso", "unusable vDSO at %#lx; "
+                            "not using it for time syscalls\n", base);
+   return False;
+}
+
+Bool VG_(vdso_clock_gettime) ( Int clk, struct vki_timespec* ts,
+                               /*OUT*/SysRes* res )
+{
+   Int r;
+
+   if (vdso_clock_gettime == NULL)
+      return False;
+
+   /* Only the clocks which the vDSO reads directly.  For anything else
+      it just does the syscall itself, and the CPU-time clocks would
+      then be charged to whichever of our threads made the call. */
+   switch (clk) {
+      case VKI_CLOCK_REALTIME:
+      case VKI_CLOCK_MONOTONIC:
+      case VKI_CLOCK_MONOTONIC_RAW:
+      case VKI_CLOCK_REALTIME_COARSE:
+      case VKI_CLOCK_MONOTONIC_COARSE:
+      case VKI_CLOCK_BOOTTIME:
+         break;
+      default:
+         n_vdso_declined++;
+         return False;
+   }
+
+   r = vdso_clock_gettime(clk, ts);
+   /* Like the syscall, the vDSO returns -errno on failure. */
+   *res = r < 0 ? VG_(mk_SysRes_Error)(-r) : VG_(mk_SysRes_Success)(r);
+   n_vdso_clock_gettime++;
+   return True;
+}
+
+Bool VG_(vdso_gettimeofday) ( struct vki_timeval* tv,
+                              struct vki_timezone* tz,
+                              /*OUT*/SysRes* res )
+{
+   Int r;
+
+   if (vdso_gettimeofday == NULL)
+      return False;
+
+   r = vdso_gettimeofday(tv, tz);
+   *res = r < 0 ? VG_(mk_SysRes_Error)(-r) : VG_(mk_SysRes_Success)(r);
+   n_vdso_gettimeofday++;
+   return True;
+}
+
+void VG_(print_vdso_stats) ( void )
+{
+   if (vdso_clock_gettime == NULL && vdso_gettimeofday == NULL)
+      return;
+   VG_(message)(Vg_DebugMsg,
+                "    vdso: %'llu clock_gettime, %'llu gettimeofday "
+                "done via vDSO; %'llu not\n",
+                n_vdso_clock_gettime, n_vdso_gettimeofday,
+                n_vdso_declined);
+}
+
+#else /* !(defined(VGP_x86_linux) || defined(VGP_amd64_linux)) */
+
+Bool VG_(vdso_init) ( Addr ehdr_addr )
+{
+   return False;
+}
+
+Bool VG_(vdso_clock_gettime) ( Int clk, struct vki_timespec* ts,
+                               /*OUT*/SysRes* res )
+{
+   return False;
+}
+
+Bool VG_(vdso_gettimeofday) ( struct vki_timeval* tv,
+                              struct vki_timezone* tz,
+                              /*OUT*/SysRes* res )
+{
+   return False;
+}
+
+void VG_(print_vdso_stats) ( void )
+{
+}
+
+#endif
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
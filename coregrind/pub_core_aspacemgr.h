@@ -288,6 +288,12 @@ extern void VG_(am_set_segment_isCH_if_SkAnonC)( NSegment* seg );
    segment. */
 extern void VG_(am_set_segment_hasT_if_SkFileC_or_SkAnonC)( NSegment* );
 
+/* For --smc-check=pageprot: make the client page containing 'a'
+   really writable or not, without changing aspacem's record of its
+   permissions.  Returns False if it is not in a writable client
+   mapping. */
+extern Bool VG_(am_set_client_page_writable)( Addr a, Bool writable );
+
 /* --- --- --- reservations --- --- --- */
 
 /* Create a reservation from START .. START+LENGTH-1, with the given
@@ -132,6 +132,33 @@ extern Bool VG_(use_CF_info) ( /*MOD*/D3UnwindRegs* uregs,
                                Addr min_accessible,
                                Addr max_accessible );
 
+/* As VG_(use_CF_info), but also records in *log every word of guest
+   memory the step read and the value found there.  n_reads is -1 if
+   the step's inputs could not all be logged (too many reads, or a
+   CFI expression was evaluated).  no_info is True iff there was no
+   CFI for the starting ip at all. */
+#define CF_READS_MAX 8
+
+typedef
+   struct {
+      Int   n_reads;
+      Addr  read_at[CF_READS_MAX];
+      UWord read_val[CF_READS_MAX];
+      Bool  no_info;
+   }
+   CFReadLog;
+
+extern Bool VG_(use_CF_info_logged) ( /*MOD*/D3UnwindRegs* uregs,
+                                      Addr min_accessible,
+                                      Addr max_accessible,
+                                      /*OUT*/CFReadLog* log );
+
+/* Changes whenever CFI which VG_(use_CF_info) might have used goes
+   away or new CFI appears, and more generally whenever debug info is
+   read or discarded, so that anything derived from earlier unwinds or
+   symbol lookups can be discarded. */
+extern ULong VG_(CF_info_generation) ( void );
+
 
 /* Use MSVC FPO data to do one step of stack unwinding. */
 extern Bool VG_(use_FPO_info) ( /*MOD*/Addr* ipP,
@@ -155,6 +182,9 @@ extern Addr VG_(get_tocptr) ( Addr guest_code_addr );
 extern
 Bool VG_(lookup_symbol_SLOW)(UChar* sopatt, UChar* name, Addr* pEnt, Addr* pToc);
 
+/* Print statistics about CFI lookups (for --stats=yes). */
+extern void VG_(print_debuginfo_stats) ( void );
+
 #endif   // __PUB_CORE_DEBUGINFO_H
 
 /*--------------------------------------------------------------------*/
@@ -59,10 +59,16 @@
    two_words holds the return values (two words).  First is
    a TRC value.  Second is generally unused, except in the case
    where we have to return a chain-me request.
+
+   fast_cache is the fast translation lookup cache to use for
+   indirect jumps (see VG_(get_fast_cache)).  It is only used on
+   x86-linux and amd64-linux; elsewhere VG_(tt_fast) is used
+   directly.
 */
 void VG_(disp_run_translations)( HWord* two_words,
                                  void*  guest_state, 
-                                 Addr   host_addr );
+                                 Addr   host_addr,
+                                 void*  fast_cache );
 
 /* We need to know addresses of the continuation-point (cp_) labels so
    we can tell VEX what they are.  They will get baked into the code
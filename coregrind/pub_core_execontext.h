@@ -46,12 +46,21 @@
 // Print stats (informational only).
 extern void VG_(print_ExeContext_stats) ( void );
 
-// Extract the StackTrace from an ExeContext.
+// Extract the StackTrace from an ExeContext.  'buf' must have room for
+// VG_(get_ExeContext_n_ips)(e) entries.  With --execontext-storage=trie
+// a context is not stored as an array, so it is copied into 'buf' and
+// the result is only good as long as 'buf' is.
 // (Minor hack: we use Addr* as the return type instead of StackTrace so
 // that modules #including this file don't also have to #include
 // pub_core_stacktrace.h also.)
 extern
-/*StackTrace*/Addr* VG_(get_ExeContext_StackTrace) ( ExeContext* e );
+/*StackTrace*/Addr* VG_(get_ExeContext_StackTrace) ( ExeContext* e,
+                                                     /*OUT*/Addr* buf );
+
+// Hash the top 'n_ips' frames of an ExeContext (or all of them, if it
+// has fewer).  Two ExeContexts which VG_(eq_ExeContext) considers
+// equal when comparing at most 'n_ips' frames hash the same.
+extern UWord VG_(hash_ExeContext_top) ( ExeContext* e, UInt n_ips );
 
 
 #endif   // __PUB_CORE_EXECONTEXT_H
@@ -31,6 +31,7 @@
 #define __PUB_CORE_GDBSERVER_H
 
 #include "pub_tool_gdbserver.h"
+#include "pub_core_options.h"   // VgVgdb
 
 /* Return the path prefix for the named pipes (FIFOs) used by vgdb/gdb
    to communicate with valgrind */
@@ -118,6 +119,10 @@ extern IRSB* VG_(instrument_for_gdbserver_if_needed)
       VexGuestExtents* vge,
       IRType gWordTy, IRType hWordTy);
 
+/* Returns the reason for which gdbserver instrumentation is needed
+   for the given extents, or Vg_VgdbNo if it is not needed. */
+extern VgVgdb VG_(gdbserver_instrumentation_needed) (VexGuestExtents* vge);
+
 /* reason for which gdbserver connection must be finished */
 typedef
    enum {
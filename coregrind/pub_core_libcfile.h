@@ -39,8 +39,6 @@
 
 #include "pub_tool_libcfile.h"
 
-/* Move an fd into the Valgrind-safe range */
-extern Int VG_(safe_fd) ( Int oldfd );
 extern Int VG_(fcntl)   ( Int fd, Int cmd, Addr arg );
 
 /* Convert an fd into a filename */
@@ -84,12 +82,6 @@ extern Int VG_(check_executable)(/*OUT*/Bool* is_setuid,
    in terms of pread()?) */
 extern SysRes VG_(pread) ( Int fd, void* buf, Int count, OffT offset );
 
-/* Create and open (-rw------) a tmp file name incorporating said arg.
-   Returns -1 on failure, else the fd of the file.  If fullname is
-   non-NULL, the file's name is written into it.  The number of bytes
-   written is guaranteed not to exceed 64+strlen(part_of_name). */
-extern Int VG_(mkstemp) ( HChar* part_of_name, /*OUT*/HChar* fullname );
-
 /* Record the process' working directory at startup.  Is intended to
    be called exactly once, at startup, before the working directory
    changes.  Return True for success, False for failure, so that the
@@ -84,6 +84,11 @@ extern void VG_(do_atfork_pre)    ( ThreadId tid );
 extern void VG_(do_atfork_parent) ( ThreadId tid );
 extern void VG_(do_atfork_child)  ( ThreadId tid );
 
+// As VG_(read_millisecond_timer), but in microseconds or nanoseconds
+// (the latter only nominally on Darwin).
+extern ULong VG_(read_microsecond_timer) ( void );
+extern ULong VG_(read_nanosecond_timer)  ( void );
+
 // icache invalidation
 extern void VG_(invalidate_icache) ( void *ptr, SizeT nbytes );
 
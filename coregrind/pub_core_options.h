@@ -155,6 +155,9 @@ extern Bool  VG_(clo_trace_redir);
 /* Enable fair scheduling on multicore systems? default: NO */
 enum FairSchedType { disable_fair_sched, enable_fair_sched, try_fair_sched };
 extern enum FairSchedType VG_(clo_fair_sched);
+/* Adapt each thread's timeslice to whether it keeps blocking, and keep
+   the lock at the end of a timeslice if nobody wants it?  default: NO */
+extern Bool  VG_(clo_adaptive_sched);
 /* DEBUG: print thread scheduling events?  default: NO */
 extern Bool  VG_(clo_trace_sched);
 /* DEBUG: do heap profiling?  default: NO */
@@ -180,6 +183,22 @@ extern Char* VG_(clo_sim_hints);
 extern Bool VG_(clo_sym_offsets);
 /* Read DWARF3 variable info even if tool doesn't ask for it? */
 extern Bool VG_(clo_read_var_info);
+/* With --read-var-info=lazy: read it one CU at a time when it is
+   needed, keeping at most VG_(clo_read_var_info_cus) CUs' info in
+   memory. */
+extern Bool VG_(clo_lazy_var_info);
+extern Int  VG_(clo_read_var_info_cus);
+/* Read line numbers, CFI and variable info only when first needed,
+   rather than when objects are mapped? */
+extern Bool VG_(clo_lazy_debuginfo);
+/* Directory in which to cache canonicalised debug info tables, keyed
+   by build-id, or NULL for none. */
+extern HChar* VG_(clo_debuginfo_cache_dir);
+/* Number of helper processes to fork to read the variable info of
+   large objects.  Zero means read it all in Valgrind itself. */
+extern Int VG_(clo_debuginfo_workers);
+/* .debug_info sections smaller than this are not worth dividing up. */
+extern Int VG_(clo_debuginfo_workers_min_szB);
 /* Which prefix to strip from full source file paths, if any. */
 extern Char* VG_(clo_prefix_to_strip);
 
@@ -237,6 +256,16 @@ extern Word VG_(clo_max_stackframe);
    be? */
 extern Word VG_(clo_main_stacksize);
 
+/* Should a thread's stack unwinds reuse the outer frames of its
+   previous unwind, where they can be shown to be unchanged?
+   Default: YES */
+extern Bool VG_(clo_unwind_memo);
+
+/* Store ExeContexts as the nodes of a trie, so that they share the
+   frames they have in common, rather than each as a separate flat
+   array?  Default: NO */
+extern Bool VG_(clo_execontext_trie);
+
 /* Delay startup to allow GDB to be attached?  Default: NO */
 extern Bool VG_(clo_wait_for_gdb);
 
@@ -249,8 +278,12 @@ typedef
       Vg_SmcStack, // generate s-c-t's for code found in stacks
                    // (this is the default)
       Vg_SmcAll,   // make all translations self-checking.
-      Vg_SmcAllNonFile // make all translations derived from
+      Vg_SmcAllNonFile, // make all translations derived from
                    // non-file-backed memory self checking
+      Vg_SmcPageProt // write-protect writable pages that code is
+                   // translated from, and discard their translations
+                   // when they are written; self-check code found in
+                   // stacks or in pages that are written often
    } 
    VgSmc;
 
@@ -258,6 +291,35 @@ typedef
    auto-detected. */
 extern VgSmc VG_(clo_smc_check);
 
+/* If not NULL, the directory in which to keep translations for reuse
+   by later runs (see m_transcache.c). */
+extern HChar* VG_(clo_translation_cache_dir);
+
+/* Number of sectors the translation cache starts with, and the
+   number it may grow to if code thrown out by recycling keeps being
+   retranslated.  0 for the latter means "don't grow". */
+extern Int VG_(clo_num_transtab_sectors);
+extern Int VG_(clo_max_transtab_sectors);
+
+/* Number of translation table entries in each sector. */
+extern Int VG_(clo_transtab_sector_entries);
+
+/* When recycling a sector, keep its most used translations? */
+extern Bool VG_(clo_transtab_survivors);
+
+/* Give each thread its own fast translation lookup cache? */
+extern Bool VG_(clo_per_thread_fast_cache);
+
+/* Translate each block quickly (no chasing, with an entry counter)
+   at first, and translate it again properly once it has been run
+   VG_(clo_tier_up_threshold) times? */
+extern Bool VG_(clo_tiered_translation);
+extern Int  VG_(clo_tier_up_threshold);
+
+/* Answer clock_gettime and gettimeofday using the host's vDSO rather
+   than doing the syscalls? */
+extern Bool VG_(clo_vdso_time);
+
 /* String containing comma-separated names of minor kernel variants,
    so they can be properly handled by m_syswrap. */
 extern HChar* VG_(clo_kernel_variant);
@@ -85,6 +85,22 @@ extern Bool VG_(owns_BigLock_LL) ( ThreadId tid );
    normal (non _LL) functions. */
 extern void VG_(vg_yield)(void);
 
+/* --parallel-execution=yes: let 'tid' run translated code without
+   holding the lock, and take the lock back afterwards. */
+extern void VG_(enter_parallel_code) ( ThreadId tid );
+extern void VG_(leave_parallel_code) ( ThreadId tid );
+
+/* Get all threads out of translated code, and keep them out until
+   the matching release, so it can be changed.  The caller must hold
+   the lock.  No-ops unless --parallel-execution=yes. */
+extern void VG_(acquire_code_exclusive) ( void );
+extern void VG_(release_code_exclusive) ( void );
+
+/* Are other threads running translated code right now, so that
+   VG_(acquire_code_exclusive) would have to stop them?  The caller
+   must hold the lock. */
+extern Bool VG_(parallel_code_running) ( void );
+
 // The scheduler.
 extern VgSchedReturnCode VG_(scheduler) ( ThreadId tid );
 
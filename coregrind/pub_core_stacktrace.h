@@ -56,6 +56,9 @@ UInt VG_(get_StackTrace_wrk) ( ThreadId tid_if_known,
                                UnwindStartRegs* startRegs,
                                Addr fp_max_orig );
 
+// Print statistics about stack unwinding, for --stats=yes.
+extern void VG_(print_stacktrace_stats) ( void );
+
 #endif   // __PUB_CORE_STACKTRACE_H
 
 /*--------------------------------------------------------------------*/
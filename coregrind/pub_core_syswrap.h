@@ -61,6 +61,9 @@ extern void VG_(reap_threads)(ThreadId self);
 // Release resources held by this thread
 extern void VG_(cleanup_thread) ( ThreadArchState* );
 
+/* Syscall counts and timings, gathered with --stats=yes. */
+extern void VG_(print_syscall_stats) ( void );
+
 /* fd leakage calls. */
 extern void VG_(init_preopened_fds) ( void );
 extern void VG_(show_open_fds) ( void );
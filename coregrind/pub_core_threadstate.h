@@ -353,6 +353,11 @@ typedef struct {
    /* Per-thread jmp_buf to resume scheduler after a signal */
    Bool               sched_jmpbuf_valid;
    VG_MINIMAL_JMP_BUF(sched_jmpbuf);
+
+   /* --parallel-execution=yes: is this thread running translated
+      code without holding the_BigLock?  Only changed by the thread
+      itself, holding the_BigLock. */
+   volatile Bool in_parallel_code;
 }
 ThreadState;
 
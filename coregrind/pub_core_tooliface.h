@@ -83,6 +83,7 @@ typedef
       Bool libc_freeres;
       Bool core_errors;
       Bool tool_errors;
+      Bool error_hash;
       Bool superblock_discards;
       Bool command_line_options;
       Bool client_requests;
@@ -92,6 +93,8 @@ typedef
       Bool malloc_replacement;
       Bool xml_output;
       Bool final_IR_tidy_pass;
+      Bool persistent_translations;
+      Bool thread_safe_instrumentation;
    } 
    VgNeeds;
 
@@ -127,6 +130,9 @@ typedef struct {
    Char* (*tool_get_error_name)              (Error*);
    Bool  (*tool_get_extra_suppression_info)  (Error*,/*OUT*/Char*,Int);
 
+   // VG_(needs).error_hash
+   UWord (*tool_hash_Error)                  (Error*);
+
    // VG_(needs).superblock_discards
    void (*tool_discard_superblock_info)(Addr64, VexGuestExtents);
 
@@ -0,0 +1,86 @@
+/*--------------------------------------------------------------------*/
+/*--- Persistent (on-disk) cache of translations.                  ---*/
+/*---                                        pub_core_transcache.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2000-2012 Julian Seward
+      jseward@acm.org
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __PUB_CORE_TRANSCACHE_H
+#define __PUB_CORE_TRANSCACHE_H
+
+//--------------------------------------------------------------------
+// PURPOSE: This module saves translations of file-backed code to
+// disk at exit (--translation-cache-dir=), and hands them back to
+// m_translate in later runs, so that they do not have to be pushed
+// through Vex again.  It is purely an accelerator: every translation
+// it hands out is checked against the guest code and the current
+// redirection/self-check/gdbserver state before being used.
+//--------------------------------------------------------------------
+
+/* Called once, after the tool's post_clo_init and after TT/TC have
+   been set up.  Decides whether the cache can be used with this tool
+   and configuration, and if not, clears
+   VG_(clo_translation_cache_dir). */
+extern void VG_(init_transcache) ( void );
+
+/* Check a candidate translation against the current state of the
+   world.  'opaque' is passed through from VG_(transcache_install).
+   Guest bytes and mappings have already been checked when this is
+   called. */
+typedef
+   Bool (*TransCacheCheckFn)( void* opaque,
+                              VexGuestExtents* vge, UInt sc_bitset );
+
+/* Look for a saved translation of 'nraddr' (which redirects to
+   'addr', with redirection kind 'kind').  If one is found and is
+   still valid, add it to TT/TC, copy its extents into *vge and
+   return True.  The cache file is read on the first call. */
+extern Bool VG_(transcache_install) ( Addr64 nraddr, Addr64 addr, UInt kind,
+                                      TransCacheCheckFn ok, void* opaque,
+                                      /*OUT*/VexGuestExtents* vge );
+
+/* Remember a freshly made translation so it can be saved at exit.
+   'code' must be the code as generated by Vex, before any patching
+   by m_transtab. */
+extern void VG_(transcache_record) ( Addr64 nraddr, Addr64 addr, UInt kind,
+                                     VexGuestExtents* vge, UInt sc_bitset,
+                                     UChar* code, UInt code_len,
+                                     UInt n_guest_instrs );
+
+/* Forget saved translations intersecting the given guest range.
+   Called from VG_(discard_translations). */
+extern void VG_(transcache_discard) ( Addr64 start, ULong range );
+
+/* Write the cache file.  Called at exit. */
+extern void VG_(transcache_save) ( void );
+
+extern void VG_(print_transcache_stats) ( void );
+
+#endif   // __PUB_CORE_TRANSCACHE_H
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
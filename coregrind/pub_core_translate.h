@@ -44,6 +44,14 @@ Bool VG_(translate) ( ThreadId tid,
                       ULong    bbs_done,
                       Bool     allow_redirection );
 
+/* --tiered-translation=yes: translate NRADDR again, as a trace
+   along its hot successors, once its quick translation has run COUNT
+   times.  Returns False, without disturbing thread TID, if it can't be
+   translated. */
+extern 
+Bool VG_(translate_hot) ( ThreadId tid, Addr64 nraddr, ULong count,
+                          ULong bbs_done );
+
 extern void VG_(print_translation_stats) ( void );
 
 #endif   // __PUB_CORE_TRANSLATE_H
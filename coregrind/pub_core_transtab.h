@@ -40,7 +40,8 @@
 #include "pub_core_transtab_asm.h"
 
 /* The fast-cache for tt-lookup.  Unused entries are denoted by .guest
-   == 1, which is assumed to be a bogus address for all guest code. */
+   == 1, which is assumed to be a bogus address for all guest code.
+   See pub_core_transtab_asm.h for its layout. */
 typedef
    struct { 
       Addr guest;
@@ -48,11 +49,30 @@ typedef
    }
    FastCacheEntry;
 
-extern __attribute__((aligned(16)))
+extern __attribute__((aligned(64)))
        FastCacheEntry VG_(tt_fast) [VG_TT_FAST_SIZE];
 
+/* The fast cache to be used when running thread tid: its own one if
+   --per-thread-fast-cache=yes, else VG_(tt_fast).  This is what
+   VG_(disp_run_translations) gets given. */
+extern FastCacheEntry* VG_(get_fast_cache) ( ThreadId tid );
+
+/* Look up guest_addr in the fast cache for thread tid, without
+   going to the full tables. */
+extern Bool VG_(lookup_fast_cache) ( /*OUT*/AddrH* res_hcode,
+                                     ThreadId tid, Addr guest_addr );
+
 #define TRANSTAB_BOGUS_GUEST_ADDR ((Addr)1)
 
+/* Default and maximum number of sectors the translation cache is
+   divided into (--num-transtab-sectors, --max-transtab-sectors). */
+#define N_SECTORS_DEFAULT 8
+#define MAX_N_SECTORS     24
+
+/* Maximum (and default) number of TT entries per sector
+   (--transtab-sector-entries).  Must be a prime <= 65535. */
+#define MAX_N_TTES_PER_SECTOR 65521
+
 extern void VG_(init_tt_tc)       ( void );
 
 extern
@@ -71,6 +91,11 @@ void VG_(tt_tc_do_chaining) ( void* from__patch_addr,
                               UInt  to_tteNo,
                               Bool  to_fastEP );
 
+/* Do the chaining requests which VG_(tt_tc_do_chaining) put off
+   because other threads were running translated code.  Called by
+   VG_(acquire_code_exclusive) once they have left it. */
+extern void VG_(tt_tc_do_queued_chaining) ( void );
+
 extern Bool VG_(search_transtab) ( /*OUT*/AddrH* res_hcode,
                                    /*OUT*/UInt*  res_sNo,
                                    /*OUT*/UInt*  res_tteNo,
@@ -80,6 +105,39 @@ extern Bool VG_(search_transtab) ( /*OUT*/AddrH* res_hcode,
 extern void VG_(discard_translations) ( Addr64 start, ULong range,
                                         HChar* who );
 
+/* --tiered-translation=yes: find and delete up to max_n quick
+   translations which have become hot, giving their entry addresses
+   in hot[] and how often they ran in counts[].  Looks at only part
+   of TT on each call. */
+extern UInt VG_(take_hot_translations) ( /*OUT*/Addr64* hot,
+                                         /*OUT*/ULong* counts, UInt max_n );
+
+/* --tiered-translation=yes: how often has the translation of
+   guest_addr run?  False if there is none. */
+extern Bool VG_(get_tier_count) ( Addr64 guest_addr, /*OUT*/ULong* count );
+
+/* --smc-check=pageprot: write-protect the pages that code in
+   [start, start+len) is in, returning False if that isn't possible and
+   the translation must check itself. */
+extern Bool VG_(pageprot_cover)        ( Addr start, SizeT len );
+
+/* --smc-check=pageprot: deal with a permissions fault at 'a' taken
+   by translated code, returning True if it was caused by such
+   protection.  Safe to call from a signal handler.  The page's
+   translations are only thrown away by the next call to
+   VG_(pageprot_discard_pending), which the scheduler makes as soon as
+   the thread stops running translations. */
+extern Bool VG_(pageprot_handle_fault)     ( Addr a );
+extern void VG_(pageprot_discard_pending)  ( void );
+
+/* --smc-check=pageprot: thread tid's syscall is about to write
+   [start, start+len), or some unknown part of memory; unprotect it
+   and keep it unprotected until VG_(pageprot_post_syscall). */
+extern void VG_(pageprot_pre_write)         ( ThreadId tid,
+                                              Addr start, SizeT len );
+extern void VG_(pageprot_pre_write_unknown) ( ThreadId tid );
+extern void VG_(pageprot_post_syscall)      ( ThreadId tid );
+
 extern void VG_(print_tt_tc_stats) ( void );
 
 extern UInt VG_(get_bbs_translated) ( void );
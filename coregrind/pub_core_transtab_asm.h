@@ -31,10 +31,22 @@
 #ifndef __PUB_CORE_TRANSTAB_ASM_H
 #define __PUB_CORE_TRANSTAB_ASM_H
 
-/* Constants for the fast translation lookup cache.  It is a direct
-   mapped cache, with 2^VG_TT_FAST_BITS entries.
-
-   On x86/amd64, the cache index is computed as
+/* Constants for the fast translation lookup cache.  It has
+   2^VG_TT_FAST_BITS entries, arranged as 2^VG_TT_FAST_SET_BITS sets
+   of VG_TT_FAST_WAYS entries each.  Set N occupies entries
+   [N * VG_TT_FAST_WAYS .. N * VG_TT_FAST_WAYS + VG_TT_FAST_WAYS - 1],
+   with the most recently used entry first.
+
+   On x86-linux and amd64-linux the cache is 4-way set associative,
+   and the set number is computed as 'address ^ (address >>
+   VG_TT_FAST_SET_BITS)', masked to VG_TT_FAST_SET_BITS bits.  Folding
+   in the higher bits stops code laid out at power-of-two strides
+   (vtables, switch tables, large functions) from all landing in the
+   same few sets.  A set is 64 bytes on amd64, a single cache line.
+
+   Elsewhere it is direct mapped (VG_TT_FAST_WAYS == 1), and:
+
+   On x86/amd64 (Darwin), the cache index is computed as
    'address[VG_TT_FAST_BITS-1 : 0]'.
 
    On ppc32/ppc64, the bottom two bits of instruction addresses are
@@ -53,10 +65,24 @@
 #define VG_TT_FAST_SIZE (1 << VG_TT_FAST_BITS)
 #define VG_TT_FAST_MASK ((VG_TT_FAST_SIZE) - 1)
 
+#if defined(VGP_x86_linux) || defined(VGP_amd64_linux)
+#  define VG_TT_FAST_WAYS_BITS 2
+#else
+#  define VG_TT_FAST_WAYS_BITS 0
+#endif
+#define VG_TT_FAST_WAYS     (1 << VG_TT_FAST_WAYS_BITS)
+#define VG_TT_FAST_SET_BITS (VG_TT_FAST_BITS - VG_TT_FAST_WAYS_BITS)
+#define VG_TT_FAST_SET_MASK ((1 << VG_TT_FAST_SET_BITS) - 1)
+
 /* This macro isn't usable in asm land; nevertheless this seems
-   like a good place to put it. */
+   like a good place to put it.  It gives the set number. */
+
+#if defined(VGP_x86_linux) || defined(VGP_amd64_linux)
+#  define VG_TT_FAST_HASH(_addr)  \
+      ((((UWord)(_addr)) ^ (((UWord)(_addr)) >> VG_TT_FAST_SET_BITS)) \
+       & VG_TT_FAST_SET_MASK)
 
-#if defined(VGA_x86) || defined(VGA_amd64)
+#elif defined(VGA_x86) || defined(VGA_amd64)
 #  define VG_TT_FAST_HASH(_addr)  ((((UWord)(_addr))     ) & VG_TT_FAST_MASK)
 
 #elif defined(VGA_s390x) || defined(VGA_arm)
@@ -0,0 +1,69 @@
+
+/*--------------------------------------------------------------------*/
+/*--- Use of the host's vDSO for time syscalls.                    ---*/
+/*---                                              pub_core_vdso.h ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   Copyright (C) 2000-2012 Julian Seward
+      jseward@acm.org
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#ifndef __PUB_CORE_VDSO_H
+#define __PUB_CORE_VDSO_H
+
+//--------------------------------------------------------------------
+// PURPOSE: The client never sees the kernel's vDSO, so it makes real
+// clock_gettime and gettimeofday syscalls, which are far slower than
+// the vDSO calls the program would make natively.  With
+// --vdso-time=yes this module keeps the vDSO mapped (as a Valgrind
+// mapping) and lets the syscall wrappers answer those two syscalls
+// by calling it directly.
+//--------------------------------------------------------------------
+
+/* Called from the initial image setup with the address given by
+   AT_SYSINFO_EHDR.  Returns True if the vDSO is going to be used, in
+   which case the caller must leave it mapped; False if the caller
+   should get rid of it as usual. */
+extern Bool VG_(vdso_init) ( Addr ehdr );
+
+/* Try to do clock_gettime(clk, ts) via the vDSO.  Returns False if
+   that is not possible (no usable vDSO, or a clock it cannot read),
+   in which case the syscall must be done for real.  Otherwise *res
+   holds the result.  'ts' must be writable. */
+extern Bool VG_(vdso_clock_gettime) ( Int clk, struct vki_timespec* ts,
+                                      /*OUT*/SysRes* res );
+
+/* Likewise for gettimeofday(tv, tz).  Either pointer may be NULL. */
+extern Bool VG_(vdso_gettimeofday) ( struct vki_timeval* tv,
+                                     struct vki_timezone* tz,
+                                     /*OUT*/SysRes* res );
+
+/* Print statistics (for --stats=yes). */
+extern void VG_(print_vdso_stats) ( void );
+
+#endif   // __PUB_CORE_VDSO_H
+
+/*--------------------------------------------------------------------*/
+/*--- end                                                          ---*/
+/*--------------------------------------------------------------------*/
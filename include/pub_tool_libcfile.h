@@ -77,8 +77,17 @@ extern void   VG_(close)  ( Int fd );
 extern Int    VG_(read)   ( Int fd, void* buf, Int count);
 extern Int    VG_(write)  ( Int fd, const void* buf, Int count);
 extern Int    VG_(pipe)   ( Int fd[2] );
+
+/* Move an fd into the Valgrind-safe range, where the client can't
+   see or close it.  Returns the new fd; the old one is closed.  The
+   range is small, so tools should only keep a few fds there. */
+extern Int    VG_(safe_fd) ( Int oldfd );
 extern Off64T VG_(lseek)  ( Int fd, Off64T offset, Int whence );
 
+/* Close every fd, the client's and Valgrind's, except keep_fd and the
+   log and XML output fds.  For helper processes. */
+extern void   VG_(close_fds_except) ( Int keep_fd );
+
 extern SysRes VG_(stat)   ( const Char* file_name, struct vg_stat* buf );
 extern Int    VG_(fstat)  ( Int   fd,        struct vg_stat* buf );
 extern SysRes VG_(dup)    ( Int oldfd );
@@ -97,6 +106,12 @@ extern Char*  VG_(dirname) ( const Char* path );
 /* Return the name of a directory for temporary files. */
 extern const HChar* VG_(tmpdir)(void);
 
+/* Create and open (-rw------) a tmp file name incorporating said arg.
+   Returns -1 on failure, else the fd of the file.  If fullname is
+   non-NULL, the file's name is written into it.  The number of bytes
+   written is guaranteed not to exceed 64+strlen(part_of_name). */
+extern Int VG_(mkstemp) ( HChar* part_of_name, /*OUT*/HChar* fullname );
+
 /* Copy the working directory at startup into buf[0 .. size-1], or return
    False if buf is too small. */
 extern Bool VG_(get_startup_wd) ( Char* buf, SizeT size );
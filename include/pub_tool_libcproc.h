@@ -55,6 +55,12 @@ extern const Char* VG_(LD_PRELOAD_var_name);
 extern Int  VG_(waitpid)( Int pid, Int *status, Int options );
 extern Int  VG_(system) ( Char* cmd );
 extern Int  VG_(fork)   ( void);
+// Like VG_(fork), but the parent is not sent a signal when the child
+// exits, so that helper processes forked by Valgrind itself never
+// cause a SIGCHLD to be delivered to the client.  Reap the child with
+// VG_(waitpid)(pid, &status, __VKI_WCLONE).  Returns -1 on failure,
+// and always on platforms which cannot do it.
+extern Int  VG_(fork_quietly) ( void );
 extern void VG_(execv)  ( Char* filename, Char** argv );
 
 /* ---------------------------------------------------------------------
@@ -173,6 +173,13 @@ extern Int   VG_(clo_backtrace_size);
 /* Continue stack traces below main()?  Default: NO */
 extern Bool VG_(clo_show_below_main);
 
+/* Do threads run translated code in parallel (--parallel-execution)?
+   This is switched off again if the tool doesn't call
+   VG_(needs_thread_safe_instrumentation), so it is only final once the
+   tool's post_clo_init has returned.  Tool-visible so that a tool can
+   use thread-safe instrumentation only when it is needed. */
+extern Bool VG_(clo_parallel_execution);
+
 
 /* Used to expand file names.  "option_name" is the option name, eg.
    "--log-file".  'format' is what follows, eg. "cachegrind.out.%p".  In
@@ -46,6 +46,12 @@
 /* Get the TID of the thread which currently has the CPU. */
 extern ThreadId VG_(get_running_tid) ( void );
 
+/* Get the TID of the thread whose guest state is at 'gst'.  Helpers
+   called from instrumented code can get 'gst' by setting needsBBP in
+   the IRDirty; unlike VG_(get_running_tid), this also works while
+   threads run in parallel (--parallel-execution=yes). */
+extern ThreadId VG_(get_tid_from_guest_state) ( void* gst );
+
 #endif   // __PUB_TOOL_THREADSTATE_H
 
 /*--------------------------------------------------------------------*/
@@ -345,6 +345,17 @@ extern void VG_(needs_tool_errors) (
                                         /*OUT*/Char* buf, Int nBuf)
 );
 
+/* Optional companion to VG_(needs_tool_errors): hash the tool-specific
+   part of an error.  The core uses it, together with the error kind
+   and the top of the stack trace, to index errors so that a new error
+   is only compared with eq_Error against likely duplicates.  Errors
+   which eq_Error considers equal at any resolution must hash the same,
+   so only parts of the error which eq_Error always compares may be
+   used. */
+extern void VG_(needs_error_hash) (
+   UWord (*hash_Error)(Error* err)
+);
+
 /* Is information kept by the tool about specific instructions or
    translations?  (Eg. for cachegrind there are cost-centres for every
    instruction, stored in a per-translation fashion.)  If so, the info
@@ -468,6 +479,20 @@ extern void VG_(needs_xml_output) ( void );
    function here. */
 extern void VG_(needs_final_IR_tidy_pass) ( IRSB*(*final_tidy)(IRSB*) );
 
+/* Can translations made by this tool be saved and reused by a later
+   run (--translation-cache-dir=)?  This is only so if the
+   instrumentation is a function of nothing but the guest code and the
+   command line -- in particular it must not contain pointers to data
+   allocated at translation time, such as per-instruction counters. */
+extern void VG_(needs_persistent_translations) ( void );
+
+/* Can threads run this tool's instrumented code at the same time
+   (--parallel-execution=yes)?  This is only so if nothing called
+   from instrumented code -- helpers and tracked events alike --
+   touches state shared between threads, since the core's locking
+   does not cover translated code. */
+extern void VG_(needs_thread_safe_instrumentation) ( void );
+
 
 /* ------------------------------------------------------------------ */
 /* Core events to track */
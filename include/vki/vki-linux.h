@@ -267,6 +267,10 @@ struct vki_sysinfo {
 #define VKI_CLOCK_MONOTONIC           1
 #define VKI_CLOCK_PROCESS_CPUTIME_ID  2
 #define VKI_CLOCK_THREAD_CPUTIME_ID   3
+#define VKI_CLOCK_MONOTONIC_RAW       4
+#define VKI_CLOCK_REALTIME_COARSE     5
+#define VKI_CLOCK_MONOTONIC_COARSE    6
+#define VKI_CLOCK_BOOTTIME            7
 
 struct vki_timespec {
 	vki_time_t	tv_sec;		/* seconds */
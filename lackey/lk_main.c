@@ -177,6 +177,7 @@
 #include "pub_tool_libcbase.h"
 #include "pub_tool_options.h"
 #include "pub_tool_machine.h"     // VG_(fnptr_to_fnentry)
+#include "pub_tool_threadstate.h" // VG_(get_tid_from_guest_state)
 
 /*------------------------------------------------------------*/
 /*--- Command line options                                 ---*/
@@ -232,7 +233,26 @@ static void lk_print_debug_usage(void)
 /*--- Stuff for --basic-counts                             ---*/
 /*------------------------------------------------------------*/
 
-/* Nb: use ULongs because the numbers can get very big */
+/* Nb: use ULongs because the numbers can get very big.  Each thread
+ * counts in its own BasicCounts, so that threads can run instrumented code
+ * at the same time (--parallel-execution=yes); lk_fini adds them up. */
+typedef
+   struct {
+      ULong func_calls;
+      ULong SBs_entered;
+      ULong SBs_completed;
+      ULong IRStmts;
+      ULong guest_instrs;
+      ULong Jccs;
+      ULong Jccs_untaken;
+      ULong IJccs;
+      ULong IJccs_untaken;
+   }
+   BasicCounts;
+
+static BasicCounts basicCounts[VG_N_THREADS];
+
+/* The totals over all threads. */
 static ULong n_func_calls    = 0;
 static ULong n_SBs_entered   = 0;
 static ULong n_SBs_completed = 0;
@@ -243,49 +263,81 @@ static ULong n_Jccs_untaken  = 0;
 static ULong n_IJccs         = 0;
 static ULong n_IJccs_untaken = 0;
 
-static void add_one_func_call(void)
+/* The helpers below are passed the guest state of the thread running
+ * them, which tells them whose counts to update. */
+#define BASIC_COUNTS(gst) \
+   (&basicCounts[VG_(get_tid_from_guest_state)(gst)])
+
+static void add_one_func_call(void* gst)
 {
-   n_func_calls++;
+   BASIC_COUNTS(gst)->func_calls++;
 }
 
-static void add_one_SB_entered(void)
+static void add_one_SB_entered(void* gst)
 {
-   n_SBs_entered++;
+   BASIC_COUNTS(gst)->SBs_entered++;
 }
 
-static void add_one_SB_completed(void)
+static void add_one_SB_completed(void* gst)
 {
-   n_SBs_completed++;
+   BASIC_COUNTS(gst)->SBs_completed++;
 }
 
-static void add_one_IRStmt(void)
+static void add_one_IRStmt(void* gst)
 {
-   n_IRStmts++;
+   BASIC_COUNTS(gst)->IRStmts++;
 }
 
-static void add_one_guest_instr(void)
+static void add_one_guest_instr(void* gst)
 {
-   n_guest_instrs++;
+   BASIC_COUNTS(gst)->guest_instrs++;
 }
 
-static void add_one_Jcc(void)
+static void add_one_Jcc(void* gst)
 {
-   n_Jccs++;
+   BASIC_COUNTS(gst)->Jccs++;
 }
 
-static void add_one_Jcc_untaken(void)
+static void add_one_Jcc_untaken(void* gst)
 {
-   n_Jccs_untaken++;
+   BASIC_COUNTS(gst)->Jccs_untaken++;
 }
 
-static void add_one_inverted_Jcc(void)
+static void add_one_inverted_Jcc(void* gst)
 {
-   n_IJccs++;
+   BASIC_COUNTS(gst)->IJccs++;
 }
 
-static void add_one_inverted_Jcc_untaken(void)
+static void add_one_inverted_Jcc_untaken(void* gst)
 {
-   n_IJccs_untaken++;
+   BASIC_COUNTS(gst)->IJccs_untaken++;
+}
+
+/* A helper that adds a call to one of the add_one_* functions. */
+static void instrument_basic(IRSB* sb, HChar* name, void* fn)
+{
+   IRDirty* di = unsafeIRDirty_0_N( 0, name, VG_(fnptr_to_fnentry)( fn ),
+                                       mkIRExprVec_0() );
+   di->needsBBP = True;
+   addStmtToIRSB( sb, IRStmt_Dirty(di) );
+}
+
+/* Add up the counts of all threads. */
+static void sum_basic_counts(void)
+{
+   ThreadId tid;
+   for (tid = 0; tid < VG_N_THREADS; tid++) {
+      BasicCounts* c = &basicCounts[tid];
+      n_func_calls    += c->func_calls;
+      n_SBs_entered   += c->SBs_entered;
+      n_SBs_completed += c->SBs_completed;
+      n_IRStmts       += c->IRStmts;
+      n_guest_instrs  += c->guest_instrs;
+      n_Jccs          += c->Jccs;
+      n_Jccs_untaken  += c->Jccs_untaken;
+      n_IJccs         += c->IJccs;
+      n_IJccs_untaken += c->IJccs_untaken;
+   }
 }
 
 /*------------------------------------------------------------*/
@@ -342,13 +394,14 @@ static HChar* nameOfTypeIndex ( Int i )
 
 /* --- Counts --- */
 
-static ULong detailCounts[N_OPS][N_TYPES];
+/* Kept per thread, like the basic counts. */
+static ULong detailCounts[VG_N_THREADS][N_OPS][N_TYPES];
 
 /* The helper that is called from the instrumented code. */
-static VG_REGPARM(1)
-void increment_detail(ULong* detail)
+static void increment_detail(void* gst, UWord detail)
 {
-   (*detail)++;
+   ThreadId tid = VG_(get_tid_from_guest_state)(gst);
+   (&detailCounts[tid][0][0])[detail]++;
 }
 
 /* A helper that adds the instrumentation for a detail. */
@@ -361,25 +414,37 @@ static void instrument_detail(IRSB* sb, Op op, IRType type)
    tl_assert(op < N_OPS);
    tl_assert(typeIx < N_TYPES);
 
-   argv = mkIRExprVec_1( mkIRExpr_HWord( (HWord)&detailCounts[op][typeIx] ) );
-   di = unsafeIRDirty_0_N( 1, "increment_detail",
+   argv = mkIRExprVec_1( mkIRExpr_HWord( op * N_TYPES + typeIx ) );
+   di = unsafeIRDirty_0_N( 0, "increment_detail",
                               VG_(fnptr_to_fnentry)( &increment_detail ), 
                               argv);
+   di->needsBBP = True;
    addStmtToIRSB( sb, IRStmt_Dirty(di) );
 }
 
 /* Summarize and print the details. */
 static void print_details ( void )
 {
-   Int typeIx;
+   ULong    totals[N_OPS][N_TYPES];
+   ThreadId tid;
+   Int      op, typeIx;
+
+   for (op = 0; op < N_OPS; op++) {
+      for (typeIx = 0; typeIx < N_TYPES; typeIx++) {
+         totals[op][typeIx] = 0;
+         for (tid = 0; tid < VG_N_THREADS; tid++)
+            totals[op][typeIx] += detailCounts[tid][op][typeIx];
+      }
+   }
+
    VG_(umsg)("   Type        Loads       Stores       AluOps\n");
    VG_(umsg)("   -------------------------------------------\n");
    for (typeIx = 0; typeIx < N_TYPES; typeIx++) {
       VG_(umsg)("   %4s %'12llu %'12llu %'12llu\n",
                 nameOfTypeIndex( typeIx ),
-                detailCounts[OpLoad ][typeIx],
-                detailCounts[OpStore][typeIx],
-                detailCounts[OpAlu  ][typeIx]
+                totals[OpLoad ][typeIx],
+                totals[OpStore][typeIx],
+                totals[OpAlu  ][typeIx]
       );
    }
 }
@@ -591,13 +656,11 @@ static void trace_superblock(Addr addr)
 
 static void lk_post_clo_init(void)
 {
-   Int op, tyIx;
-
-   if (clo_detailed_counts) {
-      for (op = 0; op < N_OPS; op++)
-         for (tyIx = 0; tyIx < N_TYPES; tyIx++)
-            detailCounts[op][tyIx] = 0;
-   }
+   /* The counts are kept per thread, but the traces are printed as
+      they happen, and several threads printing at once would mix up
+      their lines. */
+   if (!clo_trace_mem && !clo_trace_sbs)
+      VG_(needs_thread_safe_instrumentation) ();
 }
 
 static
@@ -634,10 +697,7 @@ IRSB* lk_instrument ( VgCallbackClosure* closure,
 
    if (clo_basic_counts) {
       /* Count this superblock. */
-      di = unsafeIRDirty_0_N( 0, "add_one_SB_entered", 
-                                 VG_(fnptr_to_fnentry)( &add_one_SB_entered ),
-                                 mkIRExprVec_0() );
-      addStmtToIRSB( sbOut, IRStmt_Dirty(di) );
+      instrument_basic( sbOut, "add_one_SB_entered", &add_one_SB_entered );
    }
 
    if (clo_trace_sbs) {
@@ -660,10 +720,7 @@ IRSB* lk_instrument ( VgCallbackClosure* closure,
 
       if (clo_basic_counts) {
          /* Count one VEX statement. */
-         di = unsafeIRDirty_0_N( 0, "add_one_IRStmt", 
-                                    VG_(fnptr_to_fnentry)( &add_one_IRStmt ), 
-                                    mkIRExprVec_0() );
-         addStmtToIRSB( sbOut, IRStmt_Dirty(di) );
+         instrument_basic( sbOut, "add_one_IRStmt", &add_one_IRStmt );
       }
       
       switch (st->tag) {
@@ -682,10 +739,7 @@ IRSB* lk_instrument ( VgCallbackClosure* closure,
                ilen  = st->Ist.IMark.len;
 
                /* Count guest instruction. */
-               di = unsafeIRDirty_0_N( 0, "add_one_guest_instr",
-                                          VG_(fnptr_to_fnentry)( &add_one_guest_instr ), 
-                                          mkIRExprVec_0() );
-               addStmtToIRSB( sbOut, IRStmt_Dirty(di) );
+               instrument_basic( sbOut, "add_one_guest_instr", &add_one_guest_instr );
 
                /* An unconditional branch to a known destination in the
                 * guest's instructions can be represented, in the IRSB to
@@ -704,11 +758,8 @@ IRSB* lk_instrument ( VgCallbackClosure* closure,
                if (VG_(get_fnname_if_entry)(st->Ist.IMark.addr, 
                                             fnname, sizeof(fnname))
                    && 0 == VG_(strcmp)(fnname, clo_fnname)) {
-                  di = unsafeIRDirty_0_N( 
-                          0, "add_one_func_call", 
-                             VG_(fnptr_to_fnentry)( &add_one_func_call ), 
-                             mkIRExprVec_0() );
-                  addStmtToIRSB( sbOut, IRStmt_Dirty(di) );
+                  instrument_basic( sbOut, "add_one_func_call",
+                                           &add_one_func_call );
                }
             }
             if (clo_trace_mem) {
@@ -853,16 +904,10 @@ IRSB* lk_instrument ( VgCallbackClosure* closure,
 
                /* Count Jcc */
                if (!condition_inverted)
-                  di = unsafeIRDirty_0_N( 0, "add_one_Jcc", 
-                                          VG_(fnptr_to_fnentry)( &add_one_Jcc ), 
-                                          mkIRExprVec_0() );
+                  instrument_basic( sbOut, "add_one_Jcc", &add_one_Jcc );
                else
-                  di = unsafeIRDirty_0_N( 0, "add_one_inverted_Jcc",
-                                          VG_(fnptr_to_fnentry)(
-                                             &add_one_inverted_Jcc ),
-                                          mkIRExprVec_0() );
-
-               addStmtToIRSB( sbOut, IRStmt_Dirty(di) );
+                  instrument_basic( sbOut, "add_one_inverted_Jcc",
+                                           &add_one_inverted_Jcc );
             }
             if (clo_trace_mem) {
                flushEvents(sbOut);
@@ -873,17 +918,11 @@ IRSB* lk_instrument ( VgCallbackClosure* closure,
             if (clo_basic_counts) {
                /* Count non-taken Jcc */
                if (!condition_inverted)
-                  di = unsafeIRDirty_0_N( 0, "add_one_Jcc_untaken", 
-                                          VG_(fnptr_to_fnentry)(
-                                             &add_one_Jcc_untaken ),
-                                          mkIRExprVec_0() );
+                  instrument_basic( sbOut, "add_one_Jcc_untaken",
+                                           &add_one_Jcc_untaken );
                else
-                  di = unsafeIRDirty_0_N( 0, "add_one_inverted_Jcc_untaken",
-                                          VG_(fnptr_to_fnentry)(
-                                             &add_one_inverted_Jcc_untaken ),
-                                          mkIRExprVec_0() );
-
-               addStmtToIRSB( sbOut, IRStmt_Dirty(di) );
+                  instrument_basic( sbOut, "add_one_inverted_Jcc_untaken",
+                                           &add_one_inverted_Jcc_untaken );
             }
             break;
 
@@ -894,10 +933,7 @@ IRSB* lk_instrument ( VgCallbackClosure* closure,
 
    if (clo_basic_counts) {
       /* Count this basic block. */
-      di = unsafeIRDirty_0_N( 0, "add_one_SB_completed", 
-                                 VG_(fnptr_to_fnentry)( &add_one_SB_completed ),
-                                 mkIRExprVec_0() );
-      addStmtToIRSB( sbOut, IRStmt_Dirty(di) );
+      instrument_basic( sbOut, "add_one_SB_completed", &add_one_SB_completed );
    }
 
    if (clo_trace_mem) {
@@ -918,8 +954,11 @@ static void lk_fini(Int exitcode)
    tl_assert(clo_fnname[0]);
 
    if (clo_basic_counts) {
-      ULong total_Jccs = n_Jccs + n_IJccs;
-      ULong taken_Jccs = (n_Jccs - n_Jccs_untaken) + n_IJccs_untaken;
+      ULong total_Jccs, taken_Jccs;
+
+      sum_basic_counts();
+      total_Jccs = n_Jccs + n_IJccs;
+      taken_Jccs = (n_Jccs - n_Jccs_untaken) + n_IJccs_untaken;
 
       VG_(umsg)("Counted %'llu call%s to %s()\n",
                 n_func_calls, ( n_func_calls==1 ? "" : "s" ), clo_fnname);
@@ -1077,6 +1077,36 @@ Bool MC_(eq_Error) ( VgRes res, Error* e1, Error* e2 )
    }
 }
 
+/* Hash the parts of an error which MC_(eq_Error) compares, so that
+   errors it considers equal hash the same. */
+static UWord hash_string ( const Char* s )
+{
+   UWord h = 0;
+   for (; *s; s++)
+      h = (h << 5) + h + (UChar)*s;
+   return h;
+}
+
+UWord MC_(hash_Error) ( Error* err )
+{
+   MC_Error* extra = VG_(get_error_extra)(err);
+
+   switch (VG_(get_error_kind)(err)) {
+      case Err_CoreMem:
+      case Err_RegParam:
+      case Err_MemParam:
+         return hash_string(VG_(get_error_string)(err));
+      case Err_User:
+         return extra->Err.User.isAddrErr;
+      case Err_Addr:
+         return extra->Err.Addr.szB;
+      case Err_Value:
+         return extra->Err.Value.szB;
+      default:
+         return 0;
+   }
+}
+
 /* Functions used when searching MC_Chunk lists */
 static
 Bool addr_is_in_MC_Chunk_default_REDZONE_SZB(MC_Chunk* mc, Addr a)
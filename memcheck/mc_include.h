@@ -323,11 +323,16 @@ typedef
       LeakCheckDeltaMode deltamode;
       UInt max_loss_records_output;       // limit on the nr of loss records output.
       Bool requested_by_monitor_command; // True when requested by gdb/vgdb.
+      Bool background;  // Search in a forked child, report later.
    }
    LeakCheckParams;
 
 void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams * lcp);
 
+// If a background leak search is running, waits for it to finish and
+// reports its results.
+void MC_(finish_background_leak_search) ( ThreadId tid );
+
 // maintains the lcp.deltamode given in the last call to detect_memory_leaks
 extern LeakCheckDeltaMode MC_(detect_memory_leaks_last_delta_mode);
 
@@ -368,6 +373,7 @@ extern Bool MC_(any_value_errors);
 /* Standard functions for error and suppressions as required by the
    core/tool iface */
 Bool MC_(eq_Error)           ( VgRes res, Error* e1, Error* e2 );
+UWord MC_(hash_Error)        ( Error* err );
 void MC_(before_pp_Error)    ( Error* err );
 void MC_(pp_Error)           ( Error* err );
 UInt MC_(update_Error_extra) ( Error* err );
@@ -464,6 +470,10 @@ extern Bool MC_(clo_show_reachable);
 /* In leak check, show possibly-lost blocks?  default: YES */
 extern Bool MC_(clo_show_possibly_lost);
 
+/* Do leak checks requested by client requests in a forked child,
+   reporting them later?  default: NO */
+extern Bool MC_(clo_background_leak_check);
+
 /* Assume accesses immediately below %esp are due to gcc-2.96 bugs.
  * default: NO */
 extern Bool MC_(clo_workaround_gcc296_bugs);
@@ -502,6 +512,11 @@ extern Int MC_(clo_free_fill);
 */
 extern Int MC_(clo_mc_level);
 
+/* Find the shadow of addresses above the main primary map with
+   a direct table, rather than by searching the auxiliary primary
+   map?  default: YES */
+extern Bool MC_(clo_high_shadow_map);
+
 
 /*------------------------------------------------------------*/
 /*--- Instrumentation                                      ---*/
@@ -36,7 +36,9 @@
 #include "pub_tool_hashtable.h"
 #include "pub_tool_libcbase.h"
 #include "pub_tool_libcassert.h"
+#include "pub_tool_libcfile.h"
 #include "pub_tool_libcprint.h"
+#include "pub_tool_libcproc.h"
 #include "pub_tool_libcsignal.h"
 #include "pub_tool_machine.h"
 #include "pub_tool_mallocfree.h"
@@ -480,6 +482,10 @@ static Int  lc_markstack_top;
 // (Nb: We don't keep track of how many register bytes we've scanned.)
 static SizeT lc_scanned_szB;
 
+// Set in the child process doing a background leak search, which must
+// not print anything.
+static Bool lc_in_bg_child = False;
+
 
 SizeT MC_(bytes_leaked)     = 0;
 SizeT MC_(bytes_indirect)   = 0;
@@ -952,21 +958,10 @@ static void get_printing_rules(LeakCheckParams* lcp,
         Possible  == lr->key.state );
 }
 
-static void print_results(ThreadId tid, LeakCheckParams* lcp)
+// Gets lr_table ready to receive the loss records of a new leak search.
+static void reset_lr_table(void)
 {
-   Int          i, n_lossrecords, start_lr_output_scan;
-   LossRecord*  lr;
-   Bool         is_suppressed;
-   SizeT        old_bytes_leaked      = MC_(bytes_leaked); /* to report delta in summary */
-   SizeT        old_bytes_indirect    = MC_(bytes_indirect); 
-   SizeT        old_bytes_dubious     = MC_(bytes_dubious); 
-   SizeT        old_bytes_reachable   = MC_(bytes_reachable); 
-   SizeT        old_bytes_suppressed  = MC_(bytes_suppressed); 
-   SizeT        old_blocks_leaked     = MC_(blocks_leaked);
-   SizeT        old_blocks_indirect   = MC_(blocks_indirect);
-   SizeT        old_blocks_dubious    = MC_(blocks_dubious);
-   SizeT        old_blocks_reachable  = MC_(blocks_reachable);
-   SizeT        old_blocks_suppressed = MC_(blocks_suppressed);
+   Int i, n_lossrecords;
 
    if (lr_table == NULL)
       // Create the lr_table, which holds the loss records.
@@ -1000,45 +995,73 @@ static void print_results(ThreadId tid, LeakCheckParams* lcp)
       }
    }
    // lr_array now contains "invalid" loss records => free it.
-   // lr_array will be re-created below with the kept and new loss records.
+   // lr_array will be re-created by print_results with the kept and
+   // new loss records.
    VG_(free) (lr_array);
    lr_array = NULL;
+}
+
+// Adds num_blocks blocks with the given key and sizes to lr_table,
+// merging them with the loss record there for the key, if any.
+static void add_to_lr_table(LossRecordKey* lrkey, SizeT szB,
+                            SizeT indirect_szB, UInt num_blocks)
+{
+   LossRecord* lr = VG_(OSetGen_Lookup)(lr_table, lrkey);
+   if (lr) {
+      // We found an existing loss record matching this key.  Update the
+      // loss record's details in-situ.  This is safe because we don't
+      // change the elements used as the OSet key.
+      lr->szB          += szB;
+      lr->indirect_szB += indirect_szB;
+      lr->num_blocks   += num_blocks;
+   } else {
+      // No existing loss record matches this key.  Create a new loss
+      // record, initialise it, and insert it into lr_table.
+      lr = VG_(OSetGen_AllocNode)(lr_table, sizeof(LossRecord));
+      lr->key              = *lrkey;
+      lr->szB              = szB;
+      lr->indirect_szB     = indirect_szB;
+      lr->num_blocks       = num_blocks;
+      lr->old_szB          = 0;
+      lr->old_indirect_szB = 0;
+      lr->old_num_blocks   = 0;
+      VG_(OSetGen_Insert)(lr_table, lr);
+   }
+}
 
-   // Convert the chunks into loss records, merging them where appropriate.
+// Converts the chunks into loss records, merging them where appropriate.
+static void add_chunks_to_lr_table(void)
+{
+   Int i;
    for (i = 0; i < lc_n_chunks; i++) {
       MC_Chunk*     ch = lc_chunks[i];
       LC_Extra*     ex = &(lc_extras)[i];
-      LossRecord*   old_lr;
       LossRecordKey lrkey;
       lrkey.state        = ex->state;
       lrkey.allocated_at = ch->where;
-
-      old_lr = VG_(OSetGen_Lookup)(lr_table, &lrkey);
-      if (old_lr) {
-         // We found an existing loss record matching this chunk.  Update the
-         // loss record's details in-situ.  This is safe because we don't
-         // change the elements used as the OSet key.
-         old_lr->szB          += ch->szB;
-         if (ex->state == Unreached)
-            old_lr->indirect_szB += ex->IorC.indirect_szB;
-         old_lr->num_blocks++;
-      } else {
-         // No existing loss record matches this chunk.  Create a new loss
-         // record, initialise it from the chunk, and insert it into lr_table.
-         lr = VG_(OSetGen_AllocNode)(lr_table, sizeof(LossRecord));
-         lr->key              = lrkey;
-         lr->szB              = ch->szB;
-         if (ex->state == Unreached)
-            lr->indirect_szB     = ex->IorC.indirect_szB;
-         else
-            lr->indirect_szB     = 0;
-         lr->num_blocks       = 1;
-         lr->old_szB          = 0;
-         lr->old_indirect_szB = 0;
-         lr->old_num_blocks   = 0;
-         VG_(OSetGen_Insert)(lr_table, lr);
-      }
+      add_to_lr_table(&lrkey, ch->szB,
+                      ex->state == Unreached ? ex->IorC.indirect_szB : 0,
+                      1);
    }
+}
+
+// Prints the loss records in lr_table, which reset_lr_table and then
+// add_to_lr_table have filled in.
+static void print_results(ThreadId tid, LeakCheckParams* lcp)
+{
+   Int          i, n_lossrecords, start_lr_output_scan;
+   LossRecord*  lr;
+   Bool         is_suppressed;
+   SizeT        old_bytes_leaked      = MC_(bytes_leaked); /* to report delta in summary */
+   SizeT        old_bytes_indirect    = MC_(bytes_indirect); 
+   SizeT        old_bytes_dubious     = MC_(bytes_dubious); 
+   SizeT        old_bytes_reachable   = MC_(bytes_reachable); 
+   SizeT        old_bytes_suppressed  = MC_(bytes_suppressed); 
+   SizeT        old_blocks_leaked     = MC_(blocks_leaked);
+   SizeT        old_blocks_indirect   = MC_(blocks_indirect);
+   SizeT        old_blocks_dubious    = MC_(blocks_dubious);
+   SizeT        old_blocks_reachable  = MC_(blocks_reachable);
+   SizeT        old_blocks_suppressed = MC_(blocks_suppressed);
 
    // (re-)create the array of pointers to the (new) loss records.
    n_lossrecords = get_lr_array_from_lr_table ();
@@ -1309,7 +1332,7 @@ static void scan_memory_root_set(Addr searched, SizeT szB)
       // Scan the segment.  We use -1 for the clique number, because this
       // is a root-set.
       seg_size = seg->end - seg->start + 1;
-      if (VG_(clo_verbosity) > 2) {
+      if (VG_(clo_verbosity) > 2 && !lc_in_bg_child) {
          VG_(message)(Vg_DebugMsg,
                       "  Scanning root segment: %#lx..%#lx (%lu)\n",
                       seg->start, seg->end, seg_size);
@@ -1322,26 +1345,15 @@ static void scan_memory_root_set(Addr searched, SizeT szB)
 }
 
 /*------------------------------------------------------------*/
-/*--- Top-level entry point.                               ---*/
+/*--- Searching for leaks.                                 ---*/
 /*------------------------------------------------------------*/
 
-void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
+// Finds the blocks, and determines the state of each of them, leaving
+// the results in lc_chunks and lc_extras.  Returns False if there are
+// no blocks.
+static Bool lc_search(void)
 {
    Int i, j;
-   
-   tl_assert(lcp->mode != LC_Off);
-
-   // Verify some assertions which are used in lc_scan_memory.
-   tl_assert((VKI_PAGE_SIZE % sizeof(Addr)) == 0);
-   tl_assert((SM_SIZE % sizeof(Addr)) == 0);
-   // Above two assertions are critical, while below assertion
-   // ensures that the optimisation in the loop is done in the
-   // correct order : the loop checks for (big) SM chunk skipping
-   // before checking for (smaller) page skipping.
-   tl_assert((SM_SIZE % VKI_PAGE_SIZE) == 0);
-
-
-   MC_(detect_memory_leaks_last_delta_mode) = lcp->deltamode;
 
    // Get the chunks, stop if there were none.
    if (lc_chunks) {
@@ -1352,20 +1364,7 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
    lc_chunks_n_frees_marker = MC_(get_cmalloc_n_frees)();
    if (lc_n_chunks == 0) {
       tl_assert(lc_chunks == NULL);
-      if (lr_table != NULL) {
-         // forget the previous recorded LossRecords as next leak search
-         // can in any case just create new leaks.
-         // Maybe it would be better to rather call print_result ?
-         // (at least when leak decreases are requested)
-         // This will then output all LossRecords with a size decreasing to 0
-         VG_(OSetGen_Destroy) (lr_table);
-         lr_table = NULL;
-      }
-      if (VG_(clo_verbosity) >= 1 && !VG_(clo_xml)) {
-         VG_(umsg)("All heap blocks were freed -- no leaks are possible\n");
-         VG_(umsg)("\n");
-      }
-      return;
+      return False;
    }
 
    // Sort the array so blocks are in ascending order in memory.
@@ -1459,7 +1458,7 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
    lc_markstack_top = -1;
 
    // Verbosity.
-   if (VG_(clo_verbosity) > 1 && !VG_(clo_xml)) {
+   if (VG_(clo_verbosity) > 1 && !VG_(clo_xml) && !lc_in_bg_child) {
       VG_(umsg)( "Searching for pointers to %'d not-freed blocks\n",
                  lc_n_chunks );
    }
@@ -1475,7 +1474,7 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
    // from the root-set has been traced.
    lc_process_markstack(/*clique*/-1);
 
-   if (VG_(clo_verbosity) > 1 && !VG_(clo_xml)) {
+   if (VG_(clo_verbosity) > 1 && !VG_(clo_xml) && !lc_in_bg_child) {
       VG_(umsg)("Checked %'lu bytes\n", lc_scanned_szB);
       VG_(umsg)( "\n" );
    }
@@ -1510,10 +1509,309 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
       }
    }
       
-   print_results( tid, lcp);
-
    VG_(free) ( lc_markstack );
    lc_markstack = NULL;
+   return True;
+}
+
+// What to do when there are no blocks at all.
+static void no_blocks_to_search(void)
+{
+   if (lr_table != NULL) {
+      // forget the previous recorded LossRecords as next leak search
+      // can in any case just create new leaks.
+      // Maybe it would be better to rather call print_result ?
+      // (at least when leak decreases are requested)
+      // This will then output all LossRecords with a size decreasing to 0
+      VG_(OSetGen_Destroy) (lr_table);
+      lr_table = NULL;
+   }
+   if (VG_(clo_verbosity) >= 1 && !VG_(clo_xml)) {
+      VG_(umsg)("All heap blocks were freed -- no leaks are possible\n");
+      VG_(umsg)("\n");
+   }
+}
+
+/*------------------------------------------------------------*/
+/*--- Background leak searches.                            ---*/
+/*------------------------------------------------------------*/
+
+// A background leak search is done by a child process forked (with
+// VG_(fork_quietly), so the client never hears of it) at the point the
+// search is requested.  Copy-on-write gives the child an unchanging
+// snapshot of the client's memory, registers and heap blocks, on which
+// it does exactly what a foreground search does, while the client goes
+// on running in the parent.  The child then merges the blocks into
+// loss records, writes those with any blocks to an unlinked temporary
+// file, and exits, so that it never waits for the parent.  It closes
+// every other fd but the log's first, so that it doesn't keep the
+// client's pipes and sockets open while it runs.
+// The ExeContexts the loss records refer to are never freed, so the
+// pointers to them mean the same in the parent.
+//
+// The parent looks for the results (by reaping the child) whenever
+// another leak search is requested, and at exit.  It merges them into lr_table just as if it
+// had found the blocks itself, so the delta modes work as usual, and
+// prints them with the parameters of the request which started the
+// search.  Only one background search is done at a time.  The blocks
+// themselves are not known to the parent, so block_list can't be used
+// on the results.
+
+#if defined(VGO_linux)
+#  define LC_BG_WAIT_OPTIONS   __VKI_WCLONE
+#  define LC_BG_POLL_OPTIONS   (__VKI_WCLONE | VKI_WNOHANG)
+#else
+   // VG_(fork_quietly) always fails, so there is never a child.
+#  define LC_BG_WAIT_OPTIONS   0
+#  define LC_BG_POLL_OPTIONS   0
+#endif
+
+#define LC_BG_MAGIC            0x4C43424BUL /* "LCBK" */
+
+// What the child writes first, followed by n_records LossRecords.
+typedef
+   struct {
+      UWord magic;
+      Int   n_chunks;
+      SizeT scanned_szB;
+      UInt  n_records;
+   }
+   LCBgHeader;
+
+static Int             lc_bg_pid = 0;   // child, or 0 if none running
+static Int             lc_bg_fd  = -1;  // file it writes results to
+static LeakCheckParams lc_bg_lcp;       // what it was asked to do
+
+static Bool lc_bg_write(Int fd, void* buf, SizeT szB)
+{
+   UChar* p = buf;
+   while (szB > 0) {
+      Int n = VG_(write)(fd, p, szB);
+      if (n <= 0)
+         return False;
+      p   += n;
+      szB -= n;
+   }
+   return True;
+}
+
+static Bool lc_bg_read(Int fd, void* buf, SizeT szB)
+{
+   UChar* p = buf;
+   while (szB > 0) {
+      Int n = VG_(read)(fd, p, szB);
+      if (n <= 0)
+         return False;
+      p   += n;
+      szB -= n;
+   }
+   return True;
+}
+
+// Does the search in the child, and writes the results to fd for the
+// parent.  Never returns.
+__attribute__((noreturn))
+static void lc_bg_child(Int fd)
+{
+   LCBgHeader  hdr;
+   LossRecord* lr;
+
+   lc_in_bg_child = True;
+   VG_(close_fds_except)(fd);
+   hdr.magic       = LC_BG_MAGIC;
+   hdr.n_chunks    = 0;
+   hdr.scanned_szB = 0;
+   hdr.n_records   = 0;
+   if (lc_search()) {
+      hdr.n_chunks    = lc_n_chunks;
+      hdr.scanned_szB = lc_scanned_szB;
+      reset_lr_table();
+      add_chunks_to_lr_table();
+      VG_(OSetGen_ResetIter)(lr_table);
+      while ( (lr = VG_(OSetGen_Next)(lr_table)) )
+         if (lr->num_blocks > 0)
+            hdr.n_records++;
+   }
+   if (!lc_bg_write(fd, &hdr, sizeof(hdr)))
+      VG_(exit)(1);
+   if (hdr.n_records > 0) {
+      VG_(OSetGen_ResetIter)(lr_table);
+      while ( (lr = VG_(OSetGen_Next)(lr_table)) ) {
+         if (lr->num_blocks > 0 && !lc_bg_write(fd, lr, sizeof(LossRecord)))
+            VG_(exit)(1);
+      }
+   }
+   VG_(exit)(0);
+   /*NOTREACHED*/
+   tl_assert(0);
+}
+
+// A child of the client doesn't inherit the background search.
+static void lc_bg_atfork_child(ThreadId tid)
+{
+   if (lc_bg_pid != 0) {
+      VG_(close)(lc_bg_fd);
+      lc_bg_pid = 0;
+      lc_bg_fd  = -1;
+   }
+}
+
+// Starts a background search.  Returns False if that isn't possible.
+static Bool lc_bg_start(LeakCheckParams* lcp)
+{
+   HChar name[200];
+   Int   fd, pid;
+
+   tl_assert(lc_bg_pid == 0);
+   VG_(atfork)(NULL/*pre*/, NULL/*parent*/, lc_bg_atfork_child);
+   fd = VG_(mkstemp)("leakcheck", name);
+   if (fd < 0)
+      return False;
+   // Nobody needs the name, and this way the file can't be left
+   // behind.
+   VG_(unlink)(name);
+   fd = VG_(safe_fd)(fd);
+
+   pid = VG_(fork_quietly)();
+   if (pid == 0)
+      lc_bg_child(fd);
+   if (pid < 0) {
+      VG_(close)(fd);
+      return False;
+   }
+
+   lc_bg_pid = pid;
+   lc_bg_fd  = fd;
+   lc_bg_lcp = *lcp;
+   if (VG_(clo_verbosity) > 1 && !VG_(clo_xml))
+      VG_(umsg)("Leak search started in background (pid %d)\n", pid);
+   return True;
+}
+
+// If the background search has finished, or 'wait' is True, takes in
+// and prints its results.  Returns True if it did so, False if the
+// search is still running or there is none.
+static Bool lc_bg_collect(ThreadId tid, Bool wait)
+{
+   LCBgHeader  hdr;
+   LossRecord* recs = NULL;
+   Bool        ok;
+   Int         status;
+   UInt        i;
+
+   if (lc_bg_pid == 0)
+      return False;
+
+   // The results are complete once the child has exited.
+   if (VG_(waitpid)(lc_bg_pid, &status,
+                    wait ? LC_BG_WAIT_OPTIONS : LC_BG_POLL_OPTIONS) == 0)
+      return False;
+
+   // The child moved the file offset it shares with us.
+   ok = VG_(lseek)(lc_bg_fd, 0, VKI_SEEK_SET) == 0
+        && lc_bg_read(lc_bg_fd, &hdr, sizeof(hdr))
+        && hdr.magic == LC_BG_MAGIC;
+   if (ok && hdr.n_records > 0) {
+      recs = VG_(malloc)("mc.lbc.1", hdr.n_records * sizeof(LossRecord));
+      ok = lc_bg_read(lc_bg_fd, recs, hdr.n_records * sizeof(LossRecord));
+   }
+   VG_(close)(lc_bg_fd);
+   lc_bg_pid = 0;
+   lc_bg_fd  = -1;
+
+   if (!ok) {
+      VG_(umsg)("Background leak search failed; no results\n");
+      VG_(umsg)("\n");
+      if (recs)
+         VG_(free)(recs);
+      return True;
+   }
+
+   MC_(detect_memory_leaks_last_delta_mode) = lc_bg_lcp.deltamode;
+
+   // The blocks of an earlier foreground search don't go with these
+   // loss records.
+   if (lc_chunks) {
+      VG_(free)(lc_chunks);
+      lc_chunks = NULL;
+   }
+   if (lc_extras) {
+      VG_(free)(lc_extras);
+      lc_extras = NULL;
+   }
+   lc_n_chunks = 0;
+
+   if (hdr.n_chunks == 0) {
+      no_blocks_to_search();
+      return True;
+   }
+
+   if (VG_(clo_verbosity) > 1 && !VG_(clo_xml)) {
+      VG_(umsg)("Background search for pointers to %'d not-freed blocks\n",
+                hdr.n_chunks);
+      VG_(umsg)("Checked %'lu bytes\n", hdr.scanned_szB);
+      VG_(umsg)("\n");
+   }
+
+   reset_lr_table();
+   for (i = 0; i < hdr.n_records; i++)
+      add_to_lr_table(&recs[i].key, recs[i].szB, recs[i].indirect_szB,
+                      recs[i].num_blocks);
+   if (recs)
+      VG_(free)(recs);
+   print_results(tid, &lc_bg_lcp);
+   return True;
+}
+
+void MC_(finish_background_leak_search) ( ThreadId tid )
+{
+   lc_bg_collect(tid, /*wait*/True);
+}
+
+/*------------------------------------------------------------*/
+/*--- Top-level entry point.                               ---*/
+/*------------------------------------------------------------*/
+
+void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
+{
+   tl_assert(lcp->mode != LC_Off);
+
+   // Verify some assertions which are used in lc_scan_memory.
+   tl_assert((VKI_PAGE_SIZE % sizeof(Addr)) == 0);
+   tl_assert((SM_SIZE % sizeof(Addr)) == 0);
+   // Above two assertions are critical, while below assertion
+   // ensures that the optimisation in the loop is done in the
+   // correct order : the loop checks for (big) SM chunk skipping
+   // before checking for (smaller) page skipping.
+   tl_assert((SM_SIZE % VKI_PAGE_SIZE) == 0);
+
+   // Report a background search first, so that the deltas of this
+   // search are relative to it.  Only one can run at a time.
+   if (lc_bg_pid != 0 && !lc_bg_collect(tid, /*wait*/!lcp->background)) {
+      if (VG_(clo_verbosity) >= 1 && !VG_(clo_xml)) {
+         VG_(umsg)("A background leak search is still running\n");
+         VG_(umsg)("\n");
+      }
+      return;
+   }
+   if (lcp->background) {
+      if (lc_bg_start(lcp))
+         return;
+      if (VG_(clo_verbosity) > 1 && !VG_(clo_xml))
+         VG_(umsg)("Can't search for leaks in background; searching now\n");
+   }
+
+   MC_(detect_memory_leaks_last_delta_mode) = lcp->deltamode;
+
+   if (!lc_search()) {
+      no_blocks_to_search();
+      return;
+   }
+
+   reset_lr_table();
+   add_chunks_to_lr_table();
+   print_results( tid, lcp);
+
    // lc_chunks, lc_extras, lr_array and lr_table are kept (needed if user
    // calls MC_(print_block_list)). lr_table also used for delta leak reporting
    // between this leak search and the next leak search.
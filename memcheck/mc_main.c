@@ -31,6 +31,7 @@
 */
 
 #include "pub_tool_basics.h"
+#include "pub_tool_vki.h"
 #include "pub_tool_aspacemgr.h"
 #include "pub_tool_gdbserver.h"
 #include "pub_tool_poolalloc.h"
@@ -38,6 +39,7 @@
 #include "pub_tool_libcbase.h"
 #include "pub_tool_libcassert.h"
 #include "pub_tool_libcprint.h"
+#include "pub_tool_libcproc.h"
 #include "pub_tool_machine.h"
 #include "pub_tool_mallocfree.h"
 #include "pub_tool_options.h"
@@ -138,10 +140,12 @@ static void ocache_sarp_Clear_Origins ( Addr, UWord ); /* fwds */
    On 64-bit machines it's more complicated.  If we followed the same basic
    scheme we'd have a four-level table which would require too many memory
    accesses.  So instead the top-level map table has 2^19 entries (indexed
-   using bits 16..34 of the address);  this covers the bottom 32GB.  Any
-   accesses above 32GB are handled with a slow, sparse auxiliary table.
-   Valgrind's address space manager tries very hard to keep things below
-   this 32GB barrier so that performance doesn't suffer too much.
+   using bits 16..34 of the address);  this covers the bottom 32GB.
+   Accesses above 32GB and below 2^47 find their secondary map through
+   a lazily populated two-level "high map", and any above that through
+   a slow, sparse auxiliary table.  Either way they miss the fastest
+   paths for loads and stores, so Valgrind's address space manager tries
+   very hard to keep things below this 32GB barrier.
 
    Note that this file has a lot of different functions for reading and
    writing shadow memory.  Only a couple are strictly necessary (eg.
@@ -167,8 +171,9 @@ static void ocache_sarp_Clear_Origins ( Addr, UWord ); /* fwds */
 
 #else
 
-/* Just handle the first 32G fast and the rest via auxiliary
-   primaries.  If you change this, Memcheck will assert at startup.
+/* Just handle the first 32G fast and the rest via the high map and
+   auxiliary primaries.  If you change this, Memcheck will assert at
+   startup.
    See the definition of UNALIGNED_OR_HIGH for extensive comments. */
 #  define N_PRIMARY_BITS  19
 
@@ -327,6 +332,9 @@ static ULong n_auxmap_L1_cmps      = 0;
 static ULong n_auxmap_L2_searches  = 0;
 static ULong n_auxmap_L2_nodes     = 0;
 
+/* # of second level tables allocated in the high map */
+static Int   n_high_map_L2s        = 0;
+
 static Int   n_sanity_cheap     = 0;
 static Int   n_sanity_expensive = 0;
 
@@ -586,10 +594,103 @@ static AuxMapEnt* find_or_alloc_in_auxmap ( Addr a )
    return nyu;
 }
 
+/* --------------- High map --------------- */
+
+/* On 64-bit platforms, the auxiliary primary map has to be searched,
+   which makes accesses above MAX_PRIMARY_ADDRESS far slower than those
+   below it -- and heaps, stacks and mmap'd areas above 32G are common
+   nowadays.  So addresses from there up to 2^47 (the end of user space
+   on amd64 Linux, and further than most other 64-bit platforms go) are
+   instead covered by a two level table, which takes a fixed two loads
+   to find any secondary map: bits 46..29 of the address index
+   high_map, giving a second level table, and bits 28..16 index that.
+
+   Second level tables are only allocated when something in the 512M
+   they cover is written.  Until then the high_map entry points at
+   high_map_noaccess, a shared table all of whose entries are the
+   noaccess DSM, and which is never written.
+
+   Addresses at or above high_map_limit still go to the auxiliary
+   primary map.  Normally that is 2^47, but it is zero on 32-bit
+   platforms, which have no high addresses, and with
+   --high-shadow-map=no, which keeps the old arrangement (and the
+   2M or so of memory high_map needs). */
+#if VG_WORDSIZE == 8
+#  define HM_L1_BITS  18
+#  define HM_L2_BITS  13
+#else
+#  define HM_L1_BITS  1   /* unused */
+#  define HM_L2_BITS  1
+#endif
+
+#define HM_L1_N      ( ((UWord)1) << HM_L1_BITS )
+#define HM_L2_N      ( ((UWord)1) << HM_L2_BITS )
+#define HM_L1_SHIFT  ( 16 + HM_L2_BITS )
+
+static SecMap** high_map[HM_L1_N];
+static SecMap*  high_map_noaccess[HM_L2_N];
+
+#if VG_WORDSIZE == 8
+static Addr high_map_limit = ((Addr)1) << (HM_L1_SHIFT + HM_L1_BITS);
+#else
+static Addr high_map_limit = 0;
+#endif
+
+static void init_high_map ( void )
+{
+   UWord i;
+   for (i = 0; i < HM_L2_N; i++)
+      high_map_noaccess[i] = &sm_distinguished[SM_DIST_NOACCESS];
+   for (i = 0; i < HM_L1_N; i++)
+      high_map[i] = high_map_noaccess;
+}
+
+static SecMap** alloc_high_map_L2 ( Addr a )
+{
+   UWord    i;
+   SecMap** l2 = VG_(am_shadow_alloc)(HM_L2_N * sizeof(SecMap*));
+   if (l2 == NULL)
+      VG_(out_of_memory_NORETURN)( "memcheck:allocate high map table",
+                                   HM_L2_N * sizeof(SecMap*) );
+   for (i = 0; i < HM_L2_N; i++)
+      l2[i] = &sm_distinguished[SM_DIST_NOACCESS];
+   high_map[a >> HM_L1_SHIFT] = l2;
+   n_high_map_L2s++;
+   return l2;
+}
+
+/* Check that high_map_noaccess is untouched and count the
+   non-distinguished secondaries in the high map. */
+static HChar* check_high_map_sanity ( Word* n_secmaps_found )
+{
+   UWord i, j;
+   Int   n_L2s = 0;
+   *n_secmaps_found = 0;
+   for (i = 0; i < HM_L2_N; i++)
+      if (high_map_noaccess[i] != &sm_distinguished[SM_DIST_NOACCESS])
+         return "high_map_noaccess has been written";
+   for (i = 0; i < HM_L1_N; i++) {
+      if (high_map[i] == high_map_noaccess)
+         continue;
+      if (high_map[i] == NULL)
+         return "NULL entry in high_map";
+      n_L2s++;
+      for (j = 0; j < HM_L2_N; j++) {
+         if (high_map[i][j] == NULL)
+            return "NULL entry in a high map table";
+         if (!is_distinguished_sm(high_map[i][j]))
+            (*n_secmaps_found)++;
+      }
+   }
+   if (n_L2s != n_high_map_L2s)
+      return "disagreement on number of high map tables";
+   return NULL; /* ok */
+}
+
 /* --------------- SecMap fundamentals --------------- */
 
 // In all these, 'low' means it's definitely in the main primary map,
-// 'high' means it's definitely in the auxiliary table.
+// 'high' means it's definitely in the high map or the auxiliary table.
 
 static INLINE SecMap** get_secmap_low_ptr ( Addr a )
 {
@@ -602,8 +703,15 @@ static INLINE SecMap** get_secmap_low_ptr ( Addr a )
 
 static INLINE SecMap** get_secmap_high_ptr ( Addr a )
 {
-   AuxMapEnt* am = find_or_alloc_in_auxmap(a);
-   return &am->sm;
+   if (LIKELY(a < high_map_limit)) {
+      SecMap** l2 = high_map[a >> HM_L1_SHIFT];
+      if (UNLIKELY(l2 == high_map_noaccess))
+         l2 = alloc_high_map_L2(a);
+      return &l2[(a >> 16) & (HM_L2_N-1)];
+   } else {
+      AuxMapEnt* am = find_or_alloc_in_auxmap(a);
+      return &am->sm;
+   }
 }
 
 static SecMap** get_secmap_ptr ( Addr a )
@@ -620,7 +728,10 @@ static INLINE SecMap* get_secmap_for_reading_low ( Addr a )
 
 static INLINE SecMap* get_secmap_for_reading_high ( Addr a )
 {
-   return *get_secmap_high_ptr(a);
+   if (LIKELY(a < high_map_limit))
+      return high_map[a >> HM_L1_SHIFT][(a >> 16) & (HM_L2_N-1)];
+   else
+      return *get_secmap_high_ptr(a);
 }
 
 static INLINE SecMap* get_secmap_for_writing_low(Addr a)
@@ -673,6 +784,8 @@ static SecMap* maybe_get_secmap_for ( Addr a )
 {
    if (a <= MAX_PRIMARY_ADDRESS) {
       return get_secmap_for_reading_low(a);
+   } else if (a < high_map_limit) {
+      return get_secmap_for_reading_high(a);
    } else {
       AuxMapEnt* am = maybe_find_in_auxmap(a);
       return am ? am->sm : NULL;
@@ -826,48 +939,28 @@ Bool get_vbits8 ( Addr a, UChar* vbits8 )
 // node will not necessarily be removed.  This is because checking for
 // whether removal is necessary would slow down the fast paths.  
 //
-// To avoid the stale nodes building up too much, we periodically (once the
-// table reaches a certain size) garbage collect (GC) the table by
-// traversing it and evicting any nodes not having PDB.
-// If more than a certain proportion of nodes survived, we increase the
-// table size so that GCs occur less often.  
-//
-// This policy is designed to avoid bad table bloat in the worst case where
-// a program creates huge numbers of stale PDBs -- we would get this bloat
-// if we had no GC -- while handling well the case where a node becomes
-// stale but shortly afterwards is rewritten with a PDB and so becomes
-// non-stale again (which happens quite often, eg. in perf/bz2).  If we just
-// remove all stale nodes as soon as possible, we just end up re-adding a
-// lot of them in later again.  The "sufficiently stale" approach avoids
-// this.  (If a program has many live PDBs, performance will just suck,
-// there's no way around that.)
+// To avoid the stale nodes building up too much, the table is garbage
+// collected (GC'd) incrementally: every time a node is added, the next
+// SVB_GC_STEP slots after a cursor which sweeps round the table are
+// looked at, and any nodes there not having a PDB are evicted.  So a
+// node which becomes stale stays around for a while -- until the cursor
+// comes round to it, which takes a quarter of a table size's worth of
+// additions --
+// which handles well the case where a node becomes stale but shortly
+// afterwards is rewritten with a PDB and so becomes non-stale again
+// (which happens quite often, eg. in perf/bz2).  If we just removed all
+// stale nodes as soon as possible, we would end up re-adding a lot of
+// them in later again.
 //
-// Further comments, JRS 14 Feb 2012.  It turns out that the policy of
-// holding on to stale entries for 2 GCs before discarding them can lead
-// to massive space leaks.  So we're changing to an arrangement where
-// lines are evicted as soon as they are observed to be stale during a
-// GC.  This also has a side benefit of allowing the sufficiently_stale
-// field to be removed from the SecVBitNode struct, reducing its size by
-// 8 bytes, which is a substantial space saving considering that the
-// struct was previously 32 or so bytes, on a 64 bit target.
+// If the table nonetheless fills up to SVB_MAX_LOAD, the whole of it is
+// swept at once, and if more than half of it is still in use afterwards
+// -- that is, the program really has that many live PDBs -- it is
+// doubled in size.  It is never shrunk.
 //
-// In order to try and mitigate the problem that the "sufficiently stale"
-// heuristic was designed to avoid, the table size is allowed to drift
-// up ("DRIFTUP") slowly to 80000, even if the residency is low.  This
-// means that nodes will exist in the table longer on average, and hopefully
-// will be deleted and re-added less frequently.
-//
-// The previous scaling up mechanism (now called STEPUP) is retained:
-// if residency exceeds 50%, the table is scaled up, although by a 
-// factor sqrt(2) rather than 2 as before.  This effectively doubles the
-// frequency of GCs when there are many PDBs at reduces the tendency of
-// stale PDBs to reside for long periods in the table.
-
-static OSet* secVBitTable;
-
-// Stats
-static ULong sec_vbits_new_nodes = 0;
-static ULong sec_vbits_updates   = 0;
+// History: this used to be an OSet (an AVL tree), which a GC rebuilt
+// from scratch whenever it reached a size limit.  Lookups cost O(log n)
+// and GCs stopped everything for a time proportional to the table size;
+// with programs making heavy use of bit-fields, both were noticeable.
 
 // This must be a power of two;  this is checked in mc_pre_clo_init().
 // The size chosen here is a trade-off:  if the nodes are bigger (ie. cover
@@ -878,35 +971,6 @@ static ULong sec_vbits_updates   = 0;
 // row), but often not.  So we choose something intermediate.
 #define BYTES_PER_SEC_VBIT_NODE     16
 
-// We make the table bigger by a factor of STEPUP_GROWTH_FACTOR if
-// more than this many nodes survive a GC.
-#define STEPUP_SURVIVOR_PROPORTION  0.5
-#define STEPUP_GROWTH_FACTOR        1.414213562
-
-// If the above heuristic doesn't apply, then we may make the table
-// slightly bigger, by a factor of DRIFTUP_GROWTH_FACTOR, if more than
-// this many nodes survive a GC, _and_ the total table size does
-// not exceed a fixed limit.  The numbers are somewhat arbitrary, but
-// work tolerably well on long Firefox runs.  The scaleup ratio of 1.5%
-// effectively although gradually reduces residency and increases time
-// between GCs for programs with small numbers of PDBs.  The 80000 limit
-// effectively limits the table size to around 2MB for programs with
-// small numbers of PDBs, whilst giving a reasonably long lifetime to
-// entries, to try and reduce the costs resulting from deleting and
-// re-adding of entries.
-#define DRIFTUP_SURVIVOR_PROPORTION 0.15
-#define DRIFTUP_GROWTH_FACTOR       1.015
-#define DRIFTUP_MAX_SIZE            80000
-
-// We GC the table when it gets this many nodes in it, ie. it's effectively
-// the table size.  It can change.
-static Int  secVBitLimit = 1000;
-
-// The number of GCs done, used to age sec-V-bit nodes for eviction.
-// Because it's unsigned, wrapping doesn't matter -- the right answer will
-// come out anyway.
-static UInt GCs_done = 0;
-
 typedef 
    struct {
       Addr  a;
@@ -914,90 +978,153 @@ typedef
    } 
    SecVBitNode;
 
-static OSet* createSecVBitTable(void)
+// The table itself: an open addressing hash table, with linear probing,
+// of secVBitTable_size slots, holding the nodes themselves.  Empty slots
+// have .a == SVB_EMPTY.
+#define SVB_EMPTY          ((Addr)1)  /* never a node address */
+#define SVB_MIN_SIZE       2048       /* must be a power of two */
+#define SVB_MAX_LOAD(size) ((size) / 4 * 3)
+#define SVB_GC_STEP        4
+
+static SecVBitNode* secVBitTable       = NULL;
+static UWord        secVBitTable_size  = 0;
+static UWord        secVBitTable_used  = 0;
+static UInt         secVBitTable_shift = 0;  // word size - log2(size)
+static UWord        secVBit_gc_cursor  = 0;
+
+// Stats
+static ULong sec_vbits_new_nodes  = 0;
+static ULong sec_vbits_updates    = 0;
+static ULong sec_vbits_gc_swept   = 0;
+static ULong sec_vbits_gc_evicted = 0;
+static UInt  sec_vbits_resizes    = 0;
+static UInt  sec_vbits_resize_ms  = 0;
+
+static INLINE UWord hash_SecVBitNode_addr ( Addr aAligned )
 {
-   OSet* newSecVBitTable;
-   newSecVBitTable = VG_(OSetGen_Create_With_Pool)
-      ( offsetof(SecVBitNode, a), 
-        NULL, // use fast comparisons
-        VG_(malloc), "mc.cSVT.1 (sec VBit table)", 
-        VG_(free),
-        1000,
-        sizeof(SecVBitNode));
-   return newSecVBitTable;
+   // Fibonacci hashing: the top bits of the product are well mixed.
+   return ((aAligned / BYTES_PER_SEC_VBIT_NODE)
+           * (UWord)0x9E3779B97F4A7C15ULL) >> secVBitTable_shift;
 }
 
-static void gcSecVBitTable(void)
+static void createSecVBitTable ( UWord size )
 {
-   OSet*        secVBitTable2;
-   SecVBitNode* n;
-   Int          i, n_nodes = 0, n_survivors = 0;
-
-   GCs_done++;
-
-   // Create the new table.
-   secVBitTable2 = createSecVBitTable();
-
-   // Traverse the table, moving fresh nodes into the new table.
-   VG_(OSetGen_ResetIter)(secVBitTable);
-   while ( (n = VG_(OSetGen_Next)(secVBitTable)) ) {
-      // Keep node if any of its bytes are non-stale.  Using
-      // get_vabits2() for the lookup is not very efficient, but I don't
-      // think it matters.
-      for (i = 0; i < BYTES_PER_SEC_VBIT_NODE; i++) {
-         if (VA_BITS2_PARTDEFINED == get_vabits2(n->a + i)) {
-            // Found a non-stale byte, so keep =>
-            // Insert a copy of the node into the new table.
-            SecVBitNode* n2 = 
-               VG_(OSetGen_AllocNode)(secVBitTable2, sizeof(SecVBitNode));
-            *n2 = *n;
-            VG_(OSetGen_Insert)(secVBitTable2, n2);
-            break;
-         }
-      }
-   }
+   UWord i;
+   tl_assert(size >= SVB_MIN_SIZE && -1 != VG_(log2)(size));
+   secVBitTable = VG_(malloc)( "mc.cSVT.1 (sec VBit table)",
+                               size * sizeof(SecVBitNode) );
+   for (i = 0; i < size; i++)
+      secVBitTable[i].a = SVB_EMPTY;
+   secVBitTable_size  = size;
+   secVBitTable_used  = 0;
+   secVBitTable_shift = 8 * sizeof(UWord) - VG_(log2)(size);
+   secVBit_gc_cursor  = 0;
+}
 
-   // Get the before and after sizes.
-   n_nodes     = VG_(OSetGen_Size)(secVBitTable);
-   n_survivors = VG_(OSetGen_Size)(secVBitTable2);
+static SecVBitNode* lookup_SecVBitNode ( Addr aAligned )
+{
+   UWord i = hash_SecVBitNode_addr(aAligned);
+   while (True) {
+      SecVBitNode* n = &secVBitTable[i];
+      if (n->a == aAligned)
+         return n;
+      if (n->a == SVB_EMPTY)
+         return NULL;
+      i = (i + 1) & (secVBitTable_size - 1);
+   }
+}
 
-   // Destroy the old table, and put the new one in its place.
-   VG_(OSetGen_Destroy)(secVBitTable);
-   secVBitTable = secVBitTable2;
+// Is any byte of the node still partially defined?  The node's 16 bytes
+// are all in one sec-map, and their V+A bits are in one 32-bit word of
+// it.  This doesn't allocate anything for addresses no sec-map covers.
+static Bool SecVBitNode_is_stale ( SecVBitNode* n )
+{
+   SecMap* sm = maybe_get_secmap_for(n->a);
+   UInt    w;
+   tl_assert(BYTES_PER_SEC_VBIT_NODE == 16);
+   if (sm == NULL)
+      return True;
+   w = *(UInt*)&sm->vabits8[SM_OFF(n->a)];
+   return (w & (w >> 1) & 0x55555555) == 0;
+}
 
-   if (VG_(clo_verbosity) > 1) {
-      Char percbuf[7];
-      VG_(percentify)(n_survivors, n_nodes, 1, 6, percbuf);
-      VG_(message)(Vg_DebugMsg, "memcheck GC: %d nodes, %d survivors (%s)\n",
-                   n_nodes, n_survivors, percbuf);
+// Empty slot i, moving back into it any later node in the same run
+// whose probe sequence passes through it, and so on, so that no lookup
+// stops short at the hole (no tombstones are needed).
+static void remove_SecVBitNode_at ( UWord i )
+{
+   UWord j = i, h;
+   UWord mask = secVBitTable_size - 1;
+   while (True) {
+      j = (j + 1) & mask;
+      if (secVBitTable[j].a == SVB_EMPTY)
+         break;
+      h = hash_SecVBitNode_addr(secVBitTable[j].a);
+      // Can the node in slot j move to slot i?  Only if its home slot h
+      // is not cyclically within (i, j].
+      if (i <= j ? (h <= i || h > j) : (h <= i && h > j)) {
+         secVBitTable[i] = secVBitTable[j];
+         i = j;
+      }
    }
+   secVBitTable[i].a = SVB_EMPTY;
+   secVBitTable_used--;
+}
 
-   // Increase table size if necessary.
-   if ((Double)n_survivors 
-       > ((Double)secVBitLimit * STEPUP_SURVIVOR_PROPORTION)) {
-      secVBitLimit = (Int)((Double)secVBitLimit * (Double)STEPUP_GROWTH_FACTOR);
-      if (VG_(clo_verbosity) > 1)
-         VG_(message)(Vg_DebugMsg,
-                      "memcheck GC: %d new table size (stepup)\n",
-                      secVBitLimit);
+// Look at the next n_slots slots for the sweeping GC, evicting stale
+// nodes.
+static void gcSecVBitTable_step ( UWord n_slots )
+{
+   while (n_slots-- > 0) {
+      SecVBitNode* n = &secVBitTable[secVBit_gc_cursor];
+      sec_vbits_gc_swept++;
+      if (n->a != SVB_EMPTY && SecVBitNode_is_stale(n)) {
+         remove_SecVBitNode_at(secVBit_gc_cursor);
+         sec_vbits_gc_evicted++;
+         // Another node may have moved into this slot; look at it next.
+         continue;
+      }
+      secVBit_gc_cursor = (secVBit_gc_cursor + 1) & (secVBitTable_size - 1);
    }
-   else
-   if (secVBitLimit < DRIFTUP_MAX_SIZE
-       && (Double)n_survivors 
-          > ((Double)secVBitLimit * DRIFTUP_SURVIVOR_PROPORTION)) {
-      secVBitLimit = (Int)((Double)secVBitLimit * (Double)DRIFTUP_GROWTH_FACTOR);
-      if (VG_(clo_verbosity) > 1)
-         VG_(message)(Vg_DebugMsg,
-                      "memcheck GC: %d new table size (driftup)\n",
-                      secVBitLimit);
+}
+
+// Double the table size, leaving behind any stale nodes.
+static void resizeSecVBitTable ( void )
+{
+   SecVBitNode* old      = secVBitTable;
+   UWord        old_size = secVBitTable_size;
+   UWord        i, j;
+   UInt         t0       = VG_(read_millisecond_timer)();
+
+   createSecVBitTable(2 * old_size);
+   for (i = 0; i < old_size; i++) {
+      if (old[i].a == SVB_EMPTY)
+         continue;
+      if (SecVBitNode_is_stale(&old[i])) {
+         sec_vbits_gc_evicted++;
+         continue;
+      }
+      j = hash_SecVBitNode_addr(old[i].a);
+      while (secVBitTable[j].a != SVB_EMPTY)
+         j = (j + 1) & (secVBitTable_size - 1);
+      secVBitTable[j] = old[i];
+      secVBitTable_used++;
    }
+   VG_(free)(old);
+
+   sec_vbits_resizes++;
+   sec_vbits_resize_ms += VG_(read_millisecond_timer)() - t0;
+   if (VG_(clo_verbosity) > 1)
+      VG_(message)(Vg_DebugMsg,
+                   "memcheck GC: %lu new table size, %lu nodes\n",
+                   secVBitTable_size, secVBitTable_used);
 }
 
 static UWord get_sec_vbits8(Addr a)
 {
    Addr         aAligned = VG_ROUNDDN(a, BYTES_PER_SEC_VBIT_NODE);
    Int          amod     = a % BYTES_PER_SEC_VBIT_NODE;
-   SecVBitNode* n        = VG_(OSetGen_Lookup)(secVBitTable, &aAligned);
+   SecVBitNode* n        = lookup_SecVBitNode(aAligned);
    UChar        vbits8;
    tl_assert2(n, "get_sec_vbits8: no node for address %p (%p)\n", aAligned, a);
    // Shouldn't be fully defined or fully undefined -- those cases shouldn't
@@ -1007,40 +1134,114 @@ static UWord get_sec_vbits8(Addr a)
    return vbits8;
 }
 
+/* Find the node for aAligned, creating it if there isn't one.  Its
+   bytes are all V_BITS8_UNDEFINED if it is new (they should never be
+   read as-is, but be cautious).  Creating a node may GC the table, so
+   any other node pointers held are invalid afterwards. */
+static SecVBitNode* find_or_add_SecVBitNode(Addr aAligned)
+{
+   Int          i;
+   UWord        j;
+   SecVBitNode* n = lookup_SecVBitNode(aAligned);
+   if (n) {
+      sec_vbits_updates++;
+      return n;
+   }
+
+   // Do some GC, and more if the table is full.  Nb: do this before
+   // creating and inserting the new node, to avoid erroneously GC'ing
+   // the new node.
+   gcSecVBitTable_step(SVB_GC_STEP);
+   if (secVBitTable_used + 1 > SVB_MAX_LOAD(secVBitTable_size)) {
+      gcSecVBitTable_step(secVBitTable_size);
+      if (secVBitTable_used > secVBitTable_size / 2)
+         resizeSecVBitTable();
+   }
+
+   j = hash_SecVBitNode_addr(aAligned);
+   while (secVBitTable[j].a != SVB_EMPTY)
+      j = (j + 1) & (secVBitTable_size - 1);
+   n = &secVBitTable[j];
+   n->a = aAligned;
+   for (i = 0; i < BYTES_PER_SEC_VBIT_NODE; i++) {
+      n->vbits8[i] = V_BITS8_UNDEFINED;
+   }
+   secVBitTable_used++;
+   sec_vbits_new_nodes++;
+
+   n_secVBit_nodes = secVBitTable_used;
+   if (n_secVBit_nodes > max_secVBit_nodes)
+      max_secVBit_nodes = n_secVBit_nodes;
+   return n;
+}
+
 static void set_sec_vbits8(Addr a, UWord vbits8)
 {
    Addr         aAligned = VG_ROUNDDN(a, BYTES_PER_SEC_VBIT_NODE);
-   Int          i, amod  = a % BYTES_PER_SEC_VBIT_NODE;
-   SecVBitNode* n        = VG_(OSetGen_Lookup)(secVBitTable, &aAligned);
+   Int          amod     = a % BYTES_PER_SEC_VBIT_NODE;
+   SecVBitNode* n;
    // Shouldn't be fully defined or fully undefined -- those cases shouldn't
    // make it to the secondary V bits table.
    tl_assert(V_BITS8_DEFINED != vbits8 && V_BITS8_UNDEFINED != vbits8);
-   if (n) {
-      n->vbits8[amod] = vbits8;     // update
-      sec_vbits_updates++;
-   } else {
-      // Do a table GC if necessary.  Nb: do this before creating and
-      // inserting the new node, to avoid erroneously GC'ing the new node.
-      if (secVBitLimit == VG_(OSetGen_Size)(secVBitTable)) {
-         gcSecVBitTable();
+   n = find_or_add_SecVBitNode(aAligned);
+   n->vbits8[amod] = vbits8;
+}
+
+/* Copy the secondary V bits of the partially defined bytes among the
+   nbytes at src, whose V+A bits are in vabits8[0 .. nbytes/4-1], to
+   the corresponding bytes at dst.  src and dst are 4-aligned.  When
+   they are equally aligned relative to node boundaries, which is the
+   usual case, the bytes are copied a node at a time rather than
+   looking up both nodes for every byte. */
+static void copy_sec_vbits_range ( Addr src, Addr dst, const UChar* vabits8,
+                                   SizeT nbytes )
+{
+   Bool  by_node = ((src ^ dst) & (BYTES_PER_SEC_VBIT_NODE-1)) == 0;
+   Addr  cur     = 1;  /* not a node address */
+   SecVBitNode *sn = NULL, *dn = NULL;
+   SizeT i, n_chunks = nbytes >> 2;
+   UInt  k;
+
+   tl_assert(VG_IS_4_ALIGNED(src) && VG_IS_4_ALIGNED(dst));
+   i = 0;
+   while (i < n_chunks) {
+      /* Skip a word's worth of chunks at a time if none of them
+         has a partially defined byte (one whose vabits2 has both
+         bits set). */
+      if (VG_IS_WORD_ALIGNED(&vabits8[i]) && i + sizeof(UWord) <= n_chunks) {
+         UWord w = *(const UWord*)&vabits8[i];
+         if ((w & (w >> 1) & (UWord)0x5555555555555555ULL) == 0) {
+            i += sizeof(UWord);
+            continue;
+         }
       }
-
-      // New node:  assign the specific byte, make the rest invalid (they
-      // should never be read as-is, but be cautious).
-      n = VG_(OSetGen_AllocNode)(secVBitTable, sizeof(SecVBitNode));
-      n->a            = aAligned;
-      for (i = 0; i < BYTES_PER_SEC_VBIT_NODE; i++) {
-         n->vbits8[i] = V_BITS8_UNDEFINED;
+      if ((vabits8[i] & (vabits8[i] >> 1) & 0x55) == 0) {
+         i++;
+         continue;
       }
-      n->vbits8[amod] = vbits8;
-
-      // Insert the new node.
-      VG_(OSetGen_Insert)(secVBitTable, n);
-      sec_vbits_new_nodes++;
-
-      n_secVBit_nodes = VG_(OSetGen_Size)(secVBitTable);
-      if (n_secVBit_nodes > max_secVBit_nodes)
-         max_secVBit_nodes = n_secVBit_nodes;
+      for (k = 0; k < 4; k++) {
+         Addr sa = src + 4*i + k;
+         Addr da = dst + 4*i + k;
+         if (VA_BITS2_PARTDEFINED
+             != extract_vabits2_from_vabits8(sa, vabits8[i]))
+            continue;
+         if (!by_node) {
+            set_sec_vbits8( da, get_sec_vbits8( sa ) );
+            continue;
+         }
+         if (VG_ROUNDDN(da, BYTES_PER_SEC_VBIT_NODE) != cur) {
+            Addr saAligned = VG_ROUNDDN(sa, BYTES_PER_SEC_VBIT_NODE);
+            cur = VG_ROUNDDN(da, BYTES_PER_SEC_VBIT_NODE);
+            /* In this order, since adding dn may GC the table. */
+            dn = find_or_add_SecVBitNode(cur);
+            sn = lookup_SecVBitNode(saAligned);
+            tl_assert2(sn, "copy_sec_vbits_range: no node for address %p\n",
+                       saAligned);
+         }
+         dn->vbits8[da % BYTES_PER_SEC_VBIT_NODE]
+            = sn->vbits8[sa % BYTES_PER_SEC_VBIT_NODE];
+      }
+      i++;
    }
 }
 
@@ -1135,8 +1336,8 @@ ULong mc_LOADVn_slow ( Addr a, SizeT nBits, Bool bigendian )
    PROF_EVENT(30, "mc_LOADVn_slow");
 
    /* ------------ BEGIN semi-fast cases ------------ */
-   /* These deal quickly-ish with the common auxiliary primary map
-      cases on 64-bit platforms.  Are merely a speedup hack; can be
+   /* These deal quickly-ish with the common high map and auxiliary
+      primary map cases on 64-bit platforms.  Are merely a speedup hack; can be
       omitted without loss of correctness/functionality.  Note that in
       both cases the "sizeof(void*) == 8" causes these cases to be
       folded out by compilers on 32-bit platforms.  These are derived
@@ -1270,8 +1471,8 @@ void mc_STOREVn_slow ( Addr a, SizeT nBits, ULong vbytes, Bool bigendian )
    PROF_EVENT(35, "mc_STOREVn_slow");
 
    /* ------------ BEGIN semi-fast cases ------------ */
-   /* These deal quickly-ish with the common auxiliary primary map
-      cases on 64-bit platforms.  Are merely a speedup hack; can be
+   /* These deal quickly-ish with the common high map and auxiliary
+      primary map cases on 64-bit platforms.  Are merely a speedup hack; can be
       omitted without loss of correctness/functionality.  Note that in
       both cases the "sizeof(void*) == 8" causes these cases to be
       folded out by compilers on 32-bit platforms.  These are derived
@@ -1346,10 +1547,24 @@ void mc_STOREVn_slow ( Addr a, SizeT nBits, ULong vbytes, Bool bigendian )
 /*--- Setting permissions over address ranges.             ---*/
 /*------------------------------------------------------------*/
 
+/* Make the sec-map entry *sm_ptr point to the distinguished sec-map
+   dsm, freeing the non-distinguished one it points at, if any. */
+static void set_secmap_to_dsm ( SecMap** sm_ptr, SecMap* dsm )
+{
+   tl_assert(is_distinguished_sm(dsm));
+   if (!is_distinguished_sm(*sm_ptr)) {
+      PROF_EVENT(160, "set_address_range_perms-loop64K-free-dist-sm");
+      SysRes sres = VG_(am_munmap_valgrind)((Addr)*sm_ptr, sizeof(SecMap));
+      tl_assert2(! sr_isError(sres), "SecMap valgrind munmap failure\n");
+   }
+   update_SM_counts(*sm_ptr, dsm);
+   *sm_ptr = dsm;
+}
+
 static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
                                       UWord dsm_num )
 {
-   UWord    sm_off, sm_off16;
+   UWord    sm_off;
    UWord    vabits2 = vabits16 & 0x3;
    SizeT    lenA, lenB, len_to_next_secmap;
    Addr     aNext;
@@ -1484,14 +1699,13 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
       a    += 1;
       lenA -= 1;
    }
-   // 8-aligned, 8 byte steps
-   while (True) {
-      if (lenA < 8) break;
+   // 8-aligned, all the 8 byte steps at once
+   if (lenA >= 8) {
+      SizeT len8 = lenA & ~(SizeT)7;
       PROF_EVENT(157, "set_address_range_perms-loop8a");
-      sm_off16 = SM_OFF_16(a);
-      ((UShort*)(sm->vabits8))[sm_off16] = vabits16;
-      a    += 8;
-      lenA -= 8;
+      VG_(memset)( &sm->vabits8[SM_OFF(a)], vabits16 & 0xFF, len8 >> 2 );
+      a    += len8;
+      lenA -= len8;
    }
    // 1 byte steps
    while (True) {
@@ -1519,16 +1733,7 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
       tl_assert(is_start_of_sm(a));
       PROF_EVENT(159, "set_address_range_perms-loop64K");
       sm_ptr = get_secmap_ptr(a);
-      if (!is_distinguished_sm(*sm_ptr)) {
-         PROF_EVENT(160, "set_address_range_perms-loop64K-free-dist-sm");
-         // Free the non-distinguished sec-map that we're replacing.  This
-         // case happens moderately often, enough to be worthwhile.
-         SysRes sres = VG_(am_munmap_valgrind)((Addr)*sm_ptr, sizeof(SecMap));
-         tl_assert2(! sr_isError(sres), "SecMap valgrind munmap failure\n");
-      }
-      update_SM_counts(*sm_ptr, example_dsm);
-      // Make the sec-map entry point to the example DSM
-      *sm_ptr = example_dsm;
+      set_secmap_to_dsm(sm_ptr, example_dsm);
       lenB -= SM_SIZE;
       a    += SM_SIZE;
    }
@@ -1557,14 +1762,13 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
    }
    sm = *sm_ptr;
 
-   // 8-aligned, 8 byte steps
-   while (True) {
-      if (lenB < 8) break;
+   // 8-aligned, all the 8 byte steps at once
+   if (lenB >= 8) {
+      SizeT len8 = lenB & ~(SizeT)7;
       PROF_EVENT(163, "set_address_range_perms-loop8b");
-      sm_off16 = SM_OFF_16(a);
-      ((UShort*)(sm->vabits8))[sm_off16] = vabits16;
-      a    += 8;
-      lenB -= 8;
+      VG_(memset)( &sm->vabits8[SM_OFF(a)], vabits16 & 0xFF, len8 >> 2 );
+      a    += len8;
+      lenB -= len8;
    }
    // 1 byte steps
    while (True) {
@@ -1679,7 +1883,7 @@ static void make_mem_defined_if_noaccess ( Addr a, SizeT len )
 void MC_(copy_address_range_state) ( Addr src, Addr dst, SizeT len )
 {
    SizeT i, j;
-   UChar vabits2, vabits8;
+   UChar vabits2;
    Bool  aligned, nooverlap;
 
    DEBUG("MC_(copy_address_range_state)\n");
@@ -1693,29 +1897,45 @@ void MC_(copy_address_range_state) ( Addr src, Addr dst, SizeT len )
 
    if (nooverlap && aligned) {
 
-      /* Vectorised fast case, when no overlap and suitably aligned */
-      /* vector loop */
+      /* Fast case, when no overlap and suitably aligned.  Go a sec-map
+         (or as much of one as the range covers) at a time. */
       i = 0;
       while (len >= 4) {
-         vabits8 = get_vabits8_for_aligned_word32( src+i );
-         set_vabits8_for_aligned_word32( dst+i, vabits8 );
-         if (LIKELY(VA_BITS8_DEFINED == vabits8 
-                            || VA_BITS8_UNDEFINED == vabits8 
-                            || VA_BITS8_NOACCESS == vabits8)) {
-            /* do nothing */
-         } else {
-            /* have to copy secondary map info */
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+0 ))
-               set_sec_vbits8( dst+i+0, get_sec_vbits8( src+i+0 ) );
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+1 ))
-               set_sec_vbits8( dst+i+1, get_sec_vbits8( src+i+1 ) );
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+2 ))
-               set_sec_vbits8( dst+i+2, get_sec_vbits8( src+i+2 ) );
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+3 ))
-               set_sec_vbits8( dst+i+3, get_sec_vbits8( src+i+3 ) );
+         SizeT   n      = len & ~(SizeT)3;
+         SizeT   to_src = SM_SIZE - ((src+i) & SM_MASK);
+         SizeT   to_dst = SM_SIZE - ((dst+i) & SM_MASK);
+         SecMap* src_sm = get_secmap_for_reading( src+i );
+         SecMap* dst_sm;
+         if (n > to_src) n = to_src;
+         if (n > to_dst) n = to_dst;
+         PROF_EVENT(53, "MC_(copy_address_range_state)(secmap)");
+
+         if (is_distinguished_sm(src_sm)) {
+            /* Uniform source.  A whole destination sec-map can simply
+               share the same distinguished sec-map, and one which
+               already does needs nothing done. */
+            if (n == SM_SIZE) {
+               set_secmap_to_dsm( get_secmap_ptr( dst+i ), src_sm );
+               i += n;
+               len -= n;
+               continue;
+            }
+            if (get_secmap_for_reading( dst+i ) == src_sm) {
+               i += n;
+               len -= n;
+               continue;
+            }
          }
-         i += 4;
-         len -= 4;
+
+         dst_sm = get_secmap_for_writing( dst+i );
+         VG_(memcpy)( &dst_sm->vabits8[SM_OFF(dst+i)],
+                      &src_sm->vabits8[SM_OFF(src+i)], n >> 2 );
+         /* Distinguished sec-maps have no partially defined bytes. */
+         if (!is_distinguished_sm(src_sm))
+            copy_sec_vbits_range( src+i, dst+i,
+                                  &src_sm->vabits8[SM_OFF(src+i)], n );
+         i += n;
+         len -= n;
       }
       /* fixup loop */
       while (len >= 1) {
@@ -1833,7 +2053,7 @@ void MC_(copy_address_range_state) ( Addr src, Addr dst, SizeT len )
 
    Memory is shadowed using a two level cache structure (ocacheL1 and
    ocacheL2).  Memory references are first directed to ocacheL1.  This
-   is a traditional 2-way set associative cache with 32-byte lines and
+   is a traditional 4-way set associative cache with 32-byte lines and
    approximate LRU replacement within each set.
 
    A naive implementation would require storing one 32 bit otag for
@@ -1852,8 +2072,8 @@ void MC_(copy_address_range_state) ( Addr src, Addr dst, SizeT len )
    zeroes to be installed.  However, ejecting a line containing
    nonzeroes risks losing origin information permanently.  In order to
    prevent such lossage, ejected nonzero lines are placed in a
-   secondary cache (ocacheL2), which is an OSet (AVL tree) of cache
-   lines.  This can grow arbitrarily large, and so should ensure that
+   secondary cache (ocacheL2), which is a hash table of compressed
+   cache lines.  This can grow arbitrarily large, and so should ensure that
    Memcheck runs out of memory in preference to losing useful origin
    info due to cache size limitations.
 
@@ -2080,6 +2300,7 @@ static UWord stats_ocacheL1_movefwds       = 0;
 static UWord stats__ocacheL2_refs          = 0;
 static UWord stats__ocacheL2_misses        = 0;
 static UWord stats__ocacheL2_n_nodes_max   = 0;
+static UWord stats__ocacheL2_szB_max       = 0;
 
 /* Cache of 32-bit values, one every 32 bits of address space */
 
@@ -2093,18 +2314,29 @@ static INLINE Bool is_valid_oc_tag ( Addr tag ) {
    return 0 == (tag & ((1 << OC_BITS_PER_LINE) - 1));
 }
 
-#define OC_LINES_PER_SET 2
+#define OC_LINES_PER_SET 4
 
-#define OC_N_SET_BITS    20
+#define OC_N_SET_BITS    19
 #define OC_N_SETS        (1 << OC_N_SET_BITS)
 
 /* These settings give:
    64 bit host: ocache:  100,663,296 sizeB    67,108,864 useful
    32 bit host: ocache:   92,274,688 sizeB    67,108,864 useful
+   which is the same as the 2-way, 2^20 set arrangement used
+   previously, but with far fewer conflict misses.
 */
 
 #define OC_MOVE_FORWARDS_EVERY_BITS 7
 
+/* The set for address 'a'.  Folding in the next OC_N_SET_BITS of the
+   address stops areas a multiple of 2^(OC_BITS_PER_LINE+OC_N_SET_BITS)
+   (16MB) apart -- stacks of different threads, large heap blocks,
+   mmap'd areas -- from all competing for the same sets. */
+static INLINE UWord oc_set_no ( Addr a ) {
+   return ((a >> OC_BITS_PER_LINE) 
+           ^ (a >> (OC_BITS_PER_LINE + OC_N_SET_BITS))) & (OC_N_SETS - 1);
+}
+
 
 typedef
    struct {
@@ -2188,7 +2420,34 @@ static void zeroise_OCacheLine ( OCacheLine* line, Addr tag ) {
 //////////////////////////////////////////////////////////////
 //// OCache backing store
 
-static OSet* ocacheL2 = NULL;
+/* Lines in the backing store are compressed.  The four descr bits of
+   each w32 are packed into one UInt, and each run of w32s having the
+   same otag stores that otag only once.  w32s whose descr is zero
+   carry no information, and so neither start nor break a run.  Most
+   lines hold one or two distinct otags (a block's worth of undefined
+   memory all has its allocation's otag), so typically a line takes
+   24 or 32 bytes rather than the 48 an OCacheLine does.
+
+   The lines are held in a VgHashTable keyed by their tag, and are
+   allocated from one pool for each possible number of runs, so only
+   the first n_runs entries of otags[] exist. */
+typedef
+   struct _OCacheL2Line {
+      struct _OCacheL2Line* next;
+      Addr  tag;          /* the hash key */
+      UInt  descrs;       /* descr[i] is in bits 4i .. 4i+3 */
+      UChar run_starts;   /* bit i is set iff a run starts at w32[i] */
+      UChar n_runs;       /* 1 .. OC_W32S_PER_LINE */
+      UInt  otags[OC_W32S_PER_LINE];
+   }
+   OCacheL2Line;
+
+static VgHashTable ocacheL2 = NULL;
+static PoolAlloc*  ocacheL2_pools[OC_W32S_PER_LINE];
+
+static INLINE SizeT szB_of_OCacheL2Line ( UWord n_runs ) {
+   return offsetof(OCacheL2Line, otags) + n_runs * sizeof(UInt);
+}
 
 static void* ocacheL2_malloc ( HChar* cc, SizeT szB ) {
    return VG_(malloc)(cc, szB);
@@ -2197,61 +2456,130 @@ static void ocacheL2_free ( void* v ) {
    VG_(free)( v );
 }
 
-/* Stats: # nodes currently in tree */
+/* Stats: # nodes currently in the table, and their total size */
 static UWord stats__ocacheL2_n_nodes = 0;
+static UWord stats__ocacheL2_szB     = 0;
 
 static void init_ocacheL2 ( void )
 {
+   UWord i;
    tl_assert(!ocacheL2);
    tl_assert(sizeof(Word) == sizeof(Addr)); /* since OCacheLine.tag :: Addr */
-   tl_assert(0 == offsetof(OCacheLine,tag));
-   ocacheL2 
-      = VG_(OSetGen_Create)( offsetof(OCacheLine,tag), 
-                             NULL, /* fast cmp */
-                             ocacheL2_malloc, "mc.ioL2", ocacheL2_free);
+   tl_assert(OC_W32S_PER_LINE <= 8);        /* run_starts :: UChar */
+   tl_assert(OC_W32S_PER_LINE * 4 <= 32);   /* descrs :: UInt */
+   ocacheL2 = VG_(HT_construct)( "mc.ioL2" );
    tl_assert(ocacheL2);
+   for (i = 0; i < OC_W32S_PER_LINE; i++) {
+      ocacheL2_pools[i]
+         = VG_(newPA)( VG_ROUNDUP(szB_of_OCacheL2Line(i+1), sizeof(void*)),
+                       1000, ocacheL2_malloc, "mc.ioL2.1", ocacheL2_free );
+   }
    stats__ocacheL2_n_nodes = 0;
+   stats__ocacheL2_szB     = 0;
 }
 
-/* Find line with the given tag in the tree, or NULL if not found. */
-static OCacheLine* ocacheL2_find_tag ( Addr tag )
+/* Compress 'line' into 'cl'.  The line must have at least one nonzero
+   descr. */
+static void compress_OCacheLine ( /*OUT*/OCacheL2Line* cl, OCacheLine* line )
 {
-   OCacheLine* line;
+   UWord i;
+   cl->tag        = line->tag;
+   cl->descrs     = 0;
+   cl->run_starts = 0;
+   cl->n_runs     = 0;
+   for (i = 0; i < OC_W32S_PER_LINE; i++) {
+      if (line->descr[i] == 0)
+         continue;
+      cl->descrs |= ((UInt)line->descr[i]) << (4 * i);
+      if (cl->n_runs == 0 || cl->otags[cl->n_runs-1] != line->w32[i]) {
+         cl->run_starts |= 1 << i;
+         cl->otags[cl->n_runs++] = line->w32[i];
+      }
+   }
+   tl_assert(cl->n_runs > 0);
+}
+
+static void decompress_OCacheL2Line ( /*OUT*/OCacheLine* line,
+                                      OCacheL2Line* cl )
+{
+   UWord i;
+   Int   run = -1;
+   line->tag = cl->tag;
+   for (i = 0; i < OC_W32S_PER_LINE; i++) {
+      if (cl->run_starts & (1 << i))
+         run++;
+      line->descr[i] = (cl->descrs >> (4 * i)) & 0xF;
+      line->w32[i]   = line->descr[i] == 0 ? 0 : cl->otags[run];
+   }
+   tl_assert(run == cl->n_runs - 1);
+}
+
+static void free_OCacheL2Line ( OCacheL2Line* cl )
+{
+   tl_assert(stats__ocacheL2_n_nodes > 0);
+   stats__ocacheL2_n_nodes--;
+   stats__ocacheL2_szB -= szB_of_OCacheL2Line(cl->n_runs);
+   VG_(freeEltPA)( ocacheL2_pools[cl->n_runs-1], cl );
+}
+
+/* Copy the line with the given tag into 'line', if it is in the table.
+   Returns False if it is not. */
+static Bool ocacheL2_load_tag ( /*OUT*/OCacheLine* line, Addr tag )
+{
+   OCacheL2Line* cl;
    tl_assert(is_valid_oc_tag(tag));
    stats__ocacheL2_refs++;
-   line = VG_(OSetGen_Lookup)( ocacheL2, &tag );
-   return line;
+   cl = VG_(HT_lookup)( ocacheL2, tag );
+   if (!cl)
+      return False;
+   decompress_OCacheL2Line( line, cl );
+   return True;
 }
 
-/* Delete the line with the given tag from the tree, if it is present, and
-   free up the associated memory. */
+/* Delete the line with the given tag from the table, if it is present,
+   and free up the associated memory. */
 static void ocacheL2_del_tag ( Addr tag )
 {
-   OCacheLine* line;
+   OCacheL2Line* cl;
    tl_assert(is_valid_oc_tag(tag));
    stats__ocacheL2_refs++;
-   line = VG_(OSetGen_Remove)( ocacheL2, &tag );
-   if (line) {
-      VG_(OSetGen_FreeNode)(ocacheL2, line);
-      tl_assert(stats__ocacheL2_n_nodes > 0);
-      stats__ocacheL2_n_nodes--;
-   }
+   cl = VG_(HT_remove)( ocacheL2, tag );
+   if (cl)
+      free_OCacheL2Line( cl );
 }
 
-/* Add a copy of the given line to the tree.  It must not already be
-   present. */
-static void ocacheL2_add_line ( OCacheLine* line )
+/* Store a copy of the given line in the table, replacing any line
+   already there with the same tag. */
+static void ocacheL2_store_line ( OCacheLine* line )
 {
-   OCacheLine* copy;
+   OCacheL2Line  tmp;
+   OCacheL2Line* cl;
+   SizeT         szB;
    tl_assert(is_valid_oc_tag(line->tag));
-   copy = VG_(OSetGen_AllocNode)( ocacheL2, sizeof(OCacheLine) );
-   tl_assert(copy);
-   *copy = *line;
+   compress_OCacheLine( &tmp, line );
+   szB = szB_of_OCacheL2Line(tmp.n_runs);
    stats__ocacheL2_refs++;
-   VG_(OSetGen_Insert)( ocacheL2, copy );
+   cl = VG_(HT_lookup)( ocacheL2, line->tag );
+   if (cl && cl->n_runs != tmp.n_runs) {
+      /* It no longer fits in its node. */
+      cl = VG_(HT_remove)( ocacheL2, line->tag );
+      free_OCacheL2Line( cl );
+      cl = NULL;
+   }
+   if (cl) {
+      tmp.next = cl->next;
+      VG_(memcpy)( cl, &tmp, szB );
+      return;
+   }
+   cl = VG_(allocEltPA)( ocacheL2_pools[tmp.n_runs-1] );
+   VG_(memcpy)( cl, &tmp, szB );
+   VG_(HT_add_node)( ocacheL2, cl );
    stats__ocacheL2_n_nodes++;
+   stats__ocacheL2_szB += szB;
    if (stats__ocacheL2_n_nodes > stats__ocacheL2_n_nodes_max)
       stats__ocacheL2_n_nodes_max = stats__ocacheL2_n_nodes;
+   if (stats__ocacheL2_szB > stats__ocacheL2_szB_max)
+      stats__ocacheL2_szB_max = stats__ocacheL2_szB;
 }
 
 ////
@@ -2260,17 +2588,19 @@ static void ocacheL2_add_line ( OCacheLine* line )
 __attribute__((noinline))
 static OCacheLine* find_OCacheLine_SLOW ( Addr a )
 {
-   OCacheLine *victim, *inL2;
+   OCacheLine* victim;
+   OCacheSet*  set;
    UChar c;
    UWord line;
-   UWord setno   = (a >> OC_BITS_PER_LINE) & (OC_N_SETS - 1);
+   UWord setno   = oc_set_no(a);
    UWord tagmask = ~((1 << OC_BITS_PER_LINE) - 1);
    UWord tag     = a & tagmask;
    tl_assert(setno >= 0 && setno < OC_N_SETS);
+   set = &ocacheL1->set[setno];
 
    /* we already tried line == 0; skip therefore. */
    for (line = 1; line < OC_LINES_PER_SET; line++) {
-      if (ocacheL1->set[setno].line[line].tag == tag) {
+      if (set->line[line].tag == tag) {
          if (line == 1) {
             stats_ocacheL1_found_at_1++;
          } else {
@@ -2278,22 +2608,22 @@ static OCacheLine* find_OCacheLine_SLOW ( Addr a )
          }
          if (UNLIKELY(0 == (ocacheL1_event_ctr++ 
                             & ((1<<OC_MOVE_FORWARDS_EVERY_BITS)-1)))) {
-            moveLineForwards( &ocacheL1->set[setno], line );
+            moveLineForwards( set, line );
             line--;
          }
-         return &ocacheL1->set[setno].line[line];
+         return &set->line[line];
       }
    }
 
-   /* A miss.  Use the last slot.  Implicitly this means we're
-      ejecting the line in the last slot. */
+   /* A miss.  Implicitly this means we're ejecting the line in the
+      last slot. */
    stats_ocacheL1_misses++;
    tl_assert(line == OC_LINES_PER_SET);
    line--;
    tl_assert(line > 0);
 
    /* First, move the to-be-ejected line to the L2 cache. */
-   victim = &ocacheL1->set[setno].line[line];
+   victim = &set->line[line];
    c = classify_OCacheLine(victim);
    switch (c) {
       case 'e':
@@ -2311,41 +2641,33 @@ static OCacheLine* find_OCacheLine_SLOW ( Addr a )
          /* line contains at least one real, useful origin.  Copy it
             to the backing store. */
          stats_ocacheL1_lossage++;
-         inL2 = ocacheL2_find_tag( victim->tag );
-         if (inL2) {
-            *inL2 = *victim;
-         } else {
-            ocacheL2_add_line( victim );
-         }
+         ocacheL2_store_line( victim );
          break;
       default:
          tl_assert(0);
    }
+   tl_assert(tag != victim->tag); /* stay sane */
+
+   /* Make room for the new line at the front of the set, so that it
+      survives the next few misses in the set. */
+   for (; line > 0; line--)
+      set->line[line] = set->line[line-1];
 
-   /* Now we must reload the L1 cache from the backing tree, if
+   /* Now we must reload the L1 cache from the backing store, if
       possible. */
-   tl_assert(tag != victim->tag); /* stay sane */
-   inL2 = ocacheL2_find_tag( tag );
-   if (inL2) {
-      /* We're in luck.  It's in the L2. */
-      ocacheL1->set[setno].line[line] = *inL2;
-   } else {
+   if (!ocacheL2_load_tag( &set->line[0], tag )) {
       /* Missed at both levels of the cache hierarchy.  We have to
          declare it as full of zeroes (unknown origins). */
       stats__ocacheL2_misses++;
-      zeroise_OCacheLine( &ocacheL1->set[setno].line[line], tag );
+      zeroise_OCacheLine( &set->line[0], tag );
    }
 
-   /* Move it one forwards */
-   moveLineForwards( &ocacheL1->set[setno], line );
-   line--;
-
-   return &ocacheL1->set[setno].line[line];
+   return &set->line[0];
 }
 
 static INLINE OCacheLine* find_OCacheLine ( Addr a )
 {
-   UWord setno   = (a >> OC_BITS_PER_LINE) & (OC_N_SETS - 1);
+   UWord setno   = oc_set_no(a);
    UWord tagmask = ~((1 << OC_BITS_PER_LINE) - 1);
    UWord tag     = a & tagmask;
 
@@ -4704,12 +5026,13 @@ static void init_shadow_memory ( void )
 
    /* Auxiliary primary maps */
    init_auxmap_L1_L2();
+   init_high_map();
 
    /* auxmap_size = auxmap_used = 0; 
       no ... these are statically initialised */
 
    /* Secondary V bit table */
-   secVBitTable = createSecVBitTable();
+   createSecVBitTable(SVB_MIN_SIZE);
 }
 
 
@@ -4732,6 +5055,7 @@ static Bool mc_expensive_sanity_check ( void )
 {
    Int     i;
    Word    n_secmaps_found;
+   UWord   j, n_svb_found;
    SecMap* sm;
    HChar*  errmsg;
    Bool    bad = False;
@@ -4775,10 +5099,22 @@ static Bool mc_expensive_sanity_check ( void )
    /* If we're not checking for undefined value errors, the secondary V bit
     * table should be empty. */
    if (MC_(clo_mc_level) == 1) {
-      if (0 != VG_(OSetGen_Size)(secVBitTable))
+      if (0 != secVBitTable_used)
          return False;
    }
 
+   /* check the secondary V bit table's node count */
+   n_svb_found = 0;
+   for (j = 0; j < secVBitTable_size; j++)
+      if (secVBitTable[j].a != SVB_EMPTY)
+         n_svb_found++;
+   if (n_svb_found != secVBitTable_used) {
+      VG_(printf)("memcheck expensive sanity: "
+                  "sec V bit table has %lu nodes, expected %lu\n",
+                  n_svb_found, secVBitTable_used);
+      return False;
+   }
+
    /* check the auxiliary maps, very thoroughly */
    n_secmaps_found = 0;
    errmsg = check_auxmap_L1_L2_sanity( &n_secmaps_found );
@@ -4787,9 +5123,21 @@ static Bool mc_expensive_sanity_check ( void )
       return False;
    }
 
+   /* and the high map */
+   {
+      Word n_high_secmaps_found;
+      errmsg = check_high_map_sanity( &n_high_secmaps_found );
+      if (errmsg) {
+         VG_(printf)("memcheck expensive sanity, high map:\n\t%s\n",
+                     errmsg);
+         return False;
+      }
+      n_secmaps_found += n_high_secmaps_found;
+   }
+
    /* n_secmaps_found is now the number referred to by the auxiliary
-      primary map.  Now add on the ones referred to by the main
-      primary map. */
+      primary map and the high map.  Now add on the ones referred to
+      by the main primary map. */
    for (i = 0; i < N_PRIMARY_MAP; i++) {
       if (primary_map[i] == NULL) {
          bad = True;
@@ -4832,10 +5180,12 @@ LeakCheckMode MC_(clo_leak_check)             = LC_Summary;
 VgRes         MC_(clo_leak_resolution)        = Vg_HighRes;
 Bool          MC_(clo_show_reachable)         = False;
 Bool          MC_(clo_show_possibly_lost)     = True;
+Bool          MC_(clo_background_leak_check)  = False;
 Bool          MC_(clo_workaround_gcc296_bugs) = False;
 Int           MC_(clo_malloc_fill)            = -1;
 Int           MC_(clo_free_fill)              = -1;
 Int           MC_(clo_mc_level)               = 2;
+Bool          MC_(clo_high_shadow_map)        = True;
 
 static Bool mc_process_cmd_line_options(Char* arg)
 {
@@ -4883,6 +5233,8 @@ static Bool mc_process_cmd_line_options(Char* arg)
    else if VG_BOOL_CLO(arg, "--show-reachable",   MC_(clo_show_reachable))   {}
    else if VG_BOOL_CLO(arg, "--show-possibly-lost",
                                             MC_(clo_show_possibly_lost))     {}
+   else if VG_BOOL_CLO(arg, "--background-leak-check",
+                                            MC_(clo_background_leak_check))  {}
    else if VG_BOOL_CLO(arg, "--workaround-gcc296-bugs",
                                             MC_(clo_workaround_gcc296_bugs)) {}
 
@@ -4940,6 +5292,8 @@ static Bool mc_process_cmd_line_options(Char* arg)
    else if VG_BHEX_CLO(arg, "--malloc-fill", MC_(clo_malloc_fill), 0x00,0xFF) {}
    else if VG_BHEX_CLO(arg, "--free-fill",   MC_(clo_free_fill),   0x00,0xFF) {}
 
+   else if VG_BOOL_CLO(arg, "--high-shadow-map", MC_(clo_high_shadow_map)) {}
+
    else
       return VG_(replacement_malloc_process_cmd_line_option)(arg);
 
@@ -4959,6 +5313,8 @@ static void mc_print_usage(void)
 "    --show-reachable=no|yes          show reachable blocks in leak check? [no]\n"
 "    --show-possibly-lost=no|yes      show possibly lost blocks in leak check?\n"
 "                                     [yes]\n"
+"    --background-leak-check=no|yes   do leak checks requested by the client\n"
+"                                     in a forked child, report later? [no]\n"
 "    --undef-value-errors=no|yes      check for undefined value errors [yes]\n"
 "    --track-origins=no|yes           show origins of undefined values? [no]\n"
 "    --partial-loads-ok=no|yes        too hard to explain here; see manual [no]\n"
@@ -4974,7 +5330,9 @@ static void mc_print_usage(void)
 static void mc_print_debug_usage(void)
 {  
    VG_(printf)(
-"    (none)\n"
+"    --high-shadow-map=no|yes         use a direct table, not a search, to\n"
+"                                     find the shadow of addresses above 32G\n"
+"                                     [yes]\n"
    );
 }
 
@@ -5084,10 +5442,12 @@ static void print_monitor_help ( void )
 "  leak_check [full*|summary] [reachable|possibleleak*|definiteleak]\n"
 "                [increased*|changed|any]\n"
 "                [unlimited*|limited <max_loss_records_output>]\n"
+"                [background]\n"
 "            * = defaults\n"
 "        Examples: leak_check\n"
 "                  leak_check summary any\n"
 "                  leak_check full reachable any limited 100\n"
+"                  leak_check summary background\n"
 "  block_list <loss_record_nr>\n"
 "        after a leak search, shows the list of blocks of <loss_record_nr>\n"
 "  who_points_at <addr> [<len>]\n"
@@ -5168,6 +5528,7 @@ static Bool handle_gdb_monitor_command (ThreadId tid, Char *req)
       lcp.deltamode          = LCD_Increased;
       lcp.max_loss_records_output = 999999999;
       lcp.requested_by_monitor_command = True;
+      lcp.background         = False;
       
       for (kw = VG_(strtok_r) (NULL, " ", &ssaveptr); 
            kw != NULL; 
@@ -5176,7 +5537,7 @@ static Bool handle_gdb_monitor_command (ThreadId tid, Char *req)
                  ("full summary "
                   "reachable possibleleak definiteleak "
                   "increased changed any "
-                  "unlimited limited ",
+                  "unlimited limited background ",
                   kw, kwd_report_all)) {
          case -2: err++; break;
          case -1: err++; break;
@@ -5221,6 +5582,8 @@ static Bool handle_gdb_monitor_command (ThreadId tid, Char *req)
                                 int_value);
             break;
          }
+         case 10: /* background */
+            lcp.background = True; break;
          default:
             tl_assert (0);
          }
@@ -5448,6 +5811,7 @@ static Bool mc_handle_client_request ( ThreadId tid, UWord* arg, UWord* ret )
          }
          lcp.max_loss_records_output = 999999999;
          lcp.requested_by_monitor_command = False;
+         lcp.background = MC_(clo_background_leak_check);
          
          MC_(detect_memory_leaks)(tid, &lcp);
          *ret = 0; /* return value is meaningless */
@@ -6085,6 +6449,13 @@ static void mc_post_clo_init ( void )
 
    tl_assert( MC_(clo_mc_level) >= 1 && MC_(clo_mc_level) <= 3 );
 
+   /* No client memory has been described to us yet, so the high map
+      is still empty and can be done without. */
+   if (!MC_(clo_high_shadow_map)) {
+      tl_assert(n_high_map_L2s == 0);
+      high_map_limit = 0;
+   }
+
    if (MC_(clo_mc_level) == 3) {
       /* We're doing origin tracking. */
 #     ifdef PERF_FAST_STACK
@@ -6145,6 +6516,8 @@ static void mc_fini ( Int exitcode )
 {
    MC_(print_malloc_stats)();
 
+   MC_(finish_background_leak_search)(1/*bogus ThreadId*/);
+
    if (MC_(clo_leak_check) != LC_Off) {
       LeakCheckParams lcp;
       lcp.mode = MC_(clo_leak_check);
@@ -6153,6 +6526,7 @@ static void mc_fini ( Int exitcode )
       lcp.deltamode = LCD_Any;
       lcp.max_loss_records_output = 999999999;
       lcp.requested_by_monitor_command = False;
+      lcp.background = False;
       MC_(detect_memory_leaks)(1/*bogus ThreadId*/, &lcp);
    } else {
       if (VG_(clo_verbosity) == 1 && !VG_(clo_xml)) {
@@ -6179,6 +6553,7 @@ static void mc_fini ( Int exitcode )
 
    if (VG_(clo_stats)) {
       SizeT max_secVBit_szB, max_SMs_szB, max_shmem_szB;
+      HChar buf1[16], buf2[16];
       
       VG_(message)(Vg_DebugMsg,
          " memcheck: sanity checks: %d cheap, %d expensive\n",
@@ -6198,6 +6573,11 @@ static void mc_fini ( Int exitcode )
          " memcheck: auxmaps_L2: %lld searches, %lld nodes\n",
          n_auxmap_L2_searches, n_auxmap_L2_nodes
       );   
+      VG_(message)(Vg_DebugMsg,
+         " memcheck: high map: %d tables (%ldk) in use\n",
+         n_high_map_L2s,
+         n_high_map_L2s * (HM_L2_N * sizeof(SecMap*) / 1024)
+      );
 
       print_SM_info("n_issued     ", n_issued_SMs);
       print_SM_info("n_deissued   ", n_deissued_SMs);
@@ -6208,14 +6588,9 @@ static void mc_fini ( Int exitcode )
 
       // Three DSMs, plus the non-DSM ones
       max_SMs_szB = (3 + max_non_DSM_SMs) * sizeof(SecMap);
-      // The 3*sizeof(Word) bytes is the AVL node metadata size.
-      // The VG_ROUNDUP is because the OSet pool allocator will/must align
-      // the elements on pointer size.
-      // Note that the pool allocator has some additional small overhead
-      // which is not counted in the below.
-      // Hardwiring this logic sucks, but I don't see how else to do it.
-      max_secVBit_szB = max_secVBit_nodes * 
-            (3*sizeof(Word) + VG_ROUNDUP(sizeof(SecVBitNode), sizeof(void*)));
+      // The sec V bit table never shrinks, so its current size is its
+      // maximum size.
+      max_secVBit_szB = secVBitTable_size * sizeof(SecVBitNode);
       max_shmem_szB   = sizeof(primary_map) + max_SMs_szB + max_secVBit_szB;
 
       VG_(message)(Vg_DebugMsg,
@@ -6226,6 +6601,15 @@ static void mc_fini ( Int exitcode )
          " memcheck: set_sec_vbits8 calls: %llu (new: %llu, updates: %llu)\n",
          sec_vbits_new_nodes + sec_vbits_updates,
          sec_vbits_new_nodes, sec_vbits_updates );
+      VG_(message)(Vg_DebugMsg,
+         " memcheck: sec V bit table: %lu slots (%ldk), %lu nodes in use\n",
+         secVBitTable_size, (secVBitTable_size * sizeof(SecVBitNode)) / 1024,
+         secVBitTable_used );
+      VG_(message)(Vg_DebugMsg,
+         " memcheck: sec V bit GC: %llu slots swept, %llu nodes evicted, "
+         "%u resizes (%u ms)\n",
+         sec_vbits_gc_swept, sec_vbits_gc_evicted,
+         sec_vbits_resizes, sec_vbits_resize_ms );
       VG_(message)(Vg_DebugMsg,
          " memcheck: max shadow mem size:   %ldk, %ldM\n",
          max_shmem_szB / 1024, max_shmem_szB / (1024 * 1024));
@@ -6258,6 +6642,18 @@ static void mc_fini ( Int exitcode )
                       " ocacheL2:    %'9lu max nodes %'9lu curr nodes\n",
                       stats__ocacheL2_n_nodes_max,
                       stats__ocacheL2_n_nodes );
+         VG_(message)(Vg_DebugMsg,
+                      " ocacheL2: %'12lu max szB %'12lu curr szB\n",
+                      stats__ocacheL2_szB_max,
+                      stats__ocacheL2_szB );
+         /* L2 lookups happen only on L1 misses. */
+         VG_(percentify)( stats_ocacheL1_find - stats_ocacheL1_misses,
+                          stats_ocacheL1_find, 2, 8, buf1 );
+         VG_(percentify)( stats_ocacheL1_misses - stats__ocacheL2_misses,
+                          stats_ocacheL1_misses, 2, 8, buf2 );
+         VG_(message)(Vg_DebugMsg,
+                      " ocache:   L1 hit rate %s   L2 hit rate %s\n",
+                      buf1, buf2 );
          VG_(message)(Vg_DebugMsg,
                       " niacache: %'12lu refs   %'12lu misses\n",
                       stats__nia_cache_queries, stats__nia_cache_misses);
@@ -6318,6 +6714,7 @@ static void mc_pre_clo_init(void)
                                    MC_(error_matches_suppression),
                                    MC_(get_error_name),
                                    MC_(get_extra_suppression_info));
+   VG_(needs_error_hash)          (MC_(hash_Error));
    VG_(needs_libc_freeres)        ();
    VG_(needs_command_line_options)(mc_process_cmd_line_options,
                                    mc_print_usage,
@@ -6339,6 +6736,7 @@ static void mc_pre_clo_init(void)
    MC_(Malloc_Redzone_SzB) = VG_(malloc_effective_client_redzone_size)();
 
    VG_(needs_xml_output)          ();
+   VG_(needs_persistent_translations) ();
 
    VG_(track_new_mem_startup)     ( mc_new_mem_startup );
    VG_(track_new_mem_stack_signal)( make_mem_undefined_w_tid );
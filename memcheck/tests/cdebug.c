@@ -0,0 +1,44 @@
+
+/* Check that line numbers and variable locations are found when the
+   debug sections are compressed.  Relevant compile flags are:
+
+   -Wall -g -gz=zlib       (SHF_COMPRESSED .debug_* sections)
+   -Wall -g -gz=zlib-gnu   (.zdebug_* sections)
+*/
+
+#include <stdlib.h>
+#include <assert.h>
+#include "memcheck/memcheck.h"
+
+/* Cause memcheck to complain about the address "a" and so to print
+   its best guess as to what "a" actually is.  a must be
+   addressible. */
+
+void croak ( void* aV )
+{
+  char* a = (char*)aV;
+  char* undefp = malloc(1);
+  char saved = *a;
+  assert(undefp);
+  *a = *undefp;
+  VALGRIND_CHECK_MEM_IS_DEFINED(a, 1);
+  *a = saved;
+  free(undefp);
+}
+
+struct s1
+{
+  char c;
+  int i;
+  long l;
+};
+
+struct s1 S2[30];
+
+int main ( void )
+{
+  struct s1 local;
+  croak( &S2[0].i );
+  croak( &local.i );
+  return 0;
+}
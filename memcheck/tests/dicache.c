@@ -0,0 +1,28 @@
+#include <stdlib.h>
+
+// The stack traces of this error need symbols, line numbers and CFI,
+// which is what --debuginfo-cache-dir caches.  See dicache_rerun.
+
+__attribute__((noinline))
+static int read_after_free(int* p)
+{
+   return p[1];
+}
+
+__attribute__((noinline))
+static int middle(int* p)
+{
+   return read_after_free(p) + 1;
+}
+
+int main(void)
+{
+   int* p = malloc(2 * sizeof(int));
+   volatile int x;
+
+   p[0] = p[1] = 0;
+   free(p);
+   x = middle(p);
+   (void)x;
+   return 0;
+}
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../memcheck.h"
+
+// A background leak search whose results are too big for a pipe.  The
+// child must still finish, and its results be taken in, without the
+// parent having to wait for it.
+
+#define DEPTH 12   // 1 << DEPTH blocks, each with its own loss record
+
+static void alloc_paths(int depth);
+
+__attribute__((noinline))
+static void left(int depth)
+{
+   alloc_paths(depth - 1);
+}
+
+__attribute__((noinline))
+static void right(int depth)
+{
+   alloc_paths(depth - 1);
+}
+
+// Allocates one block from each of 1 << depth different call paths,
+// and keeps no pointer to any of them.
+__attribute__((noinline))
+static void alloc_paths(int depth)
+{
+   if (depth == 0) {
+      if (malloc(16) == NULL)
+         abort();
+      return;
+   }
+   left(depth);
+   right(depth);
+}
+
+int main(void)
+{
+   unsigned long leaked, dubious, reachable, suppressed;
+   int i;
+
+   alloc_paths(DEPTH);
+
+   VALGRIND_DO_LEAK_CHECK;
+
+   // Each request takes in the results of a finished background
+   // search, and does nothing while one is still running.
+   leaked = dubious = reachable = suppressed = 0;
+   for (i = 0; i < 240; i++) {
+      usleep(250000);
+      VALGRIND_DO_LEAK_CHECK;
+      VALGRIND_COUNT_LEAK_BLOCKS(leaked, dubious, reachable, suppressed);
+      if (leaked + dubious + reachable + suppressed > 0)
+         break;
+   }
+
+   if (leaked + dubious + reachable + suppressed > 0)
+      printf("background search found %lu blocks\n",
+             leaked + dubious + reachable + suppressed);
+   else
+      printf("background search did not finish\n");
+   return 0;
+}
@@ -0,0 +1,24 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "../memcheck.h"
+
+// With --background-leak-check=yes, VALGRIND_DO_LEAK_CHECK searches a
+// snapshot of the process in a forked child, and the results are
+// reported at the next leak search, here the one at exit.  Changes
+// made after the snapshot must not affect them.
+
+char *b10;
+char *b21;
+
+int main(void)
+{
+   b10 = malloc (10);
+   b10--; // lose b10
+   fprintf(stderr, "expecting details 10 bytes lost, after finished\n");
+   VALGRIND_DO_LEAK_CHECK;
+
+   b10++; // find b10 again, after the snapshot
+   b21 = malloc (21);
+   fprintf(stderr, "finished\n");
+   return 0;
+}
@@ -0,0 +1,41 @@
+/* An extra compilation unit for varinfo1w, which is varinfo1 linked
+   behind this, so that with --debuginfo-workers the CU holding
+   varinfo1's variables is read by a helper rather than by Valgrind
+   itself.  Nothing here is called; it only needs to produce a fair
+   amount of type and variable info. */
+
+typedef struct node {
+   struct node* next;
+   struct node* prev;
+   int          key;
+   double       weight;
+   char         tag[13];
+} node_t;
+
+typedef union {
+   node_t         node;
+   unsigned long  words[8];
+   unsigned char  bytes[64];
+} cell_t;
+
+struct table {
+   cell_t          cells[17];
+   node_t*         heads[5][3];
+   int             (*hash)(const node_t*);
+   unsigned short  used;
+   enum { T_EMPTY, T_PART, T_FULL } state;
+};
+
+struct table w_table;
+node_t       w_nodes[11];
+cell_t       w_cells[3][7];
+const char*  w_names[4];
+long double  w_weights[9];
+
+int w_sum ( const struct table* t )
+{
+   int i, s = 0;
+   for (i = 0; i < 17; i++)
+      s += t->cells[i].node.key;
+   return s + t->used + (int)t->state;
+}
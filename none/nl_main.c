@@ -64,7 +64,10 @@ static void nl_pre_clo_init(void)
                                  nl_instrument,
                                  nl_fini);
 
-   /* No needs, no core events to track */
+   VG_(needs_persistent_translations) ();
+   VG_(needs_thread_safe_instrumentation) ();
+
+   /* No other needs, no core events to track */
 }
 
 VG_DETERMINE_INTERFACE_VERSION(nl_pre_clo_init)
@@ -0,0 +1,94 @@
+/* read() into a code page under --smc-check=pageprot.  The kernel
+   doesn't fault on write-protected pages, it fails the syscall, so
+   this checks that such pages are writable when the kernel writes
+   them, including while another thread runs (and so retranslates)
+   code from the same page while the read is blocked. */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+typedef int (*IntFn)(void);
+
+static unsigned char* code;
+static int fds[2];
+static ssize_t n_read;
+
+/* movl $imm32, %eax ; ret */
+static void make_code ( unsigned char* p, int imm )
+{
+   p[0] = 0xB8;
+   p[1] = imm & 0xFF;
+   p[2] = (imm >> 8) & 0xFF;
+   p[3] = (imm >> 16) & 0xFF;
+   p[4] = (imm >> 24) & 0xFF;
+   p[5] = 0xC3;
+}
+
+static int call_code ( int offset, int n )
+{
+   int i, sum = 0;
+   for (i = 0; i < n; i++)
+      sum += ((IntFn)(code + offset))();
+   return sum;
+}
+
+static void* reader ( void* v )
+{
+   n_read = read(fds[0], code + 64, 6);
+   return NULL;
+}
+
+int main ( void )
+{
+   unsigned char buf[6];
+   pthread_t th;
+   ssize_t n;
+
+   code = mmap(NULL, 4096, PROT_READ|PROT_WRITE|PROT_EXEC,
+               MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+   if (code == MAP_FAILED) {
+      perror("mmap");
+      exit(1);
+   }
+   if (pipe(fds) != 0) {
+      perror("pipe");
+      exit(1);
+   }
+
+   /* Translate code from the page, so that it gets protected. */
+   make_code(code, 1);
+   make_code(code + 64, 2);
+   printf("before: %d %d\n", call_code(0, 100), call_code(64, 100));
+
+   /* A non-blocking read straight into it. */
+   make_code(buf, 3);
+   if (write(fds[1], buf, sizeof buf) != sizeof buf) {
+      perror("write");
+      exit(1);
+   }
+   n = read(fds[0], code, sizeof buf);
+   printf("read returned %d\n", (int)n);
+   printf("after read: %d\n", call_code(0, 100));
+
+   /* A blocking read, racing with translations from the same page. */
+   if (pthread_create(&th, NULL, reader, NULL) != 0) {
+      perror("pthread_create");
+      exit(1);
+   }
+   sleep(1);
+   printf("during blocking read: %d\n", call_code(0, 100));
+   make_code(buf, 4);
+   if (write(fds[1], buf, sizeof buf) != sizeof buf) {
+      perror("write");
+      exit(1);
+   }
+   pthread_join(th, NULL);
+   printf("blocking read returned %d\n", (int)n_read);
+   printf("after blocking read: %d\n", call_code(64, 100));
+
+   return 0;
+}
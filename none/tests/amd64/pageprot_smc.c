@@ -0,0 +1,50 @@
+/* Self-modifying code under --smc-check=pageprot.  The code is in an
+   anonymous RWX mapping, so its page is write-protected once it has
+   been translated; each rewrite of it must then be seen.  Rewriting
+   it more often than Valgrind is willing to protect it checks the
+   fall back to self-checking translations too. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+typedef int (*IntFn)(void);
+
+/* movl $imm32, %eax ; ret */
+static void set_code ( unsigned char* p, int imm )
+{
+   p[0] = 0xB8;
+   p[1] = imm & 0xFF;
+   p[2] = (imm >> 8) & 0xFF;
+   p[3] = (imm >> 16) & 0xFF;
+   p[4] = (imm >> 24) & 0xFF;
+   p[5] = 0xC3;
+}
+
+int main ( void )
+{
+   unsigned char* code;
+   int i, j, sum;
+
+   code = mmap(NULL, 4096, PROT_READ|PROT_WRITE|PROT_EXEC,
+               MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+   if (code == MAP_FAILED) {
+      perror("mmap");
+      exit(1);
+   }
+
+   for (i = 1; i <= 12; i++) {
+      set_code(code, i * 100);
+      sum = 0;
+      for (j = 0; j < 1000; j++)
+         sum += ((IntFn)code)();
+      printf("round %2d: code returns %d, sum %d\n",
+             i, ((IntFn)code)(), sum);
+   }
+
+   /* A write to data sharing the page with the code. */
+   code[2048] = 1;
+   printf("after data write: code returns %d\n", ((IntFn)code)());
+
+   return 0;
+}
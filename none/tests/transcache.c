@@ -0,0 +1,68 @@
+
+/* Run twice with the same --translation-cache-dir by
+   transcache_rerun: the second run should take most of its
+   translations from the cache, and must print the same as the
+   first. */
+
+#include <stdio.h>
+#include <string.h>
+#include "../../include/valgrind.h"
+
+static unsigned int mix ( unsigned int h, unsigned int x )
+{
+   h ^= x;
+   h *= 16777619u;
+   return h ^ (h >> 13);
+}
+
+static unsigned int sum_squares ( unsigned int n )
+{
+   unsigned int i, s = 0;
+   for (i = 0; i < n; i++)
+      s += i * i;
+   return s;
+}
+
+static unsigned int collatz ( unsigned int n )
+{
+   unsigned int steps = 0;
+   while (n != 1) {
+      n = (n & 1) ? 3 * n + 1 : n / 2;
+      steps++;
+   }
+   return steps;
+}
+
+static unsigned int checksum ( const char* s )
+{
+   unsigned int h = 2166136261u;
+   while (*s)
+      h = mix(h, (unsigned char)*s++);
+   return h;
+}
+
+static unsigned int (*const fns[2]) ( unsigned int ) = {
+   sum_squares, collatz
+};
+
+int main ( void )
+{
+   unsigned int i, h = 0;
+   char buf[64];
+
+   for (i = 1; i < 1000; i++) {
+      h = mix(h, fns[i & 1](i));
+      if ((i % 250) == 0)
+         printf("%u: %08x\n", i, h);
+   }
+
+   /* Saved translations of discarded code must not come back. */
+   VALGRIND_DISCARD_TRANSLATIONS( (char*)&collatz, 64 );
+   printf("collatz(27) = %u\n", collatz(27));
+
+   for (i = 0; i < 4; i++) {
+      sprintf(buf, "string number %u", i);
+      printf("checksum(\"%s\") = %08x\n", buf, checksum(buf));
+   }
+   return 0;
+}
@@ -0,0 +1,91 @@
+// This artificial program behaves like a JIT compiler: it keeps a few
+// thousand small generated functions live, and repeatedly rewrites some of
+// them and runs them again.  Rewrites are announced to Valgrind with
+// VALGRIND_DISCARD_TRANSLATIONS, as real JITs do, and every so often a whole
+// page of code is made non-executable while it is patched, as JITs which
+// keep code W^X do, which makes Valgrind discard everything in that page.
+//
+// It's a stress test for Valgrind's translation discarding: each discard
+// only hits one or a few translations, but must find them among all the
+// others.  It only generates code on x86 and amd64;  elsewhere it does
+// nothing.
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/sys_mman.h"
+#include "valgrind.h"
+
+#define N_STUBS     4096     // Number of generated functions
+#define STUB_SIZE   16       // Bytes per generated function
+#define PAGE_SIZE   4096
+#define N_ITERS     200000
+#define FLIP_EVERY  64       // How often to flip a page's protection
+
+#if defined(__i386__) || defined(__x86_64__)
+
+typedef int (*stub_fn)(void);
+
+// Write a stub which returns 'val':  movl $val, %eax; ret
+static void gen_stub(unsigned char* p, int val)
+{
+   p[0] = 0xB8;
+   memcpy(&p[1], &val, 4);
+   p[5] = 0xC3;
+}
+
+int main(void)
+{
+   int i, sum = 0;
+   unsigned char* code = mmap(0, N_STUBS * STUB_SIZE,
+                              PROT_READ|PROT_WRITE|PROT_EXEC,
+                              MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+   if (code == (unsigned char*)MAP_FAILED) {
+      perror("mmap");
+      return 1;
+   }
+
+   // Generate and run everything once, so there are lots of live
+   // translations.
+   for (i = 0; i < N_STUBS; i++)
+      gen_stub(code + i * STUB_SIZE, i);
+   for (i = 0; i < N_STUBS; i++)
+      sum += ((stub_fn)(code + i * STUB_SIZE))();
+
+   for (i = 0; i < N_ITERS; i++) {
+      int n = (i * 7919) % N_STUBS;
+      unsigned char* stub = code + n * STUB_SIZE;
+
+      // Recompile one function.
+      gen_stub(stub, i);
+      VALGRIND_DISCARD_TRANSLATIONS(stub, STUB_SIZE);
+      sum += ((stub_fn)stub)();
+
+      // Run a couple of the others.
+      sum += ((stub_fn)(code + (i % N_STUBS) * STUB_SIZE))();
+      sum += ((stub_fn)(code + ((i * 13) % N_STUBS) * STUB_SIZE))();
+
+      // Patch a page while it is not executable.
+      if (i % FLIP_EVERY == 0) {
+         unsigned char* page
+            = code + ((i / FLIP_EVERY) % (N_STUBS * STUB_SIZE / PAGE_SIZE))
+                     * PAGE_SIZE;
+         mprotect(page, PAGE_SIZE, PROT_READ|PROT_WRITE);
+         gen_stub(page, -i);
+         mprotect(page, PAGE_SIZE, PROT_READ|PROT_WRITE|PROT_EXEC);
+         sum += ((stub_fn)page)();
+      }
+   }
+
+   printf("sum = %d\n", sum);
+   return 0;
+}
+
+#else
+
+int main(void)
+{
+   printf("sum = 0\n");
+   return 0;
+}
+
+#endif
@@ -0,0 +1,52 @@
+// Performance test for copying and setting the state of large areas of
+// memory.  Grows blocks to 32MB a step at a time with realloc, which has
+// Memcheck copy the V+A bits of the old block to the new one; copies them
+// with memcpy; and maps and unmaps big areas.  Half of each block is left
+// uninitialised, and a byte in every page of that half is only partially
+// defined, as bit-field writes leave them, so that the secondary V bits
+// have to be copied too.
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define MB     (1024*1024)
+#define MAX_SZ (32*MB)
+#define PAGE   4096
+
+static volatile char sink;
+
+int main(void)
+{
+   int    r, i;
+   size_t sz;
+   char  *a, *b, *m;
+
+   for (r = 0; r < 10; r++) {
+      sz = MB;
+      a = malloc(sz);
+      memset(a, 0, sz/2);
+      for (i = sz/2; i < sz; i += PAGE)
+         a[i] |= 1;
+
+      while (sz < MAX_SZ) {
+         sz *= 2;
+         a = realloc(a, sz);
+      }
+
+      b = malloc(sz);
+      memcpy(b, a, sz);
+      sink = b[sz-1];
+      free(b);
+      free(a);
+
+      m = mmap(NULL, MAX_SZ, PROT_READ|PROT_WRITE,
+               MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+      if (m != MAP_FAILED) {
+         for (i = 0; i < MAX_SZ; i += PAGE)
+            m[i] = 1;
+         munmap(m, MAX_SZ);
+      }
+   }
+   return 0;
+}
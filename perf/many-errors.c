@@ -0,0 +1,41 @@
+// Performance test for the error manager.  Makes 100,000 invalid reads,
+// each from its own instruction, so that Memcheck finds that many
+// different errors, and has to tell each new one from all those it has
+// already seen.  Needs --error-limit=no to get past the first 1000.
+
+#include <stdlib.h>
+
+#define R10(s)     s s s s s s s s s s
+#define R1000(s)   R10(R10(R10(s)))
+
+// Points to a freed block.
+static volatile char* volatile p;
+
+// Each function does 1000 reads, from 1000 different instructions.
+#define F(n)       static void f##n(void) { \
+                      volatile char* q = p; R1000((void)q[0];) \
+                   }
+#define F10(n)     F(n##0) F(n##1) F(n##2) F(n##3) F(n##4) \
+                   F(n##5) F(n##6) F(n##7) F(n##8) F(n##9)
+
+F10() F10(1) F10(2) F10(3) F10(4) F10(5) F10(6) F10(7) F10(8) F10(9)
+
+#define C(n)       f##n();
+#define C10(n)     C(n##0) C(n##1) C(n##2) C(n##3) C(n##4) \
+                   C(n##5) C(n##6) C(n##7) C(n##8) C(n##9)
+
+int main(void)
+{
+   int i;
+
+   p = malloc(1);
+   free((void*)p);
+
+   // Go round twice, so that the second time every error is one that
+   // has been seen before.
+   for (i = 0; i < 2; i++) {
+      C10() C10(1) C10(2) C10(3) C10(4) C10(5) C10(6) C10(7) C10(8) C10(9)
+   }
+
+   return 0;
+}
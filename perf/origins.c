@@ -0,0 +1,43 @@
+// Performance test for origin tracking.  Moves undefined data around
+// 128MB of heap blocks, twice the memory Memcheck's first-level origin
+// cache covers, so that origin tags are continually evicted to, and
+// reloaded from, the second-level cache.  Run with --track-origins=yes;
+// the data are never used in a way that produces an error.
+
+#include <stdlib.h>
+#include <string.h>
+
+#define N_BLOCKS   32
+#define BLOCK_SZ   (4*1024*1024)
+#define CHUNK_SZ   (256*1024)
+#define N_ROUNDS   20
+
+int main(void)
+{
+   int*   b[N_BLOCKS];
+   int    i, r;
+   size_t k, off;
+
+   for (i = 0; i < N_BLOCKS; i++) {
+      b[i] = malloc(BLOCK_SZ);
+      // Leave the second half of each block undefined.
+      memset(b[i], 0, BLOCK_SZ/2);
+   }
+
+   for (r = 0; r < N_ROUNDS; r++) {
+      for (i = 0; i < N_BLOCKS; i++) {
+         int* src = b[i];
+         int* dst = b[(i * 7 + r + 1) % N_BLOCKS];
+         off = ((size_t)r * 4099 * 64) % (BLOCK_SZ - CHUNK_SZ);
+         off /= sizeof(int);
+         for (k = 0; k < CHUNK_SZ / sizeof(int); k += 2) {
+            dst[off + k]     = src[BLOCK_SZ/2/sizeof(int) + k] + 1;
+            dst[off + k + 1] = src[off + k + 1];
+         }
+      }
+   }
+
+   for (i = 0; i < N_BLOCKS; i++)
+      free(b[i]);
+   return 0;
+}
@@ -0,0 +1,49 @@
+// This artificial program runs several threads which do nothing but
+// compute, each on its own data, and never synchronise until the end.
+// Normally Valgrind runs only one thread at a time, so it takes as long
+// as doing all the work in one thread; with --parallel-execution=yes and
+// a tool which allows it, the threads can use several CPUs.
+
+#include <pthread.h>
+#include <stdio.h>
+
+#define N_THREADS  4
+#define N_ITERS    20000000
+
+static unsigned long results[N_THREADS];
+
+static void* worker(void* arg)
+{
+   long          me = (long)arg;
+   unsigned long x  = me + 1;
+   int           i;
+
+   // A linear congruential generator; enough work per iteration to
+   // keep the dispatcher busy without touching memory.
+   for (i = 0; i < N_ITERS; i++)
+      x = x * 6364136223846793005UL + 1442695040888963407UL + (x >> 17);
+
+   results[me] = x;
+   return NULL;
+}
+
+int main(void)
+{
+   pthread_t     threads[N_THREADS];
+   unsigned long sum = 0;
+   long          i;
+
+   for (i = 0; i < N_THREADS; i++) {
+      if (pthread_create(&threads[i], NULL, worker, (void*)i) != 0) {
+         perror("pthread_create");
+         return 1;
+      }
+   }
+   for (i = 0; i < N_THREADS; i++) {
+      pthread_join(threads[i], NULL);
+      sum += results[i];
+   }
+
+   printf("sum = %lu\n", sum);
+   return 0;
+}